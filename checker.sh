@@ -21,11 +21,17 @@ analyzer() {
     passed=0
     for file_path in $(ls $tests_dir/*.cl); do
         ref_path=$tests_dir/$(basename $file_path .cl).ref
+        flags_path=$tests_dir/$(basename $file_path .cl).flags
 
         file_name=$(basename $file_path)
         echo -en "Testing $file_name ... "
 
-        ./$COOLC $exec_arg --module prelude $file_path 2>&1 | diff - $ref_path > /dev/null 2>&1
+        flags=""
+        if [ -f $flags_path ]; then
+            flags=$(cat $flags_path)
+        fi
+
+        ./$COOLC $exec_arg $flags --module prelude $file_path 2>&1 | diff - $ref_path > /dev/null 2>&1
 
         if [ $? -eq 0 ]; then
             echo -e "\e[32mPASSED\e[0m"
@@ -78,7 +84,129 @@ runner() {
             continue
         fi
 
-        /tmp/$file_name | diff - $ref_path > /dev/null 2>&1
+        # the runtime errors, like a case without a match, are part of the output
+        /tmp/$file_name 2>&1 | diff - $ref_path > /dev/null 2>&1
+
+        if [ $? -eq 0 ]; then
+            echo -e "\e[32mPASSED\e[0m"
+            passed=$((passed + 1))
+        else
+            echo -e "\e[31mFAILED\e[0m"
+        fi
+    done
+
+    total=$(ls $tests_dir/*.cl | wc -l)
+    echo "Passed $passed/$total tests"
+
+    TOTAL_TESTS=$((TOTAL_TESTS + total))
+    PASSED_TESTS=$((PASSED_TESTS + passed))
+}
+
+# Build the programs of a tests directory with the compiler's own encoder and
+# linker into static executables, without fasm or ld, and compare their output
+linker_runner() {
+    if [ "$#" -ne 1 ]; then
+        echo "Usage: $0 <tests_dir>"
+        exit 1
+    fi
+
+    tests_dir=$TESTS_DIR/$1
+
+    echo "Running tests for $1 with the internal linker"
+
+    passed=0
+    for file_path in $(ls $tests_dir/*.cl); do
+        ref_path=$tests_dir/$(basename $file_path .cl).ref
+
+        file_name=$(basename $file_path .cl)
+        echo -en "Testing $file_name.cl ... "
+
+        ./$COOLC --module prelude $file_path -o /tmp/$file_name-static > /tmp/$file_name-static.log 2>&1 &&
+            ! grep -q "Executing command" /tmp/$file_name-static.log &&
+            /tmp/$file_name-static 2>&1 | diff - $ref_path > /dev/null 2>&1
+
+        if [ $? -eq 0 ]; then
+            echo -e "\e[32mPASSED\e[0m"
+            passed=$((passed + 1))
+        else
+            echo -e "\e[31mFAILED\e[0m"
+        fi
+    done
+
+    total=$(ls $tests_dir/*.cl | wc -l)
+    echo "Passed $passed/$total tests"
+
+    TOTAL_TESTS=$((TOTAL_TESTS + total))
+    PASSED_TESTS=$((PASSED_TESTS + passed))
+}
+
+# Build a program with --profile-generate, run it and build it again with the
+# profile it wrote; both have to print the .ref, and the profile has to be
+# ignored with a warning when it is used for another program
+profile_runner() {
+    if [ "$#" -ne 2 ]; then
+        echo "Usage: $0 <test_file> <other_test_file>"
+        exit 1
+    fi
+
+    file_path=$TESTS_DIR/$1
+    other_path=$TESTS_DIR/$2
+    ref_path=${file_path%.cl}.ref
+    name=/tmp/$(basename $file_path .cl)
+
+    echo -en "Testing the profile of $(basename $file_path) ... "
+    rm -f $name-gen $name-gen.profile $name-use
+
+    ./$COOLC --profile-generate --module prelude $file_path -o $name-gen > /dev/null 2>&1 &&
+        $name-gen 2>&1 | diff - $ref_path > /dev/null 2>&1 &&
+        [ -f $name-gen.profile ] &&
+        ./$COOLC --profile-use=$name-gen.profile --module prelude $file_path -o $name-use 2>&1 | (! grep -q "of another program") &&
+        $name-use 2>&1 | diff - $ref_path > /dev/null 2>&1 &&
+        ./$COOLC --profile-use=$name-gen.profile --module prelude $other_path -o $name-other 2>&1 | grep -q "of another program"
+
+    if [ $? -eq 0 ]; then
+        echo -e "\e[32mPASSED\e[0m"
+        PASSED_TESTS=$((PASSED_TESTS + 1))
+    else
+        echo -e "\e[31mFAILED\e[0m"
+    fi
+    TOTAL_TESTS=$((TOTAL_TESTS + 1))
+}
+
+# Build a program of a tests directory at one optimization level and run it
+# into /tmp/<name>-O<level>.out, with its errors and its exit status
+level_run() {
+    file_path=$1
+    level=$2
+    name=/tmp/$(basename $file_path .cl)-O$level
+
+    ./$COOLC --asm -O$level --verify --module prelude $file_path 2>&1 > $name.s 2>&1 &&
+        fasm $name.s 2>&1 > /dev/null &&
+        ld $name.o -o $name 2>&1 > /dev/null &&
+        { $name > $name.out 2>&1; echo "exit $?" >> $name.out; }
+}
+
+# The programs have to print the same at -O0, with no passes at all, as at
+# -O1 and -O2, with the TAC checked after every pass
+level_runner() {
+    if [ "$#" -ne 1 ]; then
+        echo "Usage: $0 <tests_dir>"
+        exit 1
+    fi
+
+    tests_dir=$TESTS_DIR/$1
+
+    echo "Running tests for $1 at -O0, -O1 and -O2"
+
+    passed=0
+    for file_path in $(ls $tests_dir/*.cl); do
+        file_name=$(basename $file_path .cl)
+        echo -en "Testing $file_name.cl ... "
+
+        level_run $file_path 0 && level_run $file_path 1 &&
+            level_run $file_path 2 &&
+            diff /tmp/$file_name-O0.out /tmp/$file_name-O1.out > /dev/null 2>&1 &&
+            diff /tmp/$file_name-O0.out /tmp/$file_name-O2.out > /dev/null 2>&1
 
         if [ $? -eq 0 ]; then
             echo -e "\e[32mPASSED\e[0m"
@@ -116,7 +244,10 @@ librunner() {
 
         flags=$(cat $flags_path)
 
-        ./$COOLC $flags $file_path 2>&1 -o /tmp/$file_name > /dev/null 2>&1
+        # the built-in encoder has to take the modules in any order, without
+        # falling back to fasm
+        ./$COOLC $flags $file_path -o /tmp/$file_name > /tmp/$file_name.log 2>&1 &&
+            ! grep -q "Falling back" /tmp/$file_name.log
         if [ $? -ne 0 ]; then
             echo -e "\e[31mFAILED\e[0m"
             continue
@@ -224,16 +355,27 @@ semantic_analyzer() {
     echo "Testing the semantic analyzer"
     analyzer semantic --sem
     analyzer semantic2 --sem
+    # the parallel type checker has to report the same as the sequential one
+    analyzer semantic "--sem --jobs 8"
+    analyzer semantic2 "--sem --jobs 8"
 }
 
 tac_generator() {
     echo "Testing the TAC generator"
     analyzer tac --tac
+    analyzer cfg "--tac --cfg"
 }
 
 asm_generator() {
     echo "Testing the assembly generator"
     runner asm --asm
+    linker_runner asm
+}
+
+opt_levels() {
+    echo "Testing the optimization levels"
+    level_runner asm
+    profile_runner asm/26-profile.cl asm/01-hello.cl
 }
 
 lib_tests() {
@@ -254,6 +396,8 @@ elif [ "$ARG1" == "--tac" ]; then
     tac_generator
 elif [ "$ARG1" == "--asm" ]; then
     asm_generator
+elif [ "$ARG1" == "--opt" ]; then
+    opt_levels
 elif [ "$ARG1" == "--lib" ]; then
     lib_tests
 elif [ -z "$ARG1" ]; then
@@ -262,9 +406,10 @@ elif [ -z "$ARG1" ]; then
     semantic_analyzer
     tac_generator
     asm_generator
+    opt_levels
     lib_tests
 else
-    echo "Usage: $0 [--lex | --syn | --sem | --tac | --asm | --lib]"
+    echo "Usage: $0 [--lex | --syn | --sem | --tac | --asm | --opt | --lib]"
     exit 1
 fi
 
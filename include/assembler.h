@@ -1,6 +1,7 @@
 #ifndef ASSEMBLER_H
 #define ASSEMBLER_H
 
+#include "codegen.h"
 #include "semantic.h"
 
 enum assembler_result {
@@ -8,6 +9,107 @@ enum assembler_result {
     ASSEMBLER_ERROR,
 };
 
-enum assembler_result assembler_run(const char *filename, semantic_mapping *mapping);
+#define ASM_MAX_OPERANDS 3
+
+enum asm_instr_kind {
+    ASM_INSTR_NONE,    // removed by the peephole pass
+    ASM_INSTR_OP,      // an instruction with its operands
+    ASM_INSTR_LABEL,
+    ASM_INSTR_COMMENT, // a line with only a comment
+    ASM_INSTR_OTHER,   // anything else, which is kept as it is
+};
+
+// A line of the emitted assembly, split into the mnemonic and the operands
+// of an instruction so that the peephole pass can match it
+typedef struct asm_instr {
+        enum asm_instr_kind kind;
+        int align;
+        char *text;
+        char *mnemonic;
+        char *operands[ASM_MAX_OPERANDS];
+        unsigned int operand_count;
+        char *label;
+        char *comment;
+} asm_instr;
+
+// The rewrite rules of the peephole pass and how often each one applied
+typedef struct asm_peephole {
+        ds_dynamic_array rules; // asm_peephole_rule
+        unsigned long *hits;
+} asm_peephole;
+
+void assembler_instr_parse(asm_instr *instr, int align, const char *text,
+                           const char *comment);
+void assembler_instr_free(asm_instr *instr);
+
+void assembler_peephole_init(asm_peephole *peephole);
+unsigned int assembler_peephole_run(asm_peephole *peephole,
+                                    ds_dynamic_array *instrs);
+void assembler_peephole_print_hits(asm_peephole *peephole);
+void assembler_peephole_free(asm_peephole *peephole);
+
+// A section of the object that the built-in encoder writes
+typedef struct asm_section {
+        char *name;
+        unsigned long flags; // SHF_ALLOC, SHF_WRITE and SHF_EXECINSTR
+        unsigned char *bytes;
+        size_t size;
+        size_t capacity;
+        ds_dynamic_array relocs; // asm_reloc
+} asm_section;
+
+enum asm_symbol_kind {
+    ASM_SYMBOL_UNDEFINED, // only referenced so far, or declared with extrn
+    ASM_SYMBOL_LABEL,
+    ASM_SYMBOL_EQUATE, // a constant defined with `=`
+};
+
+typedef struct asm_symbol {
+        char *name;
+        enum asm_symbol_kind kind;
+        int section;
+        long value;
+        int global; // declared with public or extrn
+        int local;  // a label that starts with a dot
+} asm_symbol;
+
+// A place in a section that holds the address of a symbol, in the terms of
+// the ELF relocations of x86-64
+typedef struct asm_reloc {
+        size_t offset;
+        unsigned int type;
+        unsigned int symbol;
+        long addend;
+} asm_reloc;
+
+// The sections and symbols of the object that the assembly is encoded into
+typedef struct asm_object {
+        ds_dynamic_array sections; // asm_section
+        ds_dynamic_array symbols;  // asm_symbol
+        ds_hash_table index;       // name -> symbol
+        int current;               // the section that the lines go to
+        char *prefix;              // the last label without a dot
+} asm_object;
+
+void assembler_object_init(asm_object *object);
+int assembler_object_source(asm_object *object, const char *source);
+int assembler_object_emit(asm_object *object, asm_instr *instr);
+int assembler_object_resolve(asm_object *object);
+int assembler_object_write(asm_object *object, const char *filename);
+int assembler_object_link(asm_object *object, const char *filename);
+void assembler_object_free(asm_object *object);
+
+int assembler_symbol_find(asm_object *object, const char *name);
+unsigned int assembler_symbol_get(asm_object *object, const char *name);
+asm_symbol *assembler_symbol(asm_object *object, unsigned int index);
+asm_section *assembler_section(asm_object *object, unsigned int index);
+void assembler_section_append(asm_section *section, const void *bytes,
+                              size_t size);
+
+// Write the assembly to the file, or encode it into the object when there
+// is one
+enum assembler_result assembler_run(const char *filename, asm_object *object,
+                                    semantic_mapping *mapping,
+                                    const tac_options *options);
 
 #endif // ASSEMBLER_H
@@ -28,91 +28,164 @@ enum tac_kind {
     TAC_IDENT,
     TAC_ASSIGN_INT,
     TAC_ASSIGN_STRING,
-    TAC_ASSIGN_BOOL
+    TAC_ASSIGN_BOOL,
+    TAC_PHI,
+    TAC_LOAD_FIELD,
+    TAC_STORE_FIELD,
+    TAC_CHECK_VOID,
+    TAC_CASE
 };
 
+enum tac_operand_kind {
+    TAC_OPERAND_NONE,
+    TAC_OPERAND_TEMP,
+    TAC_OPERAND_FORMAL,
+    TAC_OPERAND_ATTRIBUTE,
+    TAC_OPERAND_SELF,
+    TAC_OPERAND_INT,
+    TAC_OPERAND_STRING,
+    TAC_OPERAND_BOOL,
+};
+
+// A TAC value: a temporary, a formal of the method, an attribute slot of
+// self, self itself or a constant. Temporaries, formals and attributes are
+// densely numbered, so their stack or object slot is just the index.
+typedef struct tac_operand {
+        enum tac_operand_kind kind;
+        union {
+                int index;
+                int value;
+                const char *string;
+        };
+} tac_operand;
+
 typedef struct tac_ident {
-        char *name;
-        int index;
+        tac_operand name;
 } tac_ident;
 
 typedef struct tac_assign_int {
-        char *ident;
-        int value;
+        tac_operand ident;
+        tac_operand value;
 } tac_assign_int;
 
 typedef struct tac_assign_string {
-        char *ident;
-        char *value;
+        tac_operand ident;
+        tac_operand value;
 } tac_assign_string;
 
 typedef struct tac_assign_bool {
-        char *ident;
-        int value;
+        tac_operand ident;
+        tac_operand value;
 } tac_assign_bool;
 
 typedef struct tac_assign_binary {
-        char *ident;
-        char *lhs;
-        char *rhs;
+        tac_operand ident;
+        tac_operand lhs;
+        tac_operand rhs;
 } tac_assign_binary;
 
 typedef struct tac_assign_eq {
         char *type;
-        char *ident;
-        char *lhs;
-        char *rhs;
+        tac_operand ident;
+        tac_operand lhs;
+        tac_operand rhs;
 } tac_assign_eq;
 
 typedef struct tac_assign_unary {
-        char *ident;
-        char *expr;
+        tac_operand ident;
+        tac_operand expr;
 } tac_assign_unary;
 
 typedef struct tac_assign_new {
-        char *ident;
+        tac_operand ident;
         char *type;
+        int stack; // the object never outlives the method
 } tac_assign_new;
 
 typedef struct tac_assign_value {
-        char *ident;
-        char *expr;
+        tac_operand ident;
+        tac_operand expr;
 } tac_assign_value;
 
 typedef struct tac_dispatch_call {
-        char *ident;
+        tac_operand ident;
         char *expr_type;
-        char *expr;
+        tac_operand expr;
         char *type;
         char *method;
-        ds_dynamic_array args; // char *
+        ds_dynamic_array args; // tac_operand
+        int devirtualized;     // a dynamic dispatch that has only one target
+        int tail;              // its value is returned right away
+        unsigned int site;     // profile counter of the call, 0 if none
+        char *guess;           // the implementation tried first, or NULL
+        unsigned int clone;    // 1 + the specialization it calls, 0 if none
 } tac_dispatch_call;
 
 typedef struct tac_label {
-        char *label;
+        int label;
 } tac_label;
 
 typedef struct tac_jump {
-        char *label;
+        int label;
 } tac_jump;
 
 typedef struct tac_jump_if_true {
-        char *expr;
-        char *label;
+        tac_operand expr;
+        int label;
+        unsigned int site; // profile counter of the branch, 0 if none
 } tac_jump_if_true;
 
 typedef struct tac_isinstance {
-        char *ident;
-        char *expr;
+        tac_operand ident;
+        tac_operand expr;
         char *type;
 } tac_isinstance;
 
 typedef struct tac_cast {
-        char *ident;
-        char *expr;
+        tac_operand ident;
+        tac_operand expr;
         char *type;
 } tac_cast;
 
+typedef struct tac_phi_arg {
+        int label; // label of the predecessor block
+        tac_operand value;
+} tac_phi_arg;
+
+typedef struct tac_phi {
+        tac_operand ident;
+        ds_dynamic_array args; // tac_phi_arg
+} tac_phi;
+
+// An attribute of an object other than self, for the methods that are
+// inlined into a caller where their self is just a value
+typedef struct tac_field {
+        tac_operand ident;  // the loaded value, NONE for a store
+        tac_operand object;
+        tac_operand value;  // the stored value, NONE for a load
+        char *name;
+        char *type;         // the declared type of the attribute
+        int index;          // slot of the attribute in the object
+} tac_field;
+
+// Fail the same way a dispatch on void does
+typedef struct tac_check_void {
+        tac_operand expr;
+} tac_check_void;
+
+typedef struct tac_case_branch {
+        char *type;
+        int label;
+} tac_case_branch;
+
+// Jump to the first branch whose type the class of the value conforms to,
+// after a single load of its tag. Aborts on void and when no branch
+// matches, so it never falls through.
+typedef struct tac_case_jump {
+        tac_operand expr;
+        ds_dynamic_array branches; // tac_case_branch, most specific first
+} tac_case_jump;
+
 typedef struct tac_instr {
         enum tac_kind kind;
         union {
@@ -133,16 +206,442 @@ typedef struct tac_instr {
                 tac_assign_int assign_int;
                 tac_assign_string assign_string;
                 tac_assign_bool assign_bool;
+                tac_phi phi;
+                tac_field field;
+                tac_check_void check_void;
+                tac_case_jump case_jump;
         };
 } tac_instr;
 
 typedef struct tac_result {
-        ds_dynamic_array locals; // char *
+        semantic_mapping_item *class;
+        const method_node *method; // NULL for attribute initializers
+        unsigned int temp_count;
+        unsigned int label_count;
         ds_dynamic_array instrs; // tac_instr
 } tac_result;
 
-int codegen_expr_to_tac(semantic_mapping *mapping, const expr_node *expr, tac_result *result);
+int codegen_expr_to_tac(semantic_mapping *mapping, semantic_mapping_item *class,
+                        const method_node *method, const expr_node *expr,
+                        tac_result *result);
+
+const char *codegen_tac_operand_name(tac_result *tac, tac_operand operand);
+
+// The operand written by an instruction, or NULL if it does not write one
+tac_operand *codegen_tac_instr_def(tac_instr *instr);
+
+// Append a pointer to every operand read by the instruction to uses
+void codegen_tac_instr_uses(tac_instr *instr, ds_dynamic_array *uses);
+
+// Liveness is tracked for the temporaries and the formals of the method;
+// temporaries come first, so formal i is variable temp_count + i
+int codegen_tac_var_index(tac_result *tac, tac_operand operand);
+
+#define TAC_BITSET_WORD (8 * sizeof(unsigned long))
+#define tac_bitset_test(set, i)                                                \
+    (((set)[(i) / TAC_BITSET_WORD] >> ((i) % TAC_BITSET_WORD)) & 1)
+
+typedef struct tac_basic_block {
+        int label;              // each block starts with a TAC_LABEL
+        unsigned int start;     // index of the first instruction
+        unsigned int end;       // index after the last instruction
+        ds_dynamic_array preds; // unsigned int
+        ds_dynamic_array succs; // unsigned int
+        int idom;               // -1 for the entry and unreachable blocks
+        int rpo;                // position in cfg.order, -1 if unreachable
+        int loop_depth;         // number of natural loops around the block
+        unsigned long *live_in;
+        unsigned long *live_out;
+} tac_basic_block;
+
+typedef struct tac_cfg {
+        ds_dynamic_array blocks; // tac_basic_block
+        ds_dynamic_array order;  // unsigned int, reachable blocks in RPO
+        ds_dynamic_array labels; // int, label -> block index
+        unsigned int var_count;
+        unsigned int word_count;
+} tac_cfg;
+
+// Split the instructions into basic blocks and compute the edges, the
+// immediate dominators and the loop nesting. Every block gets a leading
+// label, so this can add labels to the TAC.
+int codegen_tac_cfg_build(tac_result *tac, tac_cfg *cfg);
+
+// Fill in live_in and live_out of every block
+void codegen_tac_cfg_liveness(tac_result *tac, tac_cfg *cfg);
+
+int codegen_tac_cfg_dominates(tac_cfg *cfg, unsigned int a, unsigned int b);
+
+void codegen_tac_cfg_free(tac_cfg *cfg);
+
+// Rewrite the temporaries and formals into SSA form: every definition gets
+// a fresh temporary and phi instructions merge the values at the joins
+void codegen_tac_to_ssa(tac_result *tac);
+
+// Replace the phi instructions by copies in the predecessors
+void codegen_tac_from_ssa(tac_result *tac);
+
+// Merge the temporaries of copies whose live ranges do not interfere, drop
+// the copies that became redundant and renumber the temporaries densely
+void codegen_tac_coalesce(tac_result *tac);
+
+// Propagate the Int and Bool constants of an SSA form TAC, fold the
+// instructions that compute constants and the branches on constant Bools
+void codegen_tac_fold_constants(tac_result *tac);
+
+// Delete the unreachable blocks and the instructions of an SSA form TAC
+// whose results are never read and that have no side effects
+void codegen_tac_eliminate_dead_code(semantic_mapping *mapping,
+                                     tac_result *tac);
+
+// Rewrite the uses of copies, and of phis that merge a single value, to the
+// original value in an SSA form TAC and delete the copies
+void codegen_tac_propagate_copies(tac_result *tac);
+
+semantic_mapping_item *codegen_find_class(semantic_mapping *mapping,
+                                          const char *class_name);
+
+typedef struct tac_method_summary {
+        semantic_mapping_item *class; // the class that implements the method
+        const method_node *method;
+        tac_result tac;               // no instructions for extern methods
+        int side_effects;
+        unsigned int dispatch_base;   // the sites of the method come after
+        unsigned int branch_base;     // the ones of the methods before it
+} tac_method_summary;
+
+// What interprocedural constant propagation knows of a method, once its own
+// constants are folded
+typedef struct tac_method_constants {
+        int state;         // 0 not analyzed yet, 1 being analyzed, 2 done
+        tac_operand value; // the Int or Bool it returns, NONE if it varies
+        unsigned int size; // its instructions, as the inliner counts them
+} tac_method_constants;
+
+// A copy of a method whose formals hold the given constants. The calls with
+// those arguments go to it when the constants let it fold enough away.
+typedef struct tac_specialization {
+        unsigned int summary;
+        ds_dynamic_array args; // tac_operand, NONE for the varying ones
+        int used;              // smaller than the method, so calls use it
+        int called;            // a call still goes to it, so it is emitted
+        tac_operand value;     // the Int or Bool it returns, or NONE
+} tac_specialization;
+
+// The counts of a run of a program built with --profile-generate. Methods
+// are numbered like the summaries of the optimizer, and the call and branch
+// sites in the order of the methods and of the instructions of their TAC,
+// from 1.
+typedef struct tac_profile {
+        unsigned long methods;
+        unsigned long classes;
+        unsigned long dispatches;
+        unsigned long branches;
+        unsigned long *counts;    // all the counters, in the file order
+        unsigned long *entries;   // methods
+        unsigned long *receivers; // dispatches x classes, by class tag
+        unsigned long *taken;     // branches x 2: executed and taken
+        unsigned long hot;        // calls of a site that make it hot
+} tac_profile;
+
+// Read a profile that an instrumented program wrote at exit. Returns 0 on
+// success and 1 if the file is missing or is not a profile.
+int codegen_tac_profile_load(const char *path, tac_profile *profile);
+void codegen_tac_profile_free(tac_profile *profile);
+
+// The size of the largest method body, in instructions, that is inlined
+// into its callers by default
+#define TAC_INLINE_THRESHOLD 12
+
+// The passes that the pass manager can run, in the order in which it runs
+// them. The ones between fold and escape work on the SSA form, which the
+// manager builds before the first of them and leaves after the last one.
+enum tac_pass {
+    TAC_PASS_DEVIRT,    // class hierarchy analysis
+    TAC_PASS_SPECULATE, // guarded calls to the likely implementation
+    TAC_PASS_INLINE,    // inline small methods
+    TAC_PASS_FOLD,      // constant propagation and folding
+    TAC_PASS_IPCP,      // constants across calls and specialized callees
+    TAC_PASS_COPY,      // copy propagation
+    TAC_PASS_GVN,       // global value numbering
+    TAC_PASS_LICM,      // hoist loop invariant computations
+    TAC_PASS_DCE,       // dead code elimination
+    TAC_PASS_ESCAPE,    // stack allocation of objects that do not escape
+    TAC_PASS_COALESCE,  // merge the temporaries of copies
+    TAC_PASS_LAYOUT,    // put the likely successor of a block after it
+    TAC_PASS_TAIL,      // mark the tail calls
+    TAC_PASS_UNBOX,     // unboxed Int and Bool temporaries, in the assembler
+    TAC_PASS_STRENGTH,  // cheaper code for `*` and `/` by constants, likewise
+    TAC_PASS_REGALLOC,  // temporaries in registers, likewise
+    TAC_PASS_PEEPHOLE,  // rewrite patterns of the emitted instructions
+    TAC_PASS_COUNT,
+};
+
+// The optimization level that is used when none is given
+#define TAC_OPT_LEVEL 2
+
+typedef struct tac_options {
+        int inline_threshold; // 0 turns the inliner off
+        unsigned int passes;  // bit (1 << pass) set for every pass that runs
+        int verify;           // check the TAC after every pass
+        int time_passes;      // report the time and changes of every pass
+        const char *profile_path; // where the instrumented program writes
+                                  // its counts, NULL if it is not
+        tac_profile *profile;     // the counts that guide the passes
+} tac_options;
+
+void codegen_tac_options_init(tac_options *options);
+
+// Enable exactly the passes of an optimization level, from 0 (none) to 2
+// (all). Returns 0 on success and 1 if there is no such level.
+int codegen_tac_options_set_level(tac_options *options, int level);
+
+// Adjust the passes from a comma separated list of names: a name enables
+// its pass and a name prefixed with '-' disables it. A list with any plain
+// name replaces the passes of the level. Returns 0 on success and 1 if a
+// name is unknown.
+int codegen_tac_options_set_passes(tac_options *options, const char *list);
+
+const char *codegen_tac_pass_name(enum tac_pass pass);
+
+// What the pass manager measured of one pass, over all the methods
+typedef struct tac_pass_stats {
+        unsigned int runs;
+        double seconds;
+        long instrs;          // instructions added, negative if removed
+        unsigned int changes; // what the pass counts itself, if anything
+} tac_pass_stats;
+
+// What the passes know about the whole program, built once before the
+// methods are optimized one by one
+typedef struct tac_optimizer {
+        semantic_mapping *mapping;
+        tac_options options;
+        ds_dynamic_array summaries;  // tac_method_summary
+        ds_hash_table summary_index; // const method_node * -> unsigned int
+        unsigned int eliminated;     // by value numbering, in the last method
+        unsigned int dispatches;     // dynamic dispatches, in all the methods
+        unsigned int devirtualized;  // of them, turned into direct calls
+        unsigned int inlined;        // calls, in all the methods
+        unsigned int on_stack;       // objects in the frame, in all the methods
+        tac_pass_stats stats[TAC_PASS_COUNT];
+        unsigned int dispatch_sites; // numbered in all the methods
+        unsigned int branch_sites;
+        unsigned long *allocations;  // `new` of each class, in the program
+        unsigned int speculated;     // guarded calls, in all the methods
+        // what interprocedural constant propagation knows of each summary,
+        // and the specialized copies of methods that it made
+        tac_method_constants *constants;
+        ds_dynamic_array specializations; // tac_specialization
+        unsigned int propagated;     // calls, in all the methods
+        unsigned int hoisted;        // out of loops, in all the methods
+} tac_optimizer;
+
+void codegen_tac_optimizer_init(tac_optimizer *optimizer,
+                                semantic_mapping *mapping,
+                                const tac_options *options);
+void codegen_tac_optimizer_free(tac_optimizer *optimizer);
+
+// The implementation of a method that is visible in a class, if any
+tac_method_summary *codegen_tac_method_summary(tac_optimizer *optimizer,
+                                               const char *class_name,
+                                               const char *method_name);
+
+// The index of the summary of a method, -1 for attribute initializers
+int codegen_tac_summary_index(tac_optimizer *optimizer,
+                              const method_node *method);
+
+// Number the call and branch sites of the TAC of a method the way the
+// optimizer numbered the ones of its summary
+void codegen_tac_number_sites(tac_optimizer *optimizer, tac_result *tac);
+void codegen_tac_number_summary_sites(tac_optimizer *optimizer,
+                                      tac_method_summary *summary);
+
+// Whether the profile was written by a build of the same program
+int codegen_tac_profile_matches(tac_optimizer *optimizer,
+                                tac_profile *profile);
+
+// The times a call site ran, 0 without a profile
+unsigned long codegen_tac_site_count(tac_optimizer *optimizer,
+                                     tac_dispatch_call *call);
+
+// The static type of the receiver of a call, with SELF_TYPE resolved
+const char *codegen_tac_receiver_type(tac_result *tac,
+                                      tac_dispatch_call *call);
+
+int codegen_class_init_is_pure(semantic_mapping *mapping,
+                               const char *class_name);
+
+// Whether the class is class_name or inherits from it
+int codegen_class_conforms(semantic_mapping_item *class,
+                           const char *class_name);
+
+// Whether any of the methods that the call can reach writes an attribute,
+// allocates an object with an init that does, or calls a method that does
+int codegen_tac_call_has_side_effects(tac_optimizer *optimizer,
+                                      tac_result *tac,
+                                      tac_dispatch_call *call);
+
+int codegen_tac_instr_has_side_effects(tac_optimizer *optimizer,
+                                       tac_result *tac, tac_instr *instr);
+
+// How `=` compares its operands, given their static type
+enum tac_eq_kind {
+    TAC_EQ_VALUE,   // the raw values of two Ints or two Bools
+    TAC_EQ_STRING,  // the lengths and the bytes of two Strings
+    TAC_EQ_BYTE,    // the raw values of two Bytes, or Byte.equals if the
+                    // right one is not exactly a Byte
+    TAC_EQ_POINTER, // the addresses, like the equals of Object
+    TAC_EQ_CALL,    // the equals that the class defines itself
+};
+
+enum tac_eq_kind codegen_tac_eq_kind(semantic_mapping *mapping,
+                                     const char *type);
+
+// Global value numbering over the dominator tree of an SSA form TAC: pure
+// instructions and calls without side effects that compute a value already
+// available are deleted. Returns the number of deleted instructions.
+unsigned int codegen_tac_number_values(tac_optimizer *optimizer,
+                                       tac_result *tac);
+
+// Class hierarchy analysis: a dynamic dispatch that can only reach one
+// implementation of the method in the whole program becomes a direct call
+void codegen_tac_devirtualize(tac_optimizer *optimizer, tac_result *tac);
+
+// Turn a single dynamic dispatch into a direct call if it has only one
+// target, without counting it. Returns whether it did.
+int codegen_tac_devirtualize_call(tac_optimizer *optimizer, tac_result *tac,
+                                  tac_dispatch_call *call);
+
+// Speculative devirtualization: a dynamic dispatch that the profile, or the
+// allocations of the program when there is none, sees mostly reaching one
+// implementation checks the tag of the receiver first. Calls that can be
+// inlined become a branch between the dynamic call and a direct one for the
+// inliner to expand, the others keep the guess for the assembler.
+void codegen_tac_speculate(tac_optimizer *optimizer, tac_result *tac);
+
+// Count the `new` of each class in the methods of the program
+void codegen_tac_count_allocations(tac_optimizer *optimizer);
+
+// Whether the inliner would replace the direct call by the body of the
+// callee
+int codegen_tac_is_inlinable(tac_optimizer *optimizer, tac_result *tac,
+                             tac_dispatch_call *call);
+
+// Interprocedural constant propagation of an SSA form TAC: the direct calls
+// to methods that return a constant are replaced by it, and the ones that
+// pass constant arguments go to a copy of the callee specialized for them
+// when that folds away enough of it. Folds the method again after.
+void codegen_tac_propagate_interprocedural(tac_optimizer *optimizer,
+                                           tac_result *tac);
+
+// The TAC of a specialization, for the assembler to optimize and emit
+void codegen_tac_specialization(tac_optimizer *optimizer, unsigned int index,
+                                tac_result *tac);
+
+// Replace the direct calls to small methods by a renamed copy of their body.
+// The callee gets the receiver and the arguments in fresh temporaries and
+// reads and writes the attributes of a receiver other than self through
+// field instructions.
+void codegen_tac_inline(tac_optimizer *optimizer, tac_result *tac);
+
+// Loop invariant code motion of an SSA form TAC: the computations of a loop
+// whose operands do not change in it move to the block that enters it. The
+// ones that can fail only move from blocks that every trip runs through, and
+// the ones that read memory only out of loops that do not write it.
+void codegen_tac_hoist_invariants(tac_optimizer *optimizer, tac_result *tac);
+
+// Escape analysis of an SSA form TAC: the objects that are only copied,
+// tested and accessed through fields, and never stored, passed to a call or
+// returned, are allocated in the frame of the method instead of the heap
+void codegen_tac_allocate_on_stack(tac_optimizer *optimizer,
+                                   tac_result *tac);
+
+// Reorder the blocks of a TAC out of SSA form so that the successor that
+// the profile saw taken most often follows each block, inverting branches
+// and adding jumps where the fall through changes
+void codegen_tac_layout_blocks(tac_optimizer *optimizer, tac_result *tac);
+
+// Mark the calls of a method whose value is returned without anything else
+// happening after them, so that they can reuse the frame of the caller
+void codegen_tac_mark_tail_calls(tac_result *tac);
+
+// Run the enabled passes over the TAC of one method, checking it after each
+// of them if the options ask for it
+void codegen_tac_optimize(tac_optimizer *optimizer, tac_result *tac);
+
+int codegen_tac_pass_enabled(tac_optimizer *optimizer, enum tac_pass pass);
+
+// Print the statistics of the passes that ran to stderr
+void codegen_tac_print_pass_stats(tac_optimizer *optimizer);
+
+// Check the invariants of a TAC: labels defined once and jumped to only if
+// defined, operands in range, the value of the method last and, in SSA form,
+// temporaries defined once and phis only at the start of blocks. Returns
+// NULL if they hold and a description of the first violation otherwise.
+const char *codegen_tac_verify(tac_result *tac, int ssa);
+
+// How a temporary is stored: as a pointer to an object, or as the raw value
+// of an Int or a Bool that is only boxed where an object is needed
+enum tac_repr {
+    TAC_REPR_OBJECT,
+    TAC_REPR_INT,
+    TAC_REPR_BOOL,
+};
+
+// Whether the instruction reads its operands as raw Int and Bool values
+// instead of objects, given the representation of its destination
+int codegen_tac_reads_value(tac_instr *instr, enum tac_repr ident);
+
+// Choose the representation of every temporary of a TAC out of SSA form.
+// Int and Bool temporaries are unboxed unless boxing them where they are
+// used as objects allocates more than the arithmetic that defines them.
+void codegen_tac_representations(tac_optimizer *optimizer, tac_result *tac,
+                                 enum tac_repr *reprs);
+
+// The representations for the assembler: the ones of unbox if the pass is
+// enabled, objects for every temporary otherwise
+void codegen_tac_unbox(tac_optimizer *optimizer, tac_result *tac,
+                       enum tac_repr *reprs);
+
+// Whether the code of an instruction calls a routine that can change the
+// caller saved registers
+typedef int (*tac_clobbers_fn)(void *data, tac_instr *instr);
+
+// Linear scan register allocation of the temporaries of a TAC out of SSA
+// form: registers[t] is the register of temporary t, -1 if it stays in its
+// slot of the frame. The first callee_saved registers keep their value
+// across calls, the caller_saved ones after them only go to temporaries
+// that no call clobbers while they are live.
+void codegen_tac_linear_scan(tac_result *tac, tac_clobbers_fn clobbers,
+                             void *data, unsigned int callee_saved,
+                             unsigned int caller_saved, int *registers);
+
+// The registers for the assembler: the ones of linear scan if the pass is
+// enabled, none otherwise
+void codegen_tac_allocate_registers(tac_optimizer *optimizer, tac_result *tac,
+                                    tac_clobbers_fn clobbers, void *data,
+                                    unsigned int callee_saved,
+                                    unsigned int caller_saved, int *registers);
+
+// Whether the assembler computes the `*` or the `/` with cheaper
+// instructions than a multiplication or a division, because one operand is
+// a constant: sets the constant and the other operand
+int codegen_tac_strength_constant(tac_optimizer *optimizer, enum tac_kind kind,
+                                  tac_assign_binary *instr,
+                                  tac_operand *operand, long *constant);
+
+void codegen_tac_print_instr(FILE *out, tac_result *tac, tac_instr instr);
+
+enum tac_print_format {
+    TAC_PRINT_TEXT,
+    TAC_PRINT_CFG,
+    TAC_PRINT_DOT,
+};
 
-void codegen_tac_print(semantic_mapping *mapping, program_node *program);
+// The TAC is optimized with the options when they are not NULL
+void codegen_tac_print(semantic_mapping *mapping, program_node *program,
+                       enum tac_print_format format, int ssa,
+                       const tac_options *options);
 
 #endif // CODEGEN_H
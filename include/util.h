@@ -19,8 +19,21 @@
 #define ARG_SEMANTIC "sem"
 #define ARG_MAPPING "map"
 #define ARG_TACGEN "tac"
+#define ARG_CFG "cfg"
+#define ARG_DOT "dot"
+#define ARG_SSA "ssa"
+#define ARG_OPT "opt"
+#define ARG_INLINE_THRESHOLD "inline-threshold"
+#define ARG_OPT_LEVEL "opt-level"
+#define ARG_PASSES "passes"
+#define ARG_TIME_PASSES "time-passes"
+#define ARG_VERIFY "verify"
+#define ARG_PROFILE_GENERATE "profile-generate"
+#define ARG_PROFILE_USE "profile-use"
 #define ARG_ASSEMBLER "asm"
+#define ARG_FASM "fasm"
 #define ARG_MODULE "module"
+#define ARG_JOBS "jobs"
 
 int util_parse_arguments(ds_argparse_parser *parser, int argc, char **argv);
 int util_validate_module(char *cool_lib, const char *module);
@@ -19,25 +19,20 @@ class List {
         let void: List in new List.init(v, void)
     };
 
+    last(): List {
+        if isvoid next then self else next.last() fi
+    };
+
     append(v: Object): List {
-        {
-            if isvoid next then
-                let void: List
-                in next <- new List.init(v, void)
-            else
-                next.append(v)
-            fi;
+        let void: List in {
+            last().set_next(new List.init(v, void));
             self;
         }
     };
 
     concat(l: List): List {
         {
-            if isvoid next then
-                next <- l
-            else
-                next.concat(l)
-            fi;
+            last().set_next(l);
             self;
         }
     };
@@ -50,13 +45,9 @@ class List {
         fi
     };
 
-    count(): Int {
-        {
-            if isvoid next then
-                1
-            else
-                1 + next.count()
-            fi;
-        }
+    count(): Int { count_from(0) };
+
+    count_from(n: Int): Int {
+        if isvoid next then n + 1 else next.count_from(n + 1) fi
     };
 };
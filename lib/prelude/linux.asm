@@ -709,6 +709,8 @@ Linux.exit:
     mov     rbp, rsp                   ; set up stack frame
     sub     rsp, 8                     ; allocate 1 local variables
 
+    call    _profile_dump              ; of an instrumented program
+
     mov     rdi, [rbp + arg_0]
     add     rdi, [slot_0]
     mov     rdi, [rdi]
@@ -29,6 +29,13 @@ arg_5 = 56
 arg_6 = 64
 arg_7 = 72
 
+; Messages of the runtime errors
+case_abort_msg db "No match in case statement for Class "
+case_abort_msg_len = 37
+case_void_msg db "Match on void in case statement", 10
+case_void_msg_len = 32
+newline_msg db 10
+
 ; Define entry point
 section '.text' executable
 public _start
@@ -40,6 +47,8 @@ _start:
     call    Object.copy
     call    Main_init
     call    Main.main
+    ; Write the profile of an instrumented program
+    call    _profile_dump
     ; Exit the program
     mov     rax, 60
     xor     rdi, rdi
@@ -130,6 +139,80 @@ Object.type_name:
     pop     rbp                        ; restore return address
     ret
 
+;
+;
+; Case abort
+;
+;   Reports that no branch of a case matches the class of the value and
+;   exits the program.
+;
+;   INPUT: rax contains the value of the case
+;   STACK: empty
+;   OUTPUT: does not return
+;
+_case_abort:
+    push    rbp                        ; save return address
+    mov     rbp, rsp                   ; set up stack frame
+    push    rax                        ; save the value
+
+    ; write(2, case_abort_msg, case_abort_msg_len)
+    mov     rax, 1
+    mov     rdi, 2
+    mov     rsi, case_abort_msg
+    mov     rdx, case_abort_msg_len
+    syscall
+
+    ; t0 <- value.type_name()
+    pop     rax
+    call    Object.type_name
+
+    ; write(2, t0.str, t0.l.val)
+    mov     rsi, rax
+    add     rsi, [slot_1]              ; get t0.str
+    mov     rdx, rax
+    add     rdx, [slot_0]
+    mov     rdx, [rdx]                 ; get t0.l
+    add     rdx, [slot_0]
+    mov     rdx, [rdx]                 ; get t0.l.val
+    mov     rax, 1
+    mov     rdi, 2
+    syscall
+
+    ; write(2, newline_msg, 1)
+    mov     rax, 1
+    mov     rdi, 2
+    mov     rsi, newline_msg
+    mov     rdx, 1
+    syscall
+
+    ; exit(1)
+    mov     rax, 60
+    mov     rdi, 1
+    syscall
+
+;
+;
+; Case abort on void
+;
+;   Reports that the value of a case is void and exits the program.
+;
+;   INPUT: empty
+;   STACK: empty
+;   OUTPUT: does not return
+;
+_case_abort_void:
+    ; write(2, case_void_msg, case_void_msg_len)
+    mov     rax, 1
+    mov     rdi, 2
+    mov     rsi, case_void_msg
+    mov     rdx, case_void_msg_len
+    syscall
+
+    ; exit(1)
+    mov     rax, 60
+    mov     rdi, 1
+    syscall
+
 ;
 ;
 ; Object.equals
@@ -1230,3 +1313,65 @@ memcpy:
 
     pop     rbp                        ; restore return address
     ret
+
+;
+;
+; string_equals
+;
+;   Compares two strings by their length and bytes. Used by `=` on Strings
+;   instead of a call to String.equals.
+;
+;   INPUT:
+;       rdi points to the first string
+;       rsi points to the second string
+;   STACK: empty
+;   OUTPUT: rax contains 1 if they are equal, 0 otherwise
+;
+string_equals:
+    push    rbp                        ; save return address
+    mov     rbp, rsp                   ; set up stack frame
+
+    xor     rax, rax                   ; not equal until proven otherwise
+    cmp     rdi, rsi                   ; the same string
+    je      .equal
+    test    rdi, rdi                   ; void is only equal to itself
+    jz      .done
+    test    rsi, rsi
+    jz      .done
+
+    mov     rcx, rdi
+    add     rcx, [slot_0]
+    mov     rcx, [rcx]                 ; get s1.l
+    add     rcx, [slot_0]
+    mov     rcx, [rcx]                 ; get s1.l.val
+    mov     rdx, rsi
+    add     rdx, [slot_0]
+    mov     rdx, [rdx]                 ; get s2.l
+    add     rdx, [slot_0]
+    mov     rdx, [rdx]                 ; get s2.l.val
+    cmp     rcx, rdx
+    jne     .done
+
+    add     rdi, [slot_1]              ; get s1.str
+    add     rsi, [slot_1]              ; get s2.str
+
+.next_byte:
+    test    rcx, rcx                   ; check if done
+    jz      .equal
+
+    mov     dl, byte [rdi]
+    cmp     dl, byte [rsi]
+    jne     .done
+
+    inc     rdi
+    inc     rsi
+    dec     rcx
+
+    jmp     .next_byte
+
+.equal:
+    mov     rax, 1
+.done:
+
+    pop     rbp                        ; restore return address
+    ret
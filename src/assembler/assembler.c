@@ -5,6 +5,7 @@
 #include "semantic.h"
 #include "stdio.h"
 #include <stdarg.h>
+#include <time.h>
 
 #define ASM_INDENT_SIZE 4
 
@@ -16,8 +17,21 @@
 #define DISPTABLE_OFFSET 16
 #define ATTRIBUTE_OFFSET 24
 
+// A case with this many branches jumps through a table indexed by the class
+// tag instead of comparing the tag against each branch in turn
+#define ASM_CASE_TABLE_MIN 4
+
 #define locals_count_16_aligned(count) ((count + 1) / 2 * 2)
 
+// The registers that hold temporaries: the callee saved ones first, which
+// every routine keeps, then the caller saved ones that no generated code
+// uses as scratch, which only survive until the next call
+#define ASM_CALLEE_SAVED 4
+#define ASM_CALLER_SAVED 5
+static const char *asm_registers[ASM_CALLEE_SAVED + ASM_CALLER_SAVED] = {
+    "r12", "r13", "r14", "r15", "rcx", "r8", "r9", "r10", "r11",
+};
+
 enum asm_const_type {
     ASM_CONST_INT,
     ASM_CONST_STR,
@@ -44,6 +58,7 @@ typedef struct asm_const {
 
 typedef struct assembler_context {
         FILE *file;
+        asm_object *object; // the lines are encoded into it when there is one
         semantic_mapping *mapping;
         int result;
         int int_tag;
@@ -53,14 +68,59 @@ typedef struct assembler_context {
 
         semantic_mapping_item *current_class;
         implementation_mapping_item *current_method;
+        // 1 + the specialization of the current method that is emitted
+        unsigned int current_clone;
+        // TAC labels restart at 0 for every expression, but the attribute
+        // initializers of a class share the same init routine
+        int label_offset;
+        tac_optimizer optimizer;
+
+        // the representation of every temporary of the current expression,
+        // and the local that holds the boxed copy of a raw temporary while
+        // an instruction reads it as an object, -1 if it is not boxed
+        enum tac_repr *reprs;
+        int *boxed;
+
+        // the register of every temporary, -1 for the ones in the frame,
+        // and the callee saved registers that the expression pushes
+        int *registers;
+        int saved[ASM_CALLEE_SAVED];
+        int saved_count;
+
+        // the frame of the current expression, and the label after its
+        // prologue where a tail call of the method to itself jumps to
+        int num_locals;
+        int entry_label;
+
+        // the locals after the temporaries and their boxed copies hold the
+        // objects that do not escape, one after the other in emission order
+        int stack_objects;
+
+        // numbers the local labels that do not come from the TAC, like the
+        // ones of the jump tables of case expressions
+        int local_count;
+
+        // the lines of the routine that is emitted, which go to the file
+        // after the peephole pass
+        int buffering;
+        ds_dynamic_array routine; // asm_instr
+        asm_peephole peephole;
 } assembler_context;
 
 static int assembler_context_init(assembler_context *context,
-                                  const char *filename,
-                                  semantic_mapping *mapping) {
+                                  const char *filename, asm_object *object,
+                                  semantic_mapping *mapping,
+                                  const tac_options *options) {
     int result = 0;
 
-    if (filename == NULL) {
+    codegen_tac_optimizer_init(&context->optimizer, mapping, options);
+    ds_dynamic_array_init(&context->routine, sizeof(asm_instr));
+    assembler_peephole_init(&context->peephole);
+
+    context->object = object;
+    if (object != NULL) {
+        context->file = NULL;
+    } else if (filename == NULL) {
         context->file = stdout;
     } else {
         context->file = fopen(filename, "a");
@@ -71,6 +131,10 @@ static int assembler_context_init(assembler_context *context,
 
     context->mapping = mapping;
     context->result = 0;
+    context->label_offset = 0;
+    context->local_count = 0;
+    context->current_clone = 0;
+    context->buffering = 0;
 
     ds_dynamic_array_init(&context->consts, sizeof(asm_const));
 
@@ -86,32 +150,68 @@ static void assembler_context_destroy(assembler_context *context) {
     if (context->file != NULL && context->file != stdout) {
         fclose(context->file);
     }
+    ds_dynamic_array_free(&context->routine);
+    assembler_peephole_free(&context->peephole);
+    codegen_tac_optimizer_free(&context->optimizer);
 }
 
 #define COMMENT_START_COLUMN 40
 
+static void assembler_print_line(FILE *file, int align, const char *text,
+                                 const char *comment) {
+    fprintf(file, "%*s%s", align, "", text);
+
+    if (comment != NULL) {
+        int padding = COMMENT_START_COLUMN - align - (int)strlen(text);
+        if (padding < 0) {
+            padding = 1;
+        }
+        fprintf(file, "%*s; %s", padding, "", comment);
+    }
+
+    fprintf(file, "\n");
+}
+
+// Write the line to the file, or encode it into the object when there is
+// one; the first line that does not encode fails the whole run
+static void assembler_output(assembler_context *context, asm_instr *instr) {
+    if (context->object == NULL) {
+        assembler_print_line(context->file, instr->align, instr->text,
+                             instr->comment);
+    } else if (context->result == 0 &&
+               assembler_object_emit(context->object, instr) != 0) {
+        context->result = 1;
+    }
+}
+
 static void assembler_emit_fmt(assembler_context *context, int align,
                                const char *comment, const char *format, ...) {
-    fprintf(context->file, "%*s", align, "");
-
     va_list args;
     va_start(args, format);
-    int size = vsnprintf(NULL, 0, format, args) + align;
-    int padding = COMMENT_START_COLUMN - size;
+    int size = vsnprintf(NULL, 0, format, args);
     va_end(args);
 
+    char *text = malloc(size + 1);
+
     va_start(args, format);
-    vfprintf(context->file, format, args);
+    vsnprintf(text, size + 1, format, args);
     va_end(args);
 
-    if (comment != NULL) {
-        if (padding < 0) {
-            padding = 1;
-        }
-        fprintf(context->file, "%*s; %s", padding, "", comment);
+    // the code of a routine is kept until its end, for the peephole pass
+    if (context->buffering) {
+        asm_instr instr;
+        assembler_instr_parse(&instr, align, text, comment);
+        ds_dynamic_array_append(&context->routine, &instr);
+    } else if (context->object != NULL) {
+        asm_instr instr;
+        assembler_instr_parse(&instr, align, text, comment);
+        assembler_output(context, &instr);
+        assembler_instr_free(&instr);
+    } else {
+        assembler_print_line(context->file, align, text, comment);
     }
 
-    fprintf(context->file, "\n");
+    free(text);
 }
 
 #define assembler_emit(context, format, ...)                                   \
@@ -132,35 +232,37 @@ static inline const char *comment_fmt(const char *format, ...) {
     return comment;
 }
 
-static void print_tac_label(assembler_context *context, tac_label label) {}
+#define name(operand) codegen_tac_operand_name(tac, operand)
 
-static void print_tac_jump(assembler_context *context, tac_jump jump) {}
+static void print_tac_label(assembler_context *context, tac_result *tac, tac_label label) {}
 
-static void print_tac_jump_if_true(assembler_context *context, tac_jump_if_true jump_if_true) {
-    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "; bt %s %s", jump_if_true.expr, jump_if_true.label);
+static void print_tac_jump(assembler_context *context, tac_result *tac, tac_jump jump) {}
+
+static void print_tac_jump_if_true(assembler_context *context, tac_result *tac, tac_jump_if_true jump_if_true) {
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "; bt %s L%d", name(jump_if_true.expr), jump_if_true.label);
 }
 
-static void print_tac_assign_isinstance(assembler_context *context, tac_isinstance isinstance) {
-    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "; %s <- %s instanceof %s", isinstance.ident, isinstance.expr, isinstance.type);
+static void print_tac_assign_isinstance(assembler_context *context, tac_result *tac, tac_isinstance isinstance) {
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "; %s <- %s instanceof %s", name(isinstance.ident), name(isinstance.expr), isinstance.type);
 }
 
-static void print_tac_cast(assembler_context *context, tac_cast cast) {
-    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "; %s <- %s as %s", cast.ident, cast.expr, cast.type);
+static void print_tac_cast(assembler_context *context, tac_result *tac, tac_cast cast) {
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "; %s <- %s as %s", name(cast.ident), name(cast.expr), cast.type);
 }
 
-static void print_tac_assign_value(assembler_context *context, tac_assign_value assign_value) {
-    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "; %s <- %s", assign_value.ident, assign_value.expr);
+static void print_tac_assign_value(assembler_context *context, tac_result *tac, tac_assign_value assign_value) {
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "; %s <- %s", name(assign_value.ident), name(assign_value.expr));
 }
 
-static void print_tac_dispatch_call(assembler_context *context, tac_dispatch_call dispatch_call) {
+static void print_tac_dispatch_call(assembler_context *context, tac_result *tac, tac_dispatch_call dispatch_call) {
     char *buffer = NULL;
     ds_string_builder sb;
 
     ds_string_builder_init(&sb);
 
-    if (dispatch_call.expr != NULL) {
+    if (dispatch_call.expr.kind != TAC_OPERAND_NONE) {
         ds_string_builder_append(&sb, "(%s)", dispatch_call.expr_type);
-        ds_string_builder_append(&sb, "%s", dispatch_call.expr);
+        ds_string_builder_append(&sb, "%s", name(dispatch_call.expr));
         if (dispatch_call.type != NULL) {
             ds_string_builder_append(&sb, "@%s", dispatch_call.type);
         }
@@ -170,9 +272,9 @@ static void print_tac_dispatch_call(assembler_context *context, tac_dispatch_cal
     ds_string_builder_append(&sb, "%s(", dispatch_call.method);
 
     for (unsigned int i = 0; i < dispatch_call.args.count; i++) {
-        char *arg;
+        tac_operand arg;
         ds_dynamic_array_get(&dispatch_call.args, i, &arg);
-        ds_string_builder_append(&sb, "%s", arg);
+        ds_string_builder_append(&sb, "%s", name(arg));
         if (i < dispatch_call.args.count - 1) {
             ds_string_builder_appendc(&sb, ',');
         }
@@ -181,40 +283,40 @@ static void print_tac_dispatch_call(assembler_context *context, tac_dispatch_cal
     ds_string_builder_appendc(&sb, ')');
     ds_string_builder_build(&sb, &buffer);
 
-    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "; %s <- %s", dispatch_call.ident, buffer);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "; %s <- %s", name(dispatch_call.ident), buffer);
 }
 
-static void print_tac_assign_new(assembler_context *context, tac_assign_new assign_new) {
-    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "; %s <- new %s", assign_new.ident, assign_new.type);
+static void print_tac_assign_new(assembler_context *context, tac_result *tac, tac_assign_new assign_new) {
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "; %s <- %snew %s", name(assign_new.ident), assign_new.stack ? "stack " : "", assign_new.type);
 }
 
-static void print_tac_assign_default(assembler_context *context, tac_assign_new assign_new) {
-    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "; %s <- default %s", assign_new.ident, assign_new.type);
+static void print_tac_assign_default(assembler_context *context, tac_result *tac, tac_assign_new assign_new) {
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "; %s <- default %s", name(assign_new.ident), assign_new.type);
 }
 
-static void print_tac_assign_binary(assembler_context *context, tac_assign_binary assign_binary, const char *op) {
-    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "; %s <- %s %s %s", assign_binary.ident, assign_binary.lhs, op, assign_binary.rhs);
+static void print_tac_assign_binary(assembler_context *context, tac_result *tac, tac_assign_binary assign_binary, const char *op) {
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "; %s <- %s %s %s", name(assign_binary.ident), name(assign_binary.lhs), op, name(assign_binary.rhs));
 }
 
-static void print_tac_assign_eq(assembler_context *context, tac_assign_eq assign_binary) {
-    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "; %s <- %s = %s", assign_binary.ident, assign_binary.lhs, assign_binary.rhs);
+static void print_tac_assign_eq(assembler_context *context, tac_result *tac, tac_assign_eq assign_binary) {
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "; %s <- %s = %s", name(assign_binary.ident), name(assign_binary.lhs), name(assign_binary.rhs));
 }
 
-static void print_tac_assign_unary(assembler_context *context, tac_assign_unary assign_unary, const char *op) {
-    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "; %s <- %s %s", assign_unary.ident, op, assign_unary.expr);
+static void print_tac_assign_unary(assembler_context *context, tac_result *tac, tac_assign_unary assign_unary, const char *op) {
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "; %s <- %s %s", name(assign_unary.ident), op, name(assign_unary.expr));
 }
 
-static void print_tac_ident(assembler_context *context, tac_ident ident) { assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "; %s", ident.name); }
+static void print_tac_ident(assembler_context *context, tac_result *tac, tac_ident ident) { assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "; %s", name(ident.name)); }
 
-static void print_tac_assign_int(assembler_context *context, tac_assign_int assign_int) {
-    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "; %s <- int %d", assign_int.ident, assign_int.value);
+static void print_tac_assign_int(assembler_context *context, tac_result *tac, tac_assign_int assign_int) {
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "; %s <- int %s", name(assign_int.ident), name(assign_int.value));
 }
 
-static void print_tac_assign_string(assembler_context *context, tac_assign_string assign_string) {
+static void print_tac_assign_string(assembler_context *context, tac_result *tac, tac_assign_string assign_string) {
     ds_string_builder sb;
     ds_string_builder_init(&sb);
 
-    char *str = assign_string.value;
+    char *str = (char *)assign_string.value.string;
 
     size_t length = strlen(str);
     for (size_t i = 0; i < length; i++) {
@@ -226,61 +328,87 @@ static void print_tac_assign_string(assembler_context *context, tac_assign_strin
 
     ds_string_builder_build(&sb, &str);
 
-    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "; %s <- string %s", assign_string.ident, str);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "; %s <- string %s", name(assign_string.ident), str);
+}
+
+static void print_tac_assign_bool(assembler_context *context, tac_result *tac, tac_assign_bool assign_bool) {
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "; %s <- bool %s", name(assign_bool.ident), name(assign_bool.value));
+}
+
+static void print_tac_load_field(assembler_context *context, tac_result *tac, tac_field field) {
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "; %s <- %s.%s", name(field.ident), name(field.object), field.name);
+}
+
+static void print_tac_store_field(assembler_context *context, tac_result *tac, tac_field field) {
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "; %s.%s <- %s", name(field.object), field.name, name(field.value));
+}
+
+static void print_tac_check_void(assembler_context *context, tac_result *tac, tac_check_void check_void) {
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "; check %s", name(check_void.expr));
 }
 
-static void print_tac_assign_bool(assembler_context *context, tac_assign_bool assign_bool) {
-    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "; %s <- bool %s", assign_bool.ident, assign_bool.value ? "true" : "false");
+static void print_tac_case_jump(assembler_context *context, tac_result *tac, tac_case_jump case_jump) {
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "; case %s of ...", name(case_jump.expr));
 }
 
-static void assembler_emit_tac_comment(assembler_context *context, tac_instr tac) {
-    switch (tac.kind) {
+static void assembler_emit_tac_comment(assembler_context *context, tac_result *tac, tac_instr instr) {
+    switch (instr.kind) {
     case TAC_LABEL:
-        return print_tac_label(context, tac.label);
+        return print_tac_label(context, tac, instr.label);
     case TAC_JUMP:
-        return print_tac_jump(context, tac.jump);
+        return print_tac_jump(context, tac, instr.jump);
     case TAC_JUMP_IF_TRUE:
-        return print_tac_jump_if_true(context, tac.jump_if_true);
+        return print_tac_jump_if_true(context, tac, instr.jump_if_true);
     case TAC_ASSIGN_ISINSTANCE:
-        return print_tac_assign_isinstance(context, tac.isinstance);
+        return print_tac_assign_isinstance(context, tac, instr.isinstance);
     case TAC_CAST:
-        return print_tac_cast(context, tac.cast);
+        return print_tac_cast(context, tac, instr.cast);
     case TAC_ASSIGN_VALUE:
-        return print_tac_assign_value(context, tac.assign_value);
+        return print_tac_assign_value(context, tac, instr.assign_value);
     case TAC_DISPATCH_CALL:
-        return print_tac_dispatch_call(context, tac.dispatch_call);
+        return print_tac_dispatch_call(context, tac, instr.dispatch_call);
     case TAC_ASSIGN_NEW:
-        return print_tac_assign_new(context, tac.assign_new);
+        return print_tac_assign_new(context, tac, instr.assign_new);
     case TAC_ASSIGN_DEFAULT:
-        return print_tac_assign_default(context, tac.assign_default);
+        return print_tac_assign_default(context, tac, instr.assign_default);
     case TAC_ASSIGN_ISVOID:
-        return print_tac_assign_unary(context, tac.assign_unary, "isvoid");
+        return print_tac_assign_unary(context, tac, instr.assign_unary, "isvoid");
     case TAC_ASSIGN_ADD:
-        return print_tac_assign_binary(context, tac.assign_binary, "+");
+        return print_tac_assign_binary(context, tac, instr.assign_binary, "+");
     case TAC_ASSIGN_SUB:
-        return print_tac_assign_binary(context, tac.assign_binary, "-");
+        return print_tac_assign_binary(context, tac, instr.assign_binary, "-");
     case TAC_ASSIGN_MUL:
-        return print_tac_assign_binary(context, tac.assign_binary, "*");
+        return print_tac_assign_binary(context, tac, instr.assign_binary, "*");
     case TAC_ASSIGN_DIV:
-        return print_tac_assign_binary(context, tac.assign_binary, "/");
+        return print_tac_assign_binary(context, tac, instr.assign_binary, "/");
     case TAC_ASSIGN_NEG:
-        return print_tac_assign_unary(context, tac.assign_unary, "~");
+        return print_tac_assign_unary(context, tac, instr.assign_unary, "~");
     case TAC_ASSIGN_LT:
-        return print_tac_assign_binary(context, tac.assign_binary, "<");
+        return print_tac_assign_binary(context, tac, instr.assign_binary, "<");
     case TAC_ASSIGN_LE:
-        return print_tac_assign_binary(context, tac.assign_binary, "<=");
+        return print_tac_assign_binary(context, tac, instr.assign_binary, "<=");
     case TAC_ASSIGN_EQ:
-        return print_tac_assign_eq(context, tac.assign_eq);
+        return print_tac_assign_eq(context, tac, instr.assign_eq);
     case TAC_ASSIGN_NOT:
-        return print_tac_assign_unary(context, tac.assign_unary, "not");
+        return print_tac_assign_unary(context, tac, instr.assign_unary, "not");
     case TAC_IDENT:
-        return print_tac_ident(context, tac.ident);
+        return print_tac_ident(context, tac, instr.ident);
     case TAC_ASSIGN_INT:
-        return print_tac_assign_int(context, tac.assign_int);
+        return print_tac_assign_int(context, tac, instr.assign_int);
     case TAC_ASSIGN_STRING:
-        return print_tac_assign_string(context, tac.assign_string);
+        return print_tac_assign_string(context, tac, instr.assign_string);
     case TAC_ASSIGN_BOOL:
-        return print_tac_assign_bool(context, tac.assign_bool);
+        return print_tac_assign_bool(context, tac, instr.assign_bool);
+    case TAC_PHI:
+        break;
+    case TAC_LOAD_FIELD:
+        return print_tac_load_field(context, tac, instr.field);
+    case TAC_STORE_FIELD:
+        return print_tac_store_field(context, tac, instr.field);
+    case TAC_CHECK_VOID:
+        return print_tac_check_void(context, tac, instr.check_void);
+    case TAC_CASE:
+        return print_tac_case_jump(context, tac, instr.case_jump);
     }
 }
 
@@ -565,130 +693,8 @@ static void assembler_emit_object_prototypes(assembler_context *context) {
     }
 }
 
-// rax <- ident
-static void assembler_emit_load_variable(assembler_context *context,
-                                         tac_result *tac, char *ident) {
-    if (strcmp(ident, "self") == 0) {
-        const char *comment = comment_fmt("load self");
-        assembler_emit_fmt(context, ASM_INDENT_SIZE, comment,
-                           "mov     rax, rbx");
-        return;
-    }
-
-    if (tac != NULL) {
-        for (size_t i = 0; i < tac->locals.count; i++) {
-            char *local = NULL;
-            ds_dynamic_array_get_ref(&tac->locals, i, (void **)&local);
-
-            if (strcmp(local, ident) == 0) {
-                int offset = i;
-                const char *comment = comment_fmt("load %s", ident);
-                assembler_emit_fmt(context, ASM_INDENT_SIZE, comment,
-                                   "mov     rax, qword [rbp-%d]",
-                                   LOCALS_OFFSET + WORD_SIZE * offset);
-                return;
-            }
-        }
-    }
-
-    implementation_mapping_item *method = context->current_method;
-    if (method != NULL) {
-        method_node *node = (method_node *)method->method;
-
-        for (size_t i = 0; i < node->formals.count; i++) {
-            formal_node *formal = NULL;
-            ds_dynamic_array_get_ref(&node->formals, i, (void **)&formal);
-
-            if (strcmp(formal->name.value, ident) == 0) {
-                int offset = i;
-                const char *comment = comment_fmt("load %s", ident);
-                assembler_emit_fmt(context, ASM_INDENT_SIZE, comment,
-                                   "mov     rax, qword [rbp+%d]",
-                                   ARGUMENTS_OFFSET + WORD_SIZE * offset);
-                return;
-            }
-        }
-    }
-
-    semantic_mapping_item *item = context->current_class;
-    for (size_t i = 0; i < item->attributes.count; i++) {
-        class_mapping_attribute *attribute = NULL;
-        ds_dynamic_array_get_ref(&item->attributes, i, (void **)&attribute);
-
-        if (strcmp(attribute->attribute_name, ident) == 0) {
-            int offset = i;
-            const char *comment = comment_fmt("load %s", ident);
-            assembler_emit_fmt(context, ASM_INDENT_SIZE, comment,
-                               "mov     rax, qword [rbx+%d]",
-                               ATTRIBUTE_OFFSET + WORD_SIZE * offset);
-            return;
-        }
-    }
-
-    DS_PANIC("not implemented: rax <- %s", ident);
-}
-
-// ident <- rax
-static void assembler_emit_store_variable(assembler_context *context,
-                                          tac_result *tac, const char *ident) {
-    if (tac != NULL) {
-        for (size_t i = 0; i < tac->locals.count; i++) {
-            char *local = NULL;
-            ds_dynamic_array_get_ref(&tac->locals, i, (void **)&local);
-
-            if (strcmp(local, ident) == 0) {
-                int offset = i;
-                const char *comment = comment_fmt("store %s", ident);
-                assembler_emit_fmt(context, ASM_INDENT_SIZE, comment,
-                                   "mov     qword [rbp-%d], rax",
-                                   LOCALS_OFFSET + WORD_SIZE * offset);
-                return;
-            }
-        }
-    }
-
-    implementation_mapping_item *method = context->current_method;
-    if (method != NULL) {
-        method_node *node = (method_node *)method->method;
-
-        for (size_t i = 0; i < node->formals.count; i++) {
-            formal_node *formal = NULL;
-            ds_dynamic_array_get_ref(&node->formals, i, (void **)&formal);
-
-            if (strcmp(formal->name.value, ident) == 0) {
-                int offset = i;
-                const char *comment = comment_fmt("store %s", ident);
-                assembler_emit_fmt(context, ASM_INDENT_SIZE, comment,
-                                   "mov     qword [rbp+%d], rax",
-                                   ARGUMENTS_OFFSET + WORD_SIZE * offset);
-                return;
-            }
-        }
-    }
-
-    semantic_mapping_item *item = context->current_class;
-    for (size_t i = 0; i < item->attributes.count; i++) {
-        class_mapping_attribute *attribute = NULL;
-        ds_dynamic_array_get_ref(&item->attributes, i, (void **)&attribute);
-
-        if (strcmp(attribute->attribute_name, ident) == 0) {
-            int offset = i;
-            const char *comment = comment_fmt("store %s", ident);
-            assembler_emit_fmt(context, ASM_INDENT_SIZE, comment,
-                               "mov     qword [rbx+%d], rax",
-                               ATTRIBUTE_OFFSET + WORD_SIZE * offset);
-            return;
-        }
-    }
-
-    DS_PANIC("not implemented: %s <- rax", ident);
-}
-
-// rax <- ident.attr
-static void assembler_emit_get_attr(assembler_context *context, tac_result tac,
-                                    char *ident, char *type, char *attr) {
-    const char *comment = NULL;
-
+static size_t assembler_attr_offset(assembler_context *context, char *type,
+                                    char *attr) {
     semantic_mapping_item *item = NULL;
     for (size_t i = 0; i < context->mapping->classes.count; i++) {
         semantic_mapping_item *c = NULL;
@@ -719,58 +725,167 @@ static void assembler_emit_get_attr(assembler_context *context, tac_result tac,
         DS_PANIC("unreachable");
     }
 
-    assembler_emit_load_variable(context, &tac, ident);
+    return attribute_slot;
+}
+
+static char *assembler_repr_type(enum tac_repr repr) {
+    return repr == TAC_REPR_BOOL ? "Bool" : "Int";
+}
 
-    comment = comment_fmt("get %s.%s", ident, attr);
-    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "add     rax, %d",
-                       attribute_slot);
-    assembler_emit_fmt(context, ASM_INDENT_SIZE, comment,
-                       "mov     rax, qword [rax]");
+// Where a temporary lives: its register or its slot in the frame
+static const char *assembler_temp_location(assembler_context *context,
+                                           unsigned int index) {
+    if (context->registers[index] >= 0) {
+        return asm_registers[context->registers[index]];
+    }
+    return comment_fmt("qword [rbp-%d]", LOCALS_OFFSET + WORD_SIZE * index);
 }
 
-// ident.attr <- rax
-static void assembler_emit_set_attr(assembler_context *context, tac_result tac,
-                                    char *ident, char *type, char *attr) {
-    const char *comment = NULL;
+// rax <- ident
+static void assembler_emit_load_variable(assembler_context *context,
+                                         tac_result *tac, tac_operand ident) {
+    const char *comment = comment_fmt("load %s", name(ident));
 
-    semantic_mapping_item *item = NULL;
-    for (size_t i = 0; i < context->mapping->classes.count; i++) {
-        semantic_mapping_item *c = NULL;
-        ds_dynamic_array_get_ref(&context->mapping->classes, i,
-                                 (void **)&c);
+    switch (ident.kind) {
+    case TAC_OPERAND_SELF:
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, comment,
+                           "mov     rax, rbx");
+        return;
+    case TAC_OPERAND_TEMP: {
+        if (context->reprs[ident.index] == TAC_REPR_OBJECT) {
+            assembler_emit_fmt(context, ASM_INDENT_SIZE, comment,
+                               "mov     rax, %s",
+                               assembler_temp_location(context, ident.index));
+            return;
+        }
 
-        if (strcmp(c->class_name, type) == 0) {
-            item = c;
-            break;
+        int slot = context->boxed[ident.index];
+        if (slot < 0) {
+            DS_PANIC("unboxed %s read as an object", name(ident));
         }
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, comment,
+                           "mov     rax, qword [rbp-%d]",
+                           LOCALS_OFFSET + WORD_SIZE * slot);
+        return;
+    }
+    case TAC_OPERAND_FORMAL:
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, comment,
+                           "mov     rax, qword [rbp+%d]",
+                           ARGUMENTS_OFFSET + WORD_SIZE * ident.index);
+        return;
+    case TAC_OPERAND_ATTRIBUTE:
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, comment,
+                           "mov     rax, qword [rbx+%d]",
+                           ATTRIBUTE_OFFSET + WORD_SIZE * ident.index);
+        return;
+    case TAC_OPERAND_INT: {
+        asm_const *int_const = NULL;
+        assembler_new_const(context,
+                            (asm_const_value){.type = ASM_CONST_INT,
+                                              .integer = ident.value},
+                            &int_const);
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, comment, "mov     rax, %s",
+                           int_const->name);
+        return;
     }
+    case TAC_OPERAND_STRING: {
+        asm_const *int_const = NULL;
+        assembler_new_const(context,
+                            (asm_const_value){.type = ASM_CONST_INT,
+                                              .integer = strlen(ident.string)},
+                            &int_const);
 
-    if (item == NULL) {
-        DS_PANIC("unreachable");
+        asm_const *str_const = NULL;
+        assembler_new_const(
+            context,
+            (asm_const_value){.type = ASM_CONST_STR,
+                              .str = {int_const->name, ident.string}},
+            &str_const);
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rax, %s",
+                           str_const->name);
+        return;
+    }
+    case TAC_OPERAND_BOOL: {
+        asm_const *bool_const = NULL;
+        assembler_new_const(context,
+                            (asm_const_value){.type = ASM_CONST_BOOL,
+                                              .boolean = ident.value},
+                            &bool_const);
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rax, %s",
+                           bool_const->name);
+        return;
+    }
+    case TAC_OPERAND_NONE:
+        break;
     }
 
-    size_t attribute_slot = 0;
-    for (size_t i = 0; i < item->attributes.count; i++) {
-        class_mapping_attribute *attribute = NULL;
-        ds_dynamic_array_get_ref(&item->attributes, i, (void **)&attribute);
+    DS_PANIC("not implemented: rax <- %s", name(ident));
+}
 
-        if (strcmp(attribute->attribute_name, attr) == 0) {
-            attribute_slot = ATTRIBUTE_OFFSET + WORD_SIZE * i;
-            break;
+// ident <- rax
+static void assembler_emit_store_variable(assembler_context *context,
+                                          tac_result *tac, tac_operand ident) {
+    const char *comment = comment_fmt("store %s", name(ident));
+
+    switch (ident.kind) {
+    case TAC_OPERAND_TEMP:
+        if (context->reprs[ident.index] != TAC_REPR_OBJECT) {
+            size_t offset = assembler_attr_offset(
+                context, assembler_repr_type(context->reprs[ident.index]),
+                "val");
+            assembler_emit_fmt(context, ASM_INDENT_SIZE, "unbox",
+                               "mov     rax, qword [rax+%d]", offset);
         }
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, comment, "mov     %s, rax",
+                           assembler_temp_location(context, ident.index));
+        return;
+    case TAC_OPERAND_FORMAL:
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, comment,
+                           "mov     qword [rbp+%d], rax",
+                           ARGUMENTS_OFFSET + WORD_SIZE * ident.index);
+        return;
+    case TAC_OPERAND_ATTRIBUTE:
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, comment,
+                           "mov     qword [rbx+%d], rax",
+                           ATTRIBUTE_OFFSET + WORD_SIZE * ident.index);
+        return;
+    default:
+        break;
     }
 
-    if (attribute_slot == 0) {
-        DS_PANIC("unreachable");
-    }
+    DS_PANIC("not implemented: %s <- rax", name(ident));
+}
+
+// rax <- ident.attr
+static void assembler_emit_get_attr(assembler_context *context, tac_result *tac,
+                                    tac_operand ident, char *type, char *attr) {
+    const char *comment = NULL;
+
+    size_t attribute_slot = assembler_attr_offset(context, type, attr);
+
+    assembler_emit_load_variable(context, tac, ident);
+
+    comment = comment_fmt("get %s.%s", name(ident), attr);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "add     rax, %d",
+                       attribute_slot);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, comment,
+                       "mov     rax, qword [rax]");
+}
+
+// ident.attr <- rax
+static void assembler_emit_set_attr(assembler_context *context, tac_result *tac,
+                                    tac_operand ident, char *type, char *attr) {
+    const char *comment = NULL;
+
+    size_t attribute_slot = assembler_attr_offset(context, type, attr);
 
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rdi, rax");
 
-    assembler_emit_load_variable(context, &tac, ident);
+    assembler_emit_load_variable(context, tac, ident);
 
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "xchg    rdi, rax");
 
-    comment = comment_fmt("set %s.%s", ident, attr);
+    comment = comment_fmt("set %s.%s", name(ident), attr);
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "add     rdi, %d",
                        attribute_slot);
     assembler_emit_fmt(context, ASM_INDENT_SIZE, comment,
@@ -789,87 +904,219 @@ static void assembler_emit_new_type(assembler_context *context, char *type) {
                        type);
 }
 
+static int assembler_is_unboxed(assembler_context *context,
+                                tac_operand ident) {
+    return ident.kind == TAC_OPERAND_TEMP &&
+           context->reprs[ident.index] != TAC_REPR_OBJECT;
+}
+
+// rax <- ident.val, for an Int or a Bool
+static void assembler_emit_load_value(assembler_context *context,
+                                      tac_result *tac, tac_operand ident,
+                                      char *type) {
+    const char *comment = comment_fmt("load %s", name(ident));
+
+    switch (ident.kind) {
+    case TAC_OPERAND_INT:
+    case TAC_OPERAND_BOOL:
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, comment,
+                           "mov     rax, %d", ident.value);
+        return;
+    case TAC_OPERAND_TEMP:
+        if (assembler_is_unboxed(context, ident)) {
+            assembler_emit_fmt(context, ASM_INDENT_SIZE, comment,
+                               "mov     rax, %s",
+                               assembler_temp_location(context, ident.index));
+            return;
+        }
+        break;
+    default:
+        break;
+    }
+
+    assembler_emit_get_attr(context, tac, ident, type, "val");
+}
+
+// ident <- new TYPE, unless ident holds the raw value
+static void assembler_emit_new_value(assembler_context *context,
+                                     tac_result *tac, tac_operand ident,
+                                     char *type) {
+    if (assembler_is_unboxed(context, ident)) {
+        return;
+    }
+
+    assembler_emit_new_type(context, type);
+    assembler_emit_store_variable(context, tac, ident);
+}
+
+// ident.val <- rax, for the ident of assembler_emit_new_value
+static void assembler_emit_store_value(assembler_context *context,
+                                       tac_result *tac, tac_operand ident,
+                                       char *type) {
+    if (assembler_is_unboxed(context, ident)) {
+        const char *comment = comment_fmt("store %s", name(ident));
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, comment, "mov     %s, rax",
+                           assembler_temp_location(context, ident.index));
+        return;
+    }
+
+    assembler_emit_set_attr(context, tac, ident, type, "val");
+}
+
+// local <- box ident. A Bool is one of the two constants, an Int is a new
+// object.
+static void assembler_emit_box(assembler_context *context, tac_result *tac,
+                               tac_operand ident, int local) {
+    const char *comment = comment_fmt("box %s", name(ident));
+    const char *location = assembler_temp_location(context, ident.index);
+
+    if (context->reprs[ident.index] == TAC_REPR_BOOL) {
+        asm_const *false_const = NULL;
+        assembler_new_const(
+            context, (asm_const_value){.type = ASM_CONST_BOOL, .boolean = 0},
+            &false_const);
+        asm_const *true_const = NULL;
+        assembler_new_const(
+            context, (asm_const_value){.type = ASM_CONST_BOOL, .boolean = 1},
+            &true_const);
+
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rax, %s",
+                           false_const->name);
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rdi, %s",
+                           true_const->name);
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "cmp     %s, 0",
+                           location);
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, comment,
+                           "cmovne  rax, rdi");
+    } else {
+        assembler_emit_new_type(context, "Int");
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rdi, %s",
+                           location);
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, comment,
+                           "mov     qword [rax+%d], rdi",
+                           assembler_attr_offset(context, "Int", "val"));
+    }
+
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                       "mov     qword [rbp-%d], rax",
+                       LOCALS_OFFSET + WORD_SIZE * local);
+}
+
+// The program counts where it goes and writes the counts at exit
+static int assembler_is_profiling(assembler_context *context) {
+    return context->optimizer.options.profile_path != NULL;
+}
+
+// Count the class of the receiver in rax at a call site; a void receiver
+// is left for the call to fail on
+static void assembler_emit_profile_dispatch(assembler_context *context,
+                                            unsigned int site) {
+    if (!assembler_is_profiling(context) || site == 0) {
+        return;
+    }
+
+    int local = context->local_count++;
+    size_t offset = WORD_SIZE * (site - 1) * context->mapping->classes.count;
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, "profile receiver",
+                       "test    rax, rax");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "jz      .prof%d",
+                       local);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                       "mov     rdi, qword [rax+%d]", OBJTAG_OFFSET);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                       "inc     qword [_profile_receivers+%zu+rdi*8]", offset);
+    assembler_emit_fmt(context, 0, NULL, ".prof%d:", local);
+}
+
 // TAC => ASM
 static void assembler_emit_tac_dispatch_call(assembler_context *context,
-                                             tac_result tac,
+                                             tac_result *tac,
                                              tac_dispatch_call instr);
 
-static void assembler_emit_tac_label(assembler_context *context, tac_result tac,
+static void assembler_emit_tac_label(assembler_context *context, tac_result *tac,
                                      tac_label label) {
-    assembler_emit_fmt(context, 0, NULL, ".%s:", label.label);
+    assembler_emit_fmt(context, 0, NULL, ".L%d:",
+                       context->label_offset + label.label);
 }
 
-static void assembler_emit_tac_jump(assembler_context *context, tac_result tac,
+static void assembler_emit_tac_jump(assembler_context *context, tac_result *tac,
                                     tac_jump jump) {
-    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "jmp     .%s",
-                       jump.label);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "jmp     .L%d",
+                       context->label_offset + jump.label);
 }
 
 static void assembler_emit_tac_jump_if_true(assembler_context *context,
-                                            tac_result tac,
+                                            tac_result *tac,
                                             tac_jump_if_true jump) {
     const char *comment;
 
-    assembler_emit_get_attr(context, tac, jump.expr, "Bool", "val");
+    assembler_emit_load_value(context, tac, jump.expr, "Bool");
+
+    if (assembler_is_profiling(context) && jump.site != 0) {
+        size_t offset = 2 * WORD_SIZE * (jump.site - 1);
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, "profile branch",
+                           "inc     qword [_profile_branches+%zu]", offset);
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                           "add     qword [_profile_branches+%zu], rax",
+                           offset + WORD_SIZE);
+    }
 
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "test    rax, rax");
-    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "jnz     .%s",
-                       jump.label);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "jnz     .L%d",
+                       context->label_offset + jump.label);
 }
 
-static void assembler_emit_tac_assign_isinstance(assembler_context *context,
-                                                 tac_result tac,
-                                                 tac_isinstance instr) {
-    const char *comment = NULL;
-
+// The tags of the classes that conform to a type: the classes are numbered
+// in DFS order, so they are the range of the subtree of the type
+static void assembler_class_range(assembler_context *context,
+                                  const char *type, size_t *start,
+                                  size_t *end) {
     size_t start_index = 0;
     for (size_t i = 0; i < context->mapping->classes.count; i++) {
         semantic_mapping_item *item = NULL;
         ds_dynamic_array_get_ref(&context->mapping->classes, i, (void **)&item);
 
-        if (strcmp(item->class_name, instr.type) == 0) {
+        if (strcmp(item->class_name, type) == 0) {
             start_index = i;
             break;
         }
     }
 
-    semantic_mapping_item *item = NULL;
-    ds_dynamic_array_get_ref(&context->mapping->classes, start_index, (void **)&item);
-
-    semantic_mapping_item *parent = item->parent;
     size_t end_index = start_index;
 
     for (size_t i = start_index + 1; i < context->mapping->classes.count; i++) {
         semantic_mapping_item *current = NULL;
         ds_dynamic_array_get_ref(&context->mapping->classes, i, (void **)&current);
 
-        int found = 0;
-        while (current != NULL) {
-            if (strcmp(current->class_name, instr.type) == 0) {
-                found = 1;
-                break;
-            }
-
-            current = current->parent;
-        }
-
-        if (found == 0) {
+        if (!codegen_class_conforms(current, type)) {
             break;
         }
 
         end_index = i;
     }
 
-    // t0 <- new Bool
-    assembler_emit_new_type(context, "Bool");
-    assembler_emit_store_variable(context, &tac, instr.ident);
-
-    // get tag of expr in rdi
-    comment = comment_fmt("get tag(%s)", instr.expr);
-    assembler_emit_load_variable(context, &tac, instr.expr);
-    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "add     rax, %d", OBJTAG_OFFSET);
-    assembler_emit_fmt(context, ASM_INDENT_SIZE, comment, "mov     rax, qword [rax]");
-    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rdi, rax");
+    *start = start_index;
+    *end = end_index;
+}
+
+static void assembler_emit_tac_assign_isinstance(assembler_context *context,
+                                                 tac_result *tac,
+                                                 tac_isinstance instr) {
+    const char *comment = NULL;
+
+    size_t start_index = 0;
+    size_t end_index = 0;
+    assembler_class_range(context, instr.type, &start_index, &end_index);
+
+    // t0 <- new Bool
+    assembler_emit_new_value(context, tac, instr.ident, "Bool");
+
+    // get tag of expr in rdi
+    comment = comment_fmt("get tag(%s)", name(instr.expr));
+    assembler_emit_load_variable(context, tac, instr.expr);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "add     rax, %d", OBJTAG_OFFSET);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, comment, "mov     rax, qword [rax]");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rdi, rax");
 
     // start_index <= tag
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "cmp     rdi, %d", start_index);
@@ -883,82 +1130,414 @@ static void assembler_emit_tac_assign_isinstance(assembler_context *context,
 
     // t0.val <- start_index <= tag && tag <= end_index
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "and     rax, rsi");
-    assembler_emit_set_attr(context, tac, instr.ident, "Bool", "val");
+    assembler_emit_store_value(context, tac, instr.ident, "Bool");
+}
+
+// Compare the tag in rdi against the range of each branch in turn; the
+// first one that matches wins, so the most specific branches come first
+static int assembler_emit_case_chain(assembler_context *context,
+                                     tac_case_jump instr) {
+    size_t last = context->mapping->classes.count - 1;
+
+    for (unsigned int i = 0; i < instr.branches.count; i++) {
+        tac_case_branch branch;
+        ds_dynamic_array_get(&instr.branches, i, &branch);
+
+        size_t start = 0;
+        size_t end = 0;
+        assembler_class_range(context, branch.type, &start, &end);
+
+        int label = context->label_offset + branch.label;
+        if (start == 0 && end == last) {
+            // every class conforms, so the branches after this are dead
+            assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                               "jmp     .L%d", label);
+            return 1;
+        }
+
+        if (start == end) {
+            assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                               "cmp     rdi, %zu", start);
+            assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                               "je      .L%d", label);
+        } else {
+            // start <= tag <= end as a single unsigned compare
+            assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                               "lea     rsi, [rdi-%zu]", start);
+            assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                               "cmp     rsi, %zu", end - start);
+            assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                               "jbe     .L%d", label);
+        }
+    }
+
+    return 0;
+}
+
+// Jump through a table with an entry for every tag between the smallest and
+// the largest one that a branch matches
+static int assembler_emit_case_table(assembler_context *context,
+                                     tac_case_jump instr) {
+    size_t count = context->mapping->classes.count;
+    int *targets = malloc(sizeof(int) * count);
+    for (size_t t = 0; t < count; t++) {
+        targets[t] = -1;
+    }
+
+    size_t low = count;
+    size_t high = 0;
+    for (unsigned int i = 0; i < instr.branches.count; i++) {
+        tac_case_branch branch;
+        ds_dynamic_array_get(&instr.branches, i, &branch);
+
+        size_t start = 0;
+        size_t end = 0;
+        assembler_class_range(context, branch.type, &start, &end);
+
+        for (size_t t = start; t <= end; t++) {
+            if (targets[t] < 0) {
+                targets[t] = context->label_offset + branch.label;
+            }
+        }
+        low = start < low ? start : low;
+        high = end > high ? end : high;
+    }
+
+    int table = context->local_count++;
+    int covered = low == 0 && high == count - 1;
+    for (size_t t = low; t <= high; t++) {
+        covered = covered && targets[t] >= 0;
+    }
+
+    if (low > 0) {
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                           "sub     rdi, %zu", low);
+    }
+    if (!(low == 0 && high == count - 1)) {
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                           "cmp     rdi, %zu", high - low);
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                           "ja      .case%d_abort", table);
+    }
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                       "jmp     qword [.case%d_table+rdi*8]", table);
+
+    assembler_emit_fmt(context, 0, NULL, ".case%d_table:", table);
+    for (size_t t = low; t <= high; t++) {
+        if (targets[t] < 0) {
+            assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                               "dq      .case%d_abort", table);
+        } else {
+            assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                               "dq      .L%d", targets[t]);
+        }
+    }
+
+    if (!covered) {
+        assembler_emit_fmt(context, 0, NULL, ".case%d_abort:", table);
+    }
+
+    free(targets);
+    return covered;
+}
+
+static void assembler_emit_tac_case_jump(assembler_context *context,
+                                         tac_result *tac,
+                                         tac_case_jump instr) {
+    const char *comment = NULL;
+
+    // the value stays in rax for the abort routines
+    assembler_emit_load_variable(context, tac, instr.expr);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "test    rax, rax");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                       "jz      _case_abort_void");
+
+    comment = comment_fmt("get tag(%s)", name(instr.expr));
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, comment,
+                       "mov     rdi, qword [rax+%d]", OBJTAG_OFFSET);
+
+    int covered = instr.branches.count >= ASM_CASE_TABLE_MIN
+                      ? assembler_emit_case_table(context, instr)
+                      : assembler_emit_case_chain(context, instr);
+    if (!covered) {
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                           "call    _case_abort");
+    }
 }
 
 static void assembler_emit_tac_assign_cast(assembler_context *context,
-                                           tac_result tac,
+                                           tac_result *tac,
                                            tac_cast isinstance) {
     // t0 <- expr; not needed
-    assembler_emit_load_variable(context, &tac, isinstance.expr);
-    assembler_emit_store_variable(context, &tac, isinstance.ident);
+    if (assembler_is_unboxed(context, isinstance.ident)) {
+        assembler_emit_load_value(context, tac, isinstance.expr,
+                                  isinstance.type);
+        assembler_emit_store_value(context, tac, isinstance.ident,
+                                   isinstance.type);
+        return;
+    }
+
+    assembler_emit_load_variable(context, tac, isinstance.expr);
+    assembler_emit_store_variable(context, tac, isinstance.ident);
 }
 
 static void assembler_emit_tac_assign_value(assembler_context *context,
-                                            tac_result tac,
+                                            tac_result *tac,
                                             tac_assign_value instr) {
     // t0 <- value
-    assembler_emit_load_variable(context, &tac, instr.expr);
-    assembler_emit_store_variable(context, &tac, instr.ident);
+    if (assembler_is_unboxed(context, instr.ident)) {
+        char *type = assembler_repr_type(context->reprs[instr.ident.index]);
+        assembler_emit_load_value(context, tac, instr.expr, type);
+        assembler_emit_store_value(context, tac, instr.ident, type);
+        return;
+    }
+
+    assembler_emit_load_variable(context, tac, instr.expr);
+    assembler_emit_store_variable(context, tac, instr.ident);
 }
 
-static void assembler_emit_tac_dispatch_call(assembler_context *context,
-                                             tac_result tac,
-                                             tac_dispatch_call instr) {
-    if (instr.args.count % 2 == 1) {
-        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "push    0");
+// The offset of the method in the dispatch table of the static type
+static size_t assembler_method_offset(assembler_context *context,
+                                      const char *expr_type,
+                                      const char *method_name) {
+    size_t method_index = 0;
+
+    if (strcmp(expr_type, "SELF_TYPE") == 0) {
+        expr_type = context->current_class->class_name;
+    }
+
+    for (size_t i = 0; i < context->mapping->classes.count; i++) {
+        semantic_mapping_item *item = NULL;
+        ds_dynamic_array_get_ref(&context->mapping->classes, i, (void **)&item);
+
+        if (strcmp(item->class_name, expr_type) != 0) {
+            continue;
+        }
+
+        for (size_t j = 0; j < item->methods.count; j++) {
+            implementation_mapping_item *method = NULL;
+            ds_dynamic_array_get_ref(&item->methods, j, (void **)&method);
+
+            if (strcmp(method->method_name, method_name) == 0) {
+                method_index = j;
+                break;
+            }
+        }
+    }
+
+    return method_index * WORD_SIZE;
+}
+
+// Test the tag of the receiver in rax against the classes of the guess of
+// a dynamic dispatch, using the given scratch register, and go straight to
+// their implementation when it matches. A tail call has already left the
+// frame and jumps there, any other call goes on at .specN_done. A void
+// receiver takes the dispatch, which fails on it.
+static void assembler_emit_speculate_guard(assembler_context *context,
+                                           tac_dispatch_call instr,
+                                           const char *reg, int local) {
+    tac_method_summary *target = codegen_tac_method_summary(
+        &context->optimizer, instr.guess, instr.method);
+
+    size_t start = 0, end = 0;
+    assembler_class_range(context, instr.guess, &start, &end);
+
+    const char *comment = comment_fmt("guess %s", instr.guess);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, comment, "test    rax, rax");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "jz      .spec%d",
+                       local);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                       "mov     %s, qword [rax+%d]", reg, OBJTAG_OFFSET);
+    if (start == end) {
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "cmp     %s, %zu",
+                           reg, start);
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "jne     .spec%d",
+                           local);
+    } else {
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "sub     %s, %zu",
+                           reg, start);
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "cmp     %s, %zu",
+                           reg, end - start);
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "ja      .spec%d",
+                           local);
+    }
+
+    if (instr.tail) {
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, "tail call",
+                           "jmp     %s.%s", target->class->class_name,
+                           instr.method);
+    } else {
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "call    %s.%s",
+                           target->class->class_name, instr.method);
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                           "jmp     .spec%d_done", local);
+    }
+    assembler_emit_fmt(context, 0, NULL, ".spec%d:", local);
+}
+
+// The label of the method that a direct call goes to: the specialization
+// of its callee that it was given, or the callee itself
+static const char *assembler_call_target(assembler_context *context,
+                                         tac_dispatch_call instr) {
+    if (instr.clone == 0) {
+        return comment_fmt("%s.%s", instr.type, instr.method);
+    }
+
+    tac_method_summary *summary = codegen_tac_method_summary(
+        &context->optimizer, instr.type, instr.method);
+    return comment_fmt("%s.%s.spec%u", summary->class->class_name,
+                       instr.method, instr.clone);
+}
+
+// Whether the call goes to the method that is being emitted
+static int assembler_is_self_call(assembler_context *context,
+                                  tac_dispatch_call instr) {
+    if (context->current_method == NULL || instr.type == NULL ||
+        instr.clone != context->current_clone) {
+        return 0;
+    }
+
+    tac_method_summary *summary = codegen_tac_method_summary(
+        &context->optimizer, instr.type, instr.method);
+    return summary != NULL &&
+           summary->method == context->current_method->method;
+}
+
+// push the callee saved registers that the temporaries use
+static void assembler_emit_save_registers(assembler_context *context) {
+    for (int k = 0; k < context->saved_count; k++) {
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "push    %s",
+                           asm_registers[context->saved[k]]);
     }
+}
+
+// pop them back, before the frame is left
+static void assembler_emit_restore_registers(assembler_context *context) {
+    for (int k = context->saved_count - 1; k >= 0; k--) {
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "pop     %s",
+                           asm_registers[context->saved[k]]);
+    }
+}
 
+// The arguments replace the ones of the current method in its frame. A call
+// to the method itself jumps back to the start of the body with the new
+// self, any other call leaves the frame and jumps to the callee, which then
+// returns to the caller of the current method.
+static void assembler_emit_tac_tail_call(assembler_context *context,
+                                         tac_result *tac,
+                                         tac_dispatch_call instr) {
     for (size_t i = 0; i < instr.args.count; i++) {
-        char *arg = NULL;
+        tac_operand arg;
         ds_dynamic_array_get(&instr.args, instr.args.count - i - 1, &arg);
 
-        assembler_emit_load_variable(context, &tac, arg);
+        assembler_emit_load_variable(context, tac, arg);
 
-        const char *comment = comment_fmt("arg%d: %s", i, arg);
+        const char *comment = comment_fmt("arg%d: %s", i, name(arg));
         assembler_emit_fmt(context, ASM_INDENT_SIZE, comment, "push    rax");
     }
 
-    assembler_emit_load_variable(context, &tac, instr.expr);
+    assembler_emit_load_variable(context, tac, instr.expr);
+    assembler_emit_profile_dispatch(context, instr.site);
 
     if (instr.type == NULL) {
-        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rdi, qword [rax+%d]", DISPTABLE_OFFSET);
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                           "mov     rdi, qword [rax+%d]", DISPTABLE_OFFSET);
+        assembler_emit_fmt(
+            context, ASM_INDENT_SIZE, NULL, "mov     rdi, qword [rdi+%d]",
+            assembler_method_offset(context, instr.expr_type, instr.method));
+    } else if (instr.devirtualized && instr.expr.kind != TAC_OPERAND_SELF) {
+        // fault on void, the same way the dispatch table load would
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                           "mov     rdi, qword [rax+%d]", DISPTABLE_OFFSET);
+    }
 
+    for (size_t i = 0; i < instr.args.count; i++) {
+        const char *comment = comment_fmt("arg%d", i);
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "pop     rsi");
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, comment,
+                           "mov     qword [rbp+%d], rsi",
+                           ARGUMENTS_OFFSET + WORD_SIZE * i);
+    }
+
+    if (assembler_is_self_call(context, instr)) {
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rbx, rax");
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, "tail call", "jmp     .L%d",
+                           context->entry_label);
+        return;
+    }
 
-        size_t method_index = 0;
+    assembler_emit_restore_registers(context);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "pop     rbx");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "add     rsp, %d",
+                       WORD_SIZE * context->num_locals);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "pop     rbp");
 
-        const char *expr_type = instr.expr_type;
-        if (strcmp(expr_type, "SELF_TYPE") == 0) {
-            expr_type = context->current_class->class_name;
+    if (instr.type == NULL) {
+        if (instr.guess != NULL) {
+            int local = context->local_count++;
+            assembler_emit_speculate_guard(context, instr, "rsi", local);
         }
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, "tail call", "jmp     rdi");
+    } else {
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, "tail call",
+                           "jmp     %s", assembler_call_target(context, instr));
+    }
+}
 
-        for (size_t i = 0; i < context->mapping->classes.count; i++) {
-            semantic_mapping_item *item = NULL;
-            ds_dynamic_array_get_ref(&context->mapping->classes, i, (void **)&item);
+static void assembler_emit_tac_dispatch_call(assembler_context *context,
+                                             tac_result *tac,
+                                             tac_dispatch_call instr) {
+    if (instr.tail) {
+        assembler_emit_tac_tail_call(context, tac, instr);
+        return;
+    }
 
-            if (strcmp(item->class_name, expr_type) != 0) {
-                continue;
-            }
+    if (instr.args.count % 2 == 1) {
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "push    0");
+    }
 
-            for (size_t j = 0; j < item->methods.count; j++) {
-                implementation_mapping_item *method = NULL;
-                ds_dynamic_array_get_ref(&item->methods, j, (void **)&method);
+    for (size_t i = 0; i < instr.args.count; i++) {
+        tac_operand arg;
+        ds_dynamic_array_get(&instr.args, instr.args.count - i - 1, &arg);
 
-                if (strcmp(method->method_name, instr.method) == 0) {
-                    method_index = j;
-                    break;
-                }
-            }
+        assembler_emit_load_variable(context, tac, arg);
+
+        const char *comment = comment_fmt("arg%d: %s", i, name(arg));
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, comment, "push    rax");
+    }
+
+    assembler_emit_load_variable(context, tac, instr.expr);
+    assembler_emit_profile_dispatch(context, instr.site);
+
+    if (instr.type == NULL) {
+        int local = -1;
+        if (instr.guess != NULL) {
+            local = context->local_count++;
+            assembler_emit_speculate_guard(context, instr, "rdi", local);
         }
 
-        size_t method_offset = method_index * WORD_SIZE;
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rdi, qword [rax+%d]", DISPTABLE_OFFSET);
+
+        size_t method_offset =
+            assembler_method_offset(context, instr.expr_type, instr.method);
         assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rdi, qword [rdi+%d]", method_offset);
         assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "call    rdi");
+
+        if (instr.guess != NULL) {
+            assembler_emit_fmt(context, 0, NULL, ".spec%d_done:", local);
+        }
     } else {
-        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "call    %s.%s", instr.type, instr.method);
+        if (instr.devirtualized && instr.expr.kind != TAC_OPERAND_SELF) {
+            // fault on void, the same way the dispatch table load would
+            assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                               "mov     rdi, qword [rax+%d]",
+                               DISPTABLE_OFFSET);
+        }
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "call    %s",
+                           assembler_call_target(context, instr));
     }
 
-    assembler_emit_store_variable(context, &tac, instr.ident);
+    assembler_emit_store_variable(context, tac, instr.ident);
 
     const char *comment = comment_fmt("free %d args", instr.args.count);
     assembler_emit_fmt(context, ASM_INDENT_SIZE, comment, "add     rsp, %d",
@@ -970,16 +1549,52 @@ static void assembler_emit_tac_dispatch_call(assembler_context *context,
     }
 }
 
+static size_t assembler_object_size(assembler_context *context,
+                                    const char *type) {
+    semantic_mapping_item *item = codegen_find_class(context->mapping, type);
+    return item->attributes.count + 3;
+}
+
+// rax <- new TYPE, in the next free locals of the frame: the fields go up
+// from the last of them, so the object starts at the lowest address
+static void assembler_emit_stack_new_type(assembler_context *context,
+                                          char *type) {
+    const char *comment = NULL;
+
+    size_t size = assembler_object_size(context, type);
+    int last = context->stack_objects + size - 1;
+    context->stack_objects += size;
+
+    comment = comment_fmt("stack new %s", type);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, comment,
+                       "lea     rax, [rbp-%d]",
+                       LOCALS_OFFSET + WORD_SIZE * last);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                       "mov     rsi, %s_protObj", type);
+    for (size_t k = 0; k < size; k++) {
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                           "mov     rdi, qword [rsi+%zu]", WORD_SIZE * k);
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                           "mov     qword [rax+%zu], rdi", WORD_SIZE * k);
+    }
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "call    %s_init",
+                       type);
+}
+
 static void assembler_emit_tac_assign_new(assembler_context *context,
-                                          tac_result tac,
+                                          tac_result *tac,
                                           tac_assign_new instr) {
     // t0 <- new TYPE
-    assembler_emit_new_type(context, instr.type);
-    assembler_emit_store_variable(context, &tac, instr.ident);
+    if (instr.stack) {
+        assembler_emit_stack_new_type(context, instr.type);
+    } else {
+        assembler_emit_new_type(context, instr.type);
+    }
+    assembler_emit_store_variable(context, tac, instr.ident);
 }
 
 static void assembler_emit_tac_assign_default(assembler_context *context,
-                                              tac_result tac,
+                                              tac_result *tac,
                                               tac_assign_new instr) {
     // t0 <- default TYPE
     if (strcmp(instr.type, "Int") == 0) {
@@ -1019,18 +1634,17 @@ static void assembler_emit_tac_assign_default(assembler_context *context,
         // any other type is null
         assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rax, 0");
     }
-    assembler_emit_store_variable(context, &tac, instr.ident);
+    assembler_emit_store_variable(context, tac, instr.ident);
 }
 
 static void assembler_emit_tac_assign_isvoid(assembler_context *context,
-                                             tac_result tac,
+                                             tac_result *tac,
                                              tac_assign_unary instr) {
     // t0 <- new Bool
-    assembler_emit_new_type(context, "Bool");
-    assembler_emit_store_variable(context, &tac, instr.ident);
+    assembler_emit_new_value(context, tac, instr.ident, "Bool");
 
     // compare expr to 0
-    assembler_emit_load_variable(context, &tac, instr.expr);
+    assembler_emit_load_variable(context, tac, instr.expr);
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "test    rax, rax");
 
     // set rax to 1 if rax == 0
@@ -1038,202 +1652,345 @@ static void assembler_emit_tac_assign_isvoid(assembler_context *context,
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "movzx   rax, al");
 
     // set t0.val to rax
-    assembler_emit_set_attr(context, tac, instr.ident, "Bool", "val");
+    assembler_emit_store_value(context, tac, instr.ident, "Bool");
 }
 
 static void assembler_emit_tac_assign_add(assembler_context *context,
-                                          tac_result tac,
+                                          tac_result *tac,
                                           tac_assign_binary instr) {
     const char *comment;
 
     // t0 <- new Int
-    assembler_emit_new_type(context, "Int");
-    assembler_emit_store_variable(context, &tac, instr.ident);
+    assembler_emit_new_value(context, tac, instr.ident, "Int");
 
     // set rdi to t1
-    assembler_emit_get_attr(context, tac, instr.lhs, "Int", "val");
+    assembler_emit_load_value(context, tac, instr.lhs, "Int");
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rdi, rax");
 
     // set rax to t2
-    assembler_emit_get_attr(context, tac, instr.rhs, "Int", "val");
+    assembler_emit_load_value(context, tac, instr.rhs, "Int");
 
     // set rax to t1 + t2
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "add     rax, rdi");
 
     // set t0.val to rax
-    assembler_emit_set_attr(context, tac, instr.ident, "Int", "val");
+    assembler_emit_store_value(context, tac, instr.ident, "Int");
 }
 
 static void assembler_emit_tac_assign_sub(assembler_context *context,
-                                          tac_result tac,
+                                          tac_result *tac,
                                           tac_assign_binary instr) {
     const char *comment;
 
     // t0 <- new Int
-    assembler_emit_new_type(context, "Int");
-    assembler_emit_store_variable(context, &tac, instr.ident);
+    assembler_emit_new_value(context, tac, instr.ident, "Int");
 
     // set rax to t2
-    assembler_emit_get_attr(context, tac, instr.rhs, "Int", "val");
+    assembler_emit_load_value(context, tac, instr.rhs, "Int");
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rdi, rax");
 
     // set rdi to t1
-    assembler_emit_get_attr(context, tac, instr.lhs, "Int", "val");
+    assembler_emit_load_value(context, tac, instr.lhs, "Int");
 
     // set rax to t1 - t2
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "sub     rax, rdi");
 
     // set t0.val to rax
-    assembler_emit_set_attr(context, tac, instr.ident, "Int", "val");
+    assembler_emit_store_value(context, tac, instr.ident, "Int");
+}
+
+// The k of a power of two 2^k, or -1
+static int assembler_log2(unsigned long value) {
+    if (value == 0 || (value & (value - 1)) != 0) {
+        return -1;
+    }
+    return __builtin_ctzl(value);
+}
+
+// rax <- rax * constant, without a multiplication where a shift or a lea
+// does the same
+static void assembler_emit_mul_constant(assembler_context *context,
+                                        long constant) {
+    int shift = assembler_log2(constant);
+    if (constant == 0) {
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "xor     eax, eax");
+    } else if (constant == 1) {
+        return;
+    } else if (constant == -1) {
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "neg     rax");
+    } else if (shift > 0) {
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "shl     rax, %d",
+                           shift);
+    } else if (constant == 3 || constant == 5 || constant == 9) {
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                           "lea     rax, [rax+rax*%ld]", constant - 1);
+    } else {
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                           "imul    rax, rax, %ld", constant);
+    }
 }
 
 static void assembler_emit_tac_assign_mul(assembler_context *context,
-                                          tac_result tac,
+                                          tac_result *tac,
                                           tac_assign_binary instr) {
     const char *comment;
 
     // t0 <- new Int
-    assembler_emit_new_type(context, "Int");
-    assembler_emit_store_variable(context, &tac, instr.ident);
+    assembler_emit_new_value(context, tac, instr.ident, "Int");
+
+    tac_operand operand;
+    long constant;
+    if (codegen_tac_strength_constant(&context->optimizer, TAC_ASSIGN_MUL,
+                                      &instr, &operand, &constant)) {
+        // set rax to t1 * c
+        assembler_emit_load_value(context, tac, operand, "Int");
+        assembler_emit_mul_constant(context, constant);
+
+        // set t0.val to rax
+        assembler_emit_store_value(context, tac, instr.ident, "Int");
+        return;
+    }
 
     // set rdi to t1
-    assembler_emit_get_attr(context, tac, instr.lhs, "Int", "val");
+    assembler_emit_load_value(context, tac, instr.lhs, "Int");
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rdi, rax");
 
     // set rax to t2
-    assembler_emit_get_attr(context, tac, instr.rhs, "Int", "val");
+    assembler_emit_load_value(context, tac, instr.rhs, "Int");
 
     // set rax to t1 * t2
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mul     rdi");
 
     // set t0.val to rax
-    assembler_emit_set_attr(context, tac, instr.ident, "Int", "val");
+    assembler_emit_store_value(context, tac, instr.ident, "Int");
+}
+
+// The magic number and the shift that turn a signed 64 bit division by the
+// constant into a multiplication, from Hacker's Delight 10-4; the divisor is
+// not 0, 1 or -1
+static void assembler_division_magic(long divisor, long *magic, int *shift) {
+    const unsigned long two63 = 1ul << 63;
+
+    unsigned long ad =
+        divisor < 0 ? -(unsigned long)divisor : (unsigned long)divisor;
+    unsigned long t = two63 + ((unsigned long)divisor >> 63);
+    unsigned long anc = t - 1 - t % ad;
+    unsigned long q1 = two63 / anc, r1 = two63 - q1 * anc;
+    unsigned long q2 = two63 / ad, r2 = two63 - q2 * ad;
+    unsigned long delta;
+    int p = 63;
+
+    do {
+        p++;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc) {
+            q1++;
+            r1 -= anc;
+        }
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad) {
+            q2++;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+
+    *magic = (long)(q2 + 1);
+    if (divisor < 0) {
+        *magic = -*magic;
+    }
+    *shift = p - 64;
+}
+
+// rax <- rax / constant, rounding towards zero like idiv, with shifts for
+// the powers of two and a multiplication by the magic number otherwise
+static void assembler_emit_div_constant(assembler_context *context,
+                                        long constant) {
+    if (constant == 1) {
+        return;
+    }
+
+    unsigned long magnitude =
+        constant < 0 ? -(unsigned long)constant : (unsigned long)constant;
+    int shift = assembler_log2(magnitude);
+    if (shift > 0) {
+        // add 2^k - 1 to the negative dividends so the shift rounds up
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rdx, rax");
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "sar     rdx, 63");
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "shr     rdx, %d",
+                           64 - shift);
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "add     rax, rdx");
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "sar     rax, %d",
+                           shift);
+        if (constant < 0) {
+            assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "neg     rax");
+        }
+        return;
+    }
+
+    long magic;
+    assembler_division_magic(constant, &magic, &shift);
+
+    // the high half of the product, corrected when the magic number has
+    // the other sign than the divisor
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rdi, rax");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rax, %ld",
+                       magic);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "imul    rdi");
+    if (constant > 0 && magic < 0) {
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "add     rdx, rdi");
+    } else if (constant < 0 && magic > 0) {
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "sub     rdx, rdi");
+    }
+    if (shift > 0) {
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "sar     rdx, %d",
+                           shift);
+    }
+
+    // add one to a negative quotient
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rax, rdx");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "shr     rax, 63");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "add     rax, rdx");
 }
 
 static void assembler_emit_tac_assign_div(assembler_context *context,
-                                          tac_result tac,
+                                          tac_result *tac,
                                           tac_assign_binary instr) {
     const char *comment;
 
     // t0 <- new Int
-    assembler_emit_new_type(context, "Int");
-    assembler_emit_store_variable(context, &tac, instr.ident);
+    assembler_emit_new_value(context, tac, instr.ident, "Int");
+
+    tac_operand operand;
+    long constant;
+    if (codegen_tac_strength_constant(&context->optimizer, TAC_ASSIGN_DIV,
+                                      &instr, &operand, &constant)) {
+        // set rax to t1 / c
+        assembler_emit_load_value(context, tac, operand, "Int");
+        assembler_emit_div_constant(context, constant);
+
+        // set t0.val to rax
+        assembler_emit_store_value(context, tac, instr.ident, "Int");
+        return;
+    }
 
     // set rax to t2
-    assembler_emit_get_attr(context, tac, instr.rhs, "Int", "val");
+    assembler_emit_load_value(context, tac, instr.rhs, "Int");
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rdi, rax");
 
     // set rax to t1
-    assembler_emit_get_attr(context, tac, instr.lhs, "Int", "val");
+    assembler_emit_load_value(context, tac, instr.lhs, "Int");
 
     // set rax to t1 / t2
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "cqo");
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "idiv    rdi");
 
     // set t0.val to rax
-    assembler_emit_set_attr(context, tac, instr.ident, "Int", "val");
+    assembler_emit_store_value(context, tac, instr.ident, "Int");
 }
 
 static void assembler_emit_tac_assign_neg(assembler_context *context,
-                                          tac_result tac,
+                                          tac_result *tac,
                                           tac_assign_unary instr) {
     // t0 <- new Int
-    assembler_emit_new_type(context, "Int");
-    assembler_emit_store_variable(context, &tac, instr.ident);
+    assembler_emit_new_value(context, tac, instr.ident, "Int");
 
     // set rax to ~t0.val
-    assembler_emit_get_attr(context, tac, instr.expr, "Int", "val");
+    assembler_emit_load_value(context, tac, instr.expr, "Int");
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "neg     rax");
 
     // set t1 to rax
-    assembler_emit_set_attr(context, tac, instr.ident, "Bool", "val");
+    assembler_emit_store_value(context, tac, instr.ident, "Int");
 }
 
 static void assembler_emit_tac_assign_lt(assembler_context *context,
-                                         tac_result tac,
+                                         tac_result *tac,
                                          tac_assign_binary instr) {
     const char *comment;
 
     // t2 <- new Bool
-    assembler_emit_new_type(context, "Bool");
-    assembler_emit_store_variable(context, &tac, instr.ident);
+    assembler_emit_new_value(context, tac, instr.ident, "Bool");
 
     // set rdi to t0
-    assembler_emit_get_attr(context, tac, instr.lhs, "Int", "val");
+    assembler_emit_load_value(context, tac, instr.lhs, "Int");
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rdi, rax");
 
     // set rax to t1
-    assembler_emit_get_attr(context, tac, instr.rhs, "Int", "val");
+    assembler_emit_load_value(context, tac, instr.rhs, "Int");
 
     // set rax to t0 < t1
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "cmp     rdi, rax");
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "setl    al");
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "and     al, 1");
-    comment = comment_fmt("%s.val < %s.val", instr.lhs, instr.rhs);
+    comment = comment_fmt("%s.val < %s.val", name(instr.lhs), name(instr.rhs));
     assembler_emit_fmt(context, ASM_INDENT_SIZE, comment, "movzx   rax, al");
 
     // set t2.val to rax
-    assembler_emit_set_attr(context, tac, instr.ident, "Bool", "val");
+    assembler_emit_store_value(context, tac, instr.ident, "Bool");
 }
 
 static void assembler_emit_tac_assign_le(assembler_context *context,
-                                         tac_result tac,
+                                         tac_result *tac,
                                          tac_assign_binary instr) {
     const char *comment;
 
     // t2 <- new Bool
-    assembler_emit_new_type(context, "Bool");
-    assembler_emit_store_variable(context, &tac, instr.ident);
+    assembler_emit_new_value(context, tac, instr.ident, "Bool");
 
     // set rdi to t0
-    assembler_emit_get_attr(context, tac, instr.lhs, "Int", "val");
+    assembler_emit_load_value(context, tac, instr.lhs, "Int");
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rdi, rax");
 
     // set rax to t1
-    assembler_emit_get_attr(context, tac, instr.rhs, "Int", "val");
+    assembler_emit_load_value(context, tac, instr.rhs, "Int");
 
     // set rax to t0 <= t1
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "cmp     rdi, rax");
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "setle   al");
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "and     al, 1");
-    comment = comment_fmt("%s.val < %s.val", instr.lhs, instr.rhs);
+    comment = comment_fmt("%s.val < %s.val", name(instr.lhs), name(instr.rhs));
     assembler_emit_fmt(context, ASM_INDENT_SIZE, comment, "movzx   rax, al");
 
     // set t2.val to rax
-    assembler_emit_set_attr(context, tac, instr.ident, "Bool", "val");
+    assembler_emit_store_value(context, tac, instr.ident, "Bool");
 }
 
-static void assembler_emit_tac_assign_eq(assembler_context *context,
-                                         tac_result tac, tac_assign_eq instr) {
-    ds_dynamic_array args;
-    ds_dynamic_array_init(&args, sizeof(char *));
-
-    ds_dynamic_array_append(&args, &instr.rhs);
-
-    const char *type = NULL;
-    for (size_t i = 0; i < context->mapping->classes.count; i++) {
-        semantic_mapping_item *item = NULL;
-        ds_dynamic_array_get_ref(&context->mapping->classes, i, (void **)&item);
+// ident <- rax, for a Bool given as 0 or 1 in rax. A boxed Bool is one of
+// the two constants.
+static void assembler_emit_store_bool(assembler_context *context,
+                                      tac_result *tac, tac_operand ident) {
+    if (assembler_is_unboxed(context, ident)) {
+        assembler_emit_store_value(context, tac, ident, "Bool");
+        return;
+    }
 
-        if (strcmp(item->class_name, instr.type) != 0) {
-            continue;
-        }
+    asm_const *false_const = NULL;
+    assembler_new_const(
+        context, (asm_const_value){.type = ASM_CONST_BOOL, .boolean = 0},
+        &false_const);
+    asm_const *true_const = NULL;
+    assembler_new_const(
+        context, (asm_const_value){.type = ASM_CONST_BOOL, .boolean = 1},
+        &true_const);
 
-        for (size_t j = 0; j < item->methods.count; j++) {
-            implementation_mapping_item *method = NULL;
-            ds_dynamic_array_get_ref(&item->methods, j, (void **)&method);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rdi, %s",
+                       true_const->name);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "test    rax, rax");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rax, %s",
+                       false_const->name);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "cmovnz  rax, rdi");
+    assembler_emit_store_variable(context, tac, ident);
+}
 
-            if (strcmp(method->from_class, item->class_name) == 0 &&
-                strcmp(method->method_name, "equals") == 0) {
-                type = item->class_name;
-                break;
-            }
-        }
-    }
+// t0 <- lhs@type.equals(rhs)
+static void assembler_emit_eq_call(assembler_context *context, tac_result *tac,
+                                   tac_assign_eq instr, const char *type) {
+    ds_dynamic_array args;
+    ds_dynamic_array_init(&args, sizeof(tac_operand));
 
-    if (type == NULL) {
-        type = "Object";
-    }
+    ds_dynamic_array_append(&args, &instr.rhs);
 
     tac_dispatch_call dispatch_call = {
         .ident = instr.ident,
@@ -1243,90 +2000,320 @@ static void assembler_emit_tac_assign_eq(assembler_context *context,
         .args = args,
     };
 
-    // t0 <- lhs@type.equals(rhs)
     assembler_emit_tac_dispatch_call(context, tac, dispatch_call);
 }
 
+// rax <- lhs.val = rhs.val for two Bytes, through Byte.equals when rhs is
+// void or of a subclass, so that it fails or matches the same way
+static void assembler_emit_eq_byte(assembler_context *context,
+                                   tac_result *tac, tac_assign_eq instr) {
+    const char *comment = NULL;
+
+    int byte_tag = 0;
+    for (size_t i = 0; i < context->mapping->classes.count; i++) {
+        semantic_mapping_item *item = NULL;
+        ds_dynamic_array_get_ref(&context->mapping->classes, i, (void **)&item);
+
+        if (strcmp(item->class_name, "Byte") == 0) {
+            byte_tag = i;
+            break;
+        }
+    }
+
+    int local = context->local_count++;
+    size_t val = assembler_attr_offset(context, "Byte", "val");
+
+    assembler_emit_load_variable(context, tac, instr.rhs);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rsi, rax");
+    assembler_emit_load_variable(context, tac, instr.lhs);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "test    rax, rax");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "jz      .eq%d_call",
+                       local);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "test    rsi, rsi");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "jz      .eq%d_call",
+                       local);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                       "cmp     qword [rsi+%d], %d", OBJTAG_OFFSET, byte_tag);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "jne     .eq%d_call",
+                       local);
+
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                       "mov     rdi, qword [rax+%zu]", val);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                       "cmp     rdi, qword [rsi+%zu]", val);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "sete    al");
+    comment = comment_fmt("%s.val = %s.val", name(instr.lhs), name(instr.rhs));
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, comment, "movzx   rax, al");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "jmp     .eq%d_done",
+                       local);
+
+    assembler_emit_fmt(context, 0, NULL, ".eq%d_call:", local);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "push    rsi");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "call    Byte.equals");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "add     rsp, 8");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                       "mov     rax, qword [rax+%zu]",
+                       assembler_attr_offset(context, "Bool", "val"));
+    assembler_emit_fmt(context, 0, NULL, ".eq%d_done:", local);
+}
+
+static void assembler_emit_tac_assign_eq(assembler_context *context,
+                                         tac_result *tac, tac_assign_eq instr) {
+    const char *comment = NULL;
+
+    enum tac_eq_kind kind = codegen_tac_eq_kind(context->mapping, instr.type);
+    switch (kind) {
+    case TAC_EQ_CALL:
+        assembler_emit_eq_call(context, tac, instr, instr.type);
+        return;
+    case TAC_EQ_VALUE:
+        assembler_emit_load_value(context, tac, instr.lhs, instr.type);
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rdi, rax");
+        assembler_emit_load_value(context, tac, instr.rhs, instr.type);
+        comment = comment_fmt("%s.val = %s.val", name(instr.lhs),
+                              name(instr.rhs));
+        break;
+    case TAC_EQ_POINTER:
+        assembler_emit_load_variable(context, tac, instr.lhs);
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rdi, rax");
+        assembler_emit_load_variable(context, tac, instr.rhs);
+        comment = comment_fmt("%s == %s", name(instr.lhs), name(instr.rhs));
+        break;
+    case TAC_EQ_STRING:
+        assembler_emit_load_variable(context, tac, instr.rhs);
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rsi, rax");
+        assembler_emit_load_variable(context, tac, instr.lhs);
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rdi, rax");
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                           "call    string_equals");
+        assembler_emit_store_bool(context, tac, instr.ident);
+        return;
+    case TAC_EQ_BYTE:
+        assembler_emit_eq_byte(context, tac, instr);
+        assembler_emit_store_bool(context, tac, instr.ident);
+        return;
+    }
+
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "cmp     rdi, rax");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "sete    al");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, comment, "movzx   rax, al");
+    assembler_emit_store_bool(context, tac, instr.ident);
+}
+
 static void assembler_emit_tac_assign_not(assembler_context *context,
-                                          tac_result tac,
+                                          tac_result *tac,
                                           tac_assign_unary instr) {
     const char *comment;
     int offset;
 
     // t1 <- new Bool
-    assembler_emit_new_type(context, "Bool");
-    assembler_emit_store_variable(context, &tac, instr.ident);
+    assembler_emit_new_value(context, tac, instr.ident, "Bool");
 
     // set rax to not t0.val
-    assembler_emit_get_attr(context, tac, instr.expr, "Bool", "val");
+    assembler_emit_load_value(context, tac, instr.expr, "Bool");
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "xor     rax, 1");
 
     // set t1.val to rax
-    assembler_emit_set_attr(context, tac, instr.ident, "Bool", "val");
+    assembler_emit_store_value(context, tac, instr.ident, "Bool");
 }
 
-static void assembler_emit_tac_ident(assembler_context *context, tac_result tac,
+static void assembler_emit_tac_ident(assembler_context *context, tac_result *tac,
                                      tac_ident instr) {
-    assembler_emit_load_variable(context, &tac, instr.name);
+    assembler_emit_load_variable(context, tac, instr.name);
 }
 
 static void assembler_emit_tac_assign_int(assembler_context *context,
-                                          tac_result tac,
+                                          tac_result *tac,
                                           tac_assign_int instr) {
+    if (assembler_is_unboxed(context, instr.ident)) {
+        assembler_emit_load_value(context, tac, instr.value, "Int");
+        assembler_emit_store_value(context, tac, instr.ident, "Int");
+        return;
+    }
+
     asm_const *int_const = NULL;
     assembler_new_const(
         context,
-        (asm_const_value){.type = ASM_CONST_INT, .integer = instr.value},
+        (asm_const_value){.type = ASM_CONST_INT, .integer = instr.value.value},
         &int_const);
 
-    const char *comment = comment_fmt("load %d", instr.value);
+    const char *comment = comment_fmt("load %d", instr.value.value);
     assembler_emit_fmt(context, ASM_INDENT_SIZE, comment, "mov     rax, %s",
                        int_const->name);
-    assembler_emit_store_variable(context, &tac, instr.ident);
+    assembler_emit_store_variable(context, tac, instr.ident);
 }
 
 static void assembler_emit_tac_assign_string(assembler_context *context,
-                                             tac_result tac,
+                                             tac_result *tac,
                                              tac_assign_string instr) {
     asm_const *int_const = NULL;
     assembler_new_const(context,
                         (asm_const_value){.type = ASM_CONST_INT,
-                                          .integer = strlen(instr.value)},
+                                          .integer = strlen(instr.value.string)},
                         &int_const);
 
     asm_const *str_const = NULL;
     assembler_new_const(
         context,
         (asm_const_value){.type = ASM_CONST_STR,
-                          .str = {int_const->name, instr.value}},
+                          .str = {int_const->name, instr.value.string}},
         &str_const);
 
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rax, %s",
                        str_const->name);
-    assembler_emit_store_variable(context, &tac, instr.ident);
+    assembler_emit_store_variable(context, tac, instr.ident);
 }
 
 static void assembler_emit_tac_assign_bool(assembler_context *context,
-                                           tac_result tac,
+                                           tac_result *tac,
                                            tac_assign_bool instr) {
+    if (assembler_is_unboxed(context, instr.ident)) {
+        assembler_emit_load_value(context, tac, instr.value, "Bool");
+        assembler_emit_store_value(context, tac, instr.ident, "Bool");
+        return;
+    }
+
     asm_const *bool_const = NULL;
     assembler_new_const(
         context,
-        (asm_const_value){.type = ASM_CONST_BOOL, .boolean = instr.value},
+        (asm_const_value){.type = ASM_CONST_BOOL, .boolean = instr.value.value},
         &bool_const);
 
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rax, %s",
                        bool_const->name);
-    assembler_emit_store_variable(context, &tac, instr.ident);
+    assembler_emit_store_variable(context, tac, instr.ident);
 }
 
-static void assembler_emit_tac(assembler_context *context, tac_result tac,
-                               size_t instr_idx) {
-    tac_instr *instr = NULL;
-    ds_dynamic_array_get_ref(&tac.instrs, instr_idx, (void **)&instr);
+static void assembler_emit_tac_load_field(assembler_context *context,
+                                          tac_result *tac, tac_field instr) {
+    // t0 <- object.attr
+    assembler_emit_load_variable(context, tac, instr.object);
 
-    assembler_emit_tac_comment(context, *instr);
+    const char *comment =
+        comment_fmt("get %s.%s", name(instr.object), instr.name);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, comment,
+                       "mov     rax, qword [rax+%d]",
+                       ATTRIBUTE_OFFSET + WORD_SIZE * instr.index);
+    assembler_emit_store_variable(context, tac, instr.ident);
+}
+
+static void assembler_emit_tac_store_field(assembler_context *context,
+                                           tac_result *tac, tac_field instr) {
+    // object.attr <- value
+    assembler_emit_load_variable(context, tac, instr.value);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rdi, rax");
+    assembler_emit_load_variable(context, tac, instr.object);
+
+    const char *comment =
+        comment_fmt("set %s.%s", name(instr.object), instr.name);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, comment,
+                       "mov     qword [rax+%d], rdi",
+                       ATTRIBUTE_OFFSET + WORD_SIZE * instr.index);
+}
+
+static void assembler_emit_tac_check_void(assembler_context *context,
+                                          tac_result *tac,
+                                          tac_check_void instr) {
+    // a raw value or a constant is never void
+    if (assembler_is_unboxed(context, instr.expr) ||
+        instr.expr.kind == TAC_OPERAND_INT ||
+        instr.expr.kind == TAC_OPERAND_STRING ||
+        instr.expr.kind == TAC_OPERAND_BOOL) {
+        return;
+    }
+
+    // fault on void, the same way the dispatch table load would
+    assembler_emit_load_variable(context, tac, instr.expr);
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                       "mov     rdi, qword [rax+%d]", DISPTABLE_OFFSET);
+}
+
+// The unboxed temporaries that the instruction reads as objects
+static void assembler_boxed_uses(assembler_context *context, tac_instr *instr,
+                                 ds_dynamic_array *boxed) {
+    enum tac_repr ident = TAC_REPR_OBJECT;
+    tac_operand *def = codegen_tac_instr_def(instr);
+    if (def != NULL && def->kind == TAC_OPERAND_TEMP) {
+        ident = context->reprs[def->index];
+    }
+
+    boxed->count = 0;
+    if (codegen_tac_reads_value(instr, ident)) {
+        return;
+    }
+
+    ds_dynamic_array uses;
+    ds_dynamic_array_init(&uses, sizeof(tac_operand *));
+    codegen_tac_instr_uses(instr, &uses);
+
+    for (size_t i = 0; i < uses.count; i++) {
+        tac_operand *operand = NULL;
+        ds_dynamic_array_get(&uses, i, &operand);
+
+        if (!assembler_is_unboxed(context, *operand)) {
+            continue;
+        }
+
+        int found = 0;
+        for (size_t j = 0; j < boxed->count; j++) {
+            tac_operand other;
+            ds_dynamic_array_get(boxed, j, &other);
+            found = found || other.index == operand->index;
+        }
+        if (!found) {
+            ds_dynamic_array_append(boxed, operand);
+        }
+    }
+
+    ds_dynamic_array_free(&uses);
+}
+
+// Whether the code of the instruction has a call in it: the dispatches, the
+// allocations, the comparisons that call a routine and the boxing of the
+// raw values that it reads as objects
+static int assembler_clobbers(void *data, tac_instr *instr) {
+    assembler_context *context = data;
+
+    ds_dynamic_array boxed;
+    ds_dynamic_array_init(&boxed, sizeof(tac_operand));
+    assembler_boxed_uses(context, instr, &boxed);
+    int count = boxed.count;
+    ds_dynamic_array_free(&boxed);
+    if (count > 0) {
+        return 1;
+    }
 
+    switch (instr->kind) {
+    case TAC_DISPATCH_CALL:
+    case TAC_ASSIGN_NEW:
+        return 1;
+    case TAC_ASSIGN_EQ:
+        switch (codegen_tac_eq_kind(context->mapping, instr->assign_eq.type)) {
+        case TAC_EQ_VALUE:
+        case TAC_EQ_POINTER:
+            return 0;
+        default:
+            return 1;
+        }
+    case TAC_ASSIGN_ISINSTANCE:
+    case TAC_ASSIGN_ISVOID:
+    case TAC_ASSIGN_ADD:
+    case TAC_ASSIGN_SUB:
+    case TAC_ASSIGN_MUL:
+    case TAC_ASSIGN_DIV:
+    case TAC_ASSIGN_NEG:
+    case TAC_ASSIGN_LT:
+    case TAC_ASSIGN_LE:
+    case TAC_ASSIGN_NOT:
+        // a boxed result is a new object
+        return !assembler_is_unboxed(context, *codegen_tac_instr_def(instr));
+    default:
+        return 0;
+    }
+}
+
+static void assembler_emit_tac_instr(assembler_context *context,
+                                     tac_result *tac, tac_instr *instr) {
     switch (instr->kind) {
     case TAC_LABEL:
         return assembler_emit_tac_label(context, tac, instr->label);
@@ -1385,34 +2372,171 @@ static void assembler_emit_tac(assembler_context *context, tac_result tac,
                                                 instr->assign_string);
     case TAC_ASSIGN_BOOL:
         return assembler_emit_tac_assign_bool(context, tac, instr->assign_bool);
-        break;
+    case TAC_PHI:
+        DS_PANIC("phi instructions must be removed before the assembler");
+    case TAC_LOAD_FIELD:
+        return assembler_emit_tac_load_field(context, tac, instr->field);
+    case TAC_STORE_FIELD:
+        return assembler_emit_tac_store_field(context, tac, instr->field);
+    case TAC_CHECK_VOID:
+        return assembler_emit_tac_check_void(context, tac, instr->check_void);
+    case TAC_CASE:
+        return assembler_emit_tac_case_jump(context, tac, instr->case_jump);
+    }
+}
+
+// The temporaries that are boxed for the instruction go in the locals that
+// follow the ones of the TAC
+static void assembler_emit_tac(assembler_context *context, tac_result *tac,
+                               size_t instr_idx) {
+    tac_instr *instr = NULL;
+    ds_dynamic_array_get_ref(&tac->instrs, instr_idx, (void **)&instr);
+
+    assembler_emit_tac_comment(context, tac, *instr);
+
+    ds_dynamic_array boxed;
+    ds_dynamic_array_init(&boxed, sizeof(tac_operand));
+    assembler_boxed_uses(context, instr, &boxed);
+
+    for (size_t i = 0; i < boxed.count; i++) {
+        tac_operand operand;
+        ds_dynamic_array_get(&boxed, i, &operand);
+
+        context->boxed[operand.index] = tac->temp_count + i;
+        assembler_emit_box(context, tac, operand, tac->temp_count + i);
+    }
+
+    assembler_emit_tac_instr(context, tac, instr);
+
+    for (size_t i = 0; i < boxed.count; i++) {
+        tac_operand operand;
+        ds_dynamic_array_get(&boxed, i, &operand);
+        context->boxed[operand.index] = -1;
     }
+
+    ds_dynamic_array_free(&boxed);
 }
 
 static void assembler_emit_expr(assembler_context *context,
                                 const expr_node *expr) {
+    const method_node *method = NULL;
+    if (context->current_method != NULL) {
+        method = context->current_method->method;
+    }
+
     tac_result tac;
-    codegen_expr_to_tac(context->mapping, expr, &tac);
+    if (context->current_clone != 0) {
+        codegen_tac_specialization(&context->optimizer,
+                                   context->current_clone - 1, &tac);
+    } else {
+        codegen_expr_to_tac(context->mapping, context->current_class, method,
+                            expr, &tac);
+    }
+    codegen_tac_optimize(&context->optimizer, &tac);
+
+    context->reprs = malloc(sizeof(enum tac_repr) * (tac.temp_count + 1));
+    context->boxed = malloc(sizeof(int) * (tac.temp_count + 1));
+    codegen_tac_unbox(&context->optimizer, &tac, context->reprs);
+    for (size_t j = 0; j < tac.temp_count; j++) {
+        context->boxed[j] = -1;
+    }
+
+    context->registers = malloc(sizeof(int) * (tac.temp_count + 1));
+    codegen_tac_allocate_registers(&context->optimizer, &tac,
+                                   assembler_clobbers, context,
+                                   ASM_CALLEE_SAVED, ASM_CALLER_SAVED,
+                                   context->registers);
+    context->saved_count = 0;
+    for (int r = 0; r < ASM_CALLEE_SAVED; r++) {
+        for (size_t j = 0; j < tac.temp_count; j++) {
+            if (context->registers[j] == r) {
+                context->saved[context->saved_count++] = r;
+                break;
+            }
+        }
+    }
+
+    // room for the objects of the unboxed temporaries that an instruction
+    // reads as objects
+    size_t boxed_count = 0;
+    ds_dynamic_array boxed;
+    ds_dynamic_array_init(&boxed, sizeof(tac_operand));
+    for (size_t j = 0; j < tac.instrs.count; j++) {
+        tac_instr *instr = NULL;
+        ds_dynamic_array_get_ref(&tac.instrs, j, (void **)&instr);
+
+        assembler_boxed_uses(context, instr, &boxed);
+        if (boxed.count > boxed_count) {
+            boxed_count = boxed.count;
+        }
+    }
+    ds_dynamic_array_free(&boxed);
+
+    // room for the objects that live in the frame
+    size_t stack_count = 0;
+    for (size_t j = 0; j < tac.instrs.count; j++) {
+        tac_instr *instr = NULL;
+        ds_dynamic_array_get_ref(&tac.instrs, j, (void **)&instr);
+
+        if (instr->kind == TAC_ASSIGN_NEW && instr->assign_new.stack) {
+            stack_count +=
+                assembler_object_size(context, instr->assign_new.type);
+        }
+    }
+    context->stack_objects = tac.temp_count + boxed_count;
 
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "push    rbp");
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rbp, rsp");
 
-    int num_locals = locals_count_16_aligned(tac.locals.count) + 1;
+    // the locals and the saved registers after rbx keep the stack aligned
+    int num_locals = locals_count_16_aligned(tac.temp_count + boxed_count +
+                                             stack_count) +
+                     1 + context->saved_count % 2;
+    context->num_locals = num_locals;
+    context->entry_label = -1;
+    for (size_t j = 0; j < tac.instrs.count; j++) {
+        tac_instr *instr = NULL;
+        ds_dynamic_array_get_ref(&tac.instrs, j, (void **)&instr);
+
+        if (instr->kind == TAC_DISPATCH_CALL && instr->dispatch_call.tail &&
+            assembler_is_self_call(context, instr->dispatch_call)) {
+            context->entry_label = context->label_offset + tac.label_count;
+        }
+    }
 
     const char *comment = comment_fmt("allocate %d locals", num_locals);
     assembler_emit_fmt(context, ASM_INDENT_SIZE, comment, "sub     rsp, %d",
                        WORD_SIZE * num_locals);
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "push    rbx");
+    assembler_emit_save_registers(context);
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rbx, rax");
+    int summary = codegen_tac_summary_index(&context->optimizer, method);
+    if (assembler_is_profiling(context) && summary >= 0) {
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, "profile entry",
+                           "inc     qword [_profile_entries+%zu]",
+                           WORD_SIZE * summary);
+    }
+    if (context->entry_label >= 0) {
+        assembler_emit_fmt(context, 0, NULL, ".L%d:", context->entry_label);
+    }
 
     for (size_t j = 0; j < tac.instrs.count; j++) {
-        assembler_emit_tac(context, tac, j);
+        assembler_emit_tac(context, &tac, j);
     }
 
+    assembler_emit_restore_registers(context);
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "pop     rbx");
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "add     rsp, %d",
                        WORD_SIZE * num_locals);
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "pop     rbp");
+    context->label_offset += tac.label_count;
+    if (context->entry_label >= 0) {
+        context->label_offset++;
+    }
+
+    free(context->reprs);
+    free(context->boxed);
+    free(context->registers);
 }
 
 static void assembler_emit_object_init_attribute(assembler_context *context,
@@ -1431,7 +2555,9 @@ static void assembler_emit_object_init_attribute(assembler_context *context,
     assembler_emit_expr(context, &attr->attribute->value);
 
     const char *comment = comment_fmt("init %s", attr->attribute_name);
-    assembler_emit_store_variable(context, NULL, attr->attribute_name);
+    tac_result tac = {.class = item};
+    tac_operand ident = {.kind = TAC_OPERAND_ATTRIBUTE, .index = attr_idx};
+    assembler_emit_store_variable(context, &tac, ident);
 }
 
 static void assembler_emit_object_init_attributes(assembler_context *context) {
@@ -1442,11 +2568,63 @@ static void assembler_emit_object_init_attributes(assembler_context *context) {
     }
 }
 
+static void assembler_begin_routine(assembler_context *context) {
+    context->buffering = 1;
+}
+
+static void assembler_run_peephole(assembler_context *context) {
+    tac_pass_stats *stats = &context->optimizer.stats[TAC_PASS_PEEPHOLE];
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    long instrs = 0;
+    for (unsigned int i = 0; i < context->routine.count; i++) {
+        asm_instr *instr = NULL;
+        ds_dynamic_array_get_ref(&context->routine, i, (void **)&instr);
+        instrs -= instr->kind == ASM_INSTR_OP;
+    }
+
+    stats->changes +=
+        assembler_peephole_run(&context->peephole, &context->routine);
+
+    for (unsigned int i = 0; i < context->routine.count; i++) {
+        asm_instr *instr = NULL;
+        ds_dynamic_array_get_ref(&context->routine, i, (void **)&instr);
+        instrs += instr->kind == ASM_INSTR_OP;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    stats->seconds +=
+        (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    stats->instrs += instrs;
+    stats->runs++;
+}
+
+// Write the lines of the routine out, after the peephole pass
+static void assembler_end_routine(assembler_context *context) {
+    context->buffering = 0;
+    if (codegen_tac_pass_enabled(&context->optimizer, TAC_PASS_PEEPHOLE)) {
+        assembler_run_peephole(context);
+    }
+
+    for (unsigned int i = 0; i < context->routine.count; i++) {
+        asm_instr *instr = NULL;
+        ds_dynamic_array_get_ref(&context->routine, i, (void **)&instr);
+        if (instr->kind != ASM_INSTR_NONE) {
+            assembler_output(context, instr);
+        }
+        assembler_instr_free(instr);
+    }
+    context->routine.count = 0;
+}
+
 static void assembler_emit_object_init(assembler_context *context,
                                        size_t class_idx) {
     semantic_mapping_item *itemp = NULL;
     ds_dynamic_array_get_ref(&context->mapping->classes, class_idx, (void **)&itemp);
 
+    assembler_begin_routine(context);
     assembler_emit_fmt(context, 0, NULL, "%s_init:", itemp->class_name);
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "push    rbp");
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rbp, rsp");
@@ -1470,6 +2648,7 @@ static void assembler_emit_object_init(assembler_context *context,
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "pop     rbx");
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "pop     rbp");
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "ret");
+    assembler_end_routine(context);
 }
 
 static void assembler_emit_object_inits(assembler_context *context) {
@@ -1496,6 +2675,7 @@ static void assembler_emit_method(assembler_context *context,
         return;
     }
 
+    assembler_begin_routine(context);
     assembler_emit_fmt(context, 0, NULL, "%s.%s:", item->class_name, method->method_name);
 
     context->current_class = item;
@@ -1505,19 +2685,168 @@ static void assembler_emit_method(assembler_context *context,
     context->current_class = NULL;
 
     assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "ret");
+    assembler_end_routine(context);
+}
+
+static void assembler_emit_specialization(assembler_context *context,
+                                          size_t index) {
+    tac_specialization *specialization = NULL;
+    ds_dynamic_array_get_ref(&context->optimizer.specializations, index,
+                             (void **)&specialization);
+    if (!specialization->called) {
+        return;
+    }
+
+    tac_method_summary *summary = NULL;
+    ds_dynamic_array_get_ref(&context->optimizer.summaries,
+                             specialization->summary, (void **)&summary);
+
+    implementation_mapping_item *method = NULL;
+    for (size_t j = 0; j < summary->class->methods.count; j++) {
+        ds_dynamic_array_get_ref(&summary->class->methods, j, (void **)&method);
+        if (method->method == summary->method) {
+            break;
+        }
+    }
+
+    assembler_begin_routine(context);
+    assembler_emit_fmt(context, 0, NULL, "%s.%s.spec%zu:",
+                       summary->class->class_name, method->method_name,
+                       index + 1);
+
+    context->current_class = summary->class;
+    context->current_method = method;
+    context->current_clone = index + 1;
+    assembler_emit_expr(context, &method->method->body);
+    context->current_clone = 0;
+    context->current_method = NULL;
+    context->current_class = NULL;
+
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "ret");
+    assembler_end_routine(context);
+}
+
+typedef struct asm_method_order {
+        size_t class_idx;
+        size_t method_idx;
+        unsigned long entries;
+        size_t index;
+} asm_method_order;
+
+static int assembler_method_order_compare(const void *a, const void *b) {
+    const asm_method_order *x = a, *y = b;
+    if (x->entries != y->entries) {
+        return x->entries < y->entries ? 1 : -1;
+    }
+    return x->index < y->index ? -1 : x->index > y->index;
 }
 
 static void assembler_emit_methods(assembler_context *context) {
     assembler_emit(context, "section '.text' executable");
 
+    ds_dynamic_array methods;
+    ds_dynamic_array_init(&methods, sizeof(asm_method_order));
+
+    tac_profile *profile = context->optimizer.options.profile;
     for (size_t i = 0; i < context->mapping->classes.count; i++) {
         semantic_mapping_item *item = NULL;
         ds_dynamic_array_get_ref(&context->mapping->classes, i, (void **)&item);
 
         for (size_t j = 0; j < item->methods.count; j++) {
-            assembler_emit_method(context, i, j);
+            implementation_mapping_item *method = NULL;
+            ds_dynamic_array_get_ref(&item->methods, j, (void **)&method);
+
+            asm_method_order order = {.class_idx = i,
+                                      .method_idx = j,
+                                      .index = methods.count};
+            int summary =
+                codegen_tac_summary_index(&context->optimizer, method->method);
+            if (profile != NULL && summary >= 0) {
+                order.entries = profile->entries[summary];
+            }
+            ds_dynamic_array_append(&methods, &order);
         }
     }
+
+    // with a profile the methods that run most come first, so that the hot
+    // code shares the same pages
+    qsort(methods.items, methods.count, sizeof(asm_method_order),
+          assembler_method_order_compare);
+
+    for (size_t k = 0; k < methods.count; k++) {
+        asm_method_order *order = NULL;
+        ds_dynamic_array_get_ref(&methods, k, (void **)&order);
+        assembler_emit_method(context, order->class_idx, order->method_idx);
+    }
+
+    // the specializations that the methods call, and then the ones that
+    // the specializations call themselves
+    for (size_t k = 0; k < context->optimizer.specializations.count; k++) {
+        assembler_emit_specialization(context, k);
+    }
+
+    ds_dynamic_array_free(&methods);
+}
+
+static void assembler_emit_profile_counters(assembler_context *context,
+                                            const char *name, size_t count) {
+    assembler_emit_fmt(context, 0, NULL, "%s:", name);
+    if (count > 0) {
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "rq %zu", count);
+    }
+}
+
+// The routine that the prelude calls at exit. An instrumented program
+// writes its counters there, in the format of codegen_tac_profile_load.
+static void assembler_emit_profile(assembler_context *context) {
+    assembler_emit(context, "section '.text' executable");
+    assembler_emit_fmt(context, 0, NULL, "_profile_dump:");
+    if (!assembler_is_profiling(context)) {
+        assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "ret");
+        return;
+    }
+
+    tac_optimizer *optimizer = &context->optimizer;
+    size_t methods = optimizer->summaries.count;
+    size_t classes = context->mapping->classes.count;
+    size_t counters = methods + optimizer->dispatch_sites * classes +
+                      2 * optimizer->branch_sites;
+
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, "open", "mov     rax, 2");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                       "mov     rdi, _profile_path");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE,
+                       "O_WRONLY | O_CREAT | O_TRUNC", "mov     rsi, 577");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, "0644", "mov     rdx, 420");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "syscall");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "test    rax, rax");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "js      .done");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "push    rax");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, "write", "mov     rdi, rax");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rax, 1");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL,
+                       "mov     rsi, _profile_data");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rdx, %zu",
+                       WORD_SIZE * (5 + counters));
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "syscall");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, "close", "pop     rdi");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "mov     rax, 3");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "syscall");
+    assembler_emit_fmt(context, 0, NULL, ".done:");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "ret");
+
+    assembler_emit(context, "section '.data'");
+    assembler_emit_fmt(context, 0, NULL, "_profile_path db \"%s\", 0",
+                       optimizer->options.profile_path);
+    assembler_emit_fmt(context, 0, NULL, "_profile_data db \"COOLPROF\"");
+    assembler_emit_fmt(context, ASM_INDENT_SIZE, NULL, "dq %zu, %zu, %u, %u",
+                       methods, classes, optimizer->dispatch_sites,
+                       optimizer->branch_sites);
+    assembler_emit_profile_counters(context, "_profile_entries", methods);
+    assembler_emit_profile_counters(context, "_profile_receivers",
+                                    optimizer->dispatch_sites * classes);
+    assembler_emit_profile_counters(context, "_profile_branches",
+                                    2 * optimizer->branch_sites);
 }
 
 static void assembler_emit_dispatch_table(assembler_context *context,
@@ -1546,12 +2875,14 @@ static void assembler_emit_dispatch_tables(assembler_context *context) {
     }
 }
 
-enum assembler_result assembler_run(const char *filename,
-                                    semantic_mapping *mapping) {
+enum assembler_result assembler_run(const char *filename, asm_object *object,
+                                    semantic_mapping *mapping,
+                                    const tac_options *options) {
 
     int result = 0;
     assembler_context context;
-    if (assembler_context_init(&context, filename, mapping) != 0) {
+    if (assembler_context_init(&context, filename, object, mapping,
+                               options) != 0) {
         return_defer(1);
     }
 
@@ -1578,6 +2909,20 @@ enum assembler_result assembler_run(const char *filename,
     assembler_emit_object_inits(&context);
     assembler_emit_methods(&context);
     assembler_emit_consts(&context);
+    assembler_emit_profile(&context);
+
+    // the assembly itself goes to the terminal with --asm
+    if (context.file != stdout && context.optimizer.dispatches > 0) {
+        DS_LOG_INFO("Devirtualized %u of %u dynamic dispatches (%.1f%%)",
+                    context.optimizer.devirtualized,
+                    context.optimizer.dispatches,
+                    100.0 * context.optimizer.devirtualized /
+                        context.optimizer.dispatches);
+    }
+    if (options->time_passes) {
+        codegen_tac_print_pass_stats(&context.optimizer);
+        assembler_peephole_print_hits(&context.peephole);
+    }
 
 defer:
     result = context.result;
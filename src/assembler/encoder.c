@@ -0,0 +1,1605 @@
+#include "assembler.h"
+#include "ds.h"
+#include <ctype.h>
+#include <elf.h>
+
+// The longest instruction of x86-64
+#define ENCODER_MAX_BYTES 15
+
+// The fields of an instruction that can hold the address of a symbol: the
+// displacement and the immediate
+#define ENCODER_MAX_FIELDS 2
+
+// A constant, plus the address of a symbol when it has one
+typedef struct encoder_value {
+        long constant;
+        int symbol; // -1 without one
+} encoder_value;
+
+enum encoder_operand_kind {
+    ENCODER_REGISTER,
+    ENCODER_IMMEDIATE,
+    ENCODER_MEMORY,
+};
+
+typedef struct encoder_operand {
+        enum encoder_operand_kind kind;
+        int size; // in bytes, 0 for memory that does not give it
+        int reg;
+        int high; // ah, ch, dh and bh, which no instruction with REX can use
+        int xmm;
+        int base; // -1 without one
+        int index;
+        int scale;
+        encoder_value value; // the immediate or the displacement
+} encoder_operand;
+
+typedef struct encoder_field {
+        unsigned int at;
+        unsigned int type;
+        encoder_value value;
+} encoder_field;
+
+// The bytes of an instruction while it is encoded, and the fields that
+// hold the addresses of symbols, which become relocations
+typedef struct encoder_instr {
+        unsigned char bytes[ENCODER_MAX_BYTES + 1];
+        unsigned int size;
+        encoder_field fields[ENCODER_MAX_FIELDS];
+        unsigned int field_count;
+} encoder_instr;
+
+typedef int (*encoder_fn)(encoder_instr *e, encoder_operand *ops,
+                          unsigned int count, int code);
+
+typedef struct encoder_entry {
+        const char *mnemonic;
+        encoder_fn encode;
+        int code;
+} encoder_entry;
+
+static const char *encoder_names[4][16] = {
+    {"al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil", "r8b", "r9b", "r10b",
+     "r11b", "r12b", "r13b", "r14b", "r15b"},
+    {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di", "r8w", "r9w", "r10w",
+     "r11w", "r12w", "r13w", "r14w", "r15w"},
+    {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi", "r8d", "r9d",
+     "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"},
+    {"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi", "r8", "r9", "r10",
+     "r11", "r12", "r13", "r14", "r15"},
+};
+
+static const char *encoder_high_names[4] = {"ah", "ch", "dh", "bh"};
+
+// Fill the operand if the name is a register
+static int encoder_register(const char *name, size_t length,
+                            encoder_operand *operand) {
+    *operand = (encoder_operand){.kind = ENCODER_REGISTER, .base = -1,
+                                 .index = -1, .value.symbol = -1};
+
+    for (int size = 0; size < 4; size++) {
+        for (int reg = 0; reg < 16; reg++) {
+            const char *candidate = encoder_names[size][reg];
+            if (strlen(candidate) == length &&
+                strncmp(candidate, name, length) == 0) {
+                operand->size = 1 << size;
+                operand->reg = reg;
+                return 1;
+            }
+        }
+    }
+    for (int reg = 0; reg < 4; reg++) {
+        if (length == 2 && strncmp(encoder_high_names[reg], name, 2) == 0) {
+            operand->size = 1;
+            operand->reg = reg + 4;
+            operand->high = 1;
+            return 1;
+        }
+    }
+    if (length > 3 && strncmp(name, "xmm", 3) == 0) {
+        int reg = 0;
+        for (size_t k = 3; k < length; k++) {
+            if (!isdigit((unsigned char)name[k])) {
+                return 0;
+            }
+            reg = reg * 10 + name[k] - '0';
+        }
+        if (reg < 16) {
+            operand->size = 16;
+            operand->reg = reg;
+            operand->xmm = 1;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// EXPRESSIONS
+
+typedef struct encoder_parser {
+        asm_object *object;
+        const char *at;
+} encoder_parser;
+
+// A term of an address: a constant times a register, or a value
+typedef struct encoder_term {
+        encoder_value value;
+        int reg; // -1 without one
+} encoder_term;
+
+static void encoder_skip_spaces(encoder_parser *p) {
+    while (isspace((unsigned char)*p->at)) {
+        p->at++;
+    }
+}
+
+static int encoder_is_name_start(char c) {
+    return isalpha((unsigned char)c) || c == '_' || c == '.' || c == '@';
+}
+
+static int encoder_is_name(char c) {
+    return isalnum((unsigned char)c) || c == '_' || c == '.' || c == '@' ||
+           c == '$';
+}
+
+// The full name of a label: the ones that start with a dot belong to the
+// last label that does not
+static char *encoder_label_name(asm_object *object, const char *name,
+                                size_t length) {
+    size_t prefix = name[0] == '.' && object->prefix != NULL
+                        ? strlen(object->prefix)
+                        : 0;
+    char *full = malloc(prefix + length + 1);
+    if (prefix > 0) {
+        memcpy(full, object->prefix, prefix);
+    }
+    memcpy(full + prefix, name, length);
+    full[prefix + length] = '\0';
+    return full;
+}
+
+static int encoder_add(encoder_value *lhs, encoder_value rhs, int sign) {
+    if (rhs.symbol >= 0 && (lhs->symbol >= 0 || sign < 0)) {
+        return 1;
+    }
+    lhs->constant += sign * rhs.constant;
+    if (rhs.symbol >= 0) {
+        lhs->symbol = rhs.symbol;
+    }
+    return 0;
+}
+
+static int encoder_parse_number(encoder_parser *p, long *value) {
+    const char *start = p->at;
+    while (isalnum((unsigned char)*p->at)) {
+        p->at++;
+    }
+    size_t length = p->at - start;
+
+    char *digits = malloc(length + 1);
+    memcpy(digits, start, length);
+    digits[length] = '\0';
+
+    int base = 10;
+    char *text = digits;
+    if (length > 2 && digits[0] == '0' && tolower(digits[1]) == 'x') {
+        base = 16;
+        text += 2;
+    } else if (length > 1 && tolower(digits[length - 1]) == 'h') {
+        base = 16;
+        digits[length - 1] = '\0';
+    }
+
+    char *end = NULL;
+    *value = (long)strtoul(text, &end, base);
+    int result = *end != '\0' || end == text;
+    free(digits);
+    return result;
+}
+
+static int encoder_parse_sum(encoder_parser *p, encoder_term *term);
+
+static int encoder_parse_factor(encoder_parser *p, encoder_term *term) {
+    encoder_skip_spaces(p);
+    *term = (encoder_term){.value = {.symbol = -1}, .reg = -1};
+
+    if (*p->at == '-' || *p->at == '+') {
+        int sign = *p->at++ == '-' ? -1 : 1;
+        if (encoder_parse_factor(p, term) != 0 || term->reg >= 0 ||
+            (sign < 0 && term->value.symbol >= 0)) {
+            return 1;
+        }
+        term->value.constant *= sign;
+        return 0;
+    }
+
+    if (*p->at == '(') {
+        p->at++;
+        if (encoder_parse_sum(p, term) != 0) {
+            return 1;
+        }
+        encoder_skip_spaces(p);
+        return *p->at++ != ')';
+    }
+
+    if (isdigit((unsigned char)*p->at)) {
+        return encoder_parse_number(p, &term->value.constant);
+    }
+
+    if (!encoder_is_name_start(*p->at)) {
+        return 1;
+    }
+
+    const char *start = p->at;
+    while (encoder_is_name(*p->at)) {
+        p->at++;
+    }
+    size_t length = p->at - start;
+
+    encoder_operand reg;
+    if (encoder_register(start, length, &reg)) {
+        if (reg.size != 8) {
+            return 1;
+        }
+        term->reg = reg.reg;
+        term->value.constant = 1;
+        return 0;
+    }
+
+    char *name = encoder_label_name(p->object, start, length);
+    int index = assembler_symbol_find(p->object, name);
+    if (index >= 0 &&
+        assembler_symbol(p->object, index)->kind == ASM_SYMBOL_EQUATE) {
+        term->value.constant = assembler_symbol(p->object, index)->value;
+    } else {
+        term->value.symbol = assembler_symbol_get(p->object, name);
+    }
+    free(name);
+    return 0;
+}
+
+static int encoder_parse_product(encoder_parser *p, encoder_term *term) {
+    if (encoder_parse_factor(p, term) != 0) {
+        return 1;
+    }
+
+    for (;;) {
+        encoder_skip_spaces(p);
+        if (*p->at != '*') {
+            return 0;
+        }
+        p->at++;
+
+        encoder_term rhs;
+        if (encoder_parse_factor(p, &rhs) != 0 || term->value.symbol >= 0 ||
+            rhs.value.symbol >= 0 || (term->reg >= 0 && rhs.reg >= 0)) {
+            return 1;
+        }
+        term->value.constant *= rhs.value.constant;
+        if (rhs.reg >= 0) {
+            term->reg = rhs.reg;
+        }
+    }
+}
+
+// A sum without registers
+static int encoder_parse_sum(encoder_parser *p, encoder_term *term) {
+    if (encoder_parse_product(p, term) != 0 || term->reg >= 0) {
+        return 1;
+    }
+
+    for (;;) {
+        encoder_skip_spaces(p);
+        if (*p->at != '+' && *p->at != '-') {
+            return 0;
+        }
+        int sign = *p->at++ == '-' ? -1 : 1;
+
+        encoder_term rhs;
+        if (encoder_parse_product(p, &rhs) != 0 || rhs.reg >= 0 ||
+            encoder_add(&term->value, rhs.value, sign) != 0) {
+            return 1;
+        }
+    }
+}
+
+static int encoder_parse_value(asm_object *object, const char *text,
+                               encoder_value *value) {
+    encoder_parser p = {.object = object, .at = text};
+    encoder_term term;
+    if (encoder_parse_sum(&p, &term) != 0) {
+        return 1;
+    }
+    encoder_skip_spaces(&p);
+    *value = term.value;
+    return *p.at != '\0';
+}
+
+// The inside of the brackets of a memory operand: a base, an index times
+// a scale and a displacement, in any order
+static int encoder_parse_address(encoder_parser *p, encoder_operand *operand) {
+    int sign = 1;
+    for (;;) {
+        encoder_term term;
+        if (encoder_parse_product(p, &term) != 0) {
+            return 1;
+        }
+
+        if (term.reg >= 0) {
+            if (sign < 0) {
+                return 1;
+            }
+            if (term.value.constant == 1 && operand->base < 0) {
+                operand->base = term.reg;
+            } else if (operand->index < 0) {
+                operand->index = term.reg;
+                operand->scale = term.value.constant;
+            } else {
+                return 1;
+            }
+        } else if (encoder_add(&operand->value, term.value, sign) != 0) {
+            return 1;
+        }
+
+        encoder_skip_spaces(p);
+        if (*p->at == ']') {
+            p->at++;
+            return 0;
+        }
+        if (*p->at != '+' && *p->at != '-') {
+            return 1;
+        }
+        sign = *p->at++ == '-' ? -1 : 1;
+    }
+}
+
+static int encoder_parse_operand(asm_object *object, const char *text,
+                                 encoder_operand *operand) {
+    static const char *sizes[] = {"byte", "word", "dword", "qword"};
+
+    encoder_parser p = {.object = object, .at = text};
+    encoder_skip_spaces(&p);
+
+    int size = 0;
+    for (int k = 0; k < 4; k++) {
+        size_t length = strlen(sizes[k]);
+        if (strncmp(p.at, sizes[k], length) == 0 &&
+            !encoder_is_name(p.at[length])) {
+            size = 1 << k;
+            p.at += length;
+            encoder_skip_spaces(&p);
+            break;
+        }
+    }
+
+    if (*p.at == '[') {
+        p.at++;
+        *operand = (encoder_operand){.kind = ENCODER_MEMORY,
+                                     .size = size,
+                                     .base = -1,
+                                     .index = -1,
+                                     .scale = 1,
+                                     .value.symbol = -1};
+        if (encoder_parse_address(&p, operand) != 0) {
+            return 1;
+        }
+        encoder_skip_spaces(&p);
+        return *p.at != '\0';
+    }
+
+    const char *end = p.at + strlen(p.at);
+    while (end > p.at && isspace((unsigned char)end[-1])) {
+        end--;
+    }
+    if (size == 0 && encoder_register(p.at, end - p.at, operand)) {
+        return 0;
+    }
+
+    *operand = (encoder_operand){.kind = ENCODER_IMMEDIATE,
+                                 .size = size,
+                                 .base = -1,
+                                 .index = -1};
+    return encoder_parse_value(object, p.at, &operand->value);
+}
+
+// ENCODING
+
+static int encoder_fits(long value, int size) {
+    switch (size) {
+    case 1:
+        return value >= -128 && value <= 255;
+    case 2:
+        return value >= -32768 && value <= 65535;
+    case 4:
+        return value >= -2147483648L && value <= 4294967295L;
+    default:
+        return 1;
+    }
+}
+
+static int encoder_fits_signed(long value, int size) {
+    long limit = 1L << (8 * size - 1);
+    return value >= -limit && value < limit;
+}
+
+static void encoder_byte(encoder_instr *e, unsigned int byte) {
+    e->bytes[e->size++] = byte & 0xff;
+}
+
+static void encoder_int(encoder_instr *e, long value, int size) {
+    for (int k = 0; k < size; k++) {
+        encoder_byte(e, value >> (8 * k));
+    }
+}
+
+// A field of the given size that holds the value; the address of a symbol
+// is left to a relocation
+static int encoder_value_field(encoder_instr *e, encoder_value value, int size,
+                               unsigned int type) {
+    if (value.symbol >= 0) {
+        if (e->field_count == ENCODER_MAX_FIELDS) {
+            return 1;
+        }
+        e->fields[e->field_count++] =
+            (encoder_field){.at = e->size, .type = type, .value = value};
+        encoder_int(e, 0, size);
+        return 0;
+    }
+
+    if (!encoder_fits(value.constant, size)) {
+        return 1;
+    }
+    encoder_int(e, value.constant, size);
+    return 0;
+}
+
+// A register of the low byte that only exists with a REX prefix
+static int encoder_needs_rex(encoder_operand *operand) {
+    return operand != NULL && operand->kind == ENCODER_REGISTER &&
+           operand->size == 1 && !operand->high && operand->reg >= 4 &&
+           operand->reg < 8;
+}
+
+static int encoder_is_high(encoder_operand *operand) {
+    return operand != NULL && operand->kind == ENCODER_REGISTER &&
+           operand->high;
+}
+
+static int encoder_scale_bits(int scale) {
+    switch (scale) {
+    case 1:
+        return 0;
+    case 2:
+        return 1;
+    case 4:
+        return 2;
+    case 8:
+        return 3;
+    default:
+        return -1;
+    }
+}
+
+static void encoder_modrm_byte(encoder_instr *e, int mod, int reg, int rm) {
+    encoder_byte(e, (mod << 6) | ((reg & 7) << 3) | (rm & 7));
+}
+
+static int encoder_memory(encoder_instr *e, int reg, encoder_operand *m) {
+    int scale = encoder_scale_bits(m->scale);
+    if (scale < 0 || m->index == 4) {
+        return 1;
+    }
+
+    // a label alone is addressed relative to the next instruction
+    if (m->base < 0 && m->index < 0) {
+        if (m->value.symbol >= 0) {
+            encoder_modrm_byte(e, 0, reg, 5);
+            return encoder_value_field(e, m->value, 4, R_X86_64_PC32);
+        }
+        encoder_modrm_byte(e, 0, reg, 4);
+        encoder_byte(e, (4 << 3) | 5);
+        return encoder_value_field(e, m->value, 4, R_X86_64_32S);
+    }
+
+    if (m->base < 0) {
+        encoder_modrm_byte(e, 0, reg, 4);
+        encoder_byte(e, (scale << 6) | ((m->index & 7) << 3) | 5);
+        return encoder_value_field(e, m->value, 4, R_X86_64_32S);
+    }
+
+    int mod = 2;
+    if (m->value.symbol < 0 && m->value.constant == 0 && (m->base & 7) != 5) {
+        mod = 0;
+    } else if (m->value.symbol < 0 && encoder_fits_signed(m->value.constant, 1)) {
+        mod = 1;
+    }
+
+    if (m->index >= 0 || (m->base & 7) == 4) {
+        encoder_modrm_byte(e, mod, reg, 4);
+        int index = m->index >= 0 ? m->index & 7 : 4;
+        encoder_byte(e, ((m->index >= 0 ? scale : 0) << 6) | (index << 3) |
+                            (m->base & 7));
+    } else {
+        encoder_modrm_byte(e, mod, reg, m->base);
+    }
+
+    if (mod == 1) {
+        encoder_int(e, m->value.constant, 1);
+    } else if (mod == 2) {
+        if (m->value.symbol < 0 && !encoder_fits_signed(m->value.constant, 4)) {
+            return 1;
+        }
+        return encoder_value_field(e, m->value, 4, R_X86_64_32S);
+    }
+    return 0;
+}
+
+// The bytes of an opcode, the most significant first
+static void encoder_opcode(encoder_instr *e, unsigned int opcode) {
+    if (opcode > 0xffff) {
+        encoder_byte(e, opcode >> 16);
+    }
+    if (opcode > 0xff) {
+        encoder_byte(e, opcode >> 8);
+    }
+    encoder_byte(e, opcode);
+}
+
+static int encoder_rex(encoder_instr *e, int rex, encoder_operand *lhs,
+                       encoder_operand *rhs) {
+    if (rex == 0x40 && !encoder_needs_rex(lhs) && !encoder_needs_rex(rhs)) {
+        return 0;
+    }
+    if (encoder_is_high(lhs) || encoder_is_high(rhs)) {
+        return 1;
+    }
+    encoder_byte(e, rex);
+    return 0;
+}
+
+// An instruction with a ModRM byte: the reg field holds the register of
+// the operand or the extension of the opcode, and rm the other operand
+static int encoder_modrm(encoder_instr *e, int prefix, int w,
+                         unsigned int opcode, int reg, encoder_operand *reg_op,
+                         encoder_operand *rm) {
+    if (rm->kind == ENCODER_IMMEDIATE) {
+        return 1;
+    }
+    if (prefix != 0) {
+        encoder_byte(e, prefix);
+    }
+
+    int rex = 0x40 | (w << 3) | (((reg >> 3) & 1) << 2);
+    if (rm->kind == ENCODER_REGISTER) {
+        rex |= (rm->reg >> 3) & 1;
+    } else {
+        rex |= rm->index >= 0 ? ((rm->index >> 3) & 1) << 1 : 0;
+        rex |= rm->base >= 0 ? (rm->base >> 3) & 1 : 0;
+    }
+    if (encoder_rex(e, rex, reg_op, rm) != 0) {
+        return 1;
+    }
+
+    encoder_opcode(e, opcode);
+    if (rm->kind == ENCODER_REGISTER) {
+        encoder_modrm_byte(e, 3, reg, rm->reg);
+        return 0;
+    }
+    return encoder_memory(e, reg, rm);
+}
+
+// An instruction with the register in the low bits of the opcode
+static int encoder_plus(encoder_instr *e, int prefix, int w,
+                        unsigned int opcode, encoder_operand *reg) {
+    if (prefix != 0) {
+        encoder_byte(e, prefix);
+    }
+    if (encoder_rex(e, 0x40 | (w << 3) | ((reg->reg >> 3) & 1), reg, NULL) !=
+        0) {
+        return 1;
+    }
+    encoder_opcode(e, opcode + (reg->reg & 7));
+    return 0;
+}
+
+// An immediate of the given size for an operation of the operand size,
+// which extends the immediates of four bytes with their sign
+static int encoder_immediate(encoder_instr *e, encoder_operand *operand,
+                             int size, int operand_size) {
+    if (operand->value.symbol >= 0) {
+        if (size < 4) {
+            return 1;
+        }
+        unsigned int type = size == 8           ? R_X86_64_64
+                            : operand_size == 8 ? R_X86_64_32S
+                                                : R_X86_64_32;
+        return encoder_value_field(e, operand->value, size, type);
+    }
+    if (size == 4 && operand_size == 8 &&
+        !encoder_fits_signed(operand->value.constant, 4)) {
+        return 1;
+    }
+    return encoder_value_field(e, operand->value, size, 0);
+}
+
+// The size of the operation: the one of the registers, or of the memory
+static int encoder_operand_size(encoder_operand *ops, unsigned int count) {
+    for (unsigned int k = 0; k < count; k++) {
+        if (ops[k].kind == ENCODER_REGISTER) {
+            return ops[k].size;
+        }
+    }
+    for (unsigned int k = 0; k < count; k++) {
+        if (ops[k].size != 0) {
+            return ops[k].size;
+        }
+    }
+    return 0;
+}
+
+static int encoder_is_gpr(encoder_operand *operand) {
+    return operand->kind == ENCODER_REGISTER && !operand->xmm;
+}
+
+static int encoder_is_xmm(encoder_operand *operand) {
+    return operand->kind == ENCODER_REGISTER && operand->xmm;
+}
+
+static int encoder_size_prefix(int size) { return size == 2 ? 0x66 : 0; }
+
+// add, or, adc, sbb, and, sub, xor and cmp, where the code is the
+// extension of the opcode
+static int encoder_alu(encoder_instr *e, encoder_operand *ops,
+                       unsigned int count, int code) {
+    if (count != 2) {
+        return 1;
+    }
+    encoder_operand *dst = &ops[0], *src = &ops[1];
+    int size = encoder_operand_size(ops, count);
+    if (size == 0 || size == 16 || encoder_is_xmm(dst) || encoder_is_xmm(src)) {
+        return 1;
+    }
+    int prefix = encoder_size_prefix(size), w = size == 8, wide = size != 1;
+
+    if (src->kind == ENCODER_REGISTER) {
+        return encoder_modrm(e, prefix, w, code * 8 + wide, src->reg, src, dst);
+    }
+    if (src->kind == ENCODER_MEMORY) {
+        if (dst->kind != ENCODER_REGISTER) {
+            return 1;
+        }
+        return encoder_modrm(e, prefix, w, code * 8 + 2 + wide, dst->reg, dst,
+                             src);
+    }
+
+    if (!wide) {
+        return encoder_modrm(e, prefix, w, 0x80, code, NULL, dst) ||
+               encoder_immediate(e, src, 1, size);
+    }
+    if (src->value.symbol < 0 && encoder_fits_signed(src->value.constant, 1)) {
+        return encoder_modrm(e, prefix, w, 0x83, code, NULL, dst) ||
+               encoder_immediate(e, src, 1, size);
+    }
+    return encoder_modrm(e, prefix, w, 0x81, code, NULL, dst) ||
+           encoder_immediate(e, src, size == 2 ? 2 : 4, size);
+}
+
+static int encoder_mov(encoder_instr *e, encoder_operand *ops,
+                       unsigned int count, int code) {
+    (void)code;
+    if (count != 2) {
+        return 1;
+    }
+    encoder_operand *dst = &ops[0], *src = &ops[1];
+    int size = encoder_operand_size(ops, count);
+    if (size == 0 || size == 16 || encoder_is_xmm(dst) || encoder_is_xmm(src)) {
+        return 1;
+    }
+    int prefix = encoder_size_prefix(size), w = size == 8, wide = size != 1;
+
+    if (src->kind == ENCODER_REGISTER) {
+        return encoder_modrm(e, prefix, w, 0x88 + wide, src->reg, src, dst);
+    }
+    if (src->kind == ENCODER_MEMORY) {
+        if (dst->kind != ENCODER_REGISTER) {
+            return 1;
+        }
+        return encoder_modrm(e, prefix, w, 0x8a + wide, dst->reg, dst, src);
+    }
+
+    if (dst->kind == ENCODER_MEMORY) {
+        return encoder_modrm(e, prefix, w, 0xc6 + wide, 0, NULL, dst) ||
+               encoder_immediate(e, src, size > 4 ? 4 : size, size);
+    }
+
+    // the addresses and the large constants take all eight bytes
+    if (size == 8) {
+        if (src->value.symbol < 0 &&
+            encoder_fits_signed(src->value.constant, 4)) {
+            return encoder_modrm(e, prefix, w, 0xc7, 0, NULL, dst) ||
+                   encoder_immediate(e, src, 4, size);
+        }
+        return encoder_plus(e, prefix, w, 0xb8, dst) ||
+               encoder_immediate(e, src, 8, size);
+    }
+    return encoder_plus(e, prefix, w, wide ? 0xb8 : 0xb0, dst) ||
+           encoder_immediate(e, src, size, size);
+}
+
+static int encoder_test(encoder_instr *e, encoder_operand *ops,
+                        unsigned int count, int code) {
+    (void)code;
+    if (count != 2) {
+        return 1;
+    }
+    encoder_operand *dst = &ops[0], *src = &ops[1];
+    if (src->kind == ENCODER_MEMORY) {
+        dst = &ops[1];
+        src = &ops[0];
+    }
+    int size = encoder_operand_size(ops, count);
+    if (size == 0 || size == 16 || encoder_is_xmm(dst) || encoder_is_xmm(src)) {
+        return 1;
+    }
+    int prefix = encoder_size_prefix(size), w = size == 8, wide = size != 1;
+
+    if (src->kind == ENCODER_REGISTER) {
+        return encoder_modrm(e, prefix, w, 0x84 + wide, src->reg, src, dst);
+    }
+    return encoder_modrm(e, prefix, w, 0xf6 + wide, 0, NULL, dst) ||
+           encoder_immediate(e, src, size > 4 ? 4 : size, size);
+}
+
+static int encoder_xchg(encoder_instr *e, encoder_operand *ops,
+                        unsigned int count, int code) {
+    (void)code;
+    if (count != 2) {
+        return 1;
+    }
+    encoder_operand *reg = &ops[1], *rm = &ops[0];
+    if (reg->kind != ENCODER_REGISTER) {
+        reg = &ops[0];
+        rm = &ops[1];
+    }
+    int size = encoder_operand_size(ops, count);
+    if (!encoder_is_gpr(reg) || encoder_is_xmm(rm)) {
+        return 1;
+    }
+    return encoder_modrm(e, encoder_size_prefix(size), size == 8,
+                         0x86 + (size != 1), reg->reg, reg, rm);
+}
+
+static int encoder_lea(encoder_instr *e, encoder_operand *ops,
+                       unsigned int count, int code) {
+    (void)code;
+    if (count != 2 || !encoder_is_gpr(&ops[0]) ||
+        ops[1].kind != ENCODER_MEMORY || ops[0].size == 1) {
+        return 1;
+    }
+    return encoder_modrm(e, encoder_size_prefix(ops[0].size), ops[0].size == 8,
+                         0x8d, ops[0].reg, &ops[0], &ops[1]);
+}
+
+// movzx and movsx, from a byte or a word
+static int encoder_extend(encoder_instr *e, encoder_operand *ops,
+                          unsigned int count, int code) {
+    if (count != 2 || !encoder_is_gpr(&ops[0]) || encoder_is_xmm(&ops[1])) {
+        return 1;
+    }
+    int size = ops[1].size;
+    if ((size != 1 && size != 2) || ops[0].size <= size) {
+        return 1;
+    }
+    return encoder_modrm(e, encoder_size_prefix(ops[0].size), ops[0].size == 8,
+                         code + (size == 2), ops[0].reg, &ops[0], &ops[1]);
+}
+
+static int encoder_movsxd(encoder_instr *e, encoder_operand *ops,
+                          unsigned int count, int code) {
+    (void)code;
+    if (count != 2 || !encoder_is_gpr(&ops[0]) || ops[0].size != 8 ||
+        encoder_is_xmm(&ops[1]) || ops[1].size != 4) {
+        return 1;
+    }
+    return encoder_modrm(e, 0, 1, 0x63, ops[0].reg, &ops[0], &ops[1]);
+}
+
+static int encoder_push(encoder_instr *e, encoder_operand *ops,
+                        unsigned int count, int code) {
+    (void)code;
+    if (count != 1 || encoder_is_xmm(&ops[0])) {
+        return 1;
+    }
+    encoder_operand *src = &ops[0];
+
+    if (src->kind == ENCODER_REGISTER) {
+        return src->size != 8 || encoder_plus(e, 0, 0, 0x50, src);
+    }
+    if (src->kind == ENCODER_MEMORY) {
+        return encoder_modrm(e, 0, 0, 0xff, 6, NULL, src);
+    }
+    if (src->value.symbol < 0 && encoder_fits_signed(src->value.constant, 1)) {
+        encoder_byte(e, 0x6a);
+        return encoder_immediate(e, src, 1, 8);
+    }
+    encoder_byte(e, 0x68);
+    return encoder_immediate(e, src, 4, 8);
+}
+
+static int encoder_pop(encoder_instr *e, encoder_operand *ops,
+                       unsigned int count, int code) {
+    (void)code;
+    if (count != 1 || encoder_is_xmm(&ops[0])) {
+        return 1;
+    }
+    if (ops[0].kind == ENCODER_REGISTER) {
+        return ops[0].size != 8 || encoder_plus(e, 0, 0, 0x58, &ops[0]);
+    }
+    return encoder_modrm(e, 0, 0, 0x8f, 0, NULL, &ops[0]);
+}
+
+// The instructions of one operand in the groups of FE and F6: inc, dec,
+// not, neg, mul, imul, div and idiv
+static int encoder_unary(encoder_instr *e, encoder_operand *ops,
+                         unsigned int count, int code) {
+    if (count != 1 || encoder_is_xmm(&ops[0])) {
+        return 1;
+    }
+    int size = ops[0].size;
+    if (size == 0) {
+        return 1;
+    }
+    int opcode = (code >> 8) + (size != 1);
+    return encoder_modrm(e, encoder_size_prefix(size), size == 8, opcode,
+                         code & 7, NULL, &ops[0]);
+}
+
+static int encoder_imul(encoder_instr *e, encoder_operand *ops,
+                        unsigned int count, int code) {
+    (void)code;
+    if (count == 1) {
+        return encoder_unary(e, ops, count, 0xf605);
+    }
+    if (count < 2 || !encoder_is_gpr(&ops[0]) || ops[0].size == 1) {
+        return 1;
+    }
+    int size = ops[0].size;
+    int prefix = encoder_size_prefix(size), w = size == 8;
+
+    encoder_operand *src = &ops[1], *imm = count == 3 ? &ops[2] : NULL;
+    if (count == 2 && ops[1].kind == ENCODER_IMMEDIATE) {
+        src = &ops[0];
+        imm = &ops[1];
+    }
+    if (imm == NULL) {
+        return encoder_modrm(e, prefix, w, 0x0faf, ops[0].reg, &ops[0], src);
+    }
+    if (imm->kind != ENCODER_IMMEDIATE) {
+        return 1;
+    }
+    if (imm->value.symbol < 0 && encoder_fits_signed(imm->value.constant, 1)) {
+        return encoder_modrm(e, prefix, w, 0x6b, ops[0].reg, &ops[0], src) ||
+               encoder_immediate(e, imm, 1, size);
+    }
+    return encoder_modrm(e, prefix, w, 0x69, ops[0].reg, &ops[0], src) ||
+           encoder_immediate(e, imm, size == 2 ? 2 : 4, size);
+}
+
+// shl, shr and sar, by a constant or by cl
+static int encoder_shift(encoder_instr *e, encoder_operand *ops,
+                         unsigned int count, int code) {
+    if (count != 2 || encoder_is_xmm(&ops[0])) {
+        return 1;
+    }
+    int size = ops[0].size;
+    if (size == 0) {
+        return 1;
+    }
+    int prefix = encoder_size_prefix(size), w = size == 8, wide = size != 1;
+
+    encoder_operand *amount = &ops[1];
+    if (amount->kind == ENCODER_REGISTER) {
+        if (amount->size != 1 || amount->reg != 1 || amount->high) {
+            return 1;
+        }
+        return encoder_modrm(e, prefix, w, 0xd2 + wide, code, NULL, &ops[0]);
+    }
+    if (amount->kind != ENCODER_IMMEDIATE || amount->value.symbol >= 0) {
+        return 1;
+    }
+    if (amount->value.constant == 1) {
+        return encoder_modrm(e, prefix, w, 0xd0 + wide, code, NULL, &ops[0]);
+    }
+    return encoder_modrm(e, prefix, w, 0xc0 + wide, code, NULL, &ops[0]) ||
+           encoder_immediate(e, amount, 1, size);
+}
+
+// A jump or a call to a label, which is always relative to the next
+// instruction with four bytes, or to the address in the operand
+static int encoder_branch(encoder_instr *e, encoder_operand *ops,
+                          unsigned int count, int code) {
+    if (count != 1 || encoder_is_xmm(&ops[0])) {
+        return 1;
+    }
+    int call = code == 0xe8;
+
+    if (ops[0].kind != ENCODER_IMMEDIATE) {
+        if (ops[0].kind == ENCODER_REGISTER && ops[0].size != 8) {
+            return 1;
+        }
+        return encoder_modrm(e, 0, 0, 0xff, call ? 2 : 4, NULL, &ops[0]);
+    }
+    if (ops[0].value.symbol < 0) {
+        return 1;
+    }
+    encoder_opcode(e, code);
+    return encoder_value_field(e, ops[0].value, 4,
+                               call ? R_X86_64_PLT32 : R_X86_64_PC32);
+}
+
+static int encoder_jcc(encoder_instr *e, encoder_operand *ops,
+                       unsigned int count, int code) {
+    if (count != 1 || ops[0].kind != ENCODER_IMMEDIATE ||
+        ops[0].value.symbol < 0) {
+        return 1;
+    }
+    encoder_opcode(e, 0x0f80 + code);
+    return encoder_value_field(e, ops[0].value, 4, R_X86_64_PC32);
+}
+
+static int encoder_setcc(encoder_instr *e, encoder_operand *ops,
+                         unsigned int count, int code) {
+    if (count != 1 || encoder_is_xmm(&ops[0]) || ops[0].size > 1) {
+        return 1;
+    }
+    return encoder_modrm(e, 0, 0, 0x0f90 + code, 0, NULL, &ops[0]);
+}
+
+static int encoder_cmovcc(encoder_instr *e, encoder_operand *ops,
+                          unsigned int count, int code) {
+    if (count != 2 || !encoder_is_gpr(&ops[0]) || ops[0].size == 1 ||
+        encoder_is_xmm(&ops[1])) {
+        return 1;
+    }
+    int size = ops[0].size;
+    return encoder_modrm(e, encoder_size_prefix(size), size == 8,
+                         0x0f40 + code, ops[0].reg, &ops[0], &ops[1]);
+}
+
+static int encoder_plain(encoder_instr *e, encoder_operand *ops,
+                         unsigned int count, int code) {
+    (void)ops;
+    if (count != 0) {
+        return 1;
+    }
+    encoder_opcode(e, code);
+    return 0;
+}
+
+// The scalar instructions of SSE, with the mandatory prefix in the high
+// byte of the code, that take an xmm register and an xmm register or memory
+static int encoder_sse(encoder_instr *e, encoder_operand *ops,
+                       unsigned int count, int code) {
+    if (count != 2 || !encoder_is_xmm(&ops[0]) || encoder_is_gpr(&ops[1]) ||
+        ops[1].kind == ENCODER_IMMEDIATE) {
+        return 1;
+    }
+    return encoder_modrm(e, code >> 16, 0, code & 0xffff, ops[0].reg,
+                         &ops[0], &ops[1]);
+}
+
+static int encoder_movss(encoder_instr *e, encoder_operand *ops,
+                         unsigned int count, int code) {
+    (void)code;
+    if (count == 2 && ops[0].kind == ENCODER_MEMORY &&
+        encoder_is_xmm(&ops[1])) {
+        return encoder_modrm(e, 0xf3, 0, 0x0f11, ops[1].reg, &ops[1],
+                             &ops[0]);
+    }
+    return encoder_sse(e, ops, count, 0xf30f10);
+}
+
+// cvtsi2ss, from a general register or memory into an xmm register
+static int encoder_cvtsi2ss(encoder_instr *e, encoder_operand *ops,
+                            unsigned int count, int code) {
+    (void)code;
+    if (count != 2 || !encoder_is_xmm(&ops[0]) || encoder_is_xmm(&ops[1]) ||
+        ops[1].kind == ENCODER_IMMEDIATE || ops[1].size < 4) {
+        return 1;
+    }
+    return encoder_modrm(e, 0xf3, ops[1].size == 8, 0x0f2a, ops[0].reg,
+                         &ops[0], &ops[1]);
+}
+
+// cvttss2si, from an xmm register or memory into a general register
+static int encoder_cvttss2si(encoder_instr *e, encoder_operand *ops,
+                             unsigned int count, int code) {
+    (void)code;
+    if (count != 2 || !encoder_is_gpr(&ops[0]) || ops[0].size < 4 ||
+        encoder_is_gpr(&ops[1]) || ops[1].kind == ENCODER_IMMEDIATE) {
+        return 1;
+    }
+    return encoder_modrm(e, 0xf3, ops[0].size == 8, 0x0f2c, ops[0].reg,
+                         &ops[0], &ops[1]);
+}
+
+// movd and movq, between an xmm register and a general register or memory
+static int encoder_movd(encoder_instr *e, encoder_operand *ops,
+                        unsigned int count, int code) {
+    if (count != 2) {
+        return 1;
+    }
+    encoder_operand *xmm = &ops[0], *other = &ops[1];
+    unsigned int opcode = 0x0f6e;
+    if (!encoder_is_xmm(xmm)) {
+        xmm = &ops[1];
+        other = &ops[0];
+        opcode = 0x0f7e;
+    }
+    if (!encoder_is_xmm(xmm) || encoder_is_xmm(other) ||
+        other->kind == ENCODER_IMMEDIATE) {
+        return 1;
+    }
+    return encoder_modrm(e, 0x66, code == 8, opcode, xmm->reg, xmm, other);
+}
+
+static const encoder_entry encoder_table[] = {
+    {"add", encoder_alu, 0},
+    {"or", encoder_alu, 1},
+    {"adc", encoder_alu, 2},
+    {"sbb", encoder_alu, 3},
+    {"and", encoder_alu, 4},
+    {"sub", encoder_alu, 5},
+    {"xor", encoder_alu, 6},
+    {"cmp", encoder_alu, 7},
+    {"mov", encoder_mov, 0},
+    {"test", encoder_test, 0},
+    {"xchg", encoder_xchg, 0},
+    {"lea", encoder_lea, 0},
+    {"movzx", encoder_extend, 0x0fb6},
+    {"movsx", encoder_extend, 0x0fbe},
+    {"movsxd", encoder_movsxd, 0},
+    {"push", encoder_push, 0},
+    {"pop", encoder_pop, 0},
+    {"inc", encoder_unary, 0xfe00},
+    {"dec", encoder_unary, 0xfe01},
+    {"not", encoder_unary, 0xf602},
+    {"neg", encoder_unary, 0xf603},
+    {"mul", encoder_unary, 0xf604},
+    {"imul", encoder_imul, 0},
+    {"div", encoder_unary, 0xf606},
+    {"idiv", encoder_unary, 0xf607},
+    {"shl", encoder_shift, 4},
+    {"sal", encoder_shift, 4},
+    {"shr", encoder_shift, 5},
+    {"sar", encoder_shift, 7},
+    {"jmp", encoder_branch, 0xe9},
+    {"call", encoder_branch, 0xe8},
+    {"ret", encoder_plain, 0xc3},
+    {"leave", encoder_plain, 0xc9},
+    {"nop", encoder_plain, 0x90},
+    {"cdq", encoder_plain, 0x99},
+    {"cqo", encoder_plain, 0x4899},
+    {"syscall", encoder_plain, 0x0f05},
+    {"movss", encoder_movss, 0},
+    {"addss", encoder_sse, 0xf30f58},
+    {"subss", encoder_sse, 0xf30f5c},
+    {"mulss", encoder_sse, 0xf30f59},
+    {"divss", encoder_sse, 0xf30f5e},
+    {"ucomiss", encoder_sse, 0x0f2e},
+    {"pxor", encoder_sse, 0x660fef},
+    {"cvtsi2ss", encoder_cvtsi2ss, 0},
+    {"cvttss2si", encoder_cvttss2si, 0},
+    {"movd", encoder_movd, 4},
+    {"movq", encoder_movd, 8},
+};
+
+typedef struct encoder_condition {
+        const char *suffix;
+        int code;
+} encoder_condition;
+
+static const encoder_condition encoder_conditions[] = {
+    {"o", 0},    {"no", 1},  {"b", 2},   {"c", 2},   {"nae", 2}, {"ae", 3},
+    {"nb", 3},   {"nc", 3},  {"e", 4},   {"z", 4},   {"ne", 5},  {"nz", 5},
+    {"be", 6},   {"na", 6},  {"a", 7},   {"nbe", 7}, {"s", 8},   {"ns", 9},
+    {"p", 10},   {"pe", 10}, {"np", 11}, {"po", 11}, {"l", 12},  {"nge", 12},
+    {"ge", 13},  {"nl", 13}, {"le", 14}, {"ng", 14}, {"g", 15},  {"nle", 15},
+};
+
+// The encoder of the mnemonic: one of the table, or a conditional jump,
+// set or move with the condition in its suffix
+static int encoder_lookup(const char *mnemonic, encoder_entry *entry) {
+    size_t count = sizeof(encoder_table) / sizeof(encoder_table[0]);
+    for (size_t k = 0; k < count; k++) {
+        if (strcmp(encoder_table[k].mnemonic, mnemonic) == 0) {
+            *entry = encoder_table[k];
+            return 1;
+        }
+    }
+
+    static const encoder_entry families[] = {
+        {"j", encoder_jcc, 0},
+        {"set", encoder_setcc, 0},
+        {"cmov", encoder_cmovcc, 0},
+    };
+    size_t conditions = sizeof(encoder_conditions) / sizeof(encoder_conditions[0]);
+    for (size_t f = 0; f < 3; f++) {
+        size_t length = strlen(families[f].mnemonic);
+        if (strncmp(families[f].mnemonic, mnemonic, length) != 0) {
+            continue;
+        }
+        for (size_t c = 0; c < conditions; c++) {
+            if (strcmp(encoder_conditions[c].suffix, mnemonic + length) == 0) {
+                *entry = families[f];
+                entry->code = encoder_conditions[c].code;
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+// OBJECT
+
+static asm_section *encoder_current(asm_object *object) {
+    if (object->current < 0) {
+        DS_LOG_WARN("Code outside of a section");
+        return NULL;
+    }
+    return assembler_section(object, object->current);
+}
+
+static void encoder_reloc(asm_section *section, size_t offset,
+                          unsigned int type, encoder_value value) {
+    asm_reloc reloc = {.offset = offset,
+                       .type = type,
+                       .symbol = value.symbol,
+                       .addend = value.constant};
+    ds_dynamic_array_append(&section->relocs, &reloc);
+}
+
+static int encoder_instruction(asm_object *object, asm_instr *instr,
+                               encoder_entry *entry) {
+    int result = 0;
+    encoder_operand ops[ASM_MAX_OPERANDS];
+    encoder_instr e = {0};
+
+    asm_section *section = encoder_current(object);
+    if (section == NULL) {
+        return_defer(1);
+    }
+
+    for (unsigned int k = 0; k < instr->operand_count; k++) {
+        if (encoder_parse_operand(object, instr->operands[k], &ops[k]) != 0) {
+            DS_LOG_WARN("Invalid operand: %s", instr->text);
+            return_defer(1);
+        }
+    }
+    if (entry->encode(&e, ops, instr->operand_count, entry->code) != 0 ||
+        e.size > ENCODER_MAX_BYTES) {
+        DS_LOG_WARN("Invalid instruction: %s", instr->text);
+        return_defer(1);
+    }
+
+    // the relative addresses count from the end of the instruction
+    for (unsigned int k = 0; k < e.field_count; k++) {
+        encoder_field *field = &e.fields[k];
+        if (field->type == R_X86_64_PC32 || field->type == R_X86_64_PLT32) {
+            field->value.constant -= e.size - field->at;
+        }
+        encoder_reloc(section, section->size + field->at, field->type,
+                      field->value);
+    }
+    assembler_section_append(section, e.bytes, e.size);
+
+defer:
+    return result;
+}
+
+static int encoder_define(asm_object *object, const char *name,
+                          size_t length) {
+    asm_section *section = encoder_current(object);
+    if (section == NULL) {
+        return 1;
+    }
+
+    char *full = encoder_label_name(object, name, length);
+    asm_symbol *symbol = assembler_symbol(object,
+                                          assembler_symbol_get(object, full));
+    free(full);
+    if (symbol->kind != ASM_SYMBOL_UNDEFINED) {
+        DS_LOG_WARN("Duplicate label: %s", symbol->name);
+        return 1;
+    }
+
+    symbol->kind = ASM_SYMBOL_LABEL;
+    symbol->section = object->current;
+    symbol->value = section->size;
+    symbol->local = name[0] == '.';
+    if (!symbol->local) {
+        free(object->prefix);
+        object->prefix = strndup(name, length);
+    }
+    return 0;
+}
+
+// DIRECTIVES
+
+static const char *encoder_word(const char *at, size_t *length) {
+    while (isspace((unsigned char)*at)) {
+        at++;
+    }
+    *length = 0;
+    while (at[*length] != '\0' && !isspace((unsigned char)at[*length]) &&
+           at[*length] != ',') {
+        (*length)++;
+    }
+    return at;
+}
+
+static int encoder_is_word(const char *at, size_t length, const char *word) {
+    return strlen(word) == length && strncmp(at, word, length) == 0;
+}
+
+// The section of the name, which is created the first time; the lines of
+// all the sections of the same name go to the same one
+static int encoder_section(asm_object *object, const char *at) {
+    size_t length;
+    at = encoder_word(at, &length);
+    if (length < 2 || at[0] != '\'' || at[length - 1] != '\'') {
+        DS_LOG_WARN("Invalid section: %s", at);
+        return 1;
+    }
+    char *name = strndup(at + 1, length - 2);
+    at += length;
+
+    unsigned long flags = SHF_ALLOC;
+    if (strcmp(name, ".data") == 0) {
+        flags |= SHF_WRITE;
+    }
+    for (at = encoder_word(at, &length); length > 0;
+         at = encoder_word(at + length, &length)) {
+        if (encoder_is_word(at, length, "executable")) {
+            flags |= SHF_EXECINSTR;
+        } else if (encoder_is_word(at, length, "writeable")) {
+            flags |= SHF_WRITE;
+        } else if (!encoder_is_word(at, length, "readable")) {
+            DS_LOG_WARN("Invalid section flag: %.*s", (int)length, at);
+            free(name);
+            return 1;
+        }
+    }
+
+    for (unsigned int s = 0; s < object->sections.count; s++) {
+        asm_section *section = assembler_section(object, s);
+        if (strcmp(section->name, name) == 0) {
+            section->flags |= flags;
+            object->current = s;
+            free(name);
+            return 0;
+        }
+    }
+
+    asm_section section = {.name = name, .flags = flags};
+    ds_dynamic_array_init(&section.relocs, sizeof(asm_reloc));
+    ds_dynamic_array_append(&object->sections, &section);
+    object->current = object->sections.count - 1;
+    return 0;
+}
+
+// public and extrn, which make the symbols visible to the linker
+static int encoder_global(asm_object *object, const char *at) {
+    size_t length;
+    at = encoder_word(at, &length);
+    if (length == 0) {
+        DS_LOG_WARN("Missing symbol name");
+        return 1;
+    }
+
+    char *name = strndup(at, length);
+    assembler_symbol(object, assembler_symbol_get(object, name))->global = 1;
+    free(name);
+    return 0;
+}
+
+static int encoder_equate(asm_object *object, const char *name,
+                          size_t length, const char *at) {
+    encoder_value value;
+    if (encoder_parse_value(object, at, &value) != 0 || value.symbol >= 0) {
+        DS_LOG_WARN("Invalid constant: %.*s", (int)length, name);
+        return 1;
+    }
+
+    char *full = encoder_label_name(object, name, length);
+    asm_symbol *symbol = assembler_symbol(object,
+                                          assembler_symbol_get(object, full));
+    free(full);
+    if (symbol->kind == ASM_SYMBOL_LABEL) {
+        DS_LOG_WARN("Duplicate label: %s", symbol->name);
+        return 1;
+    }
+
+    symbol->kind = ASM_SYMBOL_EQUATE;
+    symbol->value = value.constant;
+    return 0;
+}
+
+// The width of the items of a data directive, which is negative for the
+// ones that only reserve the space
+static int encoder_data_width(const char *at, size_t length) {
+    static const char *define[] = {"db", "dw", "dd", "dq"};
+    static const char *reserve[] = {"rb", "rw", "rd", "rq"};
+    for (int k = 0; k < 4; k++) {
+        if (encoder_is_word(at, length, define[k])) {
+            return 1 << k;
+        }
+        if (encoder_is_word(at, length, reserve[k])) {
+            return -(1 << k);
+        }
+    }
+    return 0;
+}
+
+// A string in quotes, where a doubled quote stands for itself, padded with
+// zeros to a whole number of items
+static int encoder_string(asm_section *section, const char *start,
+                          const char *end, int width) {
+    static const unsigned char zeros[8] = {0};
+
+    char quote = start[0];
+    size_t size = 0;
+    for (const char *c = start + 1; c < end - 1; c++) {
+        if (*c == quote) {
+            c++;
+        }
+        assembler_section_append(section, c, 1);
+        size++;
+    }
+    if (size % width != 0 || size == 0) {
+        assembler_section_append(section, zeros, width - size % width);
+    }
+    return 0;
+}
+
+static int encoder_data(asm_object *object, int width, const char *at) {
+    static const unsigned char zeros[64] = {0};
+
+    asm_section *section = encoder_current(object);
+    if (section == NULL) {
+        return 1;
+    }
+
+    if (width < 0) {
+        encoder_value count;
+        if (encoder_parse_value(object, at, &count) != 0 ||
+            count.symbol >= 0 || count.constant < 0) {
+            DS_LOG_WARN("Invalid reservation: %s", at);
+            return 1;
+        }
+        for (long left = count.constant * -width; left > 0; left -= 64) {
+            assembler_section_append(section, zeros, left < 64 ? left : 64);
+        }
+        return 0;
+    }
+
+    while (*at != '\0') {
+        while (isspace((unsigned char)*at)) {
+            at++;
+        }
+
+        // the item ends at the next comma outside of the quotes
+        const char *end = at;
+        char quote = '\0';
+        while (*end != '\0' && (quote != '\0' || *end != ',')) {
+            if (quote == '\0' && (*end == '"' || *end == '\'')) {
+                quote = *end;
+            } else if (*end == quote && end[1] == quote) {
+                end++;
+            } else if (*end == quote) {
+                quote = '\0';
+            }
+            end++;
+        }
+        if (quote != '\0') {
+            DS_LOG_WARN("Unterminated string: %s", at);
+            return 1;
+        }
+
+        const char *last = end;
+        while (last > at && isspace((unsigned char)last[-1])) {
+            last--;
+        }
+
+        if (*at == '"' || *at == '\'') {
+            encoder_string(section, at, last, width);
+        } else {
+            char *item = strndup(at, last - at);
+            encoder_value value;
+            int invalid = encoder_parse_value(object, item, &value);
+            free(item);
+
+            encoder_instr e = {0};
+            unsigned int type = width == 8 ? R_X86_64_64 : R_X86_64_32;
+            if (invalid || (value.symbol >= 0 && width < 4) ||
+                encoder_value_field(&e, value, width, type) != 0) {
+                DS_LOG_WARN("Invalid data: %.*s", (int)(last - at), at);
+                return 1;
+            }
+            if (e.field_count > 0) {
+                encoder_reloc(section, section->size, type, value);
+            }
+            assembler_section_append(section, e.bytes, e.size);
+        }
+
+        at = *end == ',' ? end + 1 : end;
+    }
+    return 0;
+}
+
+// The lines that are not instructions: the sections, the symbols, the
+// constants and the data
+static int encoder_directive(asm_object *object, const char *text) {
+    size_t length;
+    const char *word = encoder_word(text, &length);
+    const char *rest = word + length;
+
+    if (encoder_is_word(word, length, "format")) {
+        return 0;
+    }
+    if (encoder_is_word(word, length, "section")) {
+        return encoder_section(object, rest);
+    }
+    if (encoder_is_word(word, length, "public") ||
+        encoder_is_word(word, length, "extrn")) {
+        return encoder_global(object, rest);
+    }
+
+    int width = encoder_data_width(word, length);
+    if (width != 0) {
+        return encoder_data(object, width, rest);
+    }
+
+    size_t next_length;
+    const char *next = encoder_word(rest, &next_length);
+    if (encoder_is_word(next, next_length, "=")) {
+        return encoder_equate(object, word, length, next + next_length);
+    }
+
+    width = encoder_data_width(next, next_length);
+    if (width != 0) {
+        return encoder_define(object, word, length) ||
+               encoder_data(object, width, next + next_length);
+    }
+
+    DS_LOG_WARN("Unknown instruction: %s", text);
+    return 1;
+}
+
+int assembler_object_emit(asm_object *object, asm_instr *instr) {
+    encoder_entry entry;
+
+    switch (instr->kind) {
+    case ASM_INSTR_NONE:
+    case ASM_INSTR_COMMENT:
+        return 0;
+    case ASM_INSTR_LABEL:
+        return encoder_define(object, instr->label, strlen(instr->label));
+    case ASM_INSTR_OP:
+        if (encoder_lookup(instr->mnemonic, &entry)) {
+            return encoder_instruction(object, instr, &entry);
+        }
+        return encoder_directive(object, instr->text);
+    case ASM_INSTR_OTHER:
+        return encoder_directive(object, instr->text);
+    }
+
+    return 0;
+}
+
+// The next line of the source, without the comment and the spaces around
+static const char *encoder_line(const char *at, const char **start,
+                                const char **stop) {
+    const char *end = strchr(at, '\n');
+    if (end == NULL) {
+        end = at + strlen(at);
+    }
+
+    // the comment starts at the first semicolon outside of the quotes
+    const char *c = at;
+    char quote = '\0';
+    while (c < end && (quote != '\0' || *c != ';')) {
+        if (quote == '\0' && (*c == '"' || *c == '\'')) {
+            quote = *c;
+        } else if (*c == quote) {
+            quote = '\0';
+        }
+        c++;
+    }
+    while (at < c && isspace((unsigned char)*at)) {
+        at++;
+    }
+    while (c > at && isspace((unsigned char)c[-1])) {
+        c--;
+    }
+
+    *start = at;
+    *stop = c;
+    return *end == '\0' ? end : end + 1;
+}
+
+// The constants of the source come first, because fasm lets the code use
+// them before their definition
+static void encoder_equates(asm_object *object, const char *source) {
+    const char *start, *stop;
+    for (const char *at = source; *at != '\0';) {
+        at = encoder_line(at, &start, &stop);
+
+        size_t length, next_length;
+        const char *word = encoder_word(start, &length);
+        const char *next = encoder_word(word + length, &next_length);
+        if (length == 0 || word[0] == '.' || next >= stop ||
+            !encoder_is_word(next, next_length, "=")) {
+            continue;
+        }
+
+        char *text = strndup(next + next_length, stop - next - next_length);
+        encoder_value value;
+        if (encoder_parse_value(object, text, &value) == 0 &&
+            value.symbol < 0) {
+            char *name = strndup(word, length);
+            asm_symbol *symbol =
+                assembler_symbol(object, assembler_symbol_get(object, name));
+            if (symbol->kind == ASM_SYMBOL_UNDEFINED) {
+                symbol->kind = ASM_SYMBOL_EQUATE;
+                symbol->value = value.constant;
+            }
+            free(name);
+        }
+        free(text);
+    }
+}
+
+// Encode the text of an assembly file, such as the runtime of the modules,
+// one line at a time
+int assembler_object_source(asm_object *object, const char *source) {
+    encoder_equates(object, source);
+
+    const char *start, *stop;
+    for (const char *at = source; *at != '\0';) {
+        at = encoder_line(at, &start, &stop);
+
+        // a label can share its line with an instruction
+        const char *colon = start;
+        while (colon < stop && encoder_is_name(*colon)) {
+            colon++;
+        }
+        if (colon > start && colon < stop && *colon == ':') {
+            if (encoder_define(object, start, colon - start) != 0) {
+                return 1;
+            }
+            start = colon + 1;
+            while (start < stop && isspace((unsigned char)*start)) {
+                start++;
+            }
+        }
+        if (start == stop) {
+            continue;
+        }
+
+        char *text = strndup(start, stop - start);
+        asm_instr instr;
+        assembler_instr_parse(&instr, 0, text, NULL);
+        free(text);
+
+        int failed = assembler_object_emit(object, &instr);
+        assembler_instr_free(&instr);
+        if (failed) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
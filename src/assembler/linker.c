@@ -0,0 +1,218 @@
+#include "assembler.h"
+#include "ds.h"
+#include <elf.h>
+#include <sys/stat.h>
+
+// The address that the program is loaded at, the one that ld uses for
+// static executables
+#define LINKER_BASE 0x400000
+#define LINKER_PAGE 0x1000
+
+#define LINKER_TEXT_ALIGN 16
+#define LINKER_DATA_ALIGN 8
+
+// The two segments of the program: the code, after the headers, and the
+// data, on their own pages
+enum linker_segment {
+    LINKER_SEGMENT_TEXT,
+    LINKER_SEGMENT_DATA,
+    LINKER_SEGMENT_COUNT,
+};
+
+typedef struct linker_layout {
+        size_t *offsets; // the place of every section in the file
+        size_t starts[LINKER_SEGMENT_COUNT];
+        size_t ends[LINKER_SEGMENT_COUNT];
+} linker_layout;
+
+static size_t linker_align(size_t value, size_t align) {
+    return (value + align - 1) / align * align;
+}
+
+static enum linker_segment linker_section_segment(asm_section *section) {
+    return section->flags & SHF_EXECINSTR ? LINKER_SEGMENT_TEXT
+                                          : LINKER_SEGMENT_DATA;
+}
+
+// Place the sections of each segment one after the other, the code right
+// after the headers and the data on the next page
+static void linker_layout_sections(asm_object *object, linker_layout *layout,
+                                   size_t headers) {
+    size_t offset = headers;
+    for (int segment = 0; segment < LINKER_SEGMENT_COUNT; segment++) {
+        if (segment == LINKER_SEGMENT_DATA) {
+            offset = linker_align(offset, LINKER_PAGE);
+        }
+        layout->starts[segment] = segment == LINKER_SEGMENT_TEXT ? 0 : offset;
+
+        for (unsigned int s = 0; s < object->sections.count; s++) {
+            asm_section *section = assembler_section(object, s);
+            if ((int)linker_section_segment(section) != segment) {
+                continue;
+            }
+
+            offset = linker_align(offset, segment == LINKER_SEGMENT_TEXT
+                                              ? LINKER_TEXT_ALIGN
+                                              : LINKER_DATA_ALIGN);
+            layout->offsets[s] = offset;
+            offset += section->size;
+        }
+        layout->ends[segment] = offset;
+    }
+}
+
+static void linker_write_int(unsigned char *at, long value, size_t size) {
+    for (size_t k = 0; k < size; k++) {
+        at[k] = (value >> (8 * k)) & 0xff;
+    }
+}
+
+// Apply the relocations that are left after the object resolved its own,
+// now that every section has its address
+static int linker_relocate(asm_object *object, linker_layout *layout) {
+    int result = 0;
+
+    for (unsigned int s = 0; s < object->sections.count; s++) {
+        asm_section *section = assembler_section(object, s);
+        for (unsigned int r = 0; r < section->relocs.count; r++) {
+            asm_reloc reloc;
+            ds_dynamic_array_get(&section->relocs, r, &reloc);
+            asm_symbol *symbol = assembler_symbol(object, reloc.symbol);
+
+            if (symbol->kind != ASM_SYMBOL_LABEL) {
+                DS_LOG_ERROR("Undefined symbol: %s", symbol->name);
+                return_defer(1);
+            }
+
+            long target = LINKER_BASE + layout->offsets[symbol->section] +
+                          symbol->value + reloc.addend;
+            long place = LINKER_BASE + layout->offsets[s] + reloc.offset;
+            unsigned char *at = section->bytes + reloc.offset;
+
+            long value = target;
+            int fits = 1;
+            switch (reloc.type) {
+            case R_X86_64_64:
+                linker_write_int(at, value, 8);
+                continue;
+            case R_X86_64_PC32:
+            case R_X86_64_PLT32:
+                value = target - place;
+                fits = value >= INT32_MIN && value <= INT32_MAX;
+                break;
+            case R_X86_64_32:
+                fits = value >= 0 && value <= UINT32_MAX;
+                break;
+            case R_X86_64_32S:
+                fits = value >= INT32_MIN && value <= INT32_MAX;
+                break;
+            default:
+                DS_LOG_ERROR("Unsupported relocation: %u", reloc.type);
+                return_defer(1);
+            }
+
+            if (!fits) {
+                DS_LOG_ERROR("Relocation out of range: %s", symbol->name);
+                return_defer(1);
+            }
+            linker_write_int(at, value, 4);
+        }
+    }
+
+defer:
+    return result;
+}
+
+// Link the object into a static executable that starts at _start, for the
+// programs that do not need any library
+int assembler_object_link(asm_object *object, const char *filename) {
+    int result = 0;
+    FILE *file = NULL;
+    unsigned char *bytes = NULL;
+
+    linker_layout layout = {0};
+    layout.offsets = calloc(object->sections.count + 1, sizeof(size_t));
+
+    if (assembler_object_resolve(object) != 0) {
+        return_defer(1);
+    }
+
+    int entry = assembler_symbol_find(object, "_start");
+    if (entry < 0 || assembler_symbol(object, entry)->kind != ASM_SYMBOL_LABEL) {
+        DS_LOG_ERROR("Undefined symbol: _start");
+        return_defer(1);
+    }
+
+    size_t headers =
+        sizeof(Elf64_Ehdr) + LINKER_SEGMENT_COUNT * sizeof(Elf64_Phdr);
+    linker_layout_sections(object, &layout, headers);
+    if (linker_relocate(object, &layout) != 0) {
+        return_defer(1);
+    }
+
+    // the headers, then the sections at their offsets with zeros between
+    size_t size = layout.ends[LINKER_SEGMENT_DATA];
+    bytes = calloc(size, 1);
+
+    asm_symbol *start = assembler_symbol(object, entry);
+    Elf64_Ehdr ehdr = {0};
+    memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+    ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+    ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    ehdr.e_type = ET_EXEC;
+    ehdr.e_machine = EM_X86_64;
+    ehdr.e_version = EV_CURRENT;
+    ehdr.e_entry = LINKER_BASE + layout.offsets[start->section] + start->value;
+    ehdr.e_phoff = sizeof(Elf64_Ehdr);
+    ehdr.e_ehsize = sizeof(Elf64_Ehdr);
+    ehdr.e_phentsize = sizeof(Elf64_Phdr);
+    ehdr.e_phnum = LINKER_SEGMENT_COUNT;
+    memcpy(bytes, &ehdr, sizeof(ehdr));
+
+    for (int segment = 0; segment < LINKER_SEGMENT_COUNT; segment++) {
+        size_t offset = layout.starts[segment];
+        size_t length = layout.ends[segment] - offset;
+        Elf64_Phdr phdr = {
+            .p_type = PT_LOAD,
+            .p_flags = segment == LINKER_SEGMENT_TEXT ? PF_R | PF_X
+                                                      : PF_R | PF_W,
+            .p_offset = offset,
+            .p_vaddr = LINKER_BASE + offset,
+            .p_paddr = LINKER_BASE + offset,
+            .p_filesz = length,
+            .p_memsz = length,
+            .p_align = LINKER_PAGE,
+        };
+        memcpy(bytes + sizeof(Elf64_Ehdr) + segment * sizeof(phdr), &phdr,
+               sizeof(phdr));
+    }
+
+    for (unsigned int s = 0; s < object->sections.count; s++) {
+        asm_section *section = assembler_section(object, s);
+        memcpy(bytes + layout.offsets[s], section->bytes, section->size);
+    }
+
+    file = fopen(filename, "wb");
+    if (file == NULL) {
+        DS_LOG_ERROR("Failed to open file: %s", filename);
+        return_defer(1);
+    }
+    if (fwrite(bytes, 1, size, file) != size) {
+        DS_LOG_ERROR("Failed to write file: %s", filename);
+        return_defer(1);
+    }
+    if (chmod(filename, 0755) != 0) {
+        DS_LOG_ERROR("Failed to make the file executable: %s", filename);
+        return_defer(1);
+    }
+
+defer:
+    if (file != NULL) {
+        fclose(file);
+    }
+    free(layout.offsets);
+    free(bytes);
+    return result;
+}
@@ -0,0 +1,380 @@
+#include "assembler.h"
+#include "ds.h"
+#include <elf.h>
+
+#define OBJECT_INDEX_CAPACITY 4096
+
+// The alignment of the sections, which keeps every routine and quad word
+// of the runtime where the external assembler would put them
+#define OBJECT_TEXT_ALIGN 16
+#define OBJECT_DATA_ALIGN 8
+
+static unsigned int object_name_hash(const void *key) {
+    const char *name = *(const char **)key;
+
+    unsigned int hash = 5381;
+    while (*name != '\0') {
+        hash = hash * 33 + (unsigned char)*name++;
+    }
+
+    return hash;
+}
+
+static int object_name_compare(const void *lhs, const void *rhs) {
+    return strcmp(*(const char **)lhs, *(const char **)rhs);
+}
+
+void assembler_object_init(asm_object *object) {
+    ds_dynamic_array_init(&object->sections, sizeof(asm_section));
+    ds_dynamic_array_init(&object->symbols, sizeof(asm_symbol));
+    ds_hash_table_init(&object->index, sizeof(const char *), sizeof(int),
+                       OBJECT_INDEX_CAPACITY, object_name_hash,
+                       object_name_compare);
+    object->current = -1;
+    object->prefix = NULL;
+}
+
+asm_symbol *assembler_symbol(asm_object *object, unsigned int index) {
+    asm_symbol *symbol = NULL;
+    ds_dynamic_array_get_ref(&object->symbols, index, (void **)&symbol);
+    return symbol;
+}
+
+asm_section *assembler_section(asm_object *object, unsigned int index) {
+    asm_section *section = NULL;
+    ds_dynamic_array_get_ref(&object->sections, index, (void **)&section);
+    return section;
+}
+
+int assembler_symbol_find(asm_object *object, const char *name) {
+    int index = -1;
+    ds_hash_table_get(&object->index, &name, &index);
+    return index;
+}
+
+// The symbol of the name, which is created undefined the first time
+unsigned int assembler_symbol_get(asm_object *object, const char *name) {
+    int index = assembler_symbol_find(object, name);
+    if (index >= 0) {
+        return index;
+    }
+
+    asm_symbol symbol = {.name = strdup(name),
+                         .kind = ASM_SYMBOL_UNDEFINED,
+                         .section = -1};
+    ds_dynamic_array_append(&object->symbols, &symbol);
+
+    index = object->symbols.count - 1;
+    ds_hash_table_insert(&object->index, &symbol.name, &index);
+    return index;
+}
+
+void assembler_section_append(asm_section *section, const void *bytes,
+                              size_t size) {
+    if (section->size + size > section->capacity) {
+        size_t capacity = section->capacity == 0 ? 4096 : section->capacity;
+        while (capacity < section->size + size) {
+            capacity *= 2;
+        }
+        section->bytes = realloc(section->bytes, capacity);
+        section->capacity = capacity;
+    }
+
+    memcpy(section->bytes + section->size, bytes, size);
+    section->size += size;
+}
+
+static void object_write_int(unsigned char *at, long value, size_t size) {
+    for (size_t k = 0; k < size; k++) {
+        at[k] = (value >> (8 * k)) & 0xff;
+    }
+}
+
+static int object_is_relative(unsigned int type) {
+    return type == R_X86_64_PC32 || type == R_X86_64_PLT32;
+}
+
+// Resolve the relocations that do not need a linker: the jumps and the
+// relative addresses within a section, and the equates. The ones that are
+// left refer to a label or to a symbol of another object.
+int assembler_object_resolve(asm_object *object) {
+    int result = 0;
+
+    for (unsigned int s = 0; s < object->sections.count; s++) {
+        asm_section *section = assembler_section(object, s);
+
+        unsigned int kept = 0;
+        for (unsigned int r = 0; r < section->relocs.count; r++) {
+            asm_reloc *reloc = NULL;
+            ds_dynamic_array_get_ref(&section->relocs, r, (void **)&reloc);
+            asm_symbol *symbol = assembler_symbol(object, reloc->symbol);
+            unsigned char *at = section->bytes + reloc->offset;
+
+            if (symbol->kind == ASM_SYMBOL_UNDEFINED && !symbol->global) {
+                DS_LOG_ERROR("Undefined symbol: %s", symbol->name);
+                return_defer(1);
+            }
+
+            if (symbol->kind == ASM_SYMBOL_EQUATE) {
+                if (object_is_relative(reloc->type)) {
+                    DS_LOG_ERROR("Relative address of a constant: %s",
+                                 symbol->name);
+                    return_defer(1);
+                }
+                object_write_int(at, symbol->value + reloc->addend,
+                                 reloc->type == R_X86_64_64 ? 8 : 4);
+                continue;
+            }
+
+            if (symbol->kind == ASM_SYMBOL_LABEL && symbol->section == (int)s &&
+                object_is_relative(reloc->type)) {
+                long value = symbol->value + reloc->addend - (long)reloc->offset;
+                object_write_int(at, value, 4);
+                continue;
+            }
+
+            asm_reloc *target = NULL;
+            ds_dynamic_array_get_ref(&section->relocs, kept++, (void **)&target);
+            *target = *reloc;
+        }
+        section->relocs.count = kept;
+    }
+
+defer:
+    return result;
+}
+
+static void object_buffer_align(asm_section *buffer, size_t align) {
+    static const unsigned char zeros[16] = {0};
+    if (buffer->size % align != 0) {
+        assembler_section_append(buffer, zeros, align - buffer->size % align);
+    }
+}
+
+static unsigned int object_string(asm_section *strtab, const char *name) {
+    unsigned int offset = strtab->size;
+    assembler_section_append(strtab, name, strlen(name) + 1);
+    return offset;
+}
+
+// The ELF symbol of every symbol of the object that goes into the table:
+// the section symbols come first, then the labels without a dot, then the
+// public and external symbols
+static void object_build_symtab(asm_object *object, asm_section *symtab,
+                                asm_section *strtab, unsigned int *elf_index,
+                                unsigned int *first_global) {
+    Elf64_Sym null = {0};
+    assembler_section_append(symtab, &null, sizeof(null));
+    object_string(strtab, "");
+
+    unsigned int count = 1;
+    for (unsigned int s = 0; s < object->sections.count; s++) {
+        Elf64_Sym sym = {.st_info = ELF64_ST_INFO(STB_LOCAL, STT_SECTION),
+                         .st_shndx = s + 1};
+        assembler_section_append(symtab, &sym, sizeof(sym));
+        count++;
+    }
+
+    for (int global = 0; global <= 1; global++) {
+        if (global) {
+            *first_global = count;
+        }
+        for (unsigned int i = 0; i < object->symbols.count; i++) {
+            asm_symbol *symbol = assembler_symbol(object, i);
+            if (symbol->global != global ||
+                symbol->kind == ASM_SYMBOL_EQUATE || symbol->local ||
+                (!global && symbol->kind != ASM_SYMBOL_LABEL)) {
+                continue;
+            }
+
+            int defined = symbol->kind == ASM_SYMBOL_LABEL;
+            Elf64_Sym sym = {
+                .st_name = object_string(strtab, symbol->name),
+                .st_info = ELF64_ST_INFO(global ? STB_GLOBAL : STB_LOCAL,
+                                         STT_NOTYPE),
+                .st_shndx = defined ? symbol->section + 1 : SHN_UNDEF,
+                .st_value = defined ? symbol->value : 0,
+            };
+            assembler_section_append(symtab, &sym, sizeof(sym));
+            elf_index[i] = count++;
+        }
+    }
+}
+
+int assembler_object_write(asm_object *object, const char *filename) {
+    int result = 0;
+    FILE *file = NULL;
+
+    unsigned int *elf_index = NULL;
+    asm_section symtab = {0}, strtab = {0}, shstrtab = {0}, body = {0};
+    ds_dynamic_array headers;
+    ds_dynamic_array_init(&headers, sizeof(Elf64_Shdr));
+
+    if (assembler_object_resolve(object) != 0) {
+        return_defer(1);
+    }
+
+    elf_index = calloc(object->symbols.count + 1, sizeof(unsigned int));
+    unsigned int first_global = 0;
+    object_build_symtab(object, &symtab, &strtab, elf_index, &first_global);
+
+    // the section headers: the null one, the sections of the object, their
+    // relocations and the tables of symbols and names
+    unsigned int sections = object->sections.count;
+    unsigned int rela_count = 0;
+    for (unsigned int s = 0; s < sections; s++) {
+        rela_count += assembler_section(object, s)->relocs.count > 0;
+    }
+    unsigned int symtab_index = 1 + sections + rela_count;
+
+    Elf64_Shdr null = {0};
+    ds_dynamic_array_append(&headers, &null);
+    object_string(&shstrtab, "");
+
+    // the contents follow the ELF header, each at its alignment
+    Elf64_Ehdr ehdr = {0};
+    unsigned char zeros[sizeof(Elf64_Ehdr)] = {0};
+    assembler_section_append(&body, zeros, sizeof(zeros));
+
+    for (unsigned int s = 0; s < sections; s++) {
+        asm_section *section = assembler_section(object, s);
+        int text = section->flags & SHF_EXECINSTR;
+        size_t align = text ? OBJECT_TEXT_ALIGN : OBJECT_DATA_ALIGN;
+
+        object_buffer_align(&body, align);
+        Elf64_Shdr shdr = {.sh_name = object_string(&shstrtab, section->name),
+                           .sh_type = SHT_PROGBITS,
+                           .sh_flags = section->flags,
+                           .sh_offset = body.size,
+                           .sh_size = section->size,
+                           .sh_addralign = align};
+        assembler_section_append(&body, section->bytes, section->size);
+        ds_dynamic_array_append(&headers, &shdr);
+    }
+
+    for (unsigned int s = 0; s < sections; s++) {
+        asm_section *section = assembler_section(object, s);
+        if (section->relocs.count == 0) {
+            continue;
+        }
+
+        char *name = malloc(strlen(section->name) + 6);
+        sprintf(name, ".rela%s", section->name);
+        object_buffer_align(&body, 8);
+        Elf64_Shdr shdr = {.sh_name = object_string(&shstrtab, name),
+                           .sh_type = SHT_RELA,
+                           .sh_flags = SHF_INFO_LINK,
+                           .sh_offset = body.size,
+                           .sh_size = section->relocs.count * sizeof(Elf64_Rela),
+                           .sh_link = symtab_index,
+                           .sh_info = s + 1,
+                           .sh_addralign = 8,
+                           .sh_entsize = sizeof(Elf64_Rela)};
+        free(name);
+
+        // a label stands for its section, at its offset
+        for (unsigned int r = 0; r < section->relocs.count; r++) {
+            asm_reloc reloc;
+            ds_dynamic_array_get(&section->relocs, r, &reloc);
+            asm_symbol *symbol = assembler_symbol(object, reloc.symbol);
+
+            unsigned int index = elf_index[reloc.symbol];
+            long addend = reloc.addend;
+            if (!symbol->global) {
+                index = 1 + symbol->section;
+                addend += symbol->value;
+            }
+
+            Elf64_Rela rela = {.r_offset = reloc.offset,
+                               .r_info = ELF64_R_INFO(index, reloc.type),
+                               .r_addend = addend};
+            assembler_section_append(&body, &rela, sizeof(rela));
+        }
+        ds_dynamic_array_append(&headers, &shdr);
+    }
+
+    object_buffer_align(&body, 8);
+    Elf64_Shdr symtab_header = {.sh_name = object_string(&shstrtab, ".symtab"),
+                                .sh_type = SHT_SYMTAB,
+                                .sh_offset = body.size,
+                                .sh_size = symtab.size,
+                                .sh_link = symtab_index + 1,
+                                .sh_info = first_global,
+                                .sh_addralign = 8,
+                                .sh_entsize = sizeof(Elf64_Sym)};
+    assembler_section_append(&body, symtab.bytes, symtab.size);
+    ds_dynamic_array_append(&headers, &symtab_header);
+
+    Elf64_Shdr strtab_header = {.sh_name = object_string(&shstrtab, ".strtab"),
+                                .sh_type = SHT_STRTAB,
+                                .sh_offset = body.size,
+                                .sh_size = strtab.size,
+                                .sh_addralign = 1};
+    assembler_section_append(&body, strtab.bytes, strtab.size);
+    ds_dynamic_array_append(&headers, &strtab_header);
+
+    Elf64_Shdr shstrtab_header = {
+        .sh_name = object_string(&shstrtab, ".shstrtab"),
+        .sh_type = SHT_STRTAB,
+        .sh_offset = body.size,
+        .sh_size = shstrtab.size,
+        .sh_addralign = 1};
+    assembler_section_append(&body, shstrtab.bytes, shstrtab.size);
+    ds_dynamic_array_append(&headers, &shstrtab_header);
+
+    object_buffer_align(&body, 8);
+    memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+    ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+    ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    ehdr.e_type = ET_REL;
+    ehdr.e_machine = EM_X86_64;
+    ehdr.e_version = EV_CURRENT;
+    ehdr.e_shoff = body.size;
+    ehdr.e_ehsize = sizeof(Elf64_Ehdr);
+    ehdr.e_shentsize = sizeof(Elf64_Shdr);
+    ehdr.e_shnum = headers.count;
+    ehdr.e_shstrndx = headers.count - 1;
+    memcpy(body.bytes, &ehdr, sizeof(ehdr));
+    assembler_section_append(&body, headers.items,
+                             headers.count * sizeof(Elf64_Shdr));
+
+    file = fopen(filename, "wb");
+    if (file == NULL) {
+        DS_LOG_ERROR("Failed to open file: %s", filename);
+        return_defer(1);
+    }
+    if (fwrite(body.bytes, 1, body.size, file) != body.size) {
+        DS_LOG_ERROR("Failed to write file: %s", filename);
+        return_defer(1);
+    }
+
+defer:
+    if (file != NULL) {
+        fclose(file);
+    }
+    free(elf_index);
+    free(symtab.bytes);
+    free(strtab.bytes);
+    free(shstrtab.bytes);
+    free(body.bytes);
+    ds_dynamic_array_free(&headers);
+    return result;
+}
+
+void assembler_object_free(asm_object *object) {
+    for (unsigned int s = 0; s < object->sections.count; s++) {
+        asm_section *section = assembler_section(object, s);
+        free(section->name);
+        free(section->bytes);
+        ds_dynamic_array_free(&section->relocs);
+    }
+    for (unsigned int i = 0; i < object->symbols.count; i++) {
+        free(assembler_symbol(object, i)->name);
+    }
+    ds_dynamic_array_free(&object->sections);
+    ds_dynamic_array_free(&object->symbols);
+    ds_hash_table_free(&object->index);
+    free(object->prefix);
+}
@@ -0,0 +1,671 @@
+#include "assembler.h"
+#include "ds.h"
+#include <ctype.h>
+
+// The most instructions that a pattern matches
+#define PEEPHOLE_MAX_PATTERN 4
+
+// How far a register is followed to find out that it is dead
+#define PEEPHOLE_WINDOW 16
+
+#define PEEPHOLE_VARIABLES 26
+
+// A rule rewrites a sequence of instructions into a shorter one. The
+// instructions of the pattern and of the replacement are separated by `;`
+// and written the way the assembler emits them. In a pattern `%n` and `%m`
+// match an integer, `%r` a register, `%c` the letters of a condition code,
+// `%l` a label and any other letter any text, and a letter matches the same
+// text everywhere in the rule. `{%n+%m}` in a replacement is the sum of the
+// integers. The conditions, also separated by `;`, are `dead rax`, when the
+// instructions after the pattern write the register before they read it,
+// and `%a free rdi`, when the text of `%a` does not name the register.
+typedef struct peephole_source {
+        const char *name;
+        const char *pattern;
+        const char *replacement;
+        const char *condition;
+} peephole_source;
+
+static const peephole_source peephole_sources[] = {
+    // the value that was just stored is still in rax
+    {"store-load", "mov %a, rax; mov rax, %a", "mov %a, rax", NULL},
+    // an attribute read through the address of its slot
+    {"load-field", "add rax, %n; mov rax, qword [rax]",
+     "mov rax, qword [rax+%n]", NULL},
+    // an attribute written through the address of its slot
+    {"store-field", "add rdi, %n; mov qword [rdi], rax",
+     "mov qword [rdi+%n], rax", "dead rdi"},
+    // the object in rdi and the value in rax, loaded the other way around
+    {"swap-load", "mov rdi, rax; mov rax, %a; xchg rdi, rax", "mov rdi, %a",
+     "%a free rdi"},
+    // setcc already writes 0 or 1
+    {"setcc-mask", "set%c al; and al, 1; movzx rax, al",
+     "set%c al; movzx rax, al", NULL},
+    // the arguments of a call and the padding that aligns them
+    {"stack-adjust", "add rsp, %n; add rsp, %m", "add rsp, {%n+%m}", NULL},
+    {"stack-zero", "add rsp, 0", "", NULL},
+    {"frame-zero", "sub rsp, 0", "", NULL},
+    // values that go through rax on the way to somewhere else
+    {"copy-through", "mov rax, %a; mov %r, rax", "mov %r, %a", "dead rax"},
+    {"spill-through", "mov rax, %r; mov %a, rax", "mov %a, %r",
+     "dead rax; %a free rax"},
+    {"push-register", "mov rax, %r; push rax", "push %r", "dead rax"},
+    {"push-memory", "mov rax, qword %a; push rax", "push qword %a",
+     "dead rax"},
+    // a jump to the next instruction
+    {"jump-next", "jmp %l; %l:", "%l:", NULL},
+};
+
+#define PEEPHOLE_RULES (sizeof(peephole_sources) / sizeof(peephole_sources[0]))
+
+typedef struct asm_peephole_rule {
+        const peephole_source *source;
+        ds_dynamic_array pattern;      // asm_instr
+        ds_dynamic_array replacement;  // char *
+} asm_peephole_rule;
+
+// The text that each letter matched, NULL while it is unbound
+typedef struct peephole_bindings {
+        const char *start[PEEPHOLE_VARIABLES];
+        size_t length[PEEPHOLE_VARIABLES];
+} peephole_bindings;
+
+// Every name of a register, the 64 and 32 bit ones first, which are the
+// ones that an instruction writes in full
+static const char *peephole_registers[][5] = {
+    {"rax", "eax", "ax", "al", "ah"},   {"rbx", "ebx", "bx", "bl", "bh"},
+    {"rcx", "ecx", "cx", "cl", "ch"},   {"rdx", "edx", "dx", "dl", "dh"},
+    {"rsi", "esi", "si", "sil", NULL},  {"rdi", "edi", "di", "dil", NULL},
+    {"rbp", "ebp", "bp", "bpl", NULL},  {"rsp", "esp", "sp", "spl", NULL},
+    {"r8", "r8d", "r8w", "r8b", NULL},  {"r9", "r9d", "r9w", "r9b", NULL},
+    {"r10", "r10d", "r10w", "r10b", NULL}, {"r11", "r11d", "r11w", "r11b", NULL},
+    {"r12", "r12d", "r12w", "r12b", NULL}, {"r13", "r13d", "r13w", "r13b", NULL},
+    {"r14", "r14d", "r14w", "r14b", NULL}, {"r15", "r15d", "r15w", "r15b", NULL},
+};
+
+#define PEEPHOLE_REGISTERS                                                     \
+    (sizeof(peephole_registers) / sizeof(peephole_registers[0]))
+
+static char *peephole_strndup(const char *text, size_t length) {
+    char *copy = malloc(length + 1);
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+static char *peephole_trim(const char *start, const char *end) {
+    while (start < end && isspace((unsigned char)*start)) {
+        start++;
+    }
+    while (end > start && isspace((unsigned char)end[-1])) {
+        end--;
+    }
+    return peephole_strndup(start, end - start);
+}
+
+void assembler_instr_parse(asm_instr *instr, int align, const char *text,
+                           const char *comment) {
+    *instr = (asm_instr){.kind = ASM_INSTR_OTHER,
+                         .align = align,
+                         .text = strdup(text),
+                         .comment = comment != NULL ? strdup(comment) : NULL};
+
+    size_t length = strlen(text);
+    if (text[0] == ';') {
+        instr->kind = ASM_INSTR_COMMENT;
+        return;
+    }
+    if (length > 1 && text[length - 1] == ':' && strchr(text, ' ') == NULL) {
+        instr->kind = ASM_INSTR_LABEL;
+        instr->label = peephole_strndup(text, length - 1);
+        return;
+    }
+
+    const char *operands = text;
+    while (*operands != '\0' && !isspace((unsigned char)*operands)) {
+        operands++;
+    }
+    if (operands == text) {
+        return;
+    }
+
+    // the operands are separated by the commas outside of the brackets,
+    // and a line with more of them is a directive
+    const char *starts[ASM_MAX_OPERANDS + 1];
+    const char *ends[ASM_MAX_OPERANDS + 1];
+    unsigned int count = 0;
+    const char *start = operands;
+    int depth = 0;
+    for (const char *c = operands;; c++) {
+        if (*c == '[') {
+            depth++;
+        } else if (*c == ']') {
+            depth--;
+        } else if (*c == '"' || *c == '\'') {
+            return;
+        }
+
+        if ((*c == ',' && depth == 0) || *c == '\0') {
+            if (count == ASM_MAX_OPERANDS) {
+                return;
+            }
+            starts[count] = start;
+            ends[count] = c;
+            count++;
+            start = c + 1;
+        }
+        if (*c == '\0') {
+            break;
+        }
+    }
+
+    instr->kind = ASM_INSTR_OP;
+    instr->mnemonic = peephole_strndup(text, operands - text);
+    for (unsigned int k = 0; k < count; k++) {
+        instr->operands[k] = peephole_trim(starts[k], ends[k]);
+    }
+    instr->operand_count = count;
+    if (count == 1 && instr->operands[0][0] == '\0') {
+        free(instr->operands[0]);
+        instr->operands[0] = NULL;
+        instr->operand_count = 0;
+    }
+}
+
+void assembler_instr_free(asm_instr *instr) {
+    free(instr->text);
+    free(instr->mnemonic);
+    for (unsigned int k = 0; k < instr->operand_count; k++) {
+        free(instr->operands[k]);
+    }
+    free(instr->label);
+    free(instr->comment);
+    *instr = (asm_instr){.kind = ASM_INSTR_NONE};
+}
+
+// The text of an instruction that the pass built, in the layout of the
+// ones that the assembler emits
+static void peephole_format(asm_instr *instr) {
+    if (instr->kind != ASM_INSTR_OP) {
+        return;
+    }
+
+    ds_string_builder sb;
+    ds_string_builder_init(&sb);
+    if (instr->operand_count == 0) {
+        ds_string_builder_append(&sb, "%s", instr->mnemonic);
+    } else {
+        ds_string_builder_append(&sb, "%-7s", instr->mnemonic);
+    }
+    for (unsigned int k = 0; k < instr->operand_count; k++) {
+        ds_string_builder_append(&sb, "%s%s", k == 0 ? " " : ", ",
+                                 instr->operands[k]);
+    }
+
+    free(instr->text);
+    ds_string_builder_build(&sb, &instr->text);
+    ds_string_builder_free(&sb);
+}
+
+static int peephole_register_index(const char *text, size_t length) {
+    for (unsigned int r = 0; r < PEEPHOLE_REGISTERS; r++) {
+        if (strlen(peephole_registers[r][0]) == length &&
+            strncmp(peephole_registers[r][0], text, length) == 0) {
+            return r;
+        }
+    }
+    return -1;
+}
+
+static int peephole_is_word(char c) {
+    return isalnum((unsigned char)c) || c == '_' || c == '.';
+}
+
+// Whether the text names the register, by any of its names
+static int peephole_mentions(const char *text, int reg) {
+    for (unsigned int k = 0; k < 5; k++) {
+        const char *name = peephole_registers[reg][k];
+        if (name == NULL) {
+            continue;
+        }
+
+        size_t length = strlen(name);
+        for (const char *at = strstr(text, name); at != NULL;
+             at = strstr(at + 1, name)) {
+            if ((at == text || !peephole_is_word(at[-1])) &&
+                !peephole_is_word(at[length])) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static int peephole_fits(char variable, const char *text, size_t length) {
+    switch (variable) {
+    case 'n':
+    case 'm': {
+        size_t k = text[0] == '-';
+        if (k == length) {
+            return 0;
+        }
+        for (; k < length; k++) {
+            if (!isdigit((unsigned char)text[k])) {
+                return 0;
+            }
+        }
+        return 1;
+    }
+    case 'r':
+        return peephole_register_index(text, length) >= 0;
+    case 'c':
+        for (size_t k = 0; k < length; k++) {
+            if (!islower((unsigned char)text[k])) {
+                return 0;
+            }
+        }
+        return 1;
+    case 'l':
+        for (size_t k = 0; k < length; k++) {
+            if (!peephole_is_word(text[k])) {
+                return 0;
+            }
+        }
+        return 1;
+    default:
+        return 1;
+    }
+}
+
+static int peephole_match_text(const char *pattern, const char *text,
+                               peephole_bindings *bindings) {
+    if (*pattern == '\0') {
+        return *text == '\0';
+    }
+
+    if (*pattern == '%' && islower((unsigned char)pattern[1])) {
+        int variable = pattern[1] - 'a';
+        if (bindings->start[variable] != NULL) {
+            size_t length = bindings->length[variable];
+            return strncmp(text, bindings->start[variable], length) == 0 &&
+                   peephole_match_text(pattern + 2, text + length, bindings);
+        }
+
+        size_t size = strlen(text);
+        for (size_t length = 1; length <= size; length++) {
+            if (!peephole_fits(pattern[1], text, length)) {
+                continue;
+            }
+            bindings->start[variable] = text;
+            bindings->length[variable] = length;
+            if (peephole_match_text(pattern + 2, text + length, bindings)) {
+                return 1;
+            }
+        }
+        bindings->start[variable] = NULL;
+        return 0;
+    }
+
+    return *pattern == *text &&
+           peephole_match_text(pattern + 1, text + 1, bindings);
+}
+
+static int peephole_match_instr(asm_instr *pattern, asm_instr *instr,
+                                peephole_bindings *bindings) {
+    if (pattern->kind != instr->kind) {
+        return 0;
+    }
+    if (pattern->kind == ASM_INSTR_LABEL) {
+        return peephole_match_text(pattern->label, instr->label, bindings);
+    }
+
+    if (pattern->operand_count != instr->operand_count ||
+        !peephole_match_text(pattern->mnemonic, instr->mnemonic, bindings)) {
+        return 0;
+    }
+    for (unsigned int k = 0; k < pattern->operand_count; k++) {
+        if (!peephole_match_text(pattern->operands[k], instr->operands[k],
+                                 bindings)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static asm_instr *peephole_instr(ds_dynamic_array *instrs, unsigned int index) {
+    asm_instr *instr = NULL;
+    ds_dynamic_array_get_ref(instrs, index, (void **)&instr);
+    return instr;
+}
+
+// Whether the pass looks at the line at all: comments and removed lines are
+// skipped over
+static int peephole_is_live(asm_instr *instr) {
+    return instr->kind != ASM_INSTR_NONE && instr->kind != ASM_INSTR_COMMENT;
+}
+
+static int peephole_mnemonic_in(const char *mnemonic, const char **list) {
+    for (; *list != NULL; list++) {
+        if (strcmp(mnemonic, *list) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Instructions that only touch the registers that they name
+static const char *peephole_plain[] = {
+    "mov", "movzx", "movsx", "movsxd", "lea", "pop", "push", "add", "sub",
+    "and", "or",    "xor",   "cmp",    "test", "shl", "shr", "sar", "neg",
+    "not", "inc",   "dec",   "xchg",   NULL,
+};
+
+// The plain instructions that write their first operand without reading it
+static const char *peephole_writes[] = {
+    "mov", "movzx", "movsx", "movsxd", "lea", "pop", NULL,
+};
+
+static int peephole_is_plain(asm_instr *instr) {
+    const char *mnemonic = instr->mnemonic;
+    if (strncmp(mnemonic, "set", 3) == 0 || strncmp(mnemonic, "cmov", 4) == 0) {
+        return 1;
+    }
+    // imul with one operand also reads and writes rax and rdx
+    if (strcmp(mnemonic, "imul") == 0) {
+        return instr->operand_count > 1;
+    }
+    return peephole_mnemonic_in(mnemonic, peephole_plain);
+}
+
+// Whether the instructions from the index on write the register before
+// anything reads it; a jump, a call or a label ends the search, as the
+// register may be read past them
+static int peephole_is_dead(ds_dynamic_array *instrs, unsigned int index,
+                            int reg) {
+    unsigned int seen = 0;
+    for (unsigned int i = index; i < instrs->count && seen < PEEPHOLE_WINDOW;
+         i++) {
+        asm_instr *instr = peephole_instr(instrs, i);
+        if (!peephole_is_live(instr)) {
+            continue;
+        }
+        seen++;
+        if (instr->kind != ASM_INSTR_OP || !peephole_is_plain(instr)) {
+            return 0;
+        }
+
+        int written = 0;
+        for (unsigned int k = 0; k < instr->operand_count; k++) {
+            const char *operand = instr->operands[k];
+            if (!peephole_mentions(operand, reg)) {
+                continue;
+            }
+            if (k == 0 && peephole_mnemonic_in(instr->mnemonic, peephole_writes) &&
+                (strcmp(operand, peephole_registers[reg][0]) == 0 ||
+                 strcmp(operand, peephole_registers[reg][1]) == 0)) {
+                written = 1;
+                continue;
+            }
+            return 0;
+        }
+        if (written) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int peephole_check_condition(const char *condition,
+                                    ds_dynamic_array *instrs,
+                                    unsigned int after,
+                                    peephole_bindings *bindings) {
+    int result = 1;
+    char *conditions = strdup(condition);
+    for (char *clause = strtok(conditions, ";"); clause != NULL && result;
+         clause = strtok(NULL, ";")) {
+        char subject[16], verb[16], object[16];
+        if (sscanf(clause, "%15s %15s %15s", subject, verb, object) == 3 &&
+            strcmp(verb, "free") == 0) {
+            int variable = subject[1] - 'a';
+            int reg = peephole_register_index(object, strlen(object));
+            char *text = peephole_strndup(bindings->start[variable],
+                                          bindings->length[variable]);
+            result = !peephole_mentions(text, reg);
+            free(text);
+        } else if (sscanf(clause, "%15s %15s", verb, object) == 2 &&
+                   strcmp(verb, "dead") == 0) {
+            int reg = peephole_register_index(object, strlen(object));
+            result = peephole_is_dead(instrs, after, reg);
+        } else {
+            DS_PANIC("Unknown peephole condition: %s", clause);
+        }
+    }
+
+    free(conditions);
+    return result;
+}
+
+static long peephole_integer(const char *term, peephole_bindings *bindings) {
+    if (term[0] == '%') {
+        int variable = term[1] - 'a';
+        return strtol(bindings->start[variable], NULL, 10);
+    }
+    return strtol(term, NULL, 10);
+}
+
+static char *peephole_substitute(const char *line,
+                                 peephole_bindings *bindings) {
+    ds_string_builder sb;
+    ds_string_builder_init(&sb);
+
+    for (const char *c = line; *c != '\0'; c++) {
+        if (*c == '%' && islower((unsigned char)c[1])) {
+            int variable = c[1] - 'a';
+            ds_string_builder_appendn(&sb, bindings->start[variable],
+                                      bindings->length[variable]);
+            c++;
+        } else if (*c == '{') {
+            const char *end = strchr(c, '}');
+            char *sum = peephole_strndup(c + 1, end - c - 1);
+            long value = 0;
+            for (char *term = strtok(sum, "+"); term != NULL;
+                 term = strtok(NULL, "+")) {
+                value += peephole_integer(term, bindings);
+            }
+            free(sum);
+            ds_string_builder_append(&sb, "%ld", value);
+            c = end;
+        } else {
+            ds_string_builder_appendc(&sb, *c);
+        }
+    }
+
+    char *text = NULL;
+    ds_string_builder_build(&sb, &text);
+    ds_string_builder_free(&sb);
+    return text;
+}
+
+// Rewrite the instructions that start at the index if the rule matches
+// them; the replacement takes the places of the first of them, in order
+static int peephole_apply(asm_peephole_rule *rule, ds_dynamic_array *instrs,
+                          unsigned int index) {
+    peephole_bindings bindings = {0};
+    unsigned int matched[PEEPHOLE_MAX_PATTERN];
+    unsigned int count = 0;
+
+    unsigned int i = index;
+    for (unsigned int k = 0; k < rule->pattern.count; k++) {
+        while (i < instrs->count && !peephole_is_live(peephole_instr(instrs, i))) {
+            i++;
+        }
+        if (i == instrs->count) {
+            return 0;
+        }
+
+        asm_instr *pattern = NULL;
+        ds_dynamic_array_get_ref(&rule->pattern, k, (void **)&pattern);
+        if (!peephole_match_instr(pattern, peephole_instr(instrs, i),
+                                  &bindings)) {
+            return 0;
+        }
+        matched[count++] = i++;
+    }
+
+    if (rule->source->condition != NULL &&
+        !peephole_check_condition(rule->source->condition, instrs, i,
+                                  &bindings)) {
+        return 0;
+    }
+
+    // the text of the matched instructions is still needed by the bindings
+    asm_instr replaced[PEEPHOLE_MAX_PATTERN];
+    for (unsigned int k = 0; k < rule->replacement.count; k++) {
+        char *line = NULL;
+        ds_dynamic_array_get(&rule->replacement, k, &line);
+
+        char *text = peephole_substitute(line, &bindings);
+        assembler_instr_parse(&replaced[k], 0, text, NULL);
+        free(text);
+        peephole_format(&replaced[k]);
+    }
+
+    const char *comment = NULL;
+    int align = peephole_instr(instrs, matched[0])->align;
+    for (unsigned int k = 0; k < count && comment == NULL; k++) {
+        comment = peephole_instr(instrs, matched[k])->comment;
+    }
+    if (comment != NULL && rule->replacement.count > 0) {
+        replaced[0].comment = strdup(comment);
+    }
+
+    for (unsigned int k = 0; k < count; k++) {
+        asm_instr *instr = peephole_instr(instrs, matched[k]);
+        assembler_instr_free(instr);
+        if (k < rule->replacement.count) {
+            *instr = replaced[k];
+            instr->align = instr->kind == ASM_INSTR_LABEL ? 0 : align;
+        }
+    }
+
+    return 1;
+}
+
+static void peephole_split(const char *lines, ds_dynamic_array *parts) {
+    char *copy = strdup(lines);
+    for (char *line = strtok(copy, ";"); line != NULL;
+         line = strtok(NULL, ";")) {
+        char *part = peephole_trim(line, line + strlen(line));
+        if (part[0] == '\0') {
+            free(part);
+            continue;
+        }
+        ds_dynamic_array_append(parts, &part);
+    }
+    free(copy);
+}
+
+void assembler_peephole_init(asm_peephole *peephole) {
+    ds_dynamic_array_init(&peephole->rules, sizeof(asm_peephole_rule));
+    peephole->hits = calloc(PEEPHOLE_RULES, sizeof(unsigned long));
+
+    ds_dynamic_array lines;
+    ds_dynamic_array_init(&lines, sizeof(char *));
+    for (unsigned int r = 0; r < PEEPHOLE_RULES; r++) {
+        asm_peephole_rule rule = {.source = &peephole_sources[r]};
+        ds_dynamic_array_init(&rule.pattern, sizeof(asm_instr));
+        ds_dynamic_array_init(&rule.replacement, sizeof(char *));
+
+        lines.count = 0;
+        peephole_split(rule.source->pattern, &lines);
+        for (unsigned int k = 0; k < lines.count; k++) {
+            char *line = NULL;
+            ds_dynamic_array_get(&lines, k, &line);
+
+            asm_instr instr;
+            assembler_instr_parse(&instr, 0, line, NULL);
+            ds_dynamic_array_append(&rule.pattern, &instr);
+            free(line);
+        }
+        peephole_split(rule.source->replacement, &rule.replacement);
+
+        // every rewrite makes the code shorter, so the pass ends
+        if (rule.pattern.count > PEEPHOLE_MAX_PATTERN ||
+            rule.replacement.count >= rule.pattern.count) {
+            DS_PANIC("Invalid peephole rule: %s", rule.source->name);
+        }
+        ds_dynamic_array_append(&peephole->rules, &rule);
+    }
+    ds_dynamic_array_free(&lines);
+}
+
+unsigned int assembler_peephole_run(asm_peephole *peephole,
+                                    ds_dynamic_array *instrs) {
+    unsigned int changes = 0;
+
+    unsigned int i = 0;
+    while (i < instrs->count) {
+        if (!peephole_is_live(peephole_instr(instrs, i))) {
+            i++;
+            continue;
+        }
+
+        int applied = 0;
+        for (unsigned int r = 0; r < peephole->rules.count && !applied; r++) {
+            asm_peephole_rule *rule = NULL;
+            ds_dynamic_array_get_ref(&peephole->rules, r, (void **)&rule);
+            if (peephole_apply(rule, instrs, i)) {
+                peephole->hits[r]++;
+                changes++;
+                applied = 1;
+            }
+        }
+        if (!applied) {
+            i++;
+            continue;
+        }
+
+        // the new instructions can complete a pattern that starts before
+        // them
+        for (unsigned int back = 1; back < PEEPHOLE_MAX_PATTERN && i > 0;) {
+            i--;
+            back += peephole_is_live(peephole_instr(instrs, i));
+        }
+    }
+
+    return changes;
+}
+
+void assembler_peephole_print_hits(asm_peephole *peephole) {
+    fprintf(stderr, "%-16s %8s\n", "pattern", "hits");
+    for (unsigned int r = 0; r < peephole->rules.count; r++) {
+        if (peephole->hits[r] == 0) {
+            continue;
+        }
+        fprintf(stderr, "%-16s %8lu\n", peephole_sources[r].name,
+                peephole->hits[r]);
+    }
+}
+
+void assembler_peephole_free(asm_peephole *peephole) {
+    for (unsigned int r = 0; r < peephole->rules.count; r++) {
+        asm_peephole_rule *rule = NULL;
+        ds_dynamic_array_get_ref(&peephole->rules, r, (void **)&rule);
+
+        for (unsigned int k = 0; k < rule->pattern.count; k++) {
+            asm_instr *instr = NULL;
+            ds_dynamic_array_get_ref(&rule->pattern, k, (void **)&instr);
+            assembler_instr_free(instr);
+        }
+        for (unsigned int k = 0; k < rule->replacement.count; k++) {
+            char *line = NULL;
+            ds_dynamic_array_get(&rule->replacement, k, &line);
+            free(line);
+        }
+        ds_dynamic_array_free(&rule->pattern);
+        ds_dynamic_array_free(&rule->replacement);
+    }
+    ds_dynamic_array_free(&peephole->rules);
+    free(peephole->hits);
+}
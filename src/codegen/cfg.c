@@ -0,0 +1,611 @@
+#include "codegen.h"
+#include "ds.h"
+
+tac_operand *codegen_tac_instr_def(tac_instr *instr) {
+    switch (instr->kind) {
+    case TAC_LABEL:
+    case TAC_JUMP:
+    case TAC_JUMP_IF_TRUE:
+    case TAC_IDENT:
+    case TAC_STORE_FIELD:
+    case TAC_CHECK_VOID:
+    case TAC_CASE:
+        return NULL;
+    case TAC_ASSIGN_ISINSTANCE:
+        return &instr->isinstance.ident;
+    case TAC_CAST:
+        return &instr->cast.ident;
+    case TAC_ASSIGN_VALUE:
+        return &instr->assign_value.ident;
+    case TAC_DISPATCH_CALL:
+        return &instr->dispatch_call.ident;
+    case TAC_ASSIGN_NEW:
+        return &instr->assign_new.ident;
+    case TAC_ASSIGN_DEFAULT:
+        return &instr->assign_default.ident;
+    case TAC_ASSIGN_ISVOID:
+    case TAC_ASSIGN_NEG:
+    case TAC_ASSIGN_NOT:
+        return &instr->assign_unary.ident;
+    case TAC_ASSIGN_ADD:
+    case TAC_ASSIGN_SUB:
+    case TAC_ASSIGN_MUL:
+    case TAC_ASSIGN_DIV:
+    case TAC_ASSIGN_LT:
+    case TAC_ASSIGN_LE:
+        return &instr->assign_binary.ident;
+    case TAC_ASSIGN_EQ:
+        return &instr->assign_eq.ident;
+    case TAC_ASSIGN_INT:
+        return &instr->assign_int.ident;
+    case TAC_ASSIGN_STRING:
+        return &instr->assign_string.ident;
+    case TAC_ASSIGN_BOOL:
+        return &instr->assign_bool.ident;
+    case TAC_PHI:
+        return &instr->phi.ident;
+    case TAC_LOAD_FIELD:
+        return &instr->field.ident;
+    }
+
+    return NULL;
+}
+
+void codegen_tac_instr_uses(tac_instr *instr, ds_dynamic_array *uses) {
+    tac_operand *operand = NULL;
+
+    switch (instr->kind) {
+    case TAC_LABEL:
+    case TAC_JUMP:
+    case TAC_ASSIGN_NEW:
+    case TAC_ASSIGN_DEFAULT:
+    case TAC_ASSIGN_INT:
+    case TAC_ASSIGN_STRING:
+    case TAC_ASSIGN_BOOL:
+        break;
+    case TAC_JUMP_IF_TRUE:
+        operand = &instr->jump_if_true.expr;
+        ds_dynamic_array_append(uses, &operand);
+        break;
+    case TAC_ASSIGN_ISINSTANCE:
+        operand = &instr->isinstance.expr;
+        ds_dynamic_array_append(uses, &operand);
+        break;
+    case TAC_CAST:
+        operand = &instr->cast.expr;
+        ds_dynamic_array_append(uses, &operand);
+        break;
+    case TAC_ASSIGN_VALUE:
+        operand = &instr->assign_value.expr;
+        ds_dynamic_array_append(uses, &operand);
+        break;
+    case TAC_DISPATCH_CALL:
+        operand = &instr->dispatch_call.expr;
+        ds_dynamic_array_append(uses, &operand);
+        for (unsigned int i = 0; i < instr->dispatch_call.args.count; i++) {
+            ds_dynamic_array_get_ref(&instr->dispatch_call.args, i,
+                                     (void **)&operand);
+            ds_dynamic_array_append(uses, &operand);
+        }
+        break;
+    case TAC_ASSIGN_ISVOID:
+    case TAC_ASSIGN_NEG:
+    case TAC_ASSIGN_NOT:
+        operand = &instr->assign_unary.expr;
+        ds_dynamic_array_append(uses, &operand);
+        break;
+    case TAC_ASSIGN_ADD:
+    case TAC_ASSIGN_SUB:
+    case TAC_ASSIGN_MUL:
+    case TAC_ASSIGN_DIV:
+    case TAC_ASSIGN_LT:
+    case TAC_ASSIGN_LE:
+        operand = &instr->assign_binary.lhs;
+        ds_dynamic_array_append(uses, &operand);
+        operand = &instr->assign_binary.rhs;
+        ds_dynamic_array_append(uses, &operand);
+        break;
+    case TAC_ASSIGN_EQ:
+        operand = &instr->assign_eq.lhs;
+        ds_dynamic_array_append(uses, &operand);
+        operand = &instr->assign_eq.rhs;
+        ds_dynamic_array_append(uses, &operand);
+        break;
+    case TAC_IDENT:
+        operand = &instr->ident.name;
+        ds_dynamic_array_append(uses, &operand);
+        break;
+    case TAC_PHI:
+        for (unsigned int i = 0; i < instr->phi.args.count; i++) {
+            tac_phi_arg *arg = NULL;
+            ds_dynamic_array_get_ref(&instr->phi.args, i, (void **)&arg);
+            operand = &arg->value;
+            ds_dynamic_array_append(uses, &operand);
+        }
+        break;
+    case TAC_LOAD_FIELD:
+        operand = &instr->field.object;
+        ds_dynamic_array_append(uses, &operand);
+        break;
+    case TAC_STORE_FIELD:
+        operand = &instr->field.object;
+        ds_dynamic_array_append(uses, &operand);
+        operand = &instr->field.value;
+        ds_dynamic_array_append(uses, &operand);
+        break;
+    case TAC_CHECK_VOID:
+        operand = &instr->check_void.expr;
+        ds_dynamic_array_append(uses, &operand);
+        break;
+    case TAC_CASE:
+        operand = &instr->case_jump.expr;
+        ds_dynamic_array_append(uses, &operand);
+        break;
+    }
+}
+
+int codegen_tac_var_index(tac_result *tac, tac_operand operand) {
+    switch (operand.kind) {
+    case TAC_OPERAND_TEMP:
+        return operand.index;
+    case TAC_OPERAND_FORMAL:
+        return tac->temp_count + operand.index;
+    default:
+        return -1;
+    }
+}
+
+static unsigned int tac_formal_count(tac_result *tac) {
+    if (tac->method == NULL) {
+        return 0;
+    }
+
+    return tac->method->formals.count;
+}
+
+static int tac_is_terminator(tac_instr *instr) {
+    return instr->kind == TAC_JUMP || instr->kind == TAC_JUMP_IF_TRUE ||
+           instr->kind == TAC_CASE;
+}
+
+// Make sure that every block starts with a label and that the label of the
+// entry block is not the target of any jump
+static void tac_cfg_add_labels(tac_result *tac) {
+    int *targeted = calloc(tac->label_count + 1, sizeof(int));
+
+    for (unsigned int i = 0; i < tac->instrs.count; i++) {
+        tac_instr *instr = NULL;
+        ds_dynamic_array_get_ref(&tac->instrs, i, (void **)&instr);
+
+        if (instr->kind == TAC_JUMP) {
+            targeted[instr->jump.label] = 1;
+        } else if (instr->kind == TAC_JUMP_IF_TRUE) {
+            targeted[instr->jump_if_true.label] = 1;
+        } else if (instr->kind == TAC_CASE) {
+            for (unsigned int k = 0; k < instr->case_jump.branches.count; k++) {
+                tac_case_branch *branch = NULL;
+                ds_dynamic_array_get_ref(&instr->case_jump.branches, k,
+                                         (void **)&branch);
+                targeted[branch->label] = 1;
+            }
+        }
+    }
+
+    ds_dynamic_array instrs;
+    ds_dynamic_array_init(&instrs, sizeof(tac_instr));
+
+    for (unsigned int i = 0; i < tac->instrs.count; i++) {
+        tac_instr *instr = NULL;
+        ds_dynamic_array_get_ref(&tac->instrs, i, (void **)&instr);
+
+        int leader = i == 0;
+        if (i > 0) {
+            tac_instr *prev = NULL;
+            ds_dynamic_array_get_ref(&tac->instrs, i - 1, (void **)&prev);
+            leader = tac_is_terminator(prev);
+        }
+
+        int needs_label = instr->kind != TAC_LABEL ||
+                          (i == 0 && targeted[instr->label.label]);
+        if (leader && needs_label) {
+            tac_instr label = {.kind = TAC_LABEL,
+                               .label = {.label = tac->label_count++}};
+            ds_dynamic_array_append(&instrs, &label);
+        }
+
+        ds_dynamic_array_append(&instrs, instr);
+    }
+
+    ds_dynamic_array_free(&tac->instrs);
+    tac->instrs = instrs;
+
+    free(targeted);
+}
+
+static void tac_cfg_add_edge(tac_cfg *cfg, unsigned int from, unsigned int to) {
+    tac_basic_block *a = NULL;
+    ds_dynamic_array_get_ref(&cfg->blocks, from, (void **)&a);
+    tac_basic_block *b = NULL;
+    ds_dynamic_array_get_ref(&cfg->blocks, to, (void **)&b);
+
+    ds_dynamic_array_append(&a->succs, &to);
+    ds_dynamic_array_append(&b->preds, &from);
+}
+
+static tac_basic_block *tac_cfg_block(tac_cfg *cfg, unsigned int index) {
+    tac_basic_block *block = NULL;
+    ds_dynamic_array_get_ref(&cfg->blocks, index, (void **)&block);
+    return block;
+}
+
+static unsigned int tac_cfg_label_block(tac_cfg *cfg, int label) {
+    int index = -1;
+    ds_dynamic_array_get(&cfg->labels, label, &index);
+    if (index < 0) {
+        DS_PANIC("jump to unknown label L%d", label);
+    }
+
+    return index;
+}
+
+// Reverse postorder of the blocks reachable from the entry
+static void tac_cfg_order(tac_cfg *cfg) {
+    unsigned int count = cfg->blocks.count;
+    int *visited = calloc(count, sizeof(int));
+    unsigned int *stack = malloc(sizeof(unsigned int) * count);
+    unsigned int *next = calloc(count, sizeof(unsigned int));
+    unsigned int *postorder = malloc(sizeof(unsigned int) * count);
+    unsigned int top = 0, post = 0;
+
+    stack[top++] = 0;
+    visited[0] = 1;
+    while (top > 0) {
+        unsigned int index = stack[top - 1];
+        tac_basic_block *block = tac_cfg_block(cfg, index);
+
+        if (next[index] < block->succs.count) {
+            unsigned int succ;
+            ds_dynamic_array_get(&block->succs, next[index]++, &succ);
+            if (!visited[succ]) {
+                visited[succ] = 1;
+                stack[top++] = succ;
+            }
+        } else {
+            postorder[post++] = index;
+            top--;
+        }
+    }
+
+    ds_dynamic_array_init(&cfg->order, sizeof(unsigned int));
+    for (unsigned int i = 0; i < post; i++) {
+        unsigned int index = postorder[post - i - 1];
+        tac_cfg_block(cfg, index)->rpo = i;
+        ds_dynamic_array_append(&cfg->order, &index);
+    }
+
+    free(visited);
+    free(stack);
+    free(next);
+    free(postorder);
+}
+
+static unsigned int tac_cfg_intersect(tac_cfg *cfg, unsigned int a,
+                                      unsigned int b) {
+    while (a != b) {
+        while (tac_cfg_block(cfg, a)->rpo > tac_cfg_block(cfg, b)->rpo) {
+            a = tac_cfg_block(cfg, a)->idom;
+        }
+        while (tac_cfg_block(cfg, b)->rpo > tac_cfg_block(cfg, a)->rpo) {
+            b = tac_cfg_block(cfg, b)->idom;
+        }
+    }
+
+    return a;
+}
+
+// Cooper, Harvey and Kennedy: iterate over the blocks in RPO until the
+// immediate dominators stop changing. The entry temporarily dominates
+// itself so that the intersection walk terminates.
+static void tac_cfg_dominators(tac_cfg *cfg) {
+    tac_cfg_block(cfg, 0)->idom = 0;
+
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+
+        for (unsigned int i = 1; i < cfg->order.count; i++) {
+            unsigned int index;
+            ds_dynamic_array_get(&cfg->order, i, &index);
+            tac_basic_block *block = tac_cfg_block(cfg, index);
+
+            int idom = -1;
+            for (unsigned int j = 0; j < block->preds.count; j++) {
+                unsigned int pred;
+                ds_dynamic_array_get(&block->preds, j, &pred);
+
+                tac_basic_block *pred_block = tac_cfg_block(cfg, pred);
+                if (pred_block->idom < 0) {
+                    continue;
+                }
+
+                if (idom < 0) {
+                    idom = pred;
+                } else {
+                    idom = tac_cfg_intersect(cfg, pred, idom);
+                }
+            }
+
+            if (block->idom != idom) {
+                block->idom = idom;
+                changed = 1;
+            }
+        }
+    }
+
+    tac_cfg_block(cfg, 0)->idom = -1;
+}
+
+// A back edge goes from a block to one of its dominators, the header of a
+// natural loop; the body is every block that reaches one of the back edges
+// of the header without going through it
+static void tac_cfg_loops(tac_cfg *cfg) {
+    unsigned int count = cfg->blocks.count;
+    unsigned int *stack = malloc(sizeof(unsigned int) * (count + 1));
+    char *body = malloc(count + 1);
+
+    for (unsigned int h = 0; h < count; h++) {
+        tac_basic_block *header = tac_cfg_block(cfg, h);
+        if (header->rpo < 0) {
+            continue;
+        }
+
+        memset(body, 0, count);
+        body[h] = 1;
+
+        unsigned int top = 0;
+        for (unsigned int j = 0; j < header->preds.count; j++) {
+            unsigned int pred;
+            ds_dynamic_array_get(&header->preds, j, &pred);
+            if (!body[pred] && codegen_tac_cfg_dominates(cfg, h, pred)) {
+                body[pred] = 1;
+                stack[top++] = pred;
+            }
+        }
+        if (top == 0) {
+            continue;
+        }
+
+        header->loop_depth++;
+        while (top > 0) {
+            tac_basic_block *block = tac_cfg_block(cfg, stack[--top]);
+            block->loop_depth++;
+
+            for (unsigned int j = 0; j < block->preds.count; j++) {
+                unsigned int pred;
+                ds_dynamic_array_get(&block->preds, j, &pred);
+                if (!body[pred] && tac_cfg_block(cfg, pred)->rpo >= 0) {
+                    body[pred] = 1;
+                    stack[top++] = pred;
+                }
+            }
+        }
+    }
+
+    free(stack);
+    free(body);
+}
+
+int codegen_tac_cfg_dominates(tac_cfg *cfg, unsigned int a, unsigned int b) {
+    if (tac_cfg_block(cfg, b)->rpo < 0) {
+        return 0;
+    }
+
+    int current = b;
+    while (current >= 0) {
+        if ((unsigned int)current == a) {
+            return 1;
+        }
+        current = tac_cfg_block(cfg, current)->idom;
+    }
+
+    return 0;
+}
+
+int codegen_tac_cfg_build(tac_result *tac, tac_cfg *cfg) {
+    tac_cfg_add_labels(tac);
+
+    ds_dynamic_array_init(&cfg->blocks, sizeof(tac_basic_block));
+    ds_dynamic_array_init(&cfg->labels, sizeof(int));
+    for (unsigned int i = 0; i < tac->label_count; i++) {
+        int none = -1;
+        ds_dynamic_array_append(&cfg->labels, &none);
+    }
+
+    cfg->var_count = tac->temp_count + tac_formal_count(tac);
+    cfg->word_count = (cfg->var_count + TAC_BITSET_WORD - 1) / TAC_BITSET_WORD;
+
+    for (unsigned int i = 0; i < tac->instrs.count; i++) {
+        tac_instr *instr = NULL;
+        ds_dynamic_array_get_ref(&tac->instrs, i, (void **)&instr);
+
+        if (instr->kind == TAC_LABEL) {
+            tac_basic_block block = {.label = instr->label.label,
+                               .start = i,
+                               .end = i + 1,
+                               .idom = -1,
+                               .rpo = -1};
+            ds_dynamic_array_init(&block.preds, sizeof(unsigned int));
+            ds_dynamic_array_init(&block.succs, sizeof(unsigned int));
+
+            int *index = NULL;
+            ds_dynamic_array_get_ref(&cfg->labels, block.label,
+                                     (void **)&index);
+            *index = cfg->blocks.count;
+            ds_dynamic_array_append(&cfg->blocks, &block);
+        } else {
+            tac_cfg_block(cfg, cfg->blocks.count - 1)->end = i + 1;
+        }
+    }
+
+    for (unsigned int i = 0; i < cfg->blocks.count; i++) {
+        tac_basic_block *block = tac_cfg_block(cfg, i);
+
+        tac_instr *last = NULL;
+        ds_dynamic_array_get_ref(&tac->instrs, block->end - 1, (void **)&last);
+
+        int falls_through = 1;
+        if (last->kind == TAC_JUMP) {
+            tac_cfg_add_edge(cfg, i, tac_cfg_label_block(cfg, last->jump.label));
+            falls_through = 0;
+        } else if (last->kind == TAC_CASE) {
+            // no match aborts instead of falling through
+            for (unsigned int k = 0; k < last->case_jump.branches.count; k++) {
+                tac_case_branch *branch = NULL;
+                ds_dynamic_array_get_ref(&last->case_jump.branches, k,
+                                         (void **)&branch);
+                tac_cfg_add_edge(cfg, i,
+                                 tac_cfg_label_block(cfg, branch->label));
+            }
+            falls_through = 0;
+        } else if (last->kind == TAC_IDENT && block->end == tac->instrs.count) {
+            falls_through = 0;
+        }
+
+        if (falls_through && i + 1 < cfg->blocks.count) {
+            tac_cfg_add_edge(cfg, i, i + 1);
+        }
+
+        if (last->kind == TAC_JUMP_IF_TRUE) {
+            unsigned int target =
+                tac_cfg_label_block(cfg, last->jump_if_true.label);
+            if (target != i + 1) {
+                tac_cfg_add_edge(cfg, i, target);
+            }
+        }
+    }
+
+    tac_cfg_order(cfg);
+    tac_cfg_dominators(cfg);
+    tac_cfg_loops(cfg);
+
+    return 0;
+}
+
+static void tac_bitset_set(unsigned long *set, unsigned int i) {
+    set[i / TAC_BITSET_WORD] |= 1UL << (i % TAC_BITSET_WORD);
+}
+
+// Backward dataflow: live_out is the union of the successors' live_in and
+// of the phi arguments coming from this block, live_in is
+// use | (live_out & ~def), iterated in postorder to a fixpoint
+void codegen_tac_cfg_liveness(tac_result *tac, tac_cfg *cfg) {
+    unsigned int words = cfg->word_count;
+    unsigned long *use = calloc(cfg->blocks.count * words + 1, sizeof(long));
+    unsigned long *def = calloc(cfg->blocks.count * words + 1, sizeof(long));
+
+    ds_dynamic_array uses;
+    ds_dynamic_array_init(&uses, sizeof(tac_operand *));
+
+    for (unsigned int i = 0; i < cfg->blocks.count; i++) {
+        tac_basic_block *block = tac_cfg_block(cfg, i);
+        block->live_in = calloc(words + 1, sizeof(long));
+        block->live_out = calloc(words + 1, sizeof(long));
+
+        unsigned long *block_use = use + i * words;
+        unsigned long *block_def = def + i * words;
+        for (unsigned int j = block->start; j < block->end; j++) {
+            tac_instr *instr = NULL;
+            ds_dynamic_array_get_ref(&tac->instrs, j, (void **)&instr);
+
+            // the arguments of a phi are live out of the predecessors
+            uses.count = 0;
+            if (instr->kind != TAC_PHI) {
+                codegen_tac_instr_uses(instr, &uses);
+            }
+            for (unsigned int k = 0; k < uses.count; k++) {
+                tac_operand *operand = NULL;
+                ds_dynamic_array_get(&uses, k, &operand);
+
+                int var = codegen_tac_var_index(tac, *operand);
+                if (var >= 0 && !tac_bitset_test(block_def, var)) {
+                    tac_bitset_set(block_use, var);
+                }
+            }
+
+            tac_operand *operand = codegen_tac_instr_def(instr);
+            if (operand != NULL) {
+                int var = codegen_tac_var_index(tac, *operand);
+                if (var >= 0) {
+                    tac_bitset_set(block_def, var);
+                }
+            }
+        }
+    }
+
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+
+        for (unsigned int i = cfg->order.count; i > 0; i--) {
+            unsigned int index;
+            ds_dynamic_array_get(&cfg->order, i - 1, &index);
+            tac_basic_block *block = tac_cfg_block(cfg, index);
+
+            for (unsigned int j = 0; j < block->succs.count; j++) {
+                unsigned int succ;
+                ds_dynamic_array_get(&block->succs, j, &succ);
+                tac_basic_block *succ_block = tac_cfg_block(cfg, succ);
+
+                for (unsigned int w = 0; w < words; w++) {
+                    block->live_out[w] |= succ_block->live_in[w];
+                }
+
+                for (unsigned int k = succ_block->start + 1;
+                     k < succ_block->end; k++) {
+                    tac_instr *instr = NULL;
+                    ds_dynamic_array_get_ref(&tac->instrs, k, (void **)&instr);
+                    if (instr->kind != TAC_PHI) {
+                        break;
+                    }
+
+                    for (unsigned int a = 0; a < instr->phi.args.count; a++) {
+                        tac_phi_arg arg;
+                        ds_dynamic_array_get(&instr->phi.args, a, &arg);
+
+                        int var = codegen_tac_var_index(tac, arg.value);
+                        if (arg.label == block->label && var >= 0) {
+                            tac_bitset_set(block->live_out, var);
+                        }
+                    }
+                }
+            }
+
+            for (unsigned int w = 0; w < words; w++) {
+                unsigned long in = use[index * words + w] |
+                                   (block->live_out[w] & ~def[index * words + w]);
+                if (in != block->live_in[w]) {
+                    block->live_in[w] = in;
+                    changed = 1;
+                }
+            }
+        }
+    }
+
+    ds_dynamic_array_free(&uses);
+    free(use);
+    free(def);
+}
+
+void codegen_tac_cfg_free(tac_cfg *cfg) {
+    for (unsigned int i = 0; i < cfg->blocks.count; i++) {
+        tac_basic_block *block = tac_cfg_block(cfg, i);
+        ds_dynamic_array_free(&block->preds);
+        ds_dynamic_array_free(&block->succs);
+        free(block->live_in);
+        free(block->live_out);
+    }
+
+    ds_dynamic_array_free(&cfg->blocks);
+    ds_dynamic_array_free(&cfg->order);
+    ds_dynamic_array_free(&cfg->labels);
+}
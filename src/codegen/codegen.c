@@ -4,46 +4,76 @@
 #include "semantic.h"
 #include <assert.h>
 
+typedef struct tac_binding {
+        const char *name;
+        tac_operand operand;
+} tac_binding;
+
 typedef struct tac_context {
         int result;
         int temp_count;
         int label_count;
-        ds_dynamic_array locals; // char *
 
-        ds_dynamic_array mapping; // tac_assign_value
+        ds_dynamic_array mapping; // tac_binding
         semantic_mapping *semantic_mapping;
+        semantic_mapping_item *class;
+        const method_node *method;
 } tac_context;
 
-static void tac_new_var(tac_context *context, char **ident) {
-    int needed = snprintf(NULL, 0, "$t%d", context->temp_count) + 1;
-
-    *ident = malloc(needed);
-    snprintf(*ident, needed, "$t%d", context->temp_count++);
-
-    ds_dynamic_array_append(&context->locals, *ident);
+static void tac_new_var(tac_context *context, tac_operand *ident) {
+    *ident = (tac_operand){.kind = TAC_OPERAND_TEMP,
+                           .index = context->temp_count++};
 }
 
-static void tac_new_label(tac_context *context, char **label) {
-    int needed = snprintf(NULL, 0, "L%d", context->label_count) + 1;
-
-    *label = malloc(needed);
-    snprintf(*label, needed, "L%d", context->label_count++);
+static void tac_new_label(tac_context *context, int *label) {
+    *label = context->label_count++;
 }
 
 static void tac_expr(tac_context *context, expr_node *expr,
                      ds_dynamic_array *instrs, tac_instr *result);
 
-static char *tac_find_ident_mapping(tac_context *context, char *ident) {
+// Resolve an identifier to a let or case binding, then to a formal of the
+// method, then to an attribute slot of the class
+static tac_operand tac_find_ident_mapping(tac_context *context,
+                                          const char *ident) {
     for (unsigned int i = 0; i < context->mapping.count; i++) {
-        tac_assign_value assign_value;
-        ds_dynamic_array_get(&context->mapping, context->mapping.count - i - 1, &assign_value);
+        tac_binding *binding = NULL;
+        ds_dynamic_array_get_ref(&context->mapping,
+                                 context->mapping.count - i - 1,
+                                 (void **)&binding);
+
+        if (strcmp(binding->name, ident) == 0) {
+            return binding->operand;
+        }
+    }
+
+    if (strcmp(ident, "self") == 0) {
+        return (tac_operand){.kind = TAC_OPERAND_SELF};
+    }
+
+    if (context->method != NULL) {
+        for (unsigned int i = 0; i < context->method->formals.count; i++) {
+            formal_node *formal = NULL;
+            ds_dynamic_array_get_ref((ds_dynamic_array *)&context->method->formals,
+                                     i, (void **)&formal);
 
-        if (strcmp(assign_value.ident, ident) == 0) {
-            return assign_value.expr;
+            if (strcmp(formal->name.value, ident) == 0) {
+                return (tac_operand){.kind = TAC_OPERAND_FORMAL, .index = i};
+            }
+        }
+    }
+
+    for (unsigned int i = 0; i < context->class->attributes.count; i++) {
+        class_mapping_attribute *attribute = NULL;
+        ds_dynamic_array_get_ref(&context->class->attributes, i,
+                                 (void **)&attribute);
+
+        if (strcmp(attribute->attribute_name, ident) == 0) {
+            return (tac_operand){.kind = TAC_OPERAND_ATTRIBUTE, .index = i};
         }
     }
 
-    return ident;
+    DS_PANIC("unknown identifier %s", ident);
 }
 
 static void tac_assign(tac_context *context, assign_node *assign,
@@ -69,7 +99,7 @@ static void tac_assign(tac_context *context, assign_node *assign,
 static void tac_dispatch_args(tac_context *context, dispatch_node *dispatch,
                               ds_dynamic_array *instrs,
                               ds_dynamic_array *args) {
-    ds_dynamic_array_init(args, sizeof(char *));
+    ds_dynamic_array_init(args, sizeof(tac_operand));
 
     for (unsigned int i = 0; i < dispatch->args.count; i++) {
         expr_node expr;
@@ -78,7 +108,7 @@ static void tac_dispatch_args(tac_context *context, dispatch_node *dispatch,
         tac_instr instr;
         tac_expr(context, &expr, instrs, &instr);
 
-        ds_dynamic_array_append(args, &instr.ident);
+        ds_dynamic_array_append(args, &instr.ident.name);
     }
 }
 
@@ -91,7 +121,7 @@ static void tac_dispatch_full(tac_context *context,
     tac_instr expr;
     tac_expr(context, dispatch_full->expr, instrs, &expr);
 
-    char *ident;
+    tac_operand ident;
     tac_new_var(context, &ident);
     tac_instr instr = {
         .kind = TAC_DISPATCH_CALL,
@@ -116,7 +146,7 @@ static void tac_dispatch(tac_context *context, dispatch_node *dispatch,
     ds_dynamic_array args;
     tac_dispatch_args(context, dispatch, instrs, &args);
 
-    char *ident;
+    tac_operand ident;
     tac_new_var(context, &ident);
     tac_instr instr = {
         .kind = TAC_DISPATCH_CALL,
@@ -125,7 +155,7 @@ static void tac_dispatch(tac_context *context, dispatch_node *dispatch,
                 .ident = ident,
                 .expr_type = "SELF_TYPE",
                 .type = NULL,
-                .expr = "self",
+                .expr = {.kind = TAC_OPERAND_SELF},
                 .method = dispatch->method.value,
                 .args = args,
             },
@@ -138,13 +168,13 @@ static void tac_dispatch(tac_context *context, dispatch_node *dispatch,
 
 static void tac_cond(tac_context *context, cond_node *cond,
                      ds_dynamic_array *instrs, tac_instr *result) {
-    char *ident;
+    tac_operand ident;
     tac_new_var(context, &ident);
 
-    char *then_label;
+    int then_label;
     tac_new_label(context, &then_label);
 
-    char *done_label;
+    int done_label;
     tac_new_label(context, &done_label);
 
     // ... PREDICATE ...
@@ -225,13 +255,13 @@ static void tac_cond(tac_context *context, cond_node *cond,
 
 static void tac_loop(tac_context *context, loop_node *loop,
                      ds_dynamic_array *instrs, tac_instr *result) {
-    char *ident;
+    tac_operand ident;
     tac_new_var(context, &ident);
 
-    char *loop_label;
+    int loop_label;
     tac_new_label(context, &loop_label);
 
-    char *done_label;
+    int done_label;
     tac_new_label(context, &done_label);
 
     // LOOP_LABEL:
@@ -248,7 +278,7 @@ static void tac_loop(tac_context *context, loop_node *loop,
     tac_instr predicate;
     tac_expr(context, loop->predicate, instrs, &predicate);
 
-    char *not_predicate_ident;
+    tac_operand not_predicate_ident;
     tac_new_var(context, &not_predicate_ident);
     tac_instr not_predicate = {
         .kind = TAC_ASSIGN_NOT,
@@ -332,7 +362,7 @@ static void tac_let(tac_context *context, let_node *let,
         if (let_init.init != NULL) {
             tac_expr(context, let_init.init, instrs, &expr);
         } else {
-            char *ident;
+            tac_operand ident;
             tac_new_var(context, &ident);
             tac_assign_new assign = {
                 .ident = ident,
@@ -343,7 +373,7 @@ static void tac_let(tac_context *context, let_node *let,
             ds_dynamic_array_append(instrs, &expr);
         }
 
-        char *ident;
+        tac_operand ident;
         tac_new_var(context, &ident);
         tac_instr instr = {
             .kind = TAC_ASSIGN_VALUE,
@@ -355,12 +385,12 @@ static void tac_let(tac_context *context, let_node *let,
         };
         ds_dynamic_array_append(instrs, &instr);
 
-        tac_assign_value assign_value = {
-            .ident = let_init.name.value,
-            .expr = ident,
+        tac_binding binding = {
+            .name = let_init.name.value,
+            .operand = ident,
         };
 
-        ds_dynamic_array_append(&context->mapping, &assign_value);
+        ds_dynamic_array_append(&context->mapping, &binding);
     }
 
     tac_expr(context, let->body, instrs, result);
@@ -371,17 +401,17 @@ static void tac_let(tac_context *context, let_node *let,
 
 static void tac_case(tac_context *context, case_node *case_,
                      ds_dynamic_array *instrs, tac_instr *result) {
-    char *ident;
+    tac_operand ident;
     tac_new_var(context, &ident);
 
-    char *done_label;
+    int done_label;
     tac_new_label(context, &done_label);
 
     tac_instr expr;
     tac_expr(context, case_->expr, instrs, &expr);
 
     ds_dynamic_array case_labels;
-    ds_dynamic_array_init(&case_labels, sizeof(char *));
+    ds_dynamic_array_init(&case_labels, sizeof(int));
 
     ds_dynamic_array indices;
     ds_dynamic_array_init(&indices, sizeof(int));
@@ -403,14 +433,21 @@ static void tac_case(tac_context *context, case_node *case_,
 
     assert(indices.count == case_->cases.count);
 
+    // case EXPR of TYPE CASE_LABEL, ...
+    tac_instr case_instr = {
+        .kind = TAC_CASE,
+        .case_jump =
+            {
+                .expr = expr.ident.name,
+            },
+    };
+    ds_dynamic_array_init(&case_instr.case_jump.branches, sizeof(tac_case_branch));
+
     for (unsigned int j = 0; j < indices.count; j++) {
         int i = 0;
         ds_dynamic_array_get(&indices, j, &i);
 
-        char *ident;
-        tac_new_var(context, &ident);
-
-        char *case_label;
+        int case_label;
         tac_new_label(context, &case_label);
 
         ds_dynamic_array_append(&case_labels, &case_label);
@@ -418,34 +455,19 @@ static void tac_case(tac_context *context, case_node *case_,
         branch_node branch;
         ds_dynamic_array_get(&case_->cases, i, &branch);
 
-        tac_instr isinatance_instr = {
-            .kind = TAC_ASSIGN_ISINSTANCE,
-            .isinstance =
-                {
-                    .ident = ident,
-                    .expr = expr.ident.name,
-                    .type = branch.type.value,
-                },
-        };
-        ds_dynamic_array_append(instrs, &isinatance_instr);
-
-        // bt ISINSTANCE CASE_LABEL
-        tac_instr jump_case_instr = {
-            .kind = TAC_JUMP_IF_TRUE,
-            .jump_if_true =
-                {
-                    .expr = ident,
-                    .label = case_label,
-                },
+        tac_case_branch case_branch = {
+            .type = branch.type.value,
+            .label = case_label,
         };
-        ds_dynamic_array_append(instrs, &jump_case_instr);
+        ds_dynamic_array_append(&case_instr.case_jump.branches, &case_branch);
     }
+    ds_dynamic_array_append(instrs, &case_instr);
 
     for (unsigned int j = 0; j < indices.count; j++) {
         int i = 0;
         ds_dynamic_array_get(&indices, j, &i);
 
-        char *case_label;
+        int case_label;
         ds_dynamic_array_get(&case_labels, j, &case_label);
 
         // CASE_LABEL:
@@ -462,7 +484,7 @@ static void tac_case(tac_context *context, case_node *case_,
         branch_node branch;
         ds_dynamic_array_get(&case_->cases, i, &branch);
 
-        char *branch_ident = NULL;
+        tac_operand branch_ident;
         tac_new_var(context, &branch_ident);
         tac_instr cast_instr = {
             .kind = TAC_CAST,
@@ -475,12 +497,12 @@ static void tac_case(tac_context *context, case_node *case_,
         };
         ds_dynamic_array_append(instrs, &cast_instr);
 
-        tac_assign_value assign_value = {
-            .ident = branch.name.value,
-            .expr = branch_ident,
+        tac_binding binding = {
+            .name = branch.name.value,
+            .operand = branch_ident,
         };
 
-        ds_dynamic_array_append(&context->mapping, &assign_value);
+        ds_dynamic_array_append(&context->mapping, &binding);
 
         tac_instr body;
         tac_expr(context, branch.body, instrs, &body);
@@ -526,7 +548,7 @@ static void tac_case(tac_context *context, case_node *case_,
 
 static void tac_new(tac_context *context, new_node *new,
                     ds_dynamic_array *instrs, tac_instr *result) {
-    char *ident;
+    tac_operand ident;
     tac_new_var(context, &ident);
     tac_instr instr = {
         .kind = TAC_ASSIGN_NEW,
@@ -551,7 +573,7 @@ static void tac_binary(tac_context *context, expr_binary_node *binary,
     tac_instr rhs;
     tac_expr(context, binary->rhs, instrs, &rhs);
 
-    char *ident;
+    tac_operand ident;
     tac_new_var(context, &ident);
     tac_instr instr = {
         .kind = kind,
@@ -576,7 +598,7 @@ static void tac_eq(tac_context *context, expr_binary_node *binary,
     tac_instr rhs;
     tac_expr(context, binary->rhs, instrs, &rhs);
 
-    char *ident;
+    tac_operand ident;
     tac_new_var(context, &ident);
     tac_instr instr = {
         .kind = TAC_ASSIGN_EQ,
@@ -600,7 +622,7 @@ static void tac_unary(tac_context *context, expr_unary_node *unary,
     tac_instr expr;
     tac_expr(context, unary->expr, instrs, &expr);
 
-    char *ident;
+    tac_operand ident;
     tac_new_var(context, &ident);
     tac_instr instr = {
         .kind = kind,
@@ -629,14 +651,15 @@ static void tac_identifier(tac_context *context, node_info *ident,
 
 static void tac_int(tac_context *context, node_info *int_node,
                     ds_dynamic_array *instrs, tac_instr *result) {
-    char *ident;
+    tac_operand ident;
     tac_new_var(context, &ident);
     tac_instr instr = {
         .kind = TAC_ASSIGN_INT,
         .assign_int =
             {
                 .ident = ident,
-                .value = atoi(int_node->value),
+                .value = {.kind = TAC_OPERAND_INT,
+                          .value = atoi(int_node->value)},
             },
     };
     ds_dynamic_array_append(instrs, &instr);
@@ -647,14 +670,15 @@ static void tac_int(tac_context *context, node_info *int_node,
 
 static void tac_string(tac_context *context, node_info *string,
                        ds_dynamic_array *instrs, tac_instr *result) {
-    char *ident;
+    tac_operand ident;
     tac_new_var(context, &ident);
     tac_instr instr = {
         .kind = TAC_ASSIGN_STRING,
         .assign_string =
             {
                 .ident = ident,
-                .value = string->value,
+                .value = {.kind = TAC_OPERAND_STRING,
+                          .string = string->value},
             },
     };
     ds_dynamic_array_append(instrs, &instr);
@@ -665,14 +689,15 @@ static void tac_string(tac_context *context, node_info *string,
 
 static void tac_bool(tac_context *context, node_info *boolean,
                      ds_dynamic_array *instrs, tac_instr *result) {
-    char *ident;
+    tac_operand ident;
     tac_new_var(context, &ident);
     tac_instr instr = {
         .kind = TAC_ASSIGN_BOOL,
         .assign_bool =
             {
                 .ident = ident,
-                .value = strcmp(boolean->value, "true") == 0 ? 1 : 0,
+                .value = {.kind = TAC_OPERAND_BOOL,
+                          .value = strcmp(boolean->value, "true") == 0},
             },
     };
     ds_dynamic_array_append(instrs, &instr);
@@ -683,7 +708,7 @@ static void tac_bool(tac_context *context, node_info *boolean,
 
 static void tac_null(tac_context *context, expr_null *null,
                      ds_dynamic_array *instrs, tac_instr *result) {
-    char *ident;
+    tac_operand ident;
     tac_new_var(context, &ident);
     tac_assign_new assign = {
         .ident = ident,
@@ -759,10 +784,16 @@ static void tac_expr(tac_context *context, expr_node *expr,
     }
 }
 
-int codegen_expr_to_tac(semantic_mapping *mapping, const expr_node *expr, tac_result *tac) {
-    tac_context context = {.result = 0, .temp_count = 0, .label_count = 0, .semantic_mapping = mapping};
-    ds_dynamic_array_init(&context.locals, sizeof(char *));
-    ds_dynamic_array_init(&context.mapping, sizeof(tac_assign_value));
+int codegen_expr_to_tac(semantic_mapping *mapping, semantic_mapping_item *class,
+                        const method_node *method, const expr_node *expr,
+                        tac_result *tac) {
+    tac_context context = {.result = 0,
+                           .temp_count = 0,
+                           .label_count = 0,
+                           .semantic_mapping = mapping,
+                           .class = class,
+                           .method = method};
+    ds_dynamic_array_init(&context.mapping, sizeof(tac_binding));
 
     ds_dynamic_array_init(&tac->instrs, sizeof(tac_instr));
     tac_instr result;
@@ -770,7 +801,56 @@ int codegen_expr_to_tac(semantic_mapping *mapping, const expr_node *expr, tac_re
     tac_expr(&context, (expr_node *)expr, &tac->instrs, &result);
 
     ds_dynamic_array_append(&tac->instrs, &result);
-    ds_dynamic_array_copy(&context.locals, &tac->locals);
+    ds_dynamic_array_free(&context.mapping);
+
+    tac->class = class;
+    tac->method = method;
+    tac->temp_count = context.temp_count;
+    tac->label_count = context.label_count;
 
     return context.result;
 }
+
+#define TAC_OPERAND_NAME_RING 8
+#define TAC_OPERAND_NAME_SIZE 32
+
+// Name of an operand for printing; the names of temporaries and constants
+// live in a small ring of buffers, so use them before the next few calls
+const char *codegen_tac_operand_name(tac_result *tac, tac_operand operand) {
+    static char ring[TAC_OPERAND_NAME_RING][TAC_OPERAND_NAME_SIZE];
+    static unsigned int next = 0;
+
+    char *buffer = ring[next];
+    next = (next + 1) % TAC_OPERAND_NAME_RING;
+
+    switch (operand.kind) {
+    case TAC_OPERAND_TEMP:
+        snprintf(buffer, TAC_OPERAND_NAME_SIZE, "$t%d", operand.index);
+        return buffer;
+    case TAC_OPERAND_FORMAL: {
+        formal_node *formal = NULL;
+        ds_dynamic_array_get_ref((ds_dynamic_array *)&tac->method->formals,
+                                 operand.index, (void **)&formal);
+        return formal->name.value;
+    }
+    case TAC_OPERAND_ATTRIBUTE: {
+        class_mapping_attribute *attribute = NULL;
+        ds_dynamic_array_get_ref(&tac->class->attributes, operand.index,
+                                 (void **)&attribute);
+        return attribute->attribute_name;
+    }
+    case TAC_OPERAND_SELF:
+        return "self";
+    case TAC_OPERAND_INT:
+        snprintf(buffer, TAC_OPERAND_NAME_SIZE, "%d", operand.value);
+        return buffer;
+    case TAC_OPERAND_BOOL:
+        return operand.value ? "true" : "false";
+    case TAC_OPERAND_STRING:
+        return operand.string;
+    case TAC_OPERAND_NONE:
+        break;
+    }
+
+    return "";
+}
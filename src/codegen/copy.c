@@ -0,0 +1,161 @@
+#include "codegen.h"
+#include "ds.h"
+
+static tac_instr *copy_instr(tac_result *tac, unsigned int index) {
+    tac_instr *instr = NULL;
+    ds_dynamic_array_get_ref(&tac->instrs, index, (void **)&instr);
+    return instr;
+}
+
+// In SSA form the formals and self are never written, so only the attributes
+// can change between the copy and a use
+static int copy_is_stable(tac_operand operand) {
+    switch (operand.kind) {
+    case TAC_OPERAND_TEMP:
+    case TAC_OPERAND_FORMAL:
+    case TAC_OPERAND_SELF:
+    case TAC_OPERAND_INT:
+    case TAC_OPERAND_STRING:
+    case TAC_OPERAND_BOOL:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+static int copy_same(tac_operand a, tac_operand b) {
+    if (a.kind != b.kind) {
+        return 0;
+    }
+
+    switch (a.kind) {
+    case TAC_OPERAND_SELF:
+    case TAC_OPERAND_NONE:
+        return 1;
+    case TAC_OPERAND_STRING:
+        return strcmp(a.string, b.string) == 0;
+    default:
+        return a.index == b.index;
+    }
+}
+
+// Follow the chain of copies from a temporary to the value it started from
+static tac_operand copy_resolve(tac_result *tac, tac_operand *sources,
+                                tac_operand operand) {
+    for (unsigned int i = 0; i < tac->temp_count; i++) {
+        if (operand.kind != TAC_OPERAND_TEMP ||
+            sources[operand.index].kind == TAC_OPERAND_NONE) {
+            break;
+        }
+        operand = sources[operand.index];
+    }
+
+    return operand;
+}
+
+// The value of a copy, or of a phi that merges a single value, if any
+static int copy_source(tac_result *tac, tac_operand *sources, tac_instr *instr,
+                       tac_operand ident, tac_operand *source) {
+    switch (instr->kind) {
+    case TAC_ASSIGN_VALUE:
+        *source = copy_resolve(tac, sources, instr->assign_value.expr);
+        break;
+    case TAC_CAST:
+        *source = copy_resolve(tac, sources, instr->cast.expr);
+        break;
+    case TAC_PHI: {
+        int found = 0;
+        for (unsigned int k = 0; k < instr->phi.args.count; k++) {
+            tac_phi_arg arg;
+            ds_dynamic_array_get(&instr->phi.args, k, &arg);
+
+            tac_operand value = copy_resolve(tac, sources, arg.value);
+            if (value.kind == TAC_OPERAND_NONE || copy_same(value, ident)) {
+                continue;
+            }
+
+            if (found && !copy_same(value, *source)) {
+                return 0;
+            }
+
+            *source = value;
+            found = 1;
+        }
+
+        if (!found) {
+            return 0;
+        }
+        break;
+    }
+    default:
+        return 0;
+    }
+
+    return copy_is_stable(*source) && !copy_same(*source, ident);
+}
+
+// Only valid on SSA form TAC, where every temporary has one definition
+void codegen_tac_propagate_copies(tac_result *tac) {
+    tac_operand *sources = malloc(sizeof(tac_operand) * (tac->temp_count + 1));
+    for (unsigned int i = 0; i < tac->temp_count; i++) {
+        sources[i] = (tac_operand){.kind = TAC_OPERAND_NONE};
+    }
+
+    // removing a copy can turn a phi into one, so iterate until no more are
+    // found
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+
+        for (unsigned int i = 0; i < tac->instrs.count; i++) {
+            tac_instr *instr = copy_instr(tac, i);
+
+            tac_operand *def = codegen_tac_instr_def(instr);
+            if (def == NULL || def->kind != TAC_OPERAND_TEMP ||
+                sources[def->index].kind != TAC_OPERAND_NONE) {
+                continue;
+            }
+
+            tac_operand source;
+            if (copy_source(tac, sources, instr, *def, &source)) {
+                sources[def->index] = source;
+                changed = 1;
+            }
+        }
+    }
+
+    ds_dynamic_array uses;
+    ds_dynamic_array_init(&uses, sizeof(tac_operand *));
+
+    ds_dynamic_array instrs;
+    ds_dynamic_array_init(&instrs, sizeof(tac_instr));
+
+    for (unsigned int i = 0; i < tac->instrs.count; i++) {
+        tac_instr *instr = copy_instr(tac, i);
+
+        tac_operand *def = codegen_tac_instr_def(instr);
+        if (def != NULL && def->kind == TAC_OPERAND_TEMP &&
+            sources[def->index].kind != TAC_OPERAND_NONE) {
+            if (instr->kind == TAC_PHI) {
+                ds_dynamic_array_free(&instr->phi.args);
+            }
+            continue;
+        }
+
+        uses.count = 0;
+        codegen_tac_instr_uses(instr, &uses);
+        for (unsigned int k = 0; k < uses.count; k++) {
+            tac_operand *operand = NULL;
+            ds_dynamic_array_get(&uses, k, &operand);
+            *operand = copy_resolve(tac, sources, *operand);
+        }
+
+        ds_dynamic_array_append(&instrs, instr);
+    }
+
+    ds_dynamic_array_free(&tac->instrs);
+    tac->instrs = instrs;
+
+    ds_dynamic_array_free(&uses);
+    free(sources);
+}
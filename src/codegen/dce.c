@@ -0,0 +1,183 @@
+#include "codegen.h"
+#include "ds.h"
+
+static tac_instr *dce_instr(tac_result *tac, unsigned int index) {
+    tac_instr *instr = NULL;
+    ds_dynamic_array_get_ref(&tac->instrs, index, (void **)&instr);
+    return instr;
+}
+
+static void dce_free_instr(tac_instr *instr) {
+    if (instr->kind == TAC_PHI) {
+        ds_dynamic_array_free(&instr->phi.args);
+    } else if (instr->kind == TAC_DISPATCH_CALL) {
+        ds_dynamic_array_free(&instr->dispatch_call.args);
+    } else if (instr->kind == TAC_CASE) {
+        ds_dynamic_array_free(&instr->case_jump.branches);
+    }
+}
+
+// Whether the instruction can be deleted when its result is never read
+static int dce_is_removable(semantic_mapping *mapping, tac_result *tac,
+                            unsigned int index) {
+    tac_instr *instr = dce_instr(tac, index);
+
+    switch (instr->kind) {
+    case TAC_LABEL:
+    case TAC_JUMP:
+    case TAC_JUMP_IF_TRUE:
+    case TAC_CASE:
+    case TAC_DISPATCH_CALL:
+    case TAC_ASSIGN_EQ:
+        return 0;
+    case TAC_IDENT:
+        // the last one is the value of the expression
+        return index + 1 < tac->instrs.count;
+    default:
+        break;
+    }
+
+    tac_operand *def = codegen_tac_instr_def(instr);
+    if (def == NULL || def->kind != TAC_OPERAND_TEMP) {
+        return 0;
+    }
+
+    switch (instr->kind) {
+    case TAC_ASSIGN_DIV:
+        // a division by zero still has to fail
+        return instr->assign_binary.rhs.kind == TAC_OPERAND_INT &&
+               instr->assign_binary.rhs.value != 0;
+    case TAC_ASSIGN_NEW:
+        return codegen_class_init_is_pure(mapping, instr->assign_new.type);
+    default:
+        return 1;
+    }
+}
+
+// Delete the blocks that cannot be reached from the entry, together with
+// the phi arguments that come from them
+static void dce_remove_unreachable(tac_result *tac) {
+    tac_cfg cfg;
+    codegen_tac_cfg_build(tac, &cfg);
+
+    ds_dynamic_array instrs;
+    ds_dynamic_array_init(&instrs, sizeof(tac_instr));
+
+    for (unsigned int i = 0; i < cfg.blocks.count; i++) {
+        tac_basic_block *block = NULL;
+        ds_dynamic_array_get_ref(&cfg.blocks, i, (void **)&block);
+
+        for (unsigned int j = block->start; j < block->end; j++) {
+            tac_instr *instr = dce_instr(tac, j);
+
+            if (block->rpo < 0) {
+                dce_free_instr(instr);
+                continue;
+            }
+
+            if (instr->kind == TAC_PHI) {
+                ds_dynamic_array args;
+                ds_dynamic_array_init(&args, sizeof(tac_phi_arg));
+
+                for (unsigned int k = 0; k < instr->phi.args.count; k++) {
+                    tac_phi_arg arg;
+                    ds_dynamic_array_get(&instr->phi.args, k, &arg);
+
+                    int pred = -1;
+                    ds_dynamic_array_get(&cfg.labels, arg.label, &pred);
+                    tac_basic_block *pred_block = NULL;
+                    if (pred >= 0) {
+                        ds_dynamic_array_get_ref(&cfg.blocks, pred,
+                                                 (void **)&pred_block);
+                    }
+                    if (pred_block == NULL || pred_block->rpo < 0) {
+                        continue;
+                    }
+
+                    ds_dynamic_array_append(&args, &arg);
+                }
+
+                ds_dynamic_array_free(&instr->phi.args);
+                instr->phi.args = args;
+            }
+
+            ds_dynamic_array_append(&instrs, instr);
+        }
+    }
+
+    ds_dynamic_array_free(&tac->instrs);
+    tac->instrs = instrs;
+
+    codegen_tac_cfg_free(&cfg);
+}
+
+void codegen_tac_eliminate_dead_code(semantic_mapping *mapping,
+                                     tac_result *tac) {
+    dce_remove_unreachable(tac);
+
+    unsigned int count = tac->instrs.count;
+    int *def_site = malloc(sizeof(int) * (tac->temp_count + 1));
+    char *live = calloc(count + 1, 1);
+    unsigned int *worklist = malloc(sizeof(unsigned int) * (count + 1));
+    unsigned int top = 0;
+
+    for (unsigned int i = 0; i < tac->temp_count; i++) {
+        def_site[i] = -1;
+    }
+
+    for (unsigned int i = 0; i < count; i++) {
+        tac_operand *def = codegen_tac_instr_def(dce_instr(tac, i));
+        if (def != NULL && def->kind == TAC_OPERAND_TEMP) {
+            def_site[def->index] = i;
+        }
+
+        if (!dce_is_removable(mapping, tac, i)) {
+            live[i] = 1;
+            worklist[top++] = i;
+        }
+    }
+
+    // everything that a live instruction reads is live as well
+    ds_dynamic_array uses;
+    ds_dynamic_array_init(&uses, sizeof(tac_operand *));
+
+    while (top > 0) {
+        unsigned int index = worklist[--top];
+
+        uses.count = 0;
+        codegen_tac_instr_uses(dce_instr(tac, index), &uses);
+        for (unsigned int k = 0; k < uses.count; k++) {
+            tac_operand *operand = NULL;
+            ds_dynamic_array_get(&uses, k, &operand);
+
+            if (operand->kind != TAC_OPERAND_TEMP) {
+                continue;
+            }
+
+            int site = def_site[operand->index];
+            if (site >= 0 && !live[site]) {
+                live[site] = 1;
+                worklist[top++] = site;
+            }
+        }
+    }
+
+    ds_dynamic_array instrs;
+    ds_dynamic_array_init(&instrs, sizeof(tac_instr));
+    for (unsigned int i = 0; i < count; i++) {
+        tac_instr *instr = dce_instr(tac, i);
+        if (live[i]) {
+            ds_dynamic_array_append(&instrs, instr);
+        } else {
+            dce_free_instr(instr);
+        }
+    }
+
+    ds_dynamic_array_free(&tac->instrs);
+    tac->instrs = instrs;
+
+    ds_dynamic_array_free(&uses);
+    free(def_site);
+    free(live);
+    free(worklist);
+}
@@ -0,0 +1,69 @@
+#include "codegen.h"
+#include "ds.h"
+
+// The class whose implementation of the method every class that conforms to
+// the type uses, or NULL if they do not all use the same one
+static const char *devirt_target(semantic_mapping *mapping, const char *type,
+                                 const char *method_name) {
+    const char *target = NULL;
+
+    for (unsigned int i = 0; i < mapping->classes.count; i++) {
+        semantic_mapping_item *class = NULL;
+        ds_dynamic_array_get_ref(&mapping->classes, i, (void **)&class);
+
+        if (!codegen_class_conforms(class, type)) {
+            continue;
+        }
+
+        const char *from_class = NULL;
+        for (unsigned int j = 0; j < class->methods.count; j++) {
+            implementation_mapping_item *method = NULL;
+            ds_dynamic_array_get_ref(&class->methods, j, (void **)&method);
+
+            if (strcmp(method->method_name, method_name) == 0) {
+                from_class = method->from_class;
+                break;
+            }
+        }
+
+        if (from_class == NULL ||
+            (target != NULL && strcmp(target, from_class) != 0)) {
+            return NULL;
+        }
+        target = from_class;
+    }
+
+    return target;
+}
+
+int codegen_tac_devirtualize_call(tac_optimizer *optimizer, tac_result *tac,
+                                  tac_dispatch_call *call) {
+    const char *target =
+        devirt_target(optimizer->mapping,
+                      codegen_tac_receiver_type(tac, call), call->method);
+    if (target == NULL) {
+        return 0;
+    }
+
+    call->type = (char *)target;
+    call->devirtualized = 1;
+    return 1;
+}
+
+void codegen_tac_devirtualize(tac_optimizer *optimizer, tac_result *tac) {
+    for (unsigned int i = 0; i < tac->instrs.count; i++) {
+        tac_instr *instr = NULL;
+        ds_dynamic_array_get_ref(&tac->instrs, i, (void **)&instr);
+
+        if (instr->kind != TAC_DISPATCH_CALL ||
+            instr->dispatch_call.type != NULL) {
+            continue;
+        }
+
+        optimizer->dispatches++;
+        if (codegen_tac_devirtualize_call(optimizer, tac,
+                                          &instr->dispatch_call)) {
+            optimizer->devirtualized++;
+        }
+    }
+}
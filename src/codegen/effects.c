@@ -0,0 +1,385 @@
+#include "codegen.h"
+#include "ds.h"
+
+// Classes nested deeper than this in attribute initializers are assumed to
+// have an init with side effects
+#define EFFECTS_INIT_DEPTH 16
+
+// Runtime methods that only read their receiver and arguments
+static const char *effects_pure_externs[] = {
+    "Object.type_name", "Object.equals", "String.concat", "String.substr",
+    "Byte.to_string",   "Byte.to_int",   "Word.to_int",   "DoubleWord.to_int",
+    "Float.to_int",     "Float.mul",     "Float.div",     "Float.add",
+    "Float.sub",        "Float.neg",     "Float.equals",
+};
+
+static int effects_init_is_pure(semantic_mapping *mapping,
+                                const char *class_name, int depth) {
+    if (depth > EFFECTS_INIT_DEPTH) {
+        return 0;
+    }
+
+    semantic_mapping_item *item = codegen_find_class(mapping, class_name);
+    if (item == NULL) {
+        return 0;
+    }
+
+    for (; item != NULL; item = item->parent) {
+        for (unsigned int i = 0; i < item->attributes.count; i++) {
+            class_mapping_attribute *attribute = NULL;
+            ds_dynamic_array_get_ref(&item->attributes, i,
+                                     (void **)&attribute);
+
+            const expr_node *value = &attribute->attribute->value;
+            switch (value->kind) {
+            case EXPR_NONE:
+            case EXPR_EXTERN:
+            case EXPR_INT:
+            case EXPR_STRING:
+            case EXPR_BOOL:
+            case EXPR_NULL:
+                break;
+            case EXPR_NEW:
+                if (!effects_init_is_pure(mapping, value->new.type.value,
+                                          depth + 1)) {
+                    return 0;
+                }
+                break;
+            default:
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+// The init routine of a class only stores into the new object if every
+// attribute, inherited ones included, starts from a literal, from the
+// runtime or from a new object of a class like that
+int codegen_class_init_is_pure(semantic_mapping *mapping,
+                               const char *class_name) {
+    return effects_init_is_pure(mapping, class_name, 0);
+}
+
+static unsigned int effects_pointer_hash(const void *key) {
+    unsigned long value = (unsigned long)*(const void **)key;
+    return (unsigned int)(value >> 4) * 2654435761u;
+}
+
+static int effects_pointer_compare(const void *a, const void *b) {
+    return *(const void **)a != *(const void **)b;
+}
+
+static tac_method_summary *effects_summary(tac_optimizer *optimizer,
+                                           semantic_mapping_item *class,
+                                           const char *method_name) {
+    for (unsigned int i = 0; i < class->methods.count; i++) {
+        implementation_mapping_item *method = NULL;
+        ds_dynamic_array_get_ref(&class->methods, i, (void **)&method);
+
+        if (strcmp(method->method_name, method_name) != 0) {
+            continue;
+        }
+
+        unsigned int index;
+        if (ds_hash_table_get(&optimizer->summary_index, &method->method,
+                              &index) != 0) {
+            return NULL;
+        }
+
+        tac_method_summary *summary = NULL;
+        ds_dynamic_array_get_ref(&optimizer->summaries, index,
+                                 (void **)&summary);
+        return summary;
+    }
+
+    return NULL;
+}
+
+tac_method_summary *codegen_tac_method_summary(tac_optimizer *optimizer,
+                                               const char *class_name,
+                                               const char *method_name) {
+    semantic_mapping_item *class =
+        codegen_find_class(optimizer->mapping, class_name);
+    if (class == NULL) {
+        return NULL;
+    }
+
+    return effects_summary(optimizer, class, method_name);
+}
+
+int codegen_class_conforms(semantic_mapping_item *class,
+                           const char *class_name) {
+    for (; class != NULL; class = class->parent) {
+        if (strcmp(class->class_name, class_name) == 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+const char *codegen_tac_receiver_type(tac_result *tac,
+                                      tac_dispatch_call *call) {
+    const char *type = call->expr_type;
+    if (type == NULL || strcmp(type, "SELF_TYPE") == 0) {
+        type = tac->class->class_name;
+    }
+
+    return type;
+}
+
+int codegen_tac_call_has_side_effects(tac_optimizer *optimizer,
+                                      tac_result *tac,
+                                      tac_dispatch_call *call) {
+    if (call->type != NULL) {
+        tac_method_summary *summary =
+            codegen_tac_method_summary(optimizer, call->type, call->method);
+        return summary == NULL || summary->side_effects;
+    }
+
+    // a dynamic dispatch can end up in any override of the method
+    const char *type = codegen_tac_receiver_type(tac, call);
+    for (unsigned int i = 0; i < optimizer->mapping->classes.count; i++) {
+        semantic_mapping_item *class = NULL;
+        ds_dynamic_array_get_ref(&optimizer->mapping->classes, i,
+                                 (void **)&class);
+
+        if (!codegen_class_conforms(class, type)) {
+            continue;
+        }
+
+        tac_method_summary *summary =
+            effects_summary(optimizer, class, call->method);
+        if (summary == NULL || summary->side_effects) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// `=` means the equals of the static type if it has its own, else the one
+// of Object. The ones of the runtime types and of Object are compiled
+// inline.
+enum tac_eq_kind codegen_tac_eq_kind(semantic_mapping *mapping,
+                                     const char *type) {
+    if (strcmp(type, "Int") == 0 || strcmp(type, "Bool") == 0) {
+        return TAC_EQ_VALUE;
+    }
+    if (strcmp(type, "String") == 0) {
+        return TAC_EQ_STRING;
+    }
+    if (strcmp(type, "Byte") == 0) {
+        return TAC_EQ_BYTE;
+    }
+
+    semantic_mapping_item *class = codegen_find_class(mapping, type);
+    if (class == NULL) {
+        return TAC_EQ_POINTER;
+    }
+
+    for (unsigned int i = 0; i < class->methods.count; i++) {
+        implementation_mapping_item *method = NULL;
+        ds_dynamic_array_get_ref(&class->methods, i, (void **)&method);
+
+        if (strcmp(method->method_name, "equals") == 0) {
+            return strcmp(method->from_class, type) == 0 ? TAC_EQ_CALL
+                                                         : TAC_EQ_POINTER;
+        }
+    }
+
+    return TAC_EQ_POINTER;
+}
+
+static int effects_eq_has_side_effects(tac_optimizer *optimizer,
+                                       tac_assign_eq *eq) {
+    if (codegen_tac_eq_kind(optimizer->mapping, eq->type) != TAC_EQ_CALL) {
+        return 0;
+    }
+
+    tac_method_summary *summary =
+        codegen_tac_method_summary(optimizer, eq->type, "equals");
+    return summary == NULL || summary->side_effects;
+}
+
+int codegen_tac_instr_has_side_effects(tac_optimizer *optimizer,
+                                       tac_result *tac, tac_instr *instr) {
+    switch (instr->kind) {
+    case TAC_DISPATCH_CALL:
+        return codegen_tac_call_has_side_effects(optimizer, tac,
+                                                 &instr->dispatch_call);
+    case TAC_ASSIGN_EQ:
+        return effects_eq_has_side_effects(optimizer, &instr->assign_eq);
+    case TAC_ASSIGN_NEW:
+        return !codegen_class_init_is_pure(optimizer->mapping,
+                                           instr->assign_new.type);
+    case TAC_STORE_FIELD:
+        return 1;
+    default:
+        break;
+    }
+
+    tac_operand *def = codegen_tac_instr_def(instr);
+    return def != NULL && def->kind == TAC_OPERAND_ATTRIBUTE;
+}
+
+static int effects_is_pure_extern(semantic_mapping_item *class,
+                                  const method_node *method) {
+    char name[256];
+    snprintf(name, sizeof(name), "%s.%s", class->class_name,
+             method->name.value);
+
+    for (unsigned int i = 0; i < sizeof(effects_pure_externs) /
+                                     sizeof(effects_pure_externs[0]);
+         i++) {
+        if (strcmp(effects_pure_externs[i], name) == 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Every method starts out without side effects, and the ones that have an
+// instruction with a side effect are marked until nothing changes, so that
+// recursive methods can still be found free of them
+static void effects_analyze(tac_optimizer *optimizer) {
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+
+        for (unsigned int i = 0; i < optimizer->summaries.count; i++) {
+            tac_method_summary *summary = NULL;
+            ds_dynamic_array_get_ref(&optimizer->summaries, i,
+                                     (void **)&summary);
+
+            if (summary->side_effects) {
+                continue;
+            }
+
+            for (unsigned int j = 0; j < summary->tac.instrs.count; j++) {
+                tac_instr *instr = NULL;
+                ds_dynamic_array_get_ref(&summary->tac.instrs, j,
+                                         (void **)&instr);
+
+                if (codegen_tac_instr_has_side_effects(optimizer,
+                                                       &summary->tac, instr)) {
+                    summary->side_effects = 1;
+                    changed = 1;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void codegen_tac_options_init(tac_options *options) {
+    options->inline_threshold = TAC_INLINE_THRESHOLD;
+    options->verify = 0;
+    options->time_passes = 0;
+    options->profile_path = NULL;
+    options->profile = NULL;
+    codegen_tac_options_set_level(options, TAC_OPT_LEVEL);
+}
+
+void codegen_tac_optimizer_init(tac_optimizer *optimizer,
+                                semantic_mapping *mapping,
+                                const tac_options *options) {
+    optimizer->mapping = mapping;
+    optimizer->options = *options;
+    optimizer->eliminated = 0;
+    optimizer->dispatches = 0;
+    optimizer->devirtualized = 0;
+    optimizer->inlined = 0;
+    optimizer->on_stack = 0;
+    memset(optimizer->stats, 0, sizeof(optimizer->stats));
+    optimizer->dispatch_sites = 0;
+    optimizer->branch_sites = 0;
+    optimizer->speculated = 0;
+    optimizer->propagated = 0;
+    optimizer->hoisted = 0;
+    ds_dynamic_array_init(&optimizer->specializations,
+                          sizeof(tac_specialization));
+    ds_dynamic_array_init(&optimizer->summaries, sizeof(tac_method_summary));
+    ds_hash_table_init(&optimizer->summary_index, sizeof(const method_node *),
+                       sizeof(unsigned int), 1024, effects_pointer_hash,
+                       effects_pointer_compare);
+
+    for (unsigned int i = 0; i < mapping->classes.count; i++) {
+        semantic_mapping_item *class = NULL;
+        ds_dynamic_array_get_ref(&mapping->classes, i, (void **)&class);
+
+        for (unsigned int j = 0; j < class->methods.count; j++) {
+            implementation_mapping_item *method = NULL;
+            ds_dynamic_array_get_ref(&class->methods, j, (void **)&method);
+
+            if (strcmp(method->from_class, class->class_name) != 0) {
+                continue;
+            }
+
+            tac_method_summary summary = {.class = class,
+                                          .method = method->method};
+            if (method->method->body.kind == EXPR_EXTERN) {
+                summary.side_effects =
+                    !effects_is_pure_extern(class, method->method);
+                summary.tac = (tac_result){.class = class,
+                                           .method = method->method};
+                ds_dynamic_array_init(&summary.tac.instrs, sizeof(tac_instr));
+            } else {
+                codegen_expr_to_tac(mapping, class, method->method,
+                                    &method->method->body, &summary.tac);
+            }
+            codegen_tac_number_summary_sites(optimizer, &summary);
+
+            unsigned int index = optimizer->summaries.count;
+            ds_hash_table_insert(&optimizer->summary_index, &method->method,
+                                 &index);
+            ds_dynamic_array_append(&optimizer->summaries, &summary);
+        }
+    }
+
+    effects_analyze(optimizer);
+    codegen_tac_count_allocations(optimizer);
+    optimizer->constants = calloc(optimizer->summaries.count + 1,
+                                  sizeof(tac_method_constants));
+
+    if (options->profile != NULL &&
+        !codegen_tac_profile_matches(optimizer, options->profile)) {
+        DS_LOG_WARN("The profile is of another program, ignoring it");
+        optimizer->options.profile = NULL;
+    }
+}
+
+int codegen_tac_summary_index(tac_optimizer *optimizer,
+                              const method_node *method) {
+    unsigned int index;
+    if (method == NULL ||
+        ds_hash_table_get(&optimizer->summary_index, &method, &index) != 0) {
+        return -1;
+    }
+
+    return index;
+}
+
+void codegen_tac_optimizer_free(tac_optimizer *optimizer) {
+    for (unsigned int i = 0; i < optimizer->summaries.count; i++) {
+        tac_method_summary *summary = NULL;
+        ds_dynamic_array_get_ref(&optimizer->summaries, i, (void **)&summary);
+        ds_dynamic_array_free(&summary->tac.instrs);
+    }
+
+    ds_dynamic_array_free(&optimizer->summaries);
+    ds_hash_table_free(&optimizer->summary_index);
+    free(optimizer->allocations);
+
+    for (unsigned int i = 0; i < optimizer->specializations.count; i++) {
+        tac_specialization *specialization = NULL;
+        ds_dynamic_array_get_ref(&optimizer->specializations, i,
+                                 (void **)&specialization);
+        ds_dynamic_array_free(&specialization->args);
+    }
+    ds_dynamic_array_free(&optimizer->specializations);
+    free(optimizer->constants);
+}
@@ -0,0 +1,178 @@
+#include "codegen.h"
+#include "ds.h"
+
+static tac_instr *escape_instr(tac_result *tac, unsigned int index) {
+    tac_instr *instr = NULL;
+    ds_dynamic_array_get_ref(&tac->instrs, index, (void **)&instr);
+    return instr;
+}
+
+static unsigned int escape_find(unsigned int *groups, unsigned int temp) {
+    while (groups[temp] != temp) {
+        groups[temp] = groups[groups[temp]];
+        temp = groups[temp];
+    }
+    return temp;
+}
+
+static void escape_union(unsigned int *groups, tac_operand a, tac_operand b) {
+    if (a.kind != TAC_OPERAND_TEMP || b.kind != TAC_OPERAND_TEMP) {
+        return;
+    }
+
+    groups[escape_find(groups, a.index)] = escape_find(groups, b.index);
+}
+
+// The objects that can live in the frame of the method: their init cannot
+// hand self to anyone and their size is known. The classes with extern
+// attributes keep raw values that the runtime may resize or point into.
+static int escape_can_stack(semantic_mapping *mapping, const char *type) {
+    if (strcmp(type, "SELF_TYPE") == 0 ||
+        !codegen_class_init_is_pure(mapping, type)) {
+        return 0;
+    }
+
+    semantic_mapping_item *item = codegen_find_class(mapping, type);
+    for (unsigned int i = 0; i < item->attributes.count; i++) {
+        class_mapping_attribute *attribute = NULL;
+        ds_dynamic_array_get_ref(&item->attributes, i, (void **)&attribute);
+
+        if (attribute->attribute->value.kind == EXPR_EXTERN) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// The temporaries whose value a copy or a phi passes on to its destination
+static int escape_is_copy(tac_instr *instr) {
+    switch (instr->kind) {
+    case TAC_ASSIGN_VALUE:
+        return instr->assign_value.ident.kind == TAC_OPERAND_TEMP;
+    case TAC_CAST:
+        return instr->cast.ident.kind == TAC_OPERAND_TEMP;
+    case TAC_PHI:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// Whether reading the operand lets the object it points to be reached after
+// the method returns: being stored, passed to a call, returned or compared
+// by a method. Field accesses and tag tests only look at the object.
+static int escape_use_escapes(semantic_mapping *mapping, tac_result *tac,
+                              unsigned int index, tac_instr *instr,
+                              tac_operand *operand) {
+    switch (instr->kind) {
+    case TAC_ASSIGN_EQ:
+        return codegen_tac_eq_kind(mapping, instr->assign_eq.type) ==
+               TAC_EQ_CALL;
+    case TAC_LOAD_FIELD:
+    case TAC_CHECK_VOID:
+    case TAC_ASSIGN_ISVOID:
+    case TAC_ASSIGN_ISINSTANCE:
+    case TAC_CASE:
+        return 0;
+    case TAC_STORE_FIELD:
+        return operand == &instr->field.value;
+    case TAC_IDENT:
+        return index + 1 == tac->instrs.count;
+    default:
+        return !escape_is_copy(instr);
+    }
+}
+
+void codegen_tac_allocate_on_stack(tac_optimizer *optimizer,
+                                   tac_result *tac) {
+    if (tac->temp_count == 0) {
+        return;
+    }
+
+    tac_cfg cfg;
+    codegen_tac_cfg_build(tac, &cfg);
+
+    unsigned int *groups = malloc(sizeof(unsigned int) * tac->temp_count);
+    int *escapes = calloc(tac->temp_count, sizeof(int));
+    int *merged = calloc(tac->temp_count, sizeof(int));
+    for (unsigned int i = 0; i < tac->temp_count; i++) {
+        groups[i] = i;
+    }
+
+    ds_dynamic_array uses;
+    ds_dynamic_array_init(&uses, sizeof(tac_operand *));
+
+    // the temporaries that can hold the same object end up in one group
+    for (unsigned int i = 0; i < tac->instrs.count; i++) {
+        tac_instr *instr = escape_instr(tac, i);
+        if (!escape_is_copy(instr)) {
+            continue;
+        }
+
+        tac_operand *def = codegen_tac_instr_def(instr);
+        uses.count = 0;
+        codegen_tac_instr_uses(instr, &uses);
+        for (unsigned int k = 0; k < uses.count; k++) {
+            tac_operand *operand = NULL;
+            ds_dynamic_array_get(&uses, k, &operand);
+            escape_union(groups, *def, *operand);
+        }
+    }
+
+    for (unsigned int i = 0; i < tac->instrs.count; i++) {
+        tac_instr *instr = escape_instr(tac, i);
+
+        if (instr->kind == TAC_PHI) {
+            merged[escape_find(groups, instr->phi.ident.index)] = 1;
+        }
+
+        uses.count = 0;
+        codegen_tac_instr_uses(instr, &uses);
+        for (unsigned int k = 0; k < uses.count; k++) {
+            tac_operand *operand = NULL;
+            ds_dynamic_array_get(&uses, k, &operand);
+
+            if (operand->kind == TAC_OPERAND_TEMP &&
+                escape_use_escapes(optimizer->mapping, tac, i, instr,
+                                   operand)) {
+                escapes[escape_find(groups, operand->index)] = 1;
+            }
+        }
+    }
+
+    for (unsigned int b = 0; b < cfg.blocks.count; b++) {
+        tac_basic_block *block = NULL;
+        ds_dynamic_array_get_ref(&cfg.blocks, b, (void **)&block);
+
+        for (unsigned int i = block->start; i < block->end; i++) {
+            tac_instr *instr = escape_instr(tac, i);
+            if (instr->kind != TAC_ASSIGN_NEW ||
+                instr->assign_new.ident.kind != TAC_OPERAND_TEMP) {
+                continue;
+            }
+
+            unsigned int group =
+                escape_find(groups, instr->assign_new.ident.index);
+            if (escapes[group] ||
+                !escape_can_stack(optimizer->mapping, instr->assign_new.type)) {
+                continue;
+            }
+
+            // inside a loop the same slots are reused by every iteration,
+            // which is only safe if no object outlives its iteration
+            if (block->loop_depth > 0 && merged[group]) {
+                continue;
+            }
+
+            instr->assign_new.stack = 1;
+            optimizer->on_stack++;
+        }
+    }
+
+    ds_dynamic_array_free(&uses);
+    free(groups);
+    free(escapes);
+    free(merged);
+    codegen_tac_cfg_free(&cfg);
+}
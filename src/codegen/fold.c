@@ -0,0 +1,556 @@
+#include "codegen.h"
+#include "ds.h"
+#include <limits.h>
+
+// The lattice of a temporary: nothing is known yet, it is a known Int or
+// Bool constant, it is some object that cannot be void, or it can be anything
+enum fold_state {
+    FOLD_UNKNOWN,
+    FOLD_CONST,
+    FOLD_OBJECT,
+    FOLD_VARYING,
+};
+
+typedef struct fold_value {
+        enum fold_state state;
+        tac_operand constant;
+} fold_value;
+
+typedef struct fold_context {
+        tac_result *tac;
+        tac_cfg *cfg;
+        fold_value *values;         // one per temporary
+        char *reachable;            // one per block
+        ds_dynamic_array *feasible; // char, parallel to the preds of a block
+        int changed;
+} fold_context;
+
+static tac_basic_block *fold_block(tac_cfg *cfg, unsigned int index) {
+    tac_basic_block *block = NULL;
+    ds_dynamic_array_get_ref(&cfg->blocks, index, (void **)&block);
+    return block;
+}
+
+static tac_instr *fold_instr(tac_result *tac, unsigned int index) {
+    tac_instr *instr = NULL;
+    ds_dynamic_array_get_ref(&tac->instrs, index, (void **)&instr);
+    return instr;
+}
+
+static unsigned int fold_label_block(tac_cfg *cfg, int label) {
+    int index = -1;
+    ds_dynamic_array_get(&cfg->labels, label, &index);
+    return index;
+}
+
+static fold_value fold_state(enum fold_state state) {
+    return (fold_value){.state = state};
+}
+
+static fold_value fold_int(long long value) {
+    if (value < INT_MIN || value > INT_MAX) {
+        return fold_state(FOLD_OBJECT);
+    }
+
+    return (fold_value){.state = FOLD_CONST,
+                        .constant = {.kind = TAC_OPERAND_INT,
+                                     .value = (int)value}};
+}
+
+static fold_value fold_bool(int value) {
+    return (fold_value){.state = FOLD_CONST,
+                        .constant = {.kind = TAC_OPERAND_BOOL,
+                                     .value = value != 0}};
+}
+
+static int fold_is_const(fold_value value, enum tac_operand_kind kind) {
+    return value.state == FOLD_CONST && value.constant.kind == kind;
+}
+
+static int fold_equal(fold_value a, fold_value b) {
+    if (a.state != b.state) {
+        return 0;
+    }
+
+    if (a.state != FOLD_CONST) {
+        return 1;
+    }
+
+    return a.constant.kind == b.constant.kind &&
+           a.constant.value == b.constant.value;
+}
+
+static fold_value fold_meet(fold_value a, fold_value b) {
+    if (a.state == FOLD_UNKNOWN) {
+        return b;
+    }
+    if (b.state == FOLD_UNKNOWN) {
+        return a;
+    }
+    if (a.state == FOLD_VARYING || b.state == FOLD_VARYING) {
+        return fold_state(FOLD_VARYING);
+    }
+    if (fold_equal(a, b)) {
+        return a;
+    }
+
+    // two different constants are still two objects
+    return fold_state(FOLD_OBJECT);
+}
+
+static fold_value fold_operand(fold_context *context, tac_operand operand) {
+    switch (operand.kind) {
+    case TAC_OPERAND_INT:
+    case TAC_OPERAND_BOOL:
+        return (fold_value){.state = FOLD_CONST, .constant = operand};
+    case TAC_OPERAND_STRING:
+    case TAC_OPERAND_SELF:
+        return fold_state(FOLD_OBJECT);
+    case TAC_OPERAND_TEMP:
+        return context->values[operand.index];
+    case TAC_OPERAND_NONE:
+        return fold_state(FOLD_UNKNOWN);
+    default:
+        return fold_state(FOLD_VARYING);
+    }
+}
+
+static fold_value fold_binary(enum tac_kind kind, fold_value lhs,
+                              fold_value rhs) {
+    if (lhs.state == FOLD_UNKNOWN || rhs.state == FOLD_UNKNOWN) {
+        return fold_state(FOLD_UNKNOWN);
+    }
+
+    // the arithmetic always allocates a fresh result
+    if (!fold_is_const(lhs, TAC_OPERAND_INT) ||
+        !fold_is_const(rhs, TAC_OPERAND_INT)) {
+        return fold_state(FOLD_OBJECT);
+    }
+
+    long long a = lhs.constant.value;
+    long long b = rhs.constant.value;
+
+    switch (kind) {
+    case TAC_ASSIGN_ADD:
+        return fold_int(a + b);
+    case TAC_ASSIGN_SUB:
+        return fold_int(a - b);
+    case TAC_ASSIGN_MUL:
+        return fold_int(a * b);
+    case TAC_ASSIGN_DIV:
+        // keep the division so that it still fails at runtime
+        if (b == 0) {
+            return fold_state(FOLD_OBJECT);
+        }
+        return fold_int(a / b);
+    case TAC_ASSIGN_LT:
+        return fold_bool(a < b);
+    case TAC_ASSIGN_LE:
+        return fold_bool(a <= b);
+    default:
+        return fold_state(FOLD_OBJECT);
+    }
+}
+
+static fold_value fold_default(const char *type) {
+    if (strcmp(type, "Int") == 0) {
+        return fold_int(0);
+    }
+    if (strcmp(type, "Bool") == 0) {
+        return fold_bool(0);
+    }
+    if (strcmp(type, "String") == 0) {
+        return fold_state(FOLD_OBJECT);
+    }
+
+    return fold_state(FOLD_VARYING);
+}
+
+static int fold_edge(fold_context *context, unsigned int from, unsigned int to,
+                     char **feasible) {
+    tac_basic_block *block = fold_block(context->cfg, to);
+
+    for (unsigned int k = 0; k < block->preds.count; k++) {
+        unsigned int pred;
+        ds_dynamic_array_get(&block->preds, k, &pred);
+        if (pred == from) {
+            ds_dynamic_array_get_ref(&context->feasible[to], k,
+                                     (void **)feasible);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+static int fold_is_feasible(fold_context *context, unsigned int from,
+                            unsigned int to) {
+    char *feasible = NULL;
+    return fold_edge(context, from, to, &feasible) && *feasible;
+}
+
+static void fold_mark_edge(fold_context *context, unsigned int from,
+                           unsigned int to) {
+    char *feasible = NULL;
+    if (!fold_edge(context, from, to, &feasible) || *feasible) {
+        return;
+    }
+
+    *feasible = 1;
+    context->reachable[to] = 1;
+    context->changed = 1;
+}
+
+static fold_value fold_phi(fold_context *context, unsigned int index,
+                           tac_phi *phi) {
+    fold_value value = fold_state(FOLD_UNKNOWN);
+
+    for (unsigned int k = 0; k < phi->args.count; k++) {
+        tac_phi_arg arg;
+        ds_dynamic_array_get(&phi->args, k, &arg);
+
+        int pred = fold_label_block(context->cfg, arg.label);
+        if (pred < 0 || !fold_is_feasible(context, pred, index)) {
+            continue;
+        }
+
+        value = fold_meet(value, fold_operand(context, arg.value));
+    }
+
+    return value;
+}
+
+static fold_value fold_eval(fold_context *context, unsigned int index,
+                            tac_instr *instr) {
+    fold_value value;
+
+    switch (instr->kind) {
+    case TAC_ASSIGN_INT:
+        return fold_operand(context, instr->assign_int.value);
+    case TAC_ASSIGN_BOOL:
+        return fold_operand(context, instr->assign_bool.value);
+    case TAC_ASSIGN_STRING:
+    case TAC_ASSIGN_NEW:
+    case TAC_ASSIGN_ISINSTANCE:
+        return fold_state(FOLD_OBJECT);
+    case TAC_ASSIGN_DEFAULT:
+        return fold_default(instr->assign_default.type);
+    case TAC_ASSIGN_VALUE:
+        return fold_operand(context, instr->assign_value.expr);
+    case TAC_CAST:
+        return fold_operand(context, instr->cast.expr);
+    case TAC_ASSIGN_ISVOID:
+        value = fold_operand(context, instr->assign_unary.expr);
+        if (value.state == FOLD_UNKNOWN) {
+            return value;
+        }
+        if (value.state == FOLD_VARYING) {
+            return fold_state(FOLD_OBJECT);
+        }
+        return fold_bool(0);
+    case TAC_ASSIGN_NEG:
+        value = fold_operand(context, instr->assign_unary.expr);
+        if (value.state == FOLD_UNKNOWN) {
+            return value;
+        }
+        if (fold_is_const(value, TAC_OPERAND_INT)) {
+            return fold_int(-(long long)value.constant.value);
+        }
+        return fold_state(FOLD_OBJECT);
+    case TAC_ASSIGN_NOT:
+        value = fold_operand(context, instr->assign_unary.expr);
+        if (value.state == FOLD_UNKNOWN) {
+            return value;
+        }
+        if (fold_is_const(value, TAC_OPERAND_BOOL)) {
+            return fold_bool(!value.constant.value);
+        }
+        return fold_state(FOLD_OBJECT);
+    case TAC_ASSIGN_ADD:
+    case TAC_ASSIGN_SUB:
+    case TAC_ASSIGN_MUL:
+    case TAC_ASSIGN_DIV:
+    case TAC_ASSIGN_LT:
+    case TAC_ASSIGN_LE:
+        return fold_binary(instr->kind,
+                           fold_operand(context, instr->assign_binary.lhs),
+                           fold_operand(context, instr->assign_binary.rhs));
+    case TAC_ASSIGN_EQ: {
+        fold_value lhs = fold_operand(context, instr->assign_eq.lhs);
+        fold_value rhs = fold_operand(context, instr->assign_eq.rhs);
+        if (lhs.state == FOLD_UNKNOWN || rhs.state == FOLD_UNKNOWN) {
+            return fold_state(FOLD_UNKNOWN);
+        }
+        // anything else goes through a call to equals
+        if (lhs.state == FOLD_CONST && rhs.state == FOLD_CONST &&
+            lhs.constant.kind == rhs.constant.kind) {
+            return fold_bool(lhs.constant.value == rhs.constant.value);
+        }
+        return fold_state(FOLD_VARYING);
+    }
+    case TAC_PHI:
+        return fold_phi(context, index, &instr->phi);
+    default:
+        return fold_state(FOLD_VARYING);
+    }
+}
+
+static void fold_visit_block(fold_context *context, unsigned int index) {
+    tac_result *tac = context->tac;
+    tac_cfg *cfg = context->cfg;
+    tac_basic_block *block = fold_block(cfg, index);
+
+    for (unsigned int i = block->start + 1; i < block->end; i++) {
+        tac_instr *instr = fold_instr(tac, i);
+
+        tac_operand *def = codegen_tac_instr_def(instr);
+        if (def == NULL || def->kind != TAC_OPERAND_TEMP) {
+            continue;
+        }
+
+        fold_value *old = &context->values[def->index];
+        fold_value value = fold_meet(*old, fold_eval(context, index, instr));
+        if (!fold_equal(*old, value)) {
+            *old = value;
+            context->changed = 1;
+        }
+    }
+
+    tac_instr *last = fold_instr(tac, block->end - 1);
+    unsigned int next = index + 1;
+
+    if (last->kind == TAC_JUMP) {
+        fold_mark_edge(context, index,
+                       fold_label_block(cfg, last->jump.label));
+    } else if (last->kind == TAC_JUMP_IF_TRUE) {
+        fold_value cond = fold_operand(context, last->jump_if_true.expr);
+        unsigned int target = fold_label_block(cfg, last->jump_if_true.label);
+
+        if (cond.state == FOLD_UNKNOWN) {
+            return;
+        }
+
+        if (fold_is_const(cond, TAC_OPERAND_BOOL)) {
+            fold_mark_edge(context, index, cond.constant.value ? target : next);
+        } else {
+            fold_mark_edge(context, index, target);
+            fold_mark_edge(context, index, next);
+        }
+    } else if (last->kind == TAC_CASE) {
+        for (unsigned int k = 0; k < last->case_jump.branches.count; k++) {
+            tac_case_branch branch;
+            ds_dynamic_array_get(&last->case_jump.branches, k, &branch);
+            fold_mark_edge(context, index, fold_label_block(cfg, branch.label));
+        }
+    } else if (!(last->kind == TAC_IDENT && block->end == tac->instrs.count) &&
+               next < cfg->blocks.count) {
+        fold_mark_edge(context, index, next);
+    }
+}
+
+static tac_instr fold_constant_instr(tac_operand ident, tac_operand constant) {
+    if (constant.kind == TAC_OPERAND_INT) {
+        return (tac_instr){.kind = TAC_ASSIGN_INT,
+                           .assign_int = {.ident = ident, .value = constant}};
+    }
+
+    return (tac_instr){.kind = TAC_ASSIGN_BOOL,
+                       .assign_bool = {.ident = ident, .value = constant}};
+}
+
+// Replace every use of a constant temporary by the constant itself
+static void fold_substitute(fold_context *context, tac_instr *instr,
+                            ds_dynamic_array *uses) {
+    uses->count = 0;
+    codegen_tac_instr_uses(instr, uses);
+
+    for (unsigned int k = 0; k < uses->count; k++) {
+        tac_operand *operand = NULL;
+        ds_dynamic_array_get(uses, k, &operand);
+
+        if (operand->kind != TAC_OPERAND_TEMP) {
+            continue;
+        }
+
+        fold_value value = context->values[operand->index];
+        if (value.state == FOLD_CONST) {
+            *operand = value.constant;
+        }
+    }
+}
+
+static void fold_rewrite(fold_context *context) {
+    tac_result *tac = context->tac;
+    tac_cfg *cfg = context->cfg;
+
+    ds_dynamic_array uses;
+    ds_dynamic_array_init(&uses, sizeof(tac_operand *));
+
+    ds_dynamic_array instrs;
+    ds_dynamic_array_init(&instrs, sizeof(tac_instr));
+
+    // constant phis become plain assignments after the remaining phis
+    ds_dynamic_array folded;
+    ds_dynamic_array_init(&folded, sizeof(tac_instr));
+
+    for (unsigned int i = 0; i < cfg->blocks.count; i++) {
+        tac_basic_block *block = fold_block(cfg, i);
+
+        if (!context->reachable[i]) {
+            for (unsigned int j = block->start; j < block->end; j++) {
+                ds_dynamic_array_append(&instrs, fold_instr(tac, j));
+            }
+            continue;
+        }
+
+        ds_dynamic_array_append(&instrs, fold_instr(tac, block->start));
+
+        unsigned int j = block->start + 1;
+        for (; j < block->end; j++) {
+            tac_instr *instr = fold_instr(tac, j);
+            if (instr->kind != TAC_PHI) {
+                break;
+            }
+
+            fold_value value = context->values[instr->phi.ident.index];
+            if (value.state == FOLD_CONST) {
+                tac_instr constant =
+                    fold_constant_instr(instr->phi.ident, value.constant);
+                ds_dynamic_array_append(&folded, &constant);
+                ds_dynamic_array_free(&instr->phi.args);
+                continue;
+            }
+
+            // drop the arguments of the edges that are never taken
+            ds_dynamic_array args;
+            ds_dynamic_array_init(&args, sizeof(tac_phi_arg));
+            for (unsigned int k = 0; k < instr->phi.args.count; k++) {
+                tac_phi_arg arg;
+                ds_dynamic_array_get(&instr->phi.args, k, &arg);
+
+                int pred = fold_label_block(cfg, arg.label);
+                if (pred < 0 || !fold_is_feasible(context, pred, i)) {
+                    continue;
+                }
+
+                ds_dynamic_array_append(&args, &arg);
+            }
+            ds_dynamic_array_free(&instr->phi.args);
+            instr->phi.args = args;
+
+            fold_substitute(context, instr, &uses);
+            ds_dynamic_array_append(&instrs, instr);
+        }
+
+        for (unsigned int k = 0; k < folded.count; k++) {
+            tac_instr constant;
+            ds_dynamic_array_get(&folded, k, &constant);
+            ds_dynamic_array_append(&instrs, &constant);
+        }
+        folded.count = 0;
+
+        for (; j < block->end; j++) {
+            tac_instr *instr = fold_instr(tac, j);
+
+            tac_operand *def = codegen_tac_instr_def(instr);
+            if (def != NULL && def->kind == TAC_OPERAND_TEMP &&
+                context->values[def->index].state == FOLD_CONST) {
+                tac_instr constant = fold_constant_instr(
+                    *def, context->values[def->index].constant);
+                ds_dynamic_array_append(&instrs, &constant);
+                continue;
+            }
+
+            // a value that cannot be void needs no check
+            if (instr->kind == TAC_CHECK_VOID) {
+                fold_value value =
+                    fold_operand(context, instr->check_void.expr);
+                if (value.state == FOLD_CONST ||
+                    value.state == FOLD_OBJECT) {
+                    continue;
+                }
+            }
+
+            fold_substitute(context, instr, &uses);
+
+            if (instr->kind == TAC_JUMP_IF_TRUE &&
+                instr->jump_if_true.expr.kind == TAC_OPERAND_BOOL) {
+                if (!instr->jump_if_true.expr.value) {
+                    continue;
+                }
+
+                tac_instr jump = {.kind = TAC_JUMP,
+                                  .jump = {.label =
+                                               instr->jump_if_true.label}};
+                ds_dynamic_array_append(&instrs, &jump);
+                continue;
+            }
+
+            ds_dynamic_array_append(&instrs, instr);
+        }
+    }
+
+    ds_dynamic_array_free(&tac->instrs);
+    tac->instrs = instrs;
+
+    ds_dynamic_array_free(&folded);
+    ds_dynamic_array_free(&uses);
+}
+
+// Sparse conditional constant propagation: the values of the temporaries
+// and the reachable edges are computed together, iterating over the blocks
+// in RPO until nothing changes, so a branch on a constant never makes the
+// other side's values varying
+void codegen_tac_fold_constants(tac_result *tac) {
+    tac_cfg cfg;
+    codegen_tac_cfg_build(tac, &cfg);
+
+    fold_context context = {.tac = tac, .cfg = &cfg};
+    context.values = malloc(sizeof(fold_value) * (tac->temp_count + 1));
+    context.reachable = calloc(cfg.blocks.count + 1, 1);
+    context.feasible =
+        malloc(sizeof(ds_dynamic_array) * (cfg.blocks.count + 1));
+
+    // a temporary without a definition keeps whatever is in its slot
+    for (unsigned int i = 0; i < tac->temp_count; i++) {
+        context.values[i] = fold_state(FOLD_VARYING);
+    }
+    for (unsigned int i = 0; i < tac->instrs.count; i++) {
+        tac_operand *def = codegen_tac_instr_def(fold_instr(tac, i));
+        if (def != NULL && def->kind == TAC_OPERAND_TEMP) {
+            context.values[def->index] = fold_state(FOLD_UNKNOWN);
+        }
+    }
+
+    for (unsigned int i = 0; i < cfg.blocks.count; i++) {
+        ds_dynamic_array_init(&context.feasible[i], sizeof(char));
+        char none = 0;
+        for (unsigned int k = 0; k < fold_block(&cfg, i)->preds.count; k++) {
+            ds_dynamic_array_append(&context.feasible[i], &none);
+        }
+    }
+
+    context.reachable[0] = 1;
+    context.changed = 1;
+    while (context.changed) {
+        context.changed = 0;
+
+        for (unsigned int i = 0; i < cfg.order.count; i++) {
+            unsigned int index;
+            ds_dynamic_array_get(&cfg.order, i, &index);
+            if (context.reachable[index]) {
+                fold_visit_block(&context, index);
+            }
+        }
+    }
+
+    fold_rewrite(&context);
+
+    for (unsigned int i = 0; i < cfg.blocks.count; i++) {
+        ds_dynamic_array_free(&context.feasible[i]);
+    }
+    free(context.feasible);
+    free(context.reachable);
+    free(context.values);
+    codegen_tac_cfg_free(&cfg);
+}
@@ -0,0 +1,479 @@
+#include "codegen.h"
+#include "ds.h"
+
+// Calls with more arguments than this are never numbered
+#define GVN_MAX_OPERANDS 8
+
+// The expression an instruction computes. Instructions that read memory,
+// the attributes of self or anything a call can reach, also carry the
+// generation of memory they read, which changes with every side effect.
+typedef struct gvn_key {
+        enum tac_kind kind;
+        const char *type;
+        const char *method;
+        unsigned int generation;
+        unsigned int count;
+        tac_operand operands[GVN_MAX_OPERANDS];
+} gvn_key;
+
+// Entries are never removed from the table, only marked dead when the walk
+// leaves the subtree of the dominator tree where they are available
+typedef struct gvn_value {
+        tac_operand operand;
+        int available;
+} gvn_value;
+
+typedef struct gvn_state {
+        tac_optimizer *optimizer;
+        tac_result *tac;
+        tac_cfg cfg;
+        ds_dynamic_array children; // ds_dynamic_array of unsigned int
+        ds_hash_table values;      // gvn_key -> gvn_value
+        ds_dynamic_array scope;    // gvn_key, in the order of insertion
+        tac_operand *replacements; // temp -> operand, NONE if kept
+        char *removed;
+        unsigned int generation;
+        unsigned int generation_count;
+        unsigned int eliminated;
+} gvn_state;
+
+static tac_instr *gvn_instr(tac_result *tac, unsigned int index) {
+    tac_instr *instr = NULL;
+    ds_dynamic_array_get_ref(&tac->instrs, index, (void **)&instr);
+    return instr;
+}
+
+static unsigned int gvn_string_hash(const char *string) {
+    unsigned int hash = 5381;
+    if (string != NULL) {
+        for (; *string != '\0'; string++) {
+            hash = hash * 33 + (unsigned char)*string;
+        }
+    }
+    return hash;
+}
+
+static int gvn_string_compare(const char *a, const char *b) {
+    if (a == NULL || b == NULL) {
+        return a != b;
+    }
+    return strcmp(a, b);
+}
+
+static unsigned int gvn_operand_hash(tac_operand operand) {
+    unsigned int hash = operand.kind * 31;
+    switch (operand.kind) {
+    case TAC_OPERAND_NONE:
+    case TAC_OPERAND_SELF:
+        return hash;
+    case TAC_OPERAND_STRING:
+        return hash + gvn_string_hash(operand.string);
+    default:
+        return hash + operand.index;
+    }
+}
+
+static int gvn_operand_compare(tac_operand a, tac_operand b) {
+    if (a.kind != b.kind) {
+        return 1;
+    }
+
+    switch (a.kind) {
+    case TAC_OPERAND_NONE:
+    case TAC_OPERAND_SELF:
+        return 0;
+    case TAC_OPERAND_STRING:
+        return gvn_string_compare(a.string, b.string);
+    default:
+        return a.index != b.index;
+    }
+}
+
+static unsigned int gvn_key_hash(const void *key) {
+    const gvn_key *k = key;
+
+    unsigned int hash = k->kind;
+    hash = hash * 31 + gvn_string_hash(k->type);
+    hash = hash * 31 + gvn_string_hash(k->method);
+    hash = hash * 31 + k->generation;
+    for (unsigned int i = 0; i < k->count; i++) {
+        hash = hash * 31 + gvn_operand_hash(k->operands[i]);
+    }
+
+    return hash;
+}
+
+static int gvn_key_compare(const void *a, const void *b) {
+    const gvn_key *ka = a;
+    const gvn_key *kb = b;
+
+    if (ka->kind != kb->kind || ka->generation != kb->generation ||
+        ka->count != kb->count || gvn_string_compare(ka->type, kb->type) ||
+        gvn_string_compare(ka->method, kb->method)) {
+        return 1;
+    }
+
+    for (unsigned int i = 0; i < ka->count; i++) {
+        if (gvn_operand_compare(ka->operands[i], kb->operands[i])) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// A value that is not a temporary is fixed for the whole method, except for
+// the attributes
+static int gvn_is_stable(tac_operand operand) {
+    return operand.kind != TAC_OPERAND_NONE &&
+           operand.kind != TAC_OPERAND_ATTRIBUTE;
+}
+
+static void gvn_key_push(gvn_key *key, tac_operand operand) {
+    key->operands[key->count++] = operand;
+}
+
+// Order the operands of a commutative instruction, so that `a + b` and
+// `b + a` get the same key
+static void gvn_key_sort(gvn_key *key) {
+    tac_operand *a = &key->operands[0];
+    tac_operand *b = &key->operands[1];
+    if (a->kind == TAC_OPERAND_STRING || b->kind == TAC_OPERAND_STRING) {
+        return;
+    }
+
+    if (a->kind > b->kind || (a->kind == b->kind && a->index > b->index)) {
+        tac_operand tmp = *a;
+        *a = *b;
+        *b = tmp;
+    }
+}
+
+// Calls are only numbered when they return a value that cannot be told
+// apart from an equal one, so sharing it between the two calls is safe
+static int gvn_call_is_candidate(gvn_state *state, tac_dispatch_call *call) {
+    if (call->args.count + 1 > GVN_MAX_OPERANDS) {
+        return 0;
+    }
+
+    if (codegen_tac_call_has_side_effects(state->optimizer, state->tac,
+                                          call)) {
+        return 0;
+    }
+
+    const char *type = call->type;
+    if (type == NULL) {
+        type = codegen_tac_receiver_type(state->tac, call);
+    }
+
+    tac_method_summary *summary =
+        codegen_tac_method_summary(state->optimizer, type, call->method);
+    if (summary == NULL) {
+        return 0;
+    }
+
+    const char *return_type = summary->method->type.value;
+    return strcmp(return_type, "Int") == 0 ||
+           strcmp(return_type, "Bool") == 0 ||
+           strcmp(return_type, "String") == 0;
+}
+
+// Build the key of the instruction, if it computes a value that can be
+// shared with another instruction that computes the same one
+static int gvn_key_build(gvn_state *state, tac_instr *instr, gvn_key *key) {
+    *key = (gvn_key){.kind = instr->kind};
+
+    int memory = 0;
+    switch (instr->kind) {
+    case TAC_ASSIGN_VALUE:
+        // only the loads of attributes are not already copies
+        if (instr->assign_value.expr.kind != TAC_OPERAND_ATTRIBUTE) {
+            return 0;
+        }
+        gvn_key_push(key, instr->assign_value.expr);
+        break;
+    case TAC_LOAD_FIELD:
+        gvn_key_push(key, instr->field.object);
+        gvn_key_push(key, (tac_operand){.kind = TAC_OPERAND_INT,
+                                        .value = instr->field.index});
+        memory = 1;
+        break;
+    case TAC_ASSIGN_ADD:
+    case TAC_ASSIGN_MUL:
+        gvn_key_push(key, instr->assign_binary.lhs);
+        gvn_key_push(key, instr->assign_binary.rhs);
+        gvn_key_sort(key);
+        break;
+    case TAC_ASSIGN_SUB:
+    case TAC_ASSIGN_DIV:
+    case TAC_ASSIGN_LT:
+    case TAC_ASSIGN_LE:
+        gvn_key_push(key, instr->assign_binary.lhs);
+        gvn_key_push(key, instr->assign_binary.rhs);
+        break;
+    case TAC_ASSIGN_NEG:
+    case TAC_ASSIGN_NOT:
+    case TAC_ASSIGN_ISVOID:
+        gvn_key_push(key, instr->assign_unary.expr);
+        break;
+    case TAC_ASSIGN_ISINSTANCE:
+        key->type = instr->isinstance.type;
+        gvn_key_push(key, instr->isinstance.expr);
+        break;
+    case TAC_ASSIGN_EQ:
+        if (codegen_tac_instr_has_side_effects(state->optimizer, state->tac,
+                                               instr)) {
+            return 0;
+        }
+        key->type = instr->assign_eq.type;
+        gvn_key_push(key, instr->assign_eq.lhs);
+        gvn_key_push(key, instr->assign_eq.rhs);
+        memory = 1;
+        break;
+    case TAC_DISPATCH_CALL: {
+        tac_dispatch_call *call = &instr->dispatch_call;
+        if (!gvn_call_is_candidate(state, call)) {
+            return 0;
+        }
+        key->type = call->type;
+        key->method = call->method;
+        gvn_key_push(key, call->expr);
+        for (unsigned int k = 0; k < call->args.count; k++) {
+            tac_operand arg;
+            ds_dynamic_array_get(&call->args, k, &arg);
+            gvn_key_push(key, arg);
+        }
+        memory = 1;
+        break;
+    }
+    default:
+        return 0;
+    }
+
+    for (unsigned int k = 0; k < key->count; k++) {
+        if (key->operands[k].kind == TAC_OPERAND_ATTRIBUTE) {
+            memory = 1;
+        } else if (key->operands[k].kind == TAC_OPERAND_NONE) {
+            return 0;
+        }
+    }
+
+    if (memory) {
+        key->generation = state->generation;
+    }
+
+    return 1;
+}
+
+static void gvn_insert(gvn_state *state, gvn_key *key, tac_operand operand) {
+    gvn_value value = {.operand = operand, .available = 1};
+    ds_hash_table_insert(&state->values, key, &value);
+    ds_dynamic_array_append(&state->scope, key);
+}
+
+static int gvn_lookup(gvn_state *state, gvn_key *key, tac_operand *operand) {
+    gvn_value value;
+    if (ds_hash_table_get(&state->values, key, &value) != 0 ||
+        !value.available) {
+        return 0;
+    }
+
+    *operand = value.operand;
+    return 1;
+}
+
+static void gvn_rewrite_uses(gvn_state *state, tac_instr *instr,
+                             ds_dynamic_array *uses) {
+    uses->count = 0;
+    codegen_tac_instr_uses(instr, uses);
+    for (unsigned int k = 0; k < uses->count; k++) {
+        tac_operand *operand = NULL;
+        ds_dynamic_array_get(uses, k, &operand);
+
+        if (operand->kind == TAC_OPERAND_TEMP &&
+            state->replacements[operand->index].kind != TAC_OPERAND_NONE) {
+            *operand = state->replacements[operand->index];
+        }
+    }
+}
+
+static void gvn_number_instr(gvn_state *state, unsigned int index,
+                             ds_dynamic_array *uses) {
+    tac_instr *instr = gvn_instr(state->tac, index);
+
+    // the operands are defined in a dominator, so they are already numbered
+    gvn_rewrite_uses(state, instr, uses);
+
+    tac_operand *def = codegen_tac_instr_def(instr);
+    gvn_key key;
+    if (def != NULL && def->kind == TAC_OPERAND_TEMP &&
+        gvn_key_build(state, instr, &key)) {
+        tac_operand value;
+        if (gvn_lookup(state, &key, &value)) {
+            state->replacements[def->index] = value;
+            state->removed[index] = 1;
+            state->eliminated++;
+            return;
+        }
+
+        gvn_insert(state, &key, *def);
+    }
+
+    if (!codegen_tac_instr_has_side_effects(state->optimizer, state->tac,
+                                            instr)) {
+        return;
+    }
+
+    state->generation = ++state->generation_count;
+
+    // a load right after a store to the same attribute reads the stored value
+    if (instr->kind == TAC_ASSIGN_VALUE && def->kind == TAC_OPERAND_ATTRIBUTE &&
+        gvn_is_stable(instr->assign_value.expr)) {
+        key = (gvn_key){.kind = TAC_ASSIGN_VALUE,
+                        .generation = state->generation};
+        gvn_key_push(&key, *def);
+        gvn_insert(state, &key, instr->assign_value.expr);
+    }
+
+    // and the same for the attributes of other objects
+    if (instr->kind == TAC_STORE_FIELD && gvn_is_stable(instr->field.value)) {
+        key = (gvn_key){.kind = TAC_LOAD_FIELD,
+                        .generation = state->generation};
+        gvn_key_push(&key, instr->field.object);
+        gvn_key_push(&key, (tac_operand){.kind = TAC_OPERAND_INT,
+                                         .value = instr->field.index});
+        gvn_insert(state, &key, instr->field.value);
+    }
+}
+
+static void gvn_number_block(gvn_state *state, unsigned int block_index,
+                             ds_dynamic_array *uses) {
+    tac_basic_block *block = NULL;
+    ds_dynamic_array_get_ref(&state->cfg.blocks, block_index, (void **)&block);
+
+    unsigned int scope = state->scope.count;
+
+    for (unsigned int i = block->start; i < block->end; i++) {
+        gvn_number_instr(state, i, uses);
+    }
+
+    unsigned int generation = state->generation;
+
+    ds_dynamic_array *children = NULL;
+    ds_dynamic_array_get_ref(&state->children, block_index,
+                             (void **)&children);
+    for (unsigned int i = 0; i < children->count; i++) {
+        unsigned int child_index;
+        ds_dynamic_array_get(children, i, &child_index);
+
+        tac_basic_block *child = NULL;
+        ds_dynamic_array_get_ref(&state->cfg.blocks, child_index,
+                                 (void **)&child);
+
+        // memory is only known to be unchanged when the block is entered
+        // from the end of its dominator and from nowhere else
+        unsigned int pred = block_index;
+        if (child->preds.count == 1) {
+            ds_dynamic_array_get(&child->preds, 0, &pred);
+        }
+        if (child->preds.count == 1 && pred == block_index) {
+            state->generation = generation;
+        } else {
+            state->generation = ++state->generation_count;
+        }
+
+        gvn_number_block(state, child_index, uses);
+    }
+
+    for (unsigned int i = scope; i < state->scope.count; i++) {
+        gvn_key key;
+        ds_dynamic_array_get(&state->scope, i, &key);
+
+        gvn_value *value = NULL;
+        ds_hash_table_get_ref(&state->values, &key, (void **)&value);
+        value->available = 0;
+    }
+    state->scope.count = scope;
+}
+
+unsigned int codegen_tac_number_values(tac_optimizer *optimizer,
+                                       tac_result *tac) {
+    gvn_state state = {.optimizer = optimizer, .tac = tac};
+    codegen_tac_cfg_build(tac, &state.cfg);
+
+    ds_dynamic_array_init(&state.children, sizeof(ds_dynamic_array));
+    for (unsigned int i = 0; i < state.cfg.blocks.count; i++) {
+        ds_dynamic_array children;
+        ds_dynamic_array_init(&children, sizeof(unsigned int));
+        ds_dynamic_array_append(&state.children, &children);
+    }
+
+    // children in reverse postorder, so a block is numbered before the
+    // blocks that it flows into
+    for (unsigned int i = 1; i < state.cfg.order.count; i++) {
+        unsigned int block_index;
+        ds_dynamic_array_get(&state.cfg.order, i, &block_index);
+
+        tac_basic_block *block = NULL;
+        ds_dynamic_array_get_ref(&state.cfg.blocks, block_index,
+                                 (void **)&block);
+
+        ds_dynamic_array *children = NULL;
+        ds_dynamic_array_get_ref(&state.children, block->idom,
+                                 (void **)&children);
+        ds_dynamic_array_append(children, &block_index);
+    }
+
+    ds_hash_table_init(&state.values, sizeof(gvn_key), sizeof(gvn_value),
+                       256, gvn_key_hash, gvn_key_compare);
+    ds_dynamic_array_init(&state.scope, sizeof(gvn_key));
+    state.replacements = malloc(sizeof(tac_operand) * (tac->temp_count + 1));
+    for (unsigned int i = 0; i < tac->temp_count; i++) {
+        state.replacements[i] = (tac_operand){.kind = TAC_OPERAND_NONE};
+    }
+    state.removed = calloc(tac->instrs.count + 1, 1);
+
+    ds_dynamic_array uses;
+    ds_dynamic_array_init(&uses, sizeof(tac_operand *));
+
+    if (state.cfg.order.count > 0) {
+        unsigned int entry;
+        ds_dynamic_array_get(&state.cfg.order, 0, &entry);
+        gvn_number_block(&state, entry, &uses);
+    }
+
+    // the phis read values at the end of their predecessors, which can come
+    // later in the walk, so their arguments are only rewritten now
+    ds_dynamic_array instrs;
+    ds_dynamic_array_init(&instrs, sizeof(tac_instr));
+    for (unsigned int i = 0; i < tac->instrs.count; i++) {
+        tac_instr *instr = gvn_instr(tac, i);
+        if (state.removed[i]) {
+            if (instr->kind == TAC_DISPATCH_CALL) {
+                ds_dynamic_array_free(&instr->dispatch_call.args);
+            }
+            continue;
+        }
+
+        gvn_rewrite_uses(&state, instr, &uses);
+        ds_dynamic_array_append(&instrs, instr);
+    }
+
+    ds_dynamic_array_free(&tac->instrs);
+    tac->instrs = instrs;
+
+    for (unsigned int i = 0; i < state.children.count; i++) {
+        ds_dynamic_array *children = NULL;
+        ds_dynamic_array_get_ref(&state.children, i, (void **)&children);
+        ds_dynamic_array_free(children);
+    }
+    ds_dynamic_array_free(&state.children);
+    ds_hash_table_free(&state.values);
+    ds_dynamic_array_free(&state.scope);
+    ds_dynamic_array_free(&uses);
+    free(state.replacements);
+    free(state.removed);
+    codegen_tac_cfg_free(&state.cfg);
+
+    return state.eliminated;
+}
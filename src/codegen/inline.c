@@ -0,0 +1,390 @@
+#include "codegen.h"
+#include "ds.h"
+
+// With a profile, the calls that run often enough take callees this many
+// times larger, and the ones that never ran are not inlined at all
+#define INLINE_HOT_FACTOR 4
+
+// Inlined bodies can contain calls that are inlined in the next round, up to
+// this many rounds deep
+#define INLINE_MAX_ROUNDS 3
+
+// A caller stops taking in callees once it has grown by this many
+// instructions
+#define INLINE_MAX_GROWTH 400
+
+// The copy of one callee that is being spliced into the caller
+typedef struct inline_site {
+        tac_result *tac;        // the caller, whose counters grow
+        tac_result *callee;
+        tac_operand receiver;   // self, or the temporary that holds it
+        unsigned int temps;     // first temporary of the callee
+        unsigned int formals;   // first temporary that holds an argument
+        unsigned int labels;    // first label of the callee
+        ds_dynamic_array *instrs;
+} inline_site;
+
+static tac_instr *inline_instr(tac_result *tac, unsigned int index) {
+    tac_instr *instr = NULL;
+    ds_dynamic_array_get_ref(&tac->instrs, index, (void **)&instr);
+    return instr;
+}
+
+static tac_operand inline_new_temp(tac_result *tac) {
+    return (tac_operand){.kind = TAC_OPERAND_TEMP, .index = tac->temp_count++};
+}
+
+// The instructions that cost something at run time; labels and the idents
+// that name the value of an expression are gone in the assembly
+static unsigned int inline_size(tac_result *tac) {
+    unsigned int size = 0;
+    for (unsigned int i = 0; i < tac->instrs.count; i++) {
+        tac_instr *instr = inline_instr(tac, i);
+        if (instr->kind != TAC_LABEL && instr->kind != TAC_IDENT) {
+            size++;
+        }
+    }
+
+    return size;
+}
+
+static class_mapping_attribute *inline_attribute(tac_result *tac,
+                                                 unsigned int index) {
+    class_mapping_attribute *attribute = NULL;
+    ds_dynamic_array_get_ref(&tac->class->attributes, index,
+                             (void **)&attribute);
+    return attribute;
+}
+
+// The slots of the extern attributes hold raw values that only the methods
+// of their own class know how to read
+static int inline_touches_extern(tac_result *callee) {
+    ds_dynamic_array operands;
+    ds_dynamic_array_init(&operands, sizeof(tac_operand *));
+
+    int found = 0;
+    for (unsigned int i = 0; i < callee->instrs.count && !found; i++) {
+        tac_instr *instr = inline_instr(callee, i);
+
+        operands.count = 0;
+        codegen_tac_instr_uses(instr, &operands);
+        tac_operand *def = codegen_tac_instr_def(instr);
+        if (def != NULL) {
+            ds_dynamic_array_append(&operands, &def);
+        }
+
+        for (unsigned int k = 0; k < operands.count; k++) {
+            tac_operand *operand = NULL;
+            ds_dynamic_array_get(&operands, k, &operand);
+
+            if (operand->kind == TAC_OPERAND_ATTRIBUTE &&
+                inline_attribute(callee, operand->index)
+                        ->attribute->value.kind == EXPR_EXTERN) {
+                found = 1;
+            }
+        }
+    }
+
+    ds_dynamic_array_free(&operands);
+    return found;
+}
+
+// Whether the callee runs on the very self of the caller, so that its
+// attributes are the same slots. A guessed call on self can reach a method
+// of a subclass, whose attributes the caller does not have.
+static int inline_shares_self(tac_result *tac, tac_dispatch_call *call,
+                              tac_result *callee) {
+    return call->expr.kind == TAC_OPERAND_SELF &&
+           codegen_class_conforms(tac->class, callee->class->class_name);
+}
+
+// The method that a call can be replaced by, if it is small enough to be
+// worth it. The bonus for the arguments accounts for the pushes, the frame
+// and the call itself that inlining saves.
+static tac_method_summary *inline_callee(tac_optimizer *optimizer,
+                                         tac_result *tac,
+                                         tac_dispatch_call *call) {
+    if (call->type == NULL) {
+        return NULL;
+    }
+
+    tac_method_summary *summary =
+        codegen_tac_method_summary(optimizer, call->type, call->method);
+    if (summary == NULL || summary->tac.instrs.count == 0 ||
+        summary->method == tac->method) {
+        return NULL;
+    }
+
+    tac_instr *last =
+        inline_instr(&summary->tac, summary->tac.instrs.count - 1);
+    if (last->kind != TAC_IDENT) {
+        return NULL;
+    }
+
+    unsigned int threshold =
+        optimizer->options.inline_threshold + call->args.count + 1;
+    if (optimizer->options.profile != NULL && call->site != 0) {
+        unsigned long count = codegen_tac_site_count(optimizer, call);
+        if (count == 0) {
+            return NULL;
+        }
+        if (count >= optimizer->options.profile->hot) {
+            threshold *= INLINE_HOT_FACTOR;
+        }
+    }
+    if (inline_size(&summary->tac) > threshold) {
+        return NULL;
+    }
+
+    if (!inline_shares_self(tac, call, &summary->tac) &&
+        inline_touches_extern(&summary->tac)) {
+        return NULL;
+    }
+
+    return summary;
+}
+
+int codegen_tac_is_inlinable(tac_optimizer *optimizer, tac_result *tac,
+                             tac_dispatch_call *call) {
+    return inline_callee(optimizer, tac, call) != NULL;
+}
+
+static int inline_on_self(inline_site *site) {
+    return site->receiver.kind == TAC_OPERAND_SELF;
+}
+
+static tac_field inline_field(inline_site *site, int index) {
+    class_mapping_attribute *attribute = inline_attribute(site->callee, index);
+    return (tac_field){
+        .object = site->receiver,
+        .name = (char *)attribute->attribute_name,
+        .type = (char *)attribute->attribute->type.value,
+        .index = index,
+    };
+}
+
+// The operand of the callee as the caller sees it. The attributes of a
+// receiver that is self are the same slots of the caller, the ones of any
+// other receiver are loaded into a temporary first.
+static tac_operand inline_use(inline_site *site, tac_operand operand) {
+    switch (operand.kind) {
+    case TAC_OPERAND_TEMP:
+        operand.index += site->temps;
+        return operand;
+    case TAC_OPERAND_FORMAL:
+        return (tac_operand){.kind = TAC_OPERAND_TEMP,
+                             .index = site->formals + operand.index};
+    case TAC_OPERAND_SELF:
+        return site->receiver;
+    case TAC_OPERAND_ATTRIBUTE: {
+        if (inline_on_self(site)) {
+            return operand;
+        }
+
+        tac_instr load = {.kind = TAC_LOAD_FIELD,
+                          .field = inline_field(site, operand.index)};
+        load.field.ident = inline_new_temp(site->tac);
+        ds_dynamic_array_append(site->instrs, &load);
+        return load.field.ident;
+    }
+    default:
+        return operand;
+    }
+}
+
+static void inline_copy_instr(tac_optimizer *optimizer, inline_site *site,
+                              tac_instr *instr, ds_dynamic_array *uses) {
+    tac_instr copy = *instr;
+
+    switch (copy.kind) {
+    case TAC_LABEL:
+        copy.label.label += site->labels;
+        break;
+    case TAC_JUMP:
+        copy.jump.label += site->labels;
+        break;
+    case TAC_JUMP_IF_TRUE:
+        copy.jump_if_true.label += site->labels;
+        break;
+    case TAC_DISPATCH_CALL: {
+        ds_dynamic_array args;
+        ds_dynamic_array_init(&args, sizeof(tac_operand));
+        for (unsigned int k = 0; k < instr->dispatch_call.args.count; k++) {
+            tac_operand arg;
+            ds_dynamic_array_get(&instr->dispatch_call.args, k, &arg);
+            ds_dynamic_array_append(&args, &arg);
+        }
+        copy.dispatch_call.args = args;
+        break;
+    }
+    case TAC_CASE: {
+        ds_dynamic_array branches;
+        ds_dynamic_array_init(&branches, sizeof(tac_case_branch));
+        for (unsigned int k = 0; k < instr->case_jump.branches.count; k++) {
+            tac_case_branch branch;
+            ds_dynamic_array_get(&instr->case_jump.branches, k, &branch);
+            branch.label += site->labels;
+            ds_dynamic_array_append(&branches, &branch);
+        }
+        copy.case_jump.branches = branches;
+        break;
+    }
+    default:
+        break;
+    }
+
+    uses->count = 0;
+    codegen_tac_instr_uses(&copy, uses);
+    for (unsigned int k = 0; k < uses->count; k++) {
+        tac_operand *operand = NULL;
+        ds_dynamic_array_get(uses, k, &operand);
+        *operand = inline_use(site, *operand);
+    }
+
+    if (copy.kind == TAC_DISPATCH_CALL) {
+        tac_dispatch_call *call = &copy.dispatch_call;
+
+        // SELF_TYPE stays the class of the caller only while self does
+        if (!inline_on_self(site) && call->expr_type != NULL &&
+            strcmp(call->expr_type, "SELF_TYPE") == 0) {
+            call->expr_type = (char *)site->callee->class->class_name;
+        }
+        if (call->type == NULL) {
+            codegen_tac_devirtualize_call(optimizer, site->tac, call);
+        }
+    }
+
+    tac_operand *def = codegen_tac_instr_def(&copy);
+    if (def == NULL) {
+        ds_dynamic_array_append(site->instrs, &copy);
+        return;
+    }
+
+    if (def->kind != TAC_OPERAND_ATTRIBUTE || inline_on_self(site)) {
+        *def = inline_use(site, *def);
+        ds_dynamic_array_append(site->instrs, &copy);
+        return;
+    }
+
+    // a write to an attribute of the receiver goes through a temporary
+    tac_instr store = {.kind = TAC_STORE_FIELD,
+                       .field = inline_field(site, def->index)};
+    *def = inline_new_temp(site->tac);
+    store.field.value = *def;
+    ds_dynamic_array_append(site->instrs, &copy);
+    ds_dynamic_array_append(site->instrs, &store);
+}
+
+static void inline_call(tac_optimizer *optimizer, tac_result *tac,
+                        tac_dispatch_call *call, tac_method_summary *summary,
+                        ds_dynamic_array *instrs, ds_dynamic_array *uses) {
+    tac_result *callee = &summary->tac;
+
+    inline_site site = {
+        .tac = tac,
+        .callee = callee,
+        .receiver = call->expr,
+        .instrs = instrs,
+    };
+
+    if (!inline_shares_self(tac, call, callee)) {
+        // the receiver is evaluated once, before the body runs
+        site.receiver = inline_new_temp(tac);
+        tac_instr copy = {.kind = TAC_ASSIGN_VALUE,
+                          .assign_value = {.ident = site.receiver,
+                                           .expr = call->expr}};
+        ds_dynamic_array_append(instrs, &copy);
+
+        if (call->devirtualized && call->expr.kind != TAC_OPERAND_SELF) {
+            tac_instr check = {.kind = TAC_CHECK_VOID,
+                               .check_void = {.expr = site.receiver}};
+            ds_dynamic_array_append(instrs, &check);
+        }
+    }
+
+    site.formals = tac->temp_count;
+    tac->temp_count += call->args.count;
+    for (unsigned int k = 0; k < call->args.count; k++) {
+        tac_operand arg;
+        ds_dynamic_array_get(&call->args, k, &arg);
+
+        tac_instr copy = {
+            .kind = TAC_ASSIGN_VALUE,
+            .assign_value = {.ident = {.kind = TAC_OPERAND_TEMP,
+                                       .index = site.formals + k},
+                             .expr = arg}};
+        ds_dynamic_array_append(instrs, &copy);
+    }
+
+    site.temps = tac->temp_count;
+    tac->temp_count += callee->temp_count;
+    site.labels = tac->label_count;
+    tac->label_count += callee->label_count;
+
+    for (unsigned int i = 0; i + 1 < callee->instrs.count; i++) {
+        tac_instr *instr = inline_instr(callee, i);
+        if (instr->kind == TAC_IDENT) {
+            continue;
+        }
+
+        inline_copy_instr(optimizer, &site, instr, uses);
+    }
+
+    // the value of the body is the result of the call
+    tac_instr *last = inline_instr(callee, callee->instrs.count - 1);
+    tac_instr result = {
+        .kind = TAC_ASSIGN_VALUE,
+        .assign_value = {.ident = call->ident,
+                         .expr = inline_use(&site, last->ident.name)}};
+    ds_dynamic_array_append(instrs, &result);
+
+    ds_dynamic_array_free(&call->args);
+    optimizer->inlined++;
+}
+
+void codegen_tac_inline(tac_optimizer *optimizer, tac_result *tac) {
+    if (optimizer->options.inline_threshold <= 0) {
+        return;
+    }
+
+    unsigned int budget = tac->instrs.count + INLINE_MAX_GROWTH;
+
+    ds_dynamic_array uses;
+    ds_dynamic_array_init(&uses, sizeof(tac_operand *));
+
+    int changed = 1;
+    for (unsigned int round = 0; round < INLINE_MAX_ROUNDS && changed;
+         round++) {
+        changed = 0;
+
+        ds_dynamic_array instrs;
+        ds_dynamic_array_init(&instrs, sizeof(tac_instr));
+
+        for (unsigned int i = 0; i < tac->instrs.count; i++) {
+            tac_instr *instr = inline_instr(tac, i);
+
+            tac_method_summary *summary = NULL;
+            if (instr->kind == TAC_DISPATCH_CALL) {
+                summary =
+                    inline_callee(optimizer, tac, &instr->dispatch_call);
+            }
+
+            unsigned int size =
+                instrs.count + (tac->instrs.count - i) +
+                (summary != NULL ? summary->tac.instrs.count : 0);
+            if (summary == NULL || size > budget) {
+                ds_dynamic_array_append(&instrs, instr);
+                continue;
+            }
+
+            inline_call(optimizer, tac, &instr->dispatch_call, summary,
+                        &instrs, &uses);
+            changed = 1;
+        }
+
+        ds_dynamic_array_free(&tac->instrs);
+        tac->instrs = instrs;
+    }
+
+    ds_dynamic_array_free(&uses);
+}
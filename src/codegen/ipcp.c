@@ -0,0 +1,406 @@
+#include "codegen.h"
+#include "ds.h"
+
+// A specialization is only worth its code when folding the constants
+// removes at least this many instructions from the method
+#define IPCP_MIN_SAVING 3
+
+// The argument patterns that are tried for each method, so that a method
+// called with many different constants is not copied over and over
+#define IPCP_MAX_CLONES 4
+
+enum ipcp_state {
+    IPCP_NEW,
+    IPCP_ANALYZING,
+    IPCP_DONE,
+};
+
+static tac_instr *ipcp_instr(tac_result *tac, unsigned int index) {
+    tac_instr *instr = NULL;
+    ds_dynamic_array_get_ref(&tac->instrs, index, (void **)&instr);
+    return instr;
+}
+
+static int ipcp_is_constant(tac_operand operand) {
+    return operand.kind == TAC_OPERAND_INT || operand.kind == TAC_OPERAND_BOOL;
+}
+
+// Two arguments that both vary are the same for a specialization
+static int ipcp_same_operand(tac_operand a, tac_operand b) {
+    if (!ipcp_is_constant(a) || !ipcp_is_constant(b)) {
+        return ipcp_is_constant(a) == ipcp_is_constant(b);
+    }
+
+    return a.kind == b.kind && a.value == b.value;
+}
+
+static void ipcp_copy_array(ds_dynamic_array *array) {
+    ds_dynamic_array copy;
+    ds_dynamic_array_init(&copy, array->item_size);
+    for (unsigned int k = 0; k < array->count; k++) {
+        void *item = NULL;
+        ds_dynamic_array_get_ref(array, k, &item);
+        ds_dynamic_array_append(&copy, item);
+    }
+    *array = copy;
+}
+
+// A copy of a TAC that owns all of its arrays, for the passes to change
+static void ipcp_copy(tac_result *from, tac_result *to) {
+    *to = *from;
+    ds_dynamic_array_init(&to->instrs, sizeof(tac_instr));
+
+    for (unsigned int i = 0; i < from->instrs.count; i++) {
+        tac_instr copy = *ipcp_instr(from, i);
+        switch (copy.kind) {
+        case TAC_DISPATCH_CALL:
+            ipcp_copy_array(&copy.dispatch_call.args);
+            break;
+        case TAC_PHI:
+            ipcp_copy_array(&copy.phi.args);
+            break;
+        case TAC_CASE:
+            ipcp_copy_array(&copy.case_jump.branches);
+            break;
+        default:
+            break;
+        }
+        ds_dynamic_array_append(&to->instrs, &copy);
+    }
+}
+
+static void ipcp_free(tac_result *tac) {
+    for (unsigned int i = 0; i < tac->instrs.count; i++) {
+        tac_instr *instr = ipcp_instr(tac, i);
+        if (instr->kind == TAC_DISPATCH_CALL) {
+            ds_dynamic_array_free(&instr->dispatch_call.args);
+        } else if (instr->kind == TAC_PHI) {
+            ds_dynamic_array_free(&instr->phi.args);
+        } else if (instr->kind == TAC_CASE) {
+            ds_dynamic_array_free(&instr->case_jump.branches);
+        }
+    }
+    ds_dynamic_array_free(&tac->instrs);
+}
+
+// The instructions that cost something at run time, counted the same way
+// the inliner counts them
+static unsigned int ipcp_size(tac_result *tac) {
+    unsigned int size = 0;
+    for (unsigned int i = 0; i < tac->instrs.count; i++) {
+        tac_instr *instr = ipcp_instr(tac, i);
+        if (instr->kind != TAC_LABEL && instr->kind != TAC_IDENT) {
+            size++;
+        }
+    }
+
+    return size;
+}
+
+static tac_operand ipcp_result(tac_result *tac) {
+    tac_instr *last = ipcp_instr(tac, tac->instrs.count - 1);
+    if (last->kind == TAC_IDENT && ipcp_is_constant(last->ident.name)) {
+        return last->ident.name;
+    }
+
+    return (tac_operand){.kind = TAC_OPERAND_NONE};
+}
+
+// Replace the reads of the formals that get a constant by the constant; a
+// formal that the method assigns keeps its slot
+static void ipcp_substitute_formals(tac_result *tac, ds_dynamic_array *args) {
+    ds_dynamic_array uses;
+    ds_dynamic_array_init(&uses, sizeof(tac_operand *));
+
+    for (unsigned int k = 0; k < args->count; k++) {
+        tac_operand arg;
+        ds_dynamic_array_get(args, k, &arg);
+        if (!ipcp_is_constant(arg)) {
+            continue;
+        }
+
+        int assigned = 0;
+        for (unsigned int i = 0; i < tac->instrs.count && !assigned; i++) {
+            tac_operand *def = codegen_tac_instr_def(ipcp_instr(tac, i));
+            assigned = def != NULL && def->kind == TAC_OPERAND_FORMAL &&
+                       (unsigned int)def->index == k;
+        }
+        if (assigned) {
+            continue;
+        }
+
+        for (unsigned int i = 0; i < tac->instrs.count; i++) {
+            uses.count = 0;
+            codegen_tac_instr_uses(ipcp_instr(tac, i), &uses);
+
+            for (unsigned int u = 0; u < uses.count; u++) {
+                tac_operand *operand = NULL;
+                ds_dynamic_array_get(&uses, u, &operand);
+                if (operand->kind == TAC_OPERAND_FORMAL &&
+                    (unsigned int)operand->index == k) {
+                    *operand = arg;
+                }
+            }
+        }
+    }
+
+    ds_dynamic_array_free(&uses);
+}
+
+static unsigned int ipcp_rewrite(tac_optimizer *optimizer, tac_result *tac,
+                                 int specialize);
+
+// Fold a copy of a method on its own, with the constants that its callees
+// return
+static void ipcp_fold(tac_optimizer *optimizer, tac_result *tac) {
+    codegen_tac_to_ssa(tac);
+    codegen_tac_fold_constants(tac);
+    ipcp_rewrite(optimizer, tac, 0);
+    codegen_tac_eliminate_dead_code(optimizer->mapping, tac);
+}
+
+static tac_method_summary *ipcp_summary(tac_optimizer *optimizer,
+                                        unsigned int index) {
+    tac_method_summary *summary = NULL;
+    ds_dynamic_array_get_ref(&optimizer->summaries, index, (void **)&summary);
+    return summary;
+}
+
+// A method that is still being analyzed when one of its callees calls it
+// back is taken to return anything
+static tac_method_constants *ipcp_analyze(tac_optimizer *optimizer,
+                                          unsigned int index) {
+    tac_method_constants *constants = &optimizer->constants[index];
+    if (constants->state != IPCP_NEW) {
+        return constants;
+    }
+
+    constants->state = IPCP_ANALYZING;
+
+    tac_method_summary *summary = ipcp_summary(optimizer, index);
+    if (summary->tac.instrs.count > 0) {
+        tac_result tac;
+        ipcp_copy(&summary->tac, &tac);
+        ipcp_fold(optimizer, &tac);
+
+        constants->value = ipcp_result(&tac);
+        constants->size = ipcp_size(&tac);
+        ipcp_free(&tac);
+    }
+
+    constants->state = IPCP_DONE;
+    return constants;
+}
+
+static tac_specialization *ipcp_get(tac_optimizer *optimizer,
+                                    unsigned int index) {
+    tac_specialization *specialization = NULL;
+    ds_dynamic_array_get_ref(&optimizer->specializations, index,
+                             (void **)&specialization);
+    return specialization;
+}
+
+static int ipcp_same_args(ds_dynamic_array *a, ds_dynamic_array *b) {
+    for (unsigned int k = 0; k < a->count; k++) {
+        tac_operand x, y;
+        ds_dynamic_array_get(a, k, &x);
+        ds_dynamic_array_get(b, k, &y);
+        if (!ipcp_same_operand(x, y)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// The specialization of the method for the constants among the arguments,
+// made on the first call that passes them unless create is not set, or -1
+// when there is none
+static int ipcp_specialize(tac_optimizer *optimizer, unsigned int summary,
+                           ds_dynamic_array *args, int create) {
+    unsigned int clones = 0;
+    for (unsigned int i = 0; i < optimizer->specializations.count; i++) {
+        tac_specialization *specialization = ipcp_get(optimizer, i);
+        if (specialization->summary != summary) {
+            continue;
+        }
+
+        if (ipcp_same_args(&specialization->args, args)) {
+            return i;
+        }
+        clones++;
+    }
+
+    if (!create || clones >= IPCP_MAX_CLONES) {
+        return -1;
+    }
+
+    unsigned int size = ipcp_analyze(optimizer, summary)->size;
+
+    tac_specialization specialization = {.summary = summary};
+    ds_dynamic_array_init(&specialization.args, sizeof(tac_operand));
+    for (unsigned int k = 0; k < args->count; k++) {
+        tac_operand arg;
+        ds_dynamic_array_get(args, k, &arg);
+        if (!ipcp_is_constant(arg)) {
+            arg = (tac_operand){.kind = TAC_OPERAND_NONE};
+        }
+        ds_dynamic_array_append(&specialization.args, &arg);
+    }
+
+    tac_result tac;
+    ipcp_copy(&ipcp_summary(optimizer, summary)->tac, &tac);
+    ipcp_substitute_formals(&tac, &specialization.args);
+    ipcp_fold(optimizer, &tac);
+
+    specialization.value = ipcp_result(&tac);
+    specialization.used = ipcp_size(&tac) + IPCP_MIN_SAVING <= size;
+    ipcp_free(&tac);
+
+    ds_dynamic_array_append(&optimizer->specializations, &specialization);
+    return optimizer->specializations.count - 1;
+}
+
+// The constant that the direct call returns, or NONE. With specialize, a
+// call that passes constants goes to a specialization of the callee when
+// there is a good one.
+static tac_operand ipcp_call(tac_optimizer *optimizer, tac_result *tac,
+                             tac_dispatch_call *call, int specialize) {
+    tac_operand none = {.kind = TAC_OPERAND_NONE};
+
+    tac_method_summary *summary =
+        codegen_tac_method_summary(optimizer, call->type, call->method);
+    if (summary == NULL || summary->tac.instrs.count == 0) {
+        return none;
+    }
+    int index = codegen_tac_summary_index(optimizer, summary->method);
+
+    // the sites that the profile never saw running are not worth a copy
+    int cold = optimizer->options.profile != NULL && call->site != 0 &&
+               codegen_tac_site_count(optimizer, call) == 0;
+
+    int constant = 0;
+    for (unsigned int k = 0; k < call->args.count; k++) {
+        tac_operand arg;
+        ds_dynamic_array_get(&call->args, k, &arg);
+        constant |= ipcp_is_constant(arg);
+    }
+
+    // a recursive call with other constants would unroll the recursion
+    // into a chain of copies, so it only reuses the copy it runs in
+    int recursive = summary->method == tac->method;
+
+    if (specialize && constant && !cold) {
+        int clone =
+            ipcp_specialize(optimizer, index, &call->args, !recursive);
+        if (clone >= 0) {
+            tac_specialization *specialization = ipcp_get(optimizer, clone);
+            if (specialization->used) {
+                call->clone = clone + 1;
+            }
+            if (ipcp_is_constant(specialization->value)) {
+                return specialization->value;
+            }
+        }
+    }
+
+    return ipcp_analyze(optimizer, index)->value;
+}
+
+static void ipcp_append_call(tac_optimizer *optimizer,
+                             ds_dynamic_array *instrs, tac_instr *instr) {
+    if (instr->dispatch_call.clone != 0) {
+        ipcp_get(optimizer, instr->dispatch_call.clone - 1)->called = 1;
+    }
+    ds_dynamic_array_append(instrs, instr);
+}
+
+// Rewrite the direct calls of an SSA form TAC and fold it again if any of
+// them returns a constant. Returns the number of calls that changed.
+static unsigned int ipcp_rewrite(tac_optimizer *optimizer, tac_result *tac,
+                                 int specialize) {
+    unsigned int changed = 0;
+    tac_operand *values = calloc(tac->temp_count + 1, sizeof(tac_operand));
+
+    ds_dynamic_array instrs;
+    ds_dynamic_array_init(&instrs, sizeof(tac_instr));
+
+    for (unsigned int i = 0; i < tac->instrs.count; i++) {
+        tac_instr *instr = ipcp_instr(tac, i);
+        if (instr->kind != TAC_DISPATCH_CALL ||
+            instr->dispatch_call.type == NULL) {
+            ds_dynamic_array_append(&instrs, instr);
+            continue;
+        }
+
+        tac_dispatch_call *call = &instr->dispatch_call;
+        tac_operand value = ipcp_call(optimizer, tac, call, specialize);
+        if (call->clone != 0) {
+            changed++;
+        }
+
+        if (!ipcp_is_constant(value) || call->ident.kind != TAC_OPERAND_TEMP) {
+            ipcp_append_call(optimizer, &instrs, instr);
+            continue;
+        }
+
+        values[call->ident.index] = value;
+        if (call->clone == 0) {
+            changed++;
+        }
+
+        // a call that only computes its value is left for its receiver to
+        // be checked, the others still run for what else they do
+        if (codegen_tac_call_has_side_effects(optimizer, tac, call)) {
+            ipcp_append_call(optimizer, &instrs, instr);
+            continue;
+        }
+
+        if (call->expr.kind != TAC_OPERAND_SELF) {
+            tac_instr check = {.kind = TAC_CHECK_VOID,
+                               .check_void = {.expr = call->expr}};
+            ds_dynamic_array_append(&instrs, &check);
+        }
+        ds_dynamic_array_free(&call->args);
+    }
+
+    ds_dynamic_array_free(&tac->instrs);
+    tac->instrs = instrs;
+
+    if (changed > 0) {
+        ds_dynamic_array uses;
+        ds_dynamic_array_init(&uses, sizeof(tac_operand *));
+
+        for (unsigned int i = 0; i < tac->instrs.count; i++) {
+            uses.count = 0;
+            codegen_tac_instr_uses(ipcp_instr(tac, i), &uses);
+
+            for (unsigned int k = 0; k < uses.count; k++) {
+                tac_operand *operand = NULL;
+                ds_dynamic_array_get(&uses, k, &operand);
+                if (operand->kind == TAC_OPERAND_TEMP &&
+                    values[operand->index].kind != TAC_OPERAND_NONE) {
+                    *operand = values[operand->index];
+                }
+            }
+        }
+
+        ds_dynamic_array_free(&uses);
+        codegen_tac_fold_constants(tac);
+    }
+
+    free(values);
+    return changed;
+}
+
+void codegen_tac_propagate_interprocedural(tac_optimizer *optimizer,
+                                           tac_result *tac) {
+    optimizer->propagated += ipcp_rewrite(optimizer, tac, 1);
+}
+
+void codegen_tac_specialization(tac_optimizer *optimizer, unsigned int index,
+                                tac_result *tac) {
+    tac_specialization *specialization = ipcp_get(optimizer, index);
+    ipcp_copy(&ipcp_summary(optimizer, specialization->summary)->tac, tac);
+    ipcp_substitute_formals(tac, &specialization->args);
+}
@@ -0,0 +1,171 @@
+#include "codegen.h"
+#include "ds.h"
+
+static tac_instr *layout_instr(tac_result *tac, unsigned int index) {
+    tac_instr *instr = NULL;
+    ds_dynamic_array_get_ref(&tac->instrs, index, (void **)&instr);
+    return instr;
+}
+
+static tac_basic_block *layout_block(tac_cfg *cfg, unsigned int index) {
+    tac_basic_block *block = NULL;
+    ds_dynamic_array_get_ref(&cfg->blocks, index, (void **)&block);
+    return block;
+}
+
+static int layout_label_block(tac_cfg *cfg, int label) {
+    int block = -1;
+    ds_dynamic_array_get(&cfg->labels, label, &block);
+    return block;
+}
+
+// The block that runs after this one most of the time, -1 if there is no
+// preference: the target of a jump, the side of a branch that the profile
+// saw most often and the next block for the ones that fall through. The
+// last block returns the value of the method.
+static int layout_likely(tac_optimizer *optimizer, tac_result *tac,
+                         tac_cfg *cfg, unsigned int b) {
+    if (b + 1 == cfg->blocks.count) {
+        return -1;
+    }
+
+    tac_basic_block *block = layout_block(cfg, b);
+    tac_instr *last = layout_instr(tac, block->end - 1);
+    tac_profile *profile = optimizer->options.profile;
+
+    switch (last->kind) {
+    case TAC_JUMP:
+        return layout_label_block(cfg, last->jump.label);
+    case TAC_JUMP_IF_TRUE: {
+        unsigned int site = last->jump_if_true.site;
+        if (site != 0) {
+            unsigned long executed = profile->taken[2 * (site - 1)];
+            unsigned long taken = profile->taken[2 * (site - 1) + 1];
+            if (2 * taken > executed) {
+                return layout_label_block(cfg, last->jump_if_true.label);
+            }
+        }
+        return b + 1;
+    }
+    case TAC_CASE:
+        return -1;
+    default:
+        return b + 1;
+    }
+}
+
+static void layout_jump(ds_dynamic_array *instrs, int label) {
+    tac_instr jump = {.kind = TAC_JUMP, .jump = {.label = label}};
+    ds_dynamic_array_append(instrs, &jump);
+}
+
+// Copy a block to its new place, fixing the control flow at its end for the
+// block that now follows it
+static void layout_emit(tac_result *tac, tac_cfg *cfg, unsigned int b,
+                        int next, ds_dynamic_array *instrs) {
+    tac_basic_block *block = layout_block(cfg, b);
+    for (unsigned int i = block->start; i + 1 < block->end; i++) {
+        ds_dynamic_array_append(instrs, layout_instr(tac, i));
+    }
+
+    tac_instr last = *layout_instr(tac, block->end - 1);
+    int fallthrough = -1;
+    if (b + 1 < cfg->blocks.count) {
+        fallthrough = b + 1;
+    }
+
+    switch (last.kind) {
+    case TAC_JUMP:
+        if (layout_label_block(cfg, last.jump.label) != next) {
+            ds_dynamic_array_append(instrs, &last);
+        }
+        return;
+    case TAC_JUMP_IF_TRUE:
+        if (fallthrough == next) {
+            ds_dynamic_array_append(instrs, &last);
+        } else if (layout_label_block(cfg, last.jump_if_true.label) == next) {
+            // the target follows, so branch to the old fall through when
+            // the condition does not hold
+            tac_operand negated = {.kind = TAC_OPERAND_TEMP,
+                                   .index = tac->temp_count++};
+            tac_instr not = {.kind = TAC_ASSIGN_NOT,
+                             .assign_unary = {.ident = negated,
+                                              .expr = last.jump_if_true.expr}};
+            tac_instr branch = {
+                .kind = TAC_JUMP_IF_TRUE,
+                .jump_if_true = {.expr = negated,
+                                 .label = layout_block(cfg, fallthrough)->label}};
+            ds_dynamic_array_append(instrs, &not);
+            ds_dynamic_array_append(instrs, &branch);
+        } else {
+            ds_dynamic_array_append(instrs, &last);
+            layout_jump(instrs, layout_block(cfg, fallthrough)->label);
+        }
+        return;
+    case TAC_CASE:
+        ds_dynamic_array_append(instrs, &last);
+        return;
+    default:
+        ds_dynamic_array_append(instrs, &last);
+        if (fallthrough >= 0 && fallthrough != next) {
+            layout_jump(instrs, layout_block(cfg, fallthrough)->label);
+        }
+        return;
+    }
+}
+
+void codegen_tac_layout_blocks(tac_optimizer *optimizer, tac_result *tac) {
+    if (optimizer->options.profile == NULL || tac->instrs.count == 0) {
+        return;
+    }
+
+    tac_cfg cfg;
+    codegen_tac_cfg_build(tac, &cfg);
+
+    // the entry stays first and the block with the value of the method
+    // stays last; the others follow their most likely predecessor, or
+    // their old order when there is none
+    unsigned int count = cfg.blocks.count;
+    unsigned int exit = count - 1;
+    int *placed = calloc(count, sizeof(int));
+    unsigned int *order = malloc(sizeof(unsigned int) * count);
+    unsigned int placed_count = 0;
+    int moved = 0;
+
+    int current = 0;
+    while (placed_count < count) {
+        if (current < 0 || placed[current] ||
+            ((unsigned int)current == exit && placed_count + 1 < count)) {
+            current = 0;
+            while (placed[current] ||
+                   ((unsigned int)current == exit && placed_count + 1 < count)) {
+                current++;
+            }
+        }
+
+        if ((unsigned int)current != placed_count) {
+            moved = 1;
+        }
+        placed[current] = 1;
+        order[placed_count++] = current;
+
+        current = layout_likely(optimizer, tac, &cfg, current);
+    }
+
+    if (moved) {
+        ds_dynamic_array instrs;
+        ds_dynamic_array_init(&instrs, sizeof(tac_instr));
+
+        for (unsigned int k = 0; k < count; k++) {
+            int next = k + 1 < count ? (int)order[k + 1] : -1;
+            layout_emit(tac, &cfg, order[k], next, &instrs);
+        }
+
+        ds_dynamic_array_free(&tac->instrs);
+        tac->instrs = instrs;
+    }
+
+    free(placed);
+    free(order);
+    codegen_tac_cfg_free(&cfg);
+}
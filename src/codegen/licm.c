@@ -0,0 +1,471 @@
+#include "codegen.h"
+#include "ds.h"
+
+// How much of the loop an invariant instruction needs to move out of it
+enum licm_kind {
+    LICM_NEVER,    // not an invariant computation, or has side effects
+    LICM_SAFE,     // cannot fail, so it can run even if the loop would not
+    LICM_FAULTING, // can fail, so it has to run on every trip through the loop
+    LICM_MEMORY,   // also reads memory that the loop must not write
+};
+
+typedef struct licm_state {
+        tac_optimizer *optimizer;
+        tac_result *tac;
+        tac_cfg cfg;
+        unsigned int *block_of; // instruction -> block
+        int *def_at;            // temp -> defining instruction, -1 if none
+        char *body;             // block -> in the current loop
+        int *invariant;         // instruction -> header of the loop it left
+        int *target;            // instruction -> preheader, -1 if it stays
+        unsigned int *sequence; // instruction -> order among the hoisted
+        unsigned int sequence_count;
+        int clobbers;           // the current loop writes memory
+} licm_state;
+
+static tac_instr *licm_instr(tac_result *tac, unsigned int index) {
+    tac_instr *instr = NULL;
+    ds_dynamic_array_get_ref(&tac->instrs, index, (void **)&instr);
+    return instr;
+}
+
+static tac_basic_block *licm_block(tac_cfg *cfg, unsigned int index) {
+    tac_basic_block *block = NULL;
+    ds_dynamic_array_get_ref(&cfg->blocks, index, (void **)&block);
+    return block;
+}
+
+static unsigned int licm_edge(ds_dynamic_array *edges, unsigned int k) {
+    unsigned int block;
+    ds_dynamic_array_get(edges, k, &block);
+    return block;
+}
+
+static int licm_is_terminator(tac_instr *instr) {
+    return instr->kind == TAC_JUMP || instr->kind == TAC_JUMP_IF_TRUE ||
+           instr->kind == TAC_CASE;
+}
+
+// Mark the natural loop of the header, the blocks that reach one of its back
+// edges without going through it. Returns 0 if the header has no back edge.
+static int licm_loop_body(licm_state *state, unsigned int h) {
+    tac_cfg *cfg = &state->cfg;
+    unsigned int count = cfg->blocks.count;
+    unsigned int *stack = malloc(sizeof(unsigned int) * (count + 1));
+    unsigned int top = 0;
+
+    memset(state->body, 0, count);
+    state->body[h] = 1;
+
+    tac_basic_block *header = licm_block(cfg, h);
+    for (unsigned int k = 0; k < header->preds.count; k++) {
+        unsigned int pred = licm_edge(&header->preds, k);
+        if (!state->body[pred] && codegen_tac_cfg_dominates(cfg, h, pred)) {
+            state->body[pred] = 1;
+            stack[top++] = pred;
+        }
+    }
+
+    int found = top > 0;
+    while (top > 0) {
+        tac_basic_block *block = licm_block(cfg, stack[--top]);
+        for (unsigned int k = 0; k < block->preds.count; k++) {
+            unsigned int pred = licm_edge(&block->preds, k);
+            if (!state->body[pred] && licm_block(cfg, pred)->rpo >= 0) {
+                state->body[pred] = 1;
+                stack[top++] = pred;
+            }
+        }
+    }
+
+    free(stack);
+    return found;
+}
+
+// The only block outside the loop that enters it, if it has no other
+// successor, so that what runs at its end runs exactly once before the loop
+static int licm_preheader(licm_state *state, unsigned int h) {
+    tac_basic_block *header = licm_block(&state->cfg, h);
+
+    int preheader = -1;
+    for (unsigned int k = 0; k < header->preds.count; k++) {
+        unsigned int pred = licm_edge(&header->preds, k);
+        if (state->body[pred]) {
+            continue;
+        }
+        if (preheader >= 0) {
+            return -1;
+        }
+        preheader = pred;
+    }
+
+    if (preheader < 0 ||
+        licm_block(&state->cfg, preheader)->succs.count != 1) {
+        return -1;
+    }
+
+    return preheader;
+}
+
+// Whether anything in the loop can change the attributes or the fields that
+// an instruction of the loop reads
+static int licm_loop_clobbers(licm_state *state) {
+    for (unsigned int b = 0; b < state->cfg.blocks.count; b++) {
+        if (!state->body[b]) {
+            continue;
+        }
+
+        tac_basic_block *block = licm_block(&state->cfg, b);
+        for (unsigned int i = block->start; i < block->end; i++) {
+            if (codegen_tac_instr_has_side_effects(
+                    state->optimizer, state->tac,
+                    licm_instr(state->tac, i))) {
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+// Whether the block runs on every trip through the loop that leaves it
+static int licm_dominates_exits(licm_state *state, unsigned int b) {
+    int exits = 0;
+    for (unsigned int e = 0; e < state->cfg.blocks.count; e++) {
+        if (!state->body[e]) {
+            continue;
+        }
+
+        tac_basic_block *block = licm_block(&state->cfg, e);
+        for (unsigned int k = 0; k < block->succs.count; k++) {
+            if (state->body[licm_edge(&block->succs, k)]) {
+                continue;
+            }
+            if (!codegen_tac_cfg_dominates(&state->cfg, b, e)) {
+                return 0;
+            }
+            exits = 1;
+        }
+    }
+
+    return exits;
+}
+
+// Calls are only hoisted when they return a value that cannot be told apart
+// from an equal one, like value numbering does, since every trip through the
+// loop then shares the one value
+static int licm_call_is_candidate(licm_state *state,
+                                  tac_dispatch_call *call) {
+    if (call->tail || codegen_tac_call_has_side_effects(
+                          state->optimizer, state->tac, call)) {
+        return 0;
+    }
+
+    const char *type = call->type;
+    if (type == NULL) {
+        type = codegen_tac_receiver_type(state->tac, call);
+    }
+
+    tac_method_summary *summary =
+        codegen_tac_method_summary(state->optimizer, type, call->method);
+    if (summary == NULL) {
+        return 0;
+    }
+
+    const char *return_type = summary->method->type.value;
+    return strcmp(return_type, "Int") == 0 ||
+           strcmp(return_type, "Bool") == 0 ||
+           strcmp(return_type, "String") == 0;
+}
+
+static enum licm_kind licm_classify(licm_state *state, tac_instr *instr) {
+    switch (instr->kind) {
+    case TAC_ASSIGN_ADD:
+    case TAC_ASSIGN_SUB:
+    case TAC_ASSIGN_MUL:
+    case TAC_ASSIGN_LT:
+    case TAC_ASSIGN_LE:
+    case TAC_ASSIGN_NEG:
+    case TAC_ASSIGN_NOT:
+    case TAC_ASSIGN_ISVOID:
+    case TAC_ASSIGN_VALUE:
+    case TAC_CAST:
+        return LICM_SAFE;
+    case TAC_ASSIGN_DIV:
+        if (instr->assign_binary.rhs.kind == TAC_OPERAND_INT &&
+            instr->assign_binary.rhs.value != 0 &&
+            instr->assign_binary.rhs.value != -1) {
+            return LICM_SAFE;
+        }
+        return LICM_FAULTING;
+    case TAC_ASSIGN_ISINSTANCE:
+    case TAC_CHECK_VOID:
+        return LICM_FAULTING;
+    case TAC_LOAD_FIELD:
+        return LICM_MEMORY;
+    case TAC_ASSIGN_EQ:
+        if (codegen_tac_instr_has_side_effects(state->optimizer, state->tac,
+                                               instr)) {
+            return LICM_NEVER;
+        }
+        switch (codegen_tac_eq_kind(state->optimizer->mapping,
+                                    instr->assign_eq.type)) {
+        case TAC_EQ_VALUE:
+        case TAC_EQ_POINTER:
+            return LICM_SAFE;
+        case TAC_EQ_CALL:
+            return LICM_MEMORY;
+        default:
+            return LICM_FAULTING;
+        }
+    case TAC_DISPATCH_CALL:
+        if (licm_call_is_candidate(state, &instr->dispatch_call)) {
+            return LICM_MEMORY;
+        }
+        return LICM_NEVER;
+    default:
+        return LICM_NEVER;
+    }
+}
+
+// A value that does not change while the loop of the header runs
+static int licm_operand_is_invariant(licm_state *state, tac_operand operand,
+                                     unsigned int h) {
+    switch (operand.kind) {
+    case TAC_OPERAND_NONE:
+        return 0;
+    case TAC_OPERAND_ATTRIBUTE:
+        return !state->clobbers;
+    case TAC_OPERAND_TEMP: {
+        int def = state->def_at[operand.index];
+        if (def < 0) {
+            return 0;
+        }
+        return !state->body[state->block_of[def]] ||
+               state->invariant[def] == (int)h;
+    }
+    default:
+        return 1;
+    }
+}
+
+// An instruction that can fail only moves when it comes before anything in
+// the loop that can fail or that has side effects, in the header, which
+// runs on every trip, so that the program fails the same way it would have
+static int licm_can_hoist(licm_state *state, unsigned int i, unsigned int h,
+                          int ordered, ds_dynamic_array *uses) {
+    tac_instr *instr = licm_instr(state->tac, i);
+    tac_operand *def = codegen_tac_instr_def(instr);
+    if (def != NULL ? def->kind != TAC_OPERAND_TEMP
+                    : instr->kind != TAC_CHECK_VOID) {
+        return 0;
+    }
+
+    switch (licm_classify(state, instr)) {
+    case LICM_NEVER:
+        return 0;
+    case LICM_MEMORY:
+        if (state->clobbers) {
+            return 0;
+        }
+        // fall through
+    case LICM_FAULTING:
+        if (!ordered || !licm_dominates_exits(state, h)) {
+            return 0;
+        }
+        break;
+    case LICM_SAFE:
+        break;
+    }
+
+    uses->count = 0;
+    codegen_tac_instr_uses(instr, uses);
+    for (unsigned int k = 0; k < uses->count; k++) {
+        tac_operand *operand = NULL;
+        ds_dynamic_array_get(uses, k, &operand);
+        if (!licm_operand_is_invariant(state, *operand, h)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Find the invariant instructions of the loop of the header, in the order
+// that their operands get defined
+static unsigned int licm_loop(licm_state *state, unsigned int h,
+                              ds_dynamic_array *uses) {
+    if (!licm_loop_body(state, h)) {
+        return 0;
+    }
+
+    int preheader = licm_preheader(state, h);
+    if (preheader < 0) {
+        return 0;
+    }
+
+    state->clobbers = licm_loop_clobbers(state);
+
+    unsigned int hoisted = 0;
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (unsigned int r = 0; r < state->cfg.order.count; r++) {
+            unsigned int b = licm_edge(&state->cfg.order, r);
+            if (!state->body[b]) {
+                continue;
+            }
+
+            tac_basic_block *block = licm_block(&state->cfg, b);
+            int ordered = b == h;
+            for (unsigned int i = block->start; i < block->end; i++) {
+                if (state->invariant[i] == (int)h) {
+                    continue;
+                }
+                if (!licm_can_hoist(state, i, h, ordered, uses)) {
+                    tac_instr *instr = licm_instr(state->tac, i);
+                    if (instr->kind != TAC_LABEL && instr->kind != TAC_PHI &&
+                        licm_classify(state, instr) != LICM_SAFE) {
+                        ordered = 0;
+                    }
+                    continue;
+                }
+
+                // an instruction that an inner loop hoisted moves on to the
+                // preheader of this one
+                if (state->target[i] < 0) {
+                    hoisted++;
+                }
+                state->invariant[i] = h;
+                state->target[i] = preheader;
+                state->sequence[i] = state->sequence_count++;
+                changed = 1;
+            }
+        }
+    }
+
+    return hoisted;
+}
+
+static void licm_emit_hoisted(licm_state *state, unsigned int b,
+                              ds_dynamic_array *instrs) {
+    unsigned int count = state->tac->instrs.count;
+
+    // the instructions were found in an order where each comes after the
+    // ones it reads
+    unsigned int last = 0;
+    while (1) {
+        int next = -1;
+        for (unsigned int i = 0; i < count; i++) {
+            if (state->target[i] == (int)b && state->sequence[i] >= last &&
+                (next < 0 || state->sequence[i] < state->sequence[next])) {
+                next = i;
+            }
+        }
+        if (next < 0) {
+            return;
+        }
+
+        ds_dynamic_array_append(instrs, licm_instr(state->tac, next));
+        last = state->sequence[next] + 1;
+    }
+}
+
+// Move the hoisted instructions to the end of their preheader, before the
+// jump to the loop if there is one
+static void licm_rewrite(licm_state *state) {
+    ds_dynamic_array instrs;
+    ds_dynamic_array_init(&instrs, sizeof(tac_instr));
+
+    for (unsigned int b = 0; b < state->cfg.blocks.count; b++) {
+        tac_basic_block *block = licm_block(&state->cfg, b);
+        for (unsigned int i = block->start; i < block->end; i++) {
+            tac_instr *instr = licm_instr(state->tac, i);
+            if (state->target[i] >= 0) {
+                continue;
+            }
+            if (i + 1 == block->end && licm_is_terminator(instr)) {
+                licm_emit_hoisted(state, b, &instrs);
+            }
+            ds_dynamic_array_append(&instrs, instr);
+        }
+
+        if (block->end == block->start ||
+            !licm_is_terminator(licm_instr(state->tac, block->end - 1))) {
+            licm_emit_hoisted(state, b, &instrs);
+        }
+    }
+
+    ds_dynamic_array_free(&state->tac->instrs);
+    state->tac->instrs = instrs;
+}
+
+void codegen_tac_hoist_invariants(tac_optimizer *optimizer, tac_result *tac) {
+    if (tac->instrs.count == 0) {
+        return;
+    }
+
+    licm_state state = {.optimizer = optimizer, .tac = tac};
+    codegen_tac_cfg_build(tac, &state.cfg);
+
+    unsigned int count = tac->instrs.count;
+    unsigned int blocks = state.cfg.blocks.count;
+    state.block_of = malloc(sizeof(unsigned int) * (count + 1));
+    state.def_at = malloc(sizeof(int) * (tac->temp_count + 1));
+    state.body = malloc(blocks + 1);
+    state.invariant = malloc(sizeof(int) * (count + 1));
+    state.target = malloc(sizeof(int) * (count + 1));
+    state.sequence = calloc(count + 1, sizeof(unsigned int));
+
+    for (unsigned int t = 0; t < tac->temp_count; t++) {
+        state.def_at[t] = -1;
+    }
+    for (unsigned int b = 0; b < blocks; b++) {
+        tac_basic_block *block = licm_block(&state.cfg, b);
+        for (unsigned int i = block->start; i < block->end; i++) {
+            state.block_of[i] = b;
+            state.invariant[i] = -1;
+            state.target[i] = -1;
+
+            tac_operand *def = codegen_tac_instr_def(licm_instr(tac, i));
+            if (def != NULL && def->kind == TAC_OPERAND_TEMP) {
+                state.def_at[def->index] = i;
+            }
+        }
+    }
+
+    int depth = 0;
+    for (unsigned int b = 0; b < blocks; b++) {
+        if (licm_block(&state.cfg, b)->loop_depth > depth) {
+            depth = licm_block(&state.cfg, b)->loop_depth;
+        }
+    }
+
+    ds_dynamic_array uses;
+    ds_dynamic_array_init(&uses, sizeof(tac_operand *));
+
+    // the inner loops go first, so that what they hoist can leave the outer
+    // ones as well
+    unsigned int hoisted = 0;
+    for (; depth > 0; depth--) {
+        for (unsigned int b = 0; b < blocks; b++) {
+            if (licm_block(&state.cfg, b)->loop_depth == depth) {
+                hoisted += licm_loop(&state, b, &uses);
+            }
+        }
+    }
+
+    if (hoisted > 0) {
+        licm_rewrite(&state);
+        optimizer->hoisted += hoisted;
+    }
+
+    ds_dynamic_array_free(&uses);
+    free(state.block_of);
+    free(state.def_at);
+    free(state.body);
+    free(state.invariant);
+    free(state.target);
+    free(state.sequence);
+    codegen_tac_cfg_free(&state.cfg);
+}
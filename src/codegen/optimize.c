@@ -0,0 +1,355 @@
+#include "codegen.h"
+#include <time.h>
+
+semantic_mapping_item *codegen_find_class(semantic_mapping *mapping,
+                                          const char *class_name) {
+    for (unsigned int i = 0; i < mapping->classes.count; i++) {
+        semantic_mapping_item *item = NULL;
+        ds_dynamic_array_get_ref(&mapping->classes, i, (void **)&item);
+
+        if (strcmp(item->class_name, class_name) == 0) {
+            return item;
+        }
+    }
+
+    return NULL;
+}
+
+// A pass returns what it counts itself of its changes, or 0
+typedef unsigned int (*tac_pass_run)(tac_optimizer *optimizer,
+                                     tac_result *tac);
+
+typedef struct tac_pass_info {
+        const char *name;
+        int level;        // the lowest optimization level that runs it
+        int ssa;          // it works on the SSA form
+        tac_pass_run run; // NULL for the ones that the assembler runs
+} tac_pass_info;
+
+static unsigned int optimize_devirtualize(tac_optimizer *optimizer,
+                                          tac_result *tac) {
+    unsigned int devirtualized = optimizer->devirtualized;
+    codegen_tac_devirtualize(optimizer, tac);
+    return optimizer->devirtualized - devirtualized;
+}
+
+static unsigned int optimize_speculate(tac_optimizer *optimizer,
+                                       tac_result *tac) {
+    unsigned int speculated = optimizer->speculated;
+    codegen_tac_speculate(optimizer, tac);
+    return optimizer->speculated - speculated;
+}
+
+static unsigned int optimize_inline(tac_optimizer *optimizer,
+                                    tac_result *tac) {
+    unsigned int inlined = optimizer->inlined;
+    codegen_tac_inline(optimizer, tac);
+    return optimizer->inlined - inlined;
+}
+
+static unsigned int optimize_fold(tac_optimizer *optimizer, tac_result *tac) {
+    codegen_tac_fold_constants(tac);
+    return 0;
+}
+
+static unsigned int optimize_ipcp(tac_optimizer *optimizer, tac_result *tac) {
+    unsigned int propagated = optimizer->propagated;
+    codegen_tac_propagate_interprocedural(optimizer, tac);
+    return optimizer->propagated - propagated;
+}
+
+static unsigned int optimize_copy(tac_optimizer *optimizer, tac_result *tac) {
+    codegen_tac_propagate_copies(tac);
+    return 0;
+}
+
+static unsigned int optimize_gvn(tac_optimizer *optimizer, tac_result *tac) {
+    optimizer->eliminated = codegen_tac_number_values(optimizer, tac);
+    return optimizer->eliminated;
+}
+
+static unsigned int optimize_licm(tac_optimizer *optimizer, tac_result *tac) {
+    unsigned int hoisted = optimizer->hoisted;
+    codegen_tac_hoist_invariants(optimizer, tac);
+    return optimizer->hoisted - hoisted;
+}
+
+static unsigned int optimize_dce(tac_optimizer *optimizer, tac_result *tac) {
+    codegen_tac_eliminate_dead_code(optimizer->mapping, tac);
+    return 0;
+}
+
+static unsigned int optimize_escape(tac_optimizer *optimizer,
+                                    tac_result *tac) {
+    unsigned int on_stack = optimizer->on_stack;
+    codegen_tac_allocate_on_stack(optimizer, tac);
+    return optimizer->on_stack - on_stack;
+}
+
+static unsigned int optimize_coalesce(tac_optimizer *optimizer,
+                                      tac_result *tac) {
+    codegen_tac_coalesce(tac);
+    return 0;
+}
+
+static unsigned int optimize_layout(tac_optimizer *optimizer,
+                                    tac_result *tac) {
+    codegen_tac_layout_blocks(optimizer, tac);
+    return 0;
+}
+
+static unsigned int optimize_tail(tac_optimizer *optimizer, tac_result *tac) {
+    codegen_tac_mark_tail_calls(tac);
+
+    unsigned int tail = 0;
+    for (unsigned int i = 0; i < tac->instrs.count; i++) {
+        tac_instr *instr = NULL;
+        ds_dynamic_array_get_ref(&tac->instrs, i, (void **)&instr);
+        if (instr->kind == TAC_DISPATCH_CALL && instr->dispatch_call.tail) {
+            tail++;
+        }
+    }
+
+    return tail;
+}
+
+// -O1 keeps to the passes that clean up a method on its own, -O2 adds the
+// ones that look at the rest of the program or change the allocations
+static const tac_pass_info tac_passes[TAC_PASS_COUNT] = {
+    [TAC_PASS_DEVIRT] = {"devirt", 2, 0, optimize_devirtualize},
+    [TAC_PASS_SPECULATE] = {"speculate", 2, 0, optimize_speculate},
+    [TAC_PASS_INLINE] = {"inline", 2, 0, optimize_inline},
+    [TAC_PASS_FOLD] = {"fold", 1, 1, optimize_fold},
+    [TAC_PASS_IPCP] = {"ipcp", 2, 1, optimize_ipcp},
+    [TAC_PASS_COPY] = {"copy", 1, 1, optimize_copy},
+    [TAC_PASS_GVN] = {"gvn", 2, 1, optimize_gvn},
+    [TAC_PASS_LICM] = {"licm", 2, 1, optimize_licm},
+    [TAC_PASS_DCE] = {"dce", 1, 1, optimize_dce},
+    [TAC_PASS_ESCAPE] = {"escape", 2, 1, optimize_escape},
+    [TAC_PASS_COALESCE] = {"coalesce", 1, 0, optimize_coalesce},
+    [TAC_PASS_LAYOUT] = {"layout", 2, 0, optimize_layout},
+    [TAC_PASS_TAIL] = {"tail", 1, 0, optimize_tail},
+    [TAC_PASS_UNBOX] = {"unbox", 1, 0, NULL},
+    [TAC_PASS_STRENGTH] = {"strength", 1, 0, NULL},
+    [TAC_PASS_REGALLOC] = {"regalloc", 1, 0, NULL},
+    [TAC_PASS_PEEPHOLE] = {"peephole", 1, 0, NULL},
+};
+
+const char *codegen_tac_pass_name(enum tac_pass pass) {
+    return tac_passes[pass].name;
+}
+
+int codegen_tac_options_set_level(tac_options *options, int level) {
+    if (level < 0 || level > 2) {
+        return 1;
+    }
+
+    options->passes = 0;
+    for (unsigned int i = 0; i < TAC_PASS_COUNT; i++) {
+        if (tac_passes[i].level <= level) {
+            options->passes |= 1u << i;
+        }
+    }
+
+    return 0;
+}
+
+int codegen_tac_options_set_passes(tac_options *options, const char *list) {
+    int result = 0;
+    unsigned int enabled = 0, disabled = 0;
+    int replace = 0;
+
+    char *names = strdup(list);
+    for (char *name = strtok(names, ","); name != NULL;
+         name = strtok(NULL, ",")) {
+        int disable = name[0] == '-';
+        if (disable) {
+            name++;
+        }
+
+        unsigned int pass = 0;
+        while (pass < TAC_PASS_COUNT && strcmp(tac_passes[pass].name, name)) {
+            pass++;
+        }
+        if (pass == TAC_PASS_COUNT) {
+            DS_LOG_ERROR("Unknown pass: %s", name);
+            return_defer(1);
+        }
+
+        if (disable) {
+            disabled |= 1u << pass;
+        } else {
+            enabled |= 1u << pass;
+            replace = 1;
+        }
+    }
+
+    if (replace) {
+        options->passes = 0;
+    }
+    options->passes = (options->passes | enabled) & ~disabled;
+
+defer:
+    free(names);
+    return result;
+}
+
+int codegen_tac_pass_enabled(tac_optimizer *optimizer, enum tac_pass pass) {
+    return (optimizer->options.passes >> pass) & 1;
+}
+
+static unsigned long optimize_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ul + now.tv_nsec;
+}
+
+static void optimize_verify(tac_optimizer *optimizer, tac_result *tac,
+                            const char *after, int ssa) {
+    if (!optimizer->options.verify) {
+        return;
+    }
+
+    const char *error = codegen_tac_verify(tac, ssa);
+    if (error != NULL) {
+        DS_PANIC("Invalid TAC after %s in %s.%s: %s", after,
+                 tac->class->class_name,
+                 tac->method != NULL ? tac->method->name.value : "init",
+                 error);
+    }
+}
+
+static void optimize_run(tac_optimizer *optimizer, tac_result *tac,
+                         enum tac_pass pass) {
+    tac_pass_stats *stats = &optimizer->stats[pass];
+    long instrs = tac->instrs.count;
+    unsigned long start = optimize_now();
+
+    stats->changes += tac_passes[pass].run(optimizer, tac);
+
+    stats->seconds += (optimize_now() - start) / 1e9;
+    stats->instrs += (long)tac->instrs.count - instrs;
+    stats->runs++;
+}
+
+void codegen_tac_optimize(tac_optimizer *optimizer, tac_result *tac) {
+    optimizer->eliminated = 0;
+    codegen_tac_number_sites(optimizer, tac);
+    optimize_verify(optimizer, tac, "tacgen", 0);
+
+    int ssa = 0;
+    for (unsigned int pass = 0; pass < TAC_PASS_COUNT; pass++) {
+        if (!codegen_tac_pass_enabled(optimizer, pass) ||
+            tac_passes[pass].run == NULL) {
+            continue;
+        }
+
+        if (tac_passes[pass].ssa && !ssa) {
+            codegen_tac_to_ssa(tac);
+            optimize_verify(optimizer, tac, "ssa", ssa = 1);
+        } else if (!tac_passes[pass].ssa && ssa) {
+            codegen_tac_from_ssa(tac);
+            optimize_verify(optimizer, tac, "from-ssa", ssa = 0);
+        }
+
+        optimize_run(optimizer, tac, pass);
+        optimize_verify(optimizer, tac, tac_passes[pass].name, ssa);
+    }
+
+    if (ssa) {
+        codegen_tac_from_ssa(tac);
+        optimize_verify(optimizer, tac, "from-ssa", 0);
+    }
+}
+
+void codegen_tac_unbox(tac_optimizer *optimizer, tac_result *tac,
+                       enum tac_repr *reprs) {
+    if (!codegen_tac_pass_enabled(optimizer, TAC_PASS_UNBOX)) {
+        for (unsigned int i = 0; i < tac->temp_count; i++) {
+            reprs[i] = TAC_REPR_OBJECT;
+        }
+        return;
+    }
+
+    tac_pass_stats *stats = &optimizer->stats[TAC_PASS_UNBOX];
+    unsigned long start = optimize_now();
+
+    codegen_tac_representations(optimizer, tac, reprs);
+
+    stats->seconds += (optimize_now() - start) / 1e9;
+    stats->runs++;
+    for (unsigned int i = 0; i < tac->temp_count; i++) {
+        stats->changes += reprs[i] != TAC_REPR_OBJECT;
+    }
+}
+
+void codegen_tac_allocate_registers(tac_optimizer *optimizer, tac_result *tac,
+                                    tac_clobbers_fn clobbers, void *data,
+                                    unsigned int callee_saved,
+                                    unsigned int caller_saved, int *registers) {
+    if (!codegen_tac_pass_enabled(optimizer, TAC_PASS_REGALLOC)) {
+        for (unsigned int i = 0; i < tac->temp_count; i++) {
+            registers[i] = -1;
+        }
+        return;
+    }
+
+    tac_pass_stats *stats = &optimizer->stats[TAC_PASS_REGALLOC];
+    unsigned long start = optimize_now();
+    long instrs = tac->instrs.count;
+
+    codegen_tac_linear_scan(tac, clobbers, data, callee_saved, caller_saved,
+                            registers);
+
+    stats->seconds += (optimize_now() - start) / 1e9;
+    stats->instrs += (long)tac->instrs.count - instrs;
+    stats->runs++;
+    for (unsigned int i = 0; i < tac->temp_count; i++) {
+        stats->changes += registers[i] >= 0;
+    }
+}
+
+int codegen_tac_strength_constant(tac_optimizer *optimizer, enum tac_kind kind,
+                                  tac_assign_binary *instr,
+                                  tac_operand *operand, long *constant) {
+    if (!codegen_tac_pass_enabled(optimizer, TAC_PASS_STRENGTH)) {
+        return 0;
+    }
+
+    tac_pass_stats *stats = &optimizer->stats[TAC_PASS_STRENGTH];
+    stats->runs++;
+
+    tac_operand value = {.kind = TAC_OPERAND_NONE};
+    if (instr->rhs.kind == TAC_OPERAND_INT) {
+        value = instr->rhs;
+        *operand = instr->lhs;
+    } else if (kind == TAC_ASSIGN_MUL && instr->lhs.kind == TAC_OPERAND_INT) {
+        value = instr->lhs;
+        *operand = instr->rhs;
+    }
+
+    // dividing by 0 and by -1 can trap, which idiv has to keep doing
+    if (value.kind == TAC_OPERAND_NONE ||
+        (kind == TAC_ASSIGN_DIV && (value.value == 0 || value.value == -1))) {
+        return 0;
+    }
+
+    *constant = value.value;
+    stats->changes++;
+    return 1;
+}
+
+void codegen_tac_print_pass_stats(tac_optimizer *optimizer) {
+    fprintf(stderr, "%-10s %8s %12s %8s %8s\n", "pass", "runs", "time (ms)",
+            "instrs", "changes");
+    for (unsigned int pass = 0; pass < TAC_PASS_COUNT; pass++) {
+        tac_pass_stats *stats = &optimizer->stats[pass];
+        if (stats->runs == 0) {
+            continue;
+        }
+
+        fprintf(stderr, "%-10s %8u %12.3f %+8ld %8u\n", tac_passes[pass].name,
+                stats->runs, stats->seconds * 1000, stats->instrs,
+                stats->changes);
+    }
+}
@@ -1,166 +1,515 @@
 #include "codegen.h"
 #include "parser.h"
 
-static void print_tac_label(tac_label label) { printf("%s:\n", label.label); }
+#define name(operand) codegen_tac_operand_name(tac, operand)
 
-static void print_tac_jump(tac_jump jump) { printf("jump %s\n", jump.label); }
+static void print_tac_label(FILE *out, tac_result *tac, tac_label label) {
+    fprintf(out, "L%d:\n", label.label);
+}
+
+static void print_tac_jump(FILE *out, tac_result *tac, tac_jump jump) {
+    fprintf(out, "jump L%d\n", jump.label);
+}
 
-static void print_tac_jump_if_true(tac_jump_if_true jump_if_true) {
-    printf("bt %s %s\n", jump_if_true.expr, jump_if_true.label);
+static void print_tac_jump_if_true(FILE *out, tac_result *tac,
+                                   tac_jump_if_true jump_if_true) {
+    fprintf(out, "bt %s L%d\n", name(jump_if_true.expr), jump_if_true.label);
 }
 
-static void print_tac_assign_isinstance(tac_isinstance isinstance) {
-    printf("%s <- %s instanceof %s\n", isinstance.ident, isinstance.expr,
-           isinstance.type);
+static void print_tac_assign_isinstance(FILE *out, tac_result *tac,
+                                        tac_isinstance isinstance) {
+    fprintf(out, "%s <- %s instanceof %s\n", name(isinstance.ident),
+           name(isinstance.expr), isinstance.type);
 }
 
-static void print_tac_cast(tac_cast cast) {
-    printf("%s <- %s as %s\n", cast.ident, cast.expr, cast.type);
+static void print_tac_cast(FILE *out, tac_result *tac, tac_cast cast) {
+    fprintf(out, "%s <- %s as %s\n", name(cast.ident), name(cast.expr), cast.type);
 }
 
-static void print_tac_assign_value(tac_assign_value assign_value) {
-    printf("%s <- %s\n", assign_value.ident, assign_value.expr);
+static void print_tac_assign_value(FILE *out, tac_result *tac,
+                                   tac_assign_value assign_value) {
+    fprintf(out, "%s <- %s\n", name(assign_value.ident), name(assign_value.expr));
 }
 
-static void print_tac_dispatch_call(tac_dispatch_call dispatch_call) {
-    printf("%s <- ", dispatch_call.ident);
+static void print_tac_dispatch_call(FILE *out, tac_result *tac,
+                                    tac_dispatch_call dispatch_call) {
+    fprintf(out, "%s <- ", name(dispatch_call.ident));
+    if (dispatch_call.tail) {
+        fprintf(out, "tail ");
+    }
+    if (dispatch_call.guess != NULL) {
+        fprintf(out, "guess %s ", dispatch_call.guess);
+    }
 
-    if (dispatch_call.expr != NULL) {
-        printf("%s", dispatch_call.expr);
+    if (dispatch_call.expr.kind != TAC_OPERAND_NONE) {
+        fprintf(out, "%s", name(dispatch_call.expr));
         if (dispatch_call.type != NULL) {
-            printf("@%s", dispatch_call.type);
+            fprintf(out, "@%s", dispatch_call.type);
         }
-        printf(".");
+        fprintf(out, ".");
     }
 
-    printf("%s(", dispatch_call.method);
+    fprintf(out, "%s(", dispatch_call.method);
 
     for (unsigned int i = 0; i < dispatch_call.args.count; i++) {
-        char *arg;
+        tac_operand arg;
         ds_dynamic_array_get(&dispatch_call.args, i, &arg);
-        printf("%s", arg);
+        fprintf(out, "%s", name(arg));
         if (i < dispatch_call.args.count - 1) {
-            printf(", ");
+            fprintf(out, ", ");
         }
     }
-    printf(")\n");
+    fprintf(out, ")\n");
 }
 
-static void print_tac_assign_new(tac_assign_new assign_new) {
-    printf("%s <- new %s\n", assign_new.ident, assign_new.type);
+static void print_tac_assign_new(FILE *out, tac_result *tac, tac_assign_new assign_new) {
+    fprintf(out, "%s <- %snew %s\n", name(assign_new.ident),
+            assign_new.stack ? "stack " : "", assign_new.type);
 }
 
-static void print_tac_assign_default(tac_assign_new assign_new) {
-    printf("%s <- default %s\n", assign_new.ident, assign_new.type);
+static void print_tac_assign_default(FILE *out, tac_result *tac,
+                                     tac_assign_new assign_new) {
+    fprintf(out, "%s <- default %s\n", name(assign_new.ident), assign_new.type);
 }
 
-static void print_tac_assign_binary(tac_assign_binary assign_binary,
+static void print_tac_assign_binary(FILE *out, tac_result *tac,
+                                    tac_assign_binary assign_binary,
                                     const char *op) {
-    printf("%s <- %s %s %s\n", assign_binary.ident, assign_binary.lhs, op,
-           assign_binary.rhs);
+    fprintf(out, "%s <- %s %s %s\n", name(assign_binary.ident),
+           name(assign_binary.lhs), op, name(assign_binary.rhs));
 }
 
-static void print_tac_assign_eq(tac_assign_eq assign_binary) {
-    printf("%s <- %s = %s\n", assign_binary.ident, assign_binary.lhs,
-           assign_binary.rhs);
+static void print_tac_assign_eq(FILE *out, tac_result *tac, tac_assign_eq assign_binary) {
+    fprintf(out, "%s <- %s = %s\n", name(assign_binary.ident),
+           name(assign_binary.lhs), name(assign_binary.rhs));
 }
 
-static void print_tac_assign_unary(tac_assign_unary assign_unary,
+static void print_tac_assign_unary(FILE *out, tac_result *tac,
+                                   tac_assign_unary assign_unary,
                                    const char *op) {
-    printf("%s <- %s %s\n", assign_unary.ident, op, assign_unary.expr);
+    fprintf(out, "%s <- %s %s\n", name(assign_unary.ident), op,
+           name(assign_unary.expr));
+}
+
+static void print_tac_ident(FILE *out, tac_result *tac, tac_ident ident) {
+    fprintf(out, "%s\n", name(ident.name));
+}
+
+static void print_tac_assign_int(FILE *out, tac_result *tac, tac_assign_int assign_int) {
+    fprintf(out, "%s <- int %s\n", name(assign_int.ident), name(assign_int.value));
+}
+
+static void print_tac_assign_string(FILE *out, tac_result *tac,
+                                    tac_assign_string assign_string) {
+    fprintf(out, "%s <- string \"%s\"\n", name(assign_string.ident),
+           name(assign_string.value));
+}
+
+static void print_tac_phi(FILE *out, tac_result *tac, tac_phi phi) {
+    fprintf(out, "%s <- phi(", name(phi.ident));
+
+    for (unsigned int i = 0; i < phi.args.count; i++) {
+        tac_phi_arg arg;
+        ds_dynamic_array_get(&phi.args, i, &arg);
+        fprintf(out, "L%d: %s", arg.label, name(arg.value));
+        if (i < phi.args.count - 1) {
+            fprintf(out, ", ");
+        }
+    }
+    fprintf(out, ")\n");
+}
+
+static void print_tac_assign_bool(FILE *out, tac_result *tac,
+                                  tac_assign_bool assign_bool) {
+    fprintf(out, "%s <- bool %s\n", name(assign_bool.ident),
+           name(assign_bool.value));
 }
 
-static void print_tac_ident(tac_ident ident) { printf("%s\n", ident.name); }
+static void print_tac_load_field(FILE *out, tac_result *tac, tac_field field) {
+    fprintf(out, "%s <- %s.%s\n", name(field.ident), name(field.object),
+            field.name);
+}
 
-static void print_tac_assign_int(tac_assign_int assign_int) {
-    printf("%s <- int %d\n", assign_int.ident, assign_int.value);
+static void print_tac_store_field(FILE *out, tac_result *tac, tac_field field) {
+    fprintf(out, "%s.%s <- %s\n", name(field.object), field.name,
+            name(field.value));
 }
 
-static void print_tac_assign_string(tac_assign_string assign_string) {
-    printf("%s <- string \"%s\"\n", assign_string.ident, assign_string.value);
+static void print_tac_check_void(FILE *out, tac_result *tac,
+                                 tac_check_void check_void) {
+    fprintf(out, "check %s\n", name(check_void.expr));
 }
 
-static void print_tac_assign_bool(tac_assign_bool assign_bool) {
-    printf("%s <- bool %s\n", assign_bool.ident,
-           assign_bool.value ? "true" : "false");
+static void print_tac_case_jump(FILE *out, tac_result *tac,
+                                tac_case_jump case_jump) {
+    fprintf(out, "case %s of", name(case_jump.expr));
+    for (unsigned int i = 0; i < case_jump.branches.count; i++) {
+        tac_case_branch branch;
+        ds_dynamic_array_get(&case_jump.branches, i, &branch);
+        fprintf(out, "%s %s L%d", i > 0 ? "," : "", branch.type, branch.label);
+    }
+    fprintf(out, "\n");
 }
 
-static void print_tac(tac_instr tac) {
-    switch (tac.kind) {
+void codegen_tac_print_instr(FILE *out, tac_result *tac, tac_instr instr) {
+    switch (instr.kind) {
     case TAC_LABEL:
-        return print_tac_label(tac.label);
+        return print_tac_label(out, tac, instr.label);
     case TAC_JUMP:
-        return print_tac_jump(tac.jump);
+        return print_tac_jump(out, tac, instr.jump);
     case TAC_JUMP_IF_TRUE:
-        return print_tac_jump_if_true(tac.jump_if_true);
+        return print_tac_jump_if_true(out, tac, instr.jump_if_true);
     case TAC_ASSIGN_ISINSTANCE:
-        return print_tac_assign_isinstance(tac.isinstance);
+        return print_tac_assign_isinstance(out, tac, instr.isinstance);
     case TAC_CAST:
-        return print_tac_cast(tac.cast);
+        return print_tac_cast(out, tac, instr.cast);
     case TAC_ASSIGN_VALUE:
-        return print_tac_assign_value(tac.assign_value);
+        return print_tac_assign_value(out, tac, instr.assign_value);
     case TAC_DISPATCH_CALL:
-        return print_tac_dispatch_call(tac.dispatch_call);
+        return print_tac_dispatch_call(out, tac, instr.dispatch_call);
     case TAC_ASSIGN_NEW:
-        return print_tac_assign_new(tac.assign_new);
+        return print_tac_assign_new(out, tac, instr.assign_new);
     case TAC_ASSIGN_DEFAULT:
-        return print_tac_assign_default(tac.assign_default);
+        return print_tac_assign_default(out, tac, instr.assign_default);
     case TAC_ASSIGN_ISVOID:
-        return print_tac_assign_unary(tac.assign_unary, "isvoid");
+        return print_tac_assign_unary(out, tac, instr.assign_unary, "isvoid");
     case TAC_ASSIGN_ADD:
-        return print_tac_assign_binary(tac.assign_binary, "+");
+        return print_tac_assign_binary(out, tac, instr.assign_binary, "+");
     case TAC_ASSIGN_SUB:
-        return print_tac_assign_binary(tac.assign_binary, "-");
+        return print_tac_assign_binary(out, tac, instr.assign_binary, "-");
     case TAC_ASSIGN_MUL:
-        return print_tac_assign_binary(tac.assign_binary, "*");
+        return print_tac_assign_binary(out, tac, instr.assign_binary, "*");
     case TAC_ASSIGN_DIV:
-        return print_tac_assign_binary(tac.assign_binary, "/");
+        return print_tac_assign_binary(out, tac, instr.assign_binary, "/");
     case TAC_ASSIGN_NEG:
-        return print_tac_assign_unary(tac.assign_unary, "~");
+        return print_tac_assign_unary(out, tac, instr.assign_unary, "~");
     case TAC_ASSIGN_LT:
-        return print_tac_assign_binary(tac.assign_binary, "<");
+        return print_tac_assign_binary(out, tac, instr.assign_binary, "<");
     case TAC_ASSIGN_LE:
-        return print_tac_assign_binary(tac.assign_binary, "<=");
+        return print_tac_assign_binary(out, tac, instr.assign_binary, "<=");
     case TAC_ASSIGN_EQ:
-        return print_tac_assign_eq(tac.assign_eq);
+        return print_tac_assign_eq(out, tac, instr.assign_eq);
     case TAC_ASSIGN_NOT:
-        return print_tac_assign_unary(tac.assign_unary, "not");
+        return print_tac_assign_unary(out, tac, instr.assign_unary, "not");
     case TAC_IDENT:
-        return print_tac_ident(tac.ident);
+        return print_tac_ident(out, tac, instr.ident);
     case TAC_ASSIGN_INT:
-        return print_tac_assign_int(tac.assign_int);
+        return print_tac_assign_int(out, tac, instr.assign_int);
     case TAC_ASSIGN_STRING:
-        return print_tac_assign_string(tac.assign_string);
+        return print_tac_assign_string(out, tac, instr.assign_string);
     case TAC_ASSIGN_BOOL:
-        return print_tac_assign_bool(tac.assign_bool);
+        return print_tac_assign_bool(out, tac, instr.assign_bool);
+    case TAC_PHI:
+        return print_tac_phi(out, tac, instr.phi);
+    case TAC_LOAD_FIELD:
+        return print_tac_load_field(out, tac, instr.field);
+    case TAC_STORE_FIELD:
+        return print_tac_store_field(out, tac, instr.field);
+    case TAC_CHECK_VOID:
+        return print_tac_check_void(out, tac, instr.check_void);
+    case TAC_CASE:
+        return print_tac_case_jump(out, tac, instr.case_jump);
     default:
         DS_PANIC("Unknown tac kind");
     }
 }
 
-void codegen_tac_print(semantic_mapping *mapping, program_node *program) {
+static semantic_mapping_item *find_class_mapping(semantic_mapping *mapping,
+                                                 const char *name) {
+    for (unsigned int i = 0; i < mapping->classes.count; i++) {
+        semantic_mapping_item *item = NULL;
+        ds_dynamic_array_get_ref(&mapping->classes, i, (void **)&item);
+
+        if (strcmp(item->class_name, name) == 0) {
+            return item;
+        }
+    }
+
+    return NULL;
+}
+
+static const char *tac_var_name(tac_result *tac, unsigned int var) {
+    tac_operand operand = {.kind = TAC_OPERAND_TEMP, .index = var};
+    if (var >= tac->temp_count) {
+        operand.kind = TAC_OPERAND_FORMAL;
+        operand.index = var - tac->temp_count;
+    }
+
+    return codegen_tac_operand_name(tac, operand);
+}
+
+static void print_tac_live_set(FILE *out, tac_result *tac, tac_cfg *cfg,
+                               unsigned long *set) {
+    int empty = 1;
+    for (unsigned int i = 0; i < cfg->var_count; i++) {
+        if (tac_bitset_test(set, i)) {
+            fprintf(out, " %s", tac_var_name(tac, i));
+            empty = 0;
+        }
+    }
+
+    if (empty) {
+        fprintf(out, " -");
+    }
+}
+
+static void print_tac_block_list(FILE *out, tac_cfg *cfg,
+                                 ds_dynamic_array *blocks) {
+    if (blocks->count == 0) {
+        fprintf(out, " -");
+    }
+
+    for (unsigned int i = 0; i < blocks->count; i++) {
+        unsigned int index;
+        ds_dynamic_array_get(blocks, i, &index);
+
+        tac_basic_block *block = NULL;
+        ds_dynamic_array_get_ref(&cfg->blocks, index, (void **)&block);
+        fprintf(out, " L%d", block->label);
+    }
+}
+
+static void print_tac_block_idom(FILE *out, tac_cfg *cfg, tac_basic_block *block) {
+    if (block->idom < 0) {
+        fprintf(out, " -");
+        return;
+    }
+
+    tac_basic_block *idom = NULL;
+    ds_dynamic_array_get_ref(&cfg->blocks, block->idom, (void **)&idom);
+    fprintf(out, " L%d", idom->label);
+}
+
+static void print_tac_cfg(FILE *out, tac_result *tac, tac_cfg *cfg) {
+    for (unsigned int i = 0; i < cfg->blocks.count; i++) {
+        tac_basic_block *block = NULL;
+        ds_dynamic_array_get_ref(&cfg->blocks, i, (void **)&block);
+
+        for (unsigned int j = block->start; j < block->end; j++) {
+            tac_instr instr;
+            ds_dynamic_array_get(&tac->instrs, j, &instr);
+            codegen_tac_print_instr(out, tac, instr);
+
+            if (j != block->start) {
+                continue;
+            }
+
+            fprintf(out, "    ; preds:");
+            print_tac_block_list(out, cfg, &block->preds);
+            fprintf(out, "\n    ; succs:");
+            print_tac_block_list(out, cfg, &block->succs);
+            fprintf(out, "\n    ; idom:");
+            print_tac_block_idom(out, cfg, block);
+            fprintf(out, "\n    ; live in:");
+            print_tac_live_set(out, tac, cfg, block->live_in);
+            fprintf(out, "\n");
+        }
+
+        fprintf(out, "    ; live out:");
+        print_tac_live_set(out, tac, cfg, block->live_out);
+        fprintf(out, "\n");
+    }
+}
+
+// Write the text of an instruction with the characters that are special
+// inside a DOT string escaped, and its newline as a left justified break
+static void print_tac_dot_instr(FILE *out, tac_result *tac, tac_instr instr) {
+    char *buffer = NULL;
+    size_t size = 0;
+    FILE *stream = open_memstream(&buffer, &size);
+    codegen_tac_print_instr(stream, tac, instr);
+    fclose(stream);
+
+    for (size_t i = 0; i < size; i++) {
+        switch (buffer[i]) {
+        case '"':
+        case '\\':
+            fprintf(out, "\\%c", buffer[i]);
+            break;
+        case '\n':
+            fprintf(out, "\\l");
+            break;
+        default:
+            fputc(buffer[i], out);
+        }
+    }
+
+    free(buffer);
+}
+
+static void print_tac_dot(FILE *out, tac_result *tac, tac_cfg *cfg,
+                          const char *name) {
+    fprintf(out, "    subgraph \"cluster_%s\" {\n", name);
+    fprintf(out, "        label=\"%s\";\n", name);
+
+    for (unsigned int i = 0; i < cfg->blocks.count; i++) {
+        tac_basic_block *block = NULL;
+        ds_dynamic_array_get_ref(&cfg->blocks, i, (void **)&block);
+
+        fprintf(out, "        \"%s.L%d\" [label=\"", name, block->label);
+        for (unsigned int j = block->start; j < block->end; j++) {
+            tac_instr instr;
+            ds_dynamic_array_get(&tac->instrs, j, &instr);
+            print_tac_dot_instr(out, tac, instr);
+        }
+        fprintf(out, "\\llive in:");
+        print_tac_live_set(out, tac, cfg, block->live_in);
+        fprintf(out, "\\llive out:");
+        print_tac_live_set(out, tac, cfg, block->live_out);
+        fprintf(out, "\\l\"];\n");
+    }
+
+    for (unsigned int i = 0; i < cfg->blocks.count; i++) {
+        tac_basic_block *block = NULL;
+        ds_dynamic_array_get_ref(&cfg->blocks, i, (void **)&block);
+
+        for (unsigned int j = 0; j < block->succs.count; j++) {
+            unsigned int index;
+            ds_dynamic_array_get(&block->succs, j, &index);
+
+            tac_basic_block *succ = NULL;
+            ds_dynamic_array_get_ref(&cfg->blocks, index, (void **)&succ);
+            fprintf(out, "        \"%s.L%d\" -> \"%s.L%d\";\n", name,
+                    block->label, name, succ->label);
+        }
+
+        if (block->idom >= 0) {
+            tac_basic_block *idom = NULL;
+            ds_dynamic_array_get_ref(&cfg->blocks, block->idom,
+                                     (void **)&idom);
+            fprintf(out,
+                    "        \"%s.L%d\" -> \"%s.L%d\" [style=dashed, "
+                    "color=gray, constraint=false];\n",
+                    name, idom->label, name, block->label);
+        }
+    }
+
+    fprintf(out, "    }\n");
+}
+
+void codegen_tac_print(semantic_mapping *mapping, program_node *program,
+                       enum tac_print_format format, int ssa,
+                       const tac_options *options) {
+    int optimized = options != NULL;
+    tac_optimizer optimizer;
+    if (optimized) {
+        codegen_tac_optimizer_init(&optimizer, mapping, options);
+    }
+
+    if (format == TAC_PRINT_DOT) {
+        printf("digraph tac {\n");
+        printf("    node [shape=box, fontname=\"monospace\"];\n");
+    }
+
     for (unsigned int i = 0; i < program->classes.count; i++) {
-        class_node class;
-        ds_dynamic_array_get(&program->classes, i, &class);
+        class_node *class = NULL;
+        ds_dynamic_array_get_ref(&program->classes, i, (void **)&class);
 
-        for (unsigned int j = 0; j < class.methods.count; j++) {
-            method_node method;
-            ds_dynamic_array_get(&class.methods, j, &method);
+        semantic_mapping_item *item =
+            find_class_mapping(mapping, class->name.value);
 
-            if (method.body.kind == EXPR_EXTERN) {
+        for (unsigned int j = 0; j < class->methods.count; j++) {
+            method_node *method = NULL;
+            ds_dynamic_array_get_ref(&class->methods, j, (void **)&method);
+
+            if (method->body.kind == EXPR_EXTERN) {
                 continue;
             }
 
             tac_result tac;
-            codegen_expr_to_tac(mapping, &method.body, &tac);
+            codegen_expr_to_tac(mapping, item, method, &method->body, &tac);
+            unsigned int dispatches = 0, devirtualized = 0, inlined = 0;
+            unsigned int on_stack = 0, speculated = 0, propagated = 0;
+            unsigned int hoisted = 0, unboxed = 0;
+            if (optimized) {
+                dispatches = optimizer.dispatches;
+                devirtualized = optimizer.devirtualized;
+                speculated = optimizer.speculated;
+                propagated = optimizer.propagated;
+                hoisted = optimizer.hoisted;
+                inlined = optimizer.inlined;
+                on_stack = optimizer.on_stack;
+                codegen_tac_optimize(&optimizer, &tac);
+                dispatches = optimizer.dispatches - dispatches;
+                devirtualized = optimizer.devirtualized - devirtualized;
+                speculated = optimizer.speculated - speculated;
+                propagated = optimizer.propagated - propagated;
+                hoisted = optimizer.hoisted - hoisted;
+                inlined = optimizer.inlined - inlined;
+                on_stack = optimizer.on_stack - on_stack;
+
+                // the representations the assembler would pick for the temps
+                enum tac_repr *reprs =
+                    malloc(sizeof(enum tac_repr) * (tac.temp_count + 1));
+                codegen_tac_unbox(&optimizer, &tac, reprs);
+                for (unsigned int k = 0; k < tac.temp_count; k++) {
+                    unboxed += reprs[k] != TAC_REPR_OBJECT;
+                }
+                free(reprs);
+            } else if (ssa) {
+                codegen_tac_to_ssa(&tac);
+            }
 
-            printf("%s.%s\n", class.name.value, method.name.value);
-            for (unsigned int k = 0; k < tac.instrs.count; k++) {
-                tac_instr instr;
-                ds_dynamic_array_get(&tac.instrs, k, &instr);
+            if (format == TAC_PRINT_TEXT) {
+                printf("%s.%s\n", class->name.value, method->name.value);
+                for (unsigned int k = 0; k < tac.instrs.count; k++) {
+                    tac_instr instr;
+                    ds_dynamic_array_get(&tac.instrs, k, &instr);
 
-                print_tac(instr);
+                    codegen_tac_print_instr(stdout, &tac, instr);
+                }
+                if (optimized) {
+                    printf("; cha: devirtualized %u of %u dispatches",
+                           devirtualized, dispatches);
+                    if (dispatches > 0) {
+                        printf(" (%.1f%%)",
+                               100.0 * devirtualized / dispatches);
+                    }
+                    printf("\n");
+                    printf("; speculate: guarded %u dispatches\n",
+                           speculated);
+                    printf("; inline: inlined %u calls\n", inlined);
+                    printf("; ipcp: rewrote %u calls\n", propagated);
+                    printf("; escape: %u objects on the stack\n",
+                           on_stack);
+                    printf("; gvn: eliminated %u instructions\n",
+                           optimizer.eliminated);
+                    printf("; licm: hoisted %u instructions\n", hoisted);
+                    printf("; unbox: %u temporaries unboxed\n", unboxed);
+                }
+                continue;
+            }
+
+            tac_cfg cfg;
+            codegen_tac_cfg_build(&tac, &cfg);
+            codegen_tac_cfg_liveness(&tac, &cfg);
+
+            if (format == TAC_PRINT_CFG) {
+                printf("%s.%s\n", class->name.value, method->name.value);
+                print_tac_cfg(stdout, &tac, &cfg);
+            } else {
+                char *name = NULL;
+                ds_string_builder sb;
+                ds_string_builder_init(&sb);
+                ds_string_builder_append(&sb, "%s.%s", class->name.value,
+                                         method->name.value);
+                ds_string_builder_build(&sb, &name);
+
+                print_tac_dot(stdout, &tac, &cfg, name);
             }
+
+            codegen_tac_cfg_free(&cfg);
+        }
+    }
+
+    if (format == TAC_PRINT_DOT) {
+        printf("}\n");
+    }
+
+    if (optimized) {
+        if (options->time_passes) {
+            codegen_tac_print_pass_stats(&optimizer);
         }
+        codegen_tac_optimizer_free(&optimizer);
     }
 }
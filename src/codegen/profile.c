@@ -0,0 +1,137 @@
+#include "codegen.h"
+#include "ds.h"
+
+// The file starts with the magic and the four counts of the header
+#define PROFILE_MAGIC "COOLPROF"
+#define PROFILE_MAGIC_SIZE 8
+#define PROFILE_HEADER_WORDS 4
+
+// A site is hot when it runs at least this fraction of the times the
+// hottest site of the program runs
+#define PROFILE_HOT_RATIO 100
+
+static void profile_number(tac_result *tac, unsigned int *dispatch,
+                           unsigned int *branch) {
+    for (unsigned int i = 0; i < tac->instrs.count; i++) {
+        tac_instr *instr = NULL;
+        ds_dynamic_array_get_ref(&tac->instrs, i, (void **)&instr);
+
+        if (instr->kind == TAC_DISPATCH_CALL) {
+            instr->dispatch_call.site = ++*dispatch;
+        } else if (instr->kind == TAC_JUMP_IF_TRUE) {
+            instr->jump_if_true.site = ++*branch;
+        }
+    }
+}
+
+void codegen_tac_number_sites(tac_optimizer *optimizer, tac_result *tac) {
+    int index = codegen_tac_summary_index(optimizer, tac->method);
+    if (index < 0) {
+        return;
+    }
+
+    tac_method_summary *summary = NULL;
+    ds_dynamic_array_get_ref(&optimizer->summaries, index, (void **)&summary);
+
+    unsigned int dispatch = summary->dispatch_base;
+    unsigned int branch = summary->branch_base;
+    profile_number(tac, &dispatch, &branch);
+}
+
+void codegen_tac_number_summary_sites(tac_optimizer *optimizer,
+                                      tac_method_summary *summary) {
+    summary->dispatch_base = optimizer->dispatch_sites;
+    summary->branch_base = optimizer->branch_sites;
+    profile_number(&summary->tac, &optimizer->dispatch_sites,
+                   &optimizer->branch_sites);
+}
+
+unsigned long codegen_tac_site_count(tac_optimizer *optimizer,
+                                     tac_dispatch_call *call) {
+    tac_profile *profile = optimizer->options.profile;
+    if (profile == NULL || call->site == 0) {
+        return 0;
+    }
+
+    unsigned long count = 0;
+    unsigned long *receivers =
+        profile->receivers + (call->site - 1) * profile->classes;
+    for (unsigned long i = 0; i < profile->classes; i++) {
+        count += receivers[i];
+    }
+
+    return count;
+}
+
+int codegen_tac_profile_matches(tac_optimizer *optimizer,
+                                tac_profile *profile) {
+    return profile->methods == optimizer->summaries.count &&
+           profile->classes == optimizer->mapping->classes.count &&
+           profile->dispatches == optimizer->dispatch_sites &&
+           profile->branches == optimizer->branch_sites;
+}
+
+int codegen_tac_profile_load(const char *path, tac_profile *profile) {
+    int result = 0;
+    unsigned long header[PROFILE_HEADER_WORDS];
+    char magic[PROFILE_MAGIC_SIZE];
+
+    profile->counts = NULL;
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        DS_LOG_ERROR("Failed to open profile: %s", path);
+        return 1;
+    }
+
+    if (fread(magic, 1, PROFILE_MAGIC_SIZE, file) != PROFILE_MAGIC_SIZE ||
+        memcmp(magic, PROFILE_MAGIC, PROFILE_MAGIC_SIZE) != 0 ||
+        fread(header, sizeof(unsigned long), PROFILE_HEADER_WORDS, file) !=
+            PROFILE_HEADER_WORDS) {
+        DS_LOG_ERROR("Not a profile: %s", path);
+        return_defer(1);
+    }
+
+    profile->methods = header[0];
+    profile->classes = header[1];
+    profile->dispatches = header[2];
+    profile->branches = header[3];
+
+    unsigned long count = profile->methods +
+                          profile->dispatches * profile->classes +
+                          2 * profile->branches;
+    profile->counts = calloc(count + 1, sizeof(unsigned long));
+    if (fread(profile->counts, sizeof(unsigned long), count, file) != count) {
+        DS_LOG_ERROR("Truncated profile: %s", path);
+        return_defer(1);
+    }
+
+    profile->entries = profile->counts;
+    profile->receivers = profile->entries + profile->methods;
+    profile->taken =
+        profile->receivers + profile->dispatches * profile->classes;
+
+    unsigned long hottest = 0;
+    for (unsigned long site = 0; site < profile->dispatches; site++) {
+        unsigned long calls = 0;
+        for (unsigned long i = 0; i < profile->classes; i++) {
+            calls += profile->receivers[site * profile->classes + i];
+        }
+        if (calls > hottest) {
+            hottest = calls;
+        }
+    }
+    profile->hot = hottest / PROFILE_HOT_RATIO + 1;
+
+defer:
+    if (result != 0) {
+        free(profile->counts);
+        profile->counts = NULL;
+    }
+    fclose(file);
+    return result;
+}
+
+void codegen_tac_profile_free(tac_profile *profile) {
+    free(profile->counts);
+}
@@ -0,0 +1,214 @@
+#include "codegen.h"
+#include "ds.h"
+
+// Loops deeper than this weigh the same as this
+#define REGALLOC_MAX_DEPTH 4
+
+// The positions where a temporary is live, from its first definition or use
+// to its last one, stretched over the blocks it is live in or out of
+typedef struct regalloc_interval {
+        unsigned int temp;
+        unsigned int start;
+        unsigned int end;
+        int crosses_call;      // a call clobbers the caller saved registers
+        unsigned long weight;  // the uses and definitions, by loop depth
+} regalloc_interval;
+
+static tac_instr *regalloc_instr(tac_result *tac, unsigned int index) {
+    tac_instr *instr = NULL;
+    ds_dynamic_array_get_ref(&tac->instrs, index, (void **)&instr);
+    return instr;
+}
+
+static void regalloc_extend(regalloc_interval *intervals, char *seen,
+                            unsigned int temp, unsigned int position) {
+    regalloc_interval *interval = &intervals[temp];
+    if (!seen[temp]) {
+        seen[temp] = 1;
+        interval->start = position;
+        interval->end = position;
+        return;
+    }
+
+    if (position < interval->start) {
+        interval->start = position;
+    }
+    if (position > interval->end) {
+        interval->end = position;
+    }
+}
+
+static unsigned long regalloc_depth_weight(int depth) {
+    unsigned long weight = 1;
+    for (int k = 0; k < depth && k < REGALLOC_MAX_DEPTH; k++) {
+        weight *= 8;
+    }
+    return weight;
+}
+
+static void regalloc_build_intervals(tac_result *tac, tac_cfg *cfg,
+                                     regalloc_interval *intervals,
+                                     char *seen) {
+    ds_dynamic_array uses;
+    ds_dynamic_array_init(&uses, sizeof(tac_operand *));
+
+    for (unsigned int b = 0; b < cfg->blocks.count; b++) {
+        tac_basic_block *block = NULL;
+        ds_dynamic_array_get_ref(&cfg->blocks, b, (void **)&block);
+        if (block->start == block->end) {
+            continue;
+        }
+
+        for (unsigned int t = 0; t < tac->temp_count; t++) {
+            if (tac_bitset_test(block->live_in, t)) {
+                regalloc_extend(intervals, seen, t, block->start);
+            }
+            if (tac_bitset_test(block->live_out, t)) {
+                regalloc_extend(intervals, seen, t, block->end - 1);
+            }
+        }
+
+        unsigned long weight = regalloc_depth_weight(block->loop_depth);
+        for (unsigned int i = block->start; i < block->end; i++) {
+            tac_instr *instr = regalloc_instr(tac, i);
+
+            tac_operand *def = codegen_tac_instr_def(instr);
+            if (def != NULL && def->kind == TAC_OPERAND_TEMP) {
+                regalloc_extend(intervals, seen, def->index, i);
+                intervals[def->index].weight += weight;
+            }
+
+            uses.count = 0;
+            codegen_tac_instr_uses(instr, &uses);
+            for (unsigned int k = 0; k < uses.count; k++) {
+                tac_operand *operand = NULL;
+                ds_dynamic_array_get(&uses, k, &operand);
+                if (operand->kind == TAC_OPERAND_TEMP) {
+                    regalloc_extend(intervals, seen, operand->index, i);
+                    intervals[operand->index].weight += weight;
+                }
+            }
+        }
+    }
+
+    ds_dynamic_array_free(&uses);
+}
+
+static int regalloc_compare_start(const void *a, const void *b) {
+    const regalloc_interval *x = a, *y = b;
+    if (x->start != y->start) {
+        return x->start < y->start ? -1 : 1;
+    }
+    return x->temp < y->temp ? -1 : x->temp > y->temp;
+}
+
+// Whether the interval of the current temporary can take the register
+static int regalloc_fits(regalloc_interval *interval, unsigned int reg,
+                         unsigned int callee_saved) {
+    return reg < callee_saved || !interval->crosses_call;
+}
+
+void codegen_tac_linear_scan(tac_result *tac, tac_clobbers_fn clobbers,
+                             void *data, unsigned int callee_saved,
+                             unsigned int caller_saved, int *registers) {
+    for (unsigned int t = 0; t < tac->temp_count; t++) {
+        registers[t] = -1;
+    }
+    if (tac->instrs.count == 0 || tac->temp_count == 0) {
+        return;
+    }
+
+    tac_cfg cfg;
+    codegen_tac_cfg_build(tac, &cfg);
+    codegen_tac_cfg_liveness(tac, &cfg);
+
+    unsigned int count = tac->instrs.count;
+    regalloc_interval *intervals =
+        calloc(tac->temp_count + 1, sizeof(regalloc_interval));
+    char *seen = calloc(tac->temp_count + 1, 1);
+    regalloc_build_intervals(tac, &cfg, intervals, seen);
+
+    // calls[i] counts the instructions before i that clobber the caller
+    // saved registers
+    unsigned int *calls = calloc(count + 1, sizeof(unsigned int));
+    for (unsigned int i = 0; i < count; i++) {
+        calls[i + 1] = calls[i] + (clobbers(data, regalloc_instr(tac, i)) != 0);
+    }
+
+    // an instruction can read its operands after its call, but it only
+    // writes its result after it
+    unsigned int interval_count = 0;
+    for (unsigned int t = 0; t < tac->temp_count; t++) {
+        if (!seen[t]) {
+            continue;
+        }
+        regalloc_interval interval = intervals[t];
+        interval.temp = t;
+        interval.crosses_call = calls[interval.end + 1] > calls[interval.start + 1];
+        intervals[interval_count++] = interval;
+    }
+    qsort(intervals, interval_count, sizeof(regalloc_interval),
+          regalloc_compare_start);
+
+    unsigned int reg_count = callee_saved + caller_saved;
+    int *active = malloc(sizeof(int) * (reg_count + 1)); // reg -> interval
+    for (unsigned int r = 0; r < reg_count; r++) {
+        active[r] = -1;
+    }
+
+    for (unsigned int i = 0; i < interval_count; i++) {
+        regalloc_interval *current = &intervals[i];
+
+        // an interval that ends where the current one starts is one of its
+        // operands, which still has to be read after the result is written
+        for (unsigned int r = 0; r < reg_count; r++) {
+            if (active[r] >= 0 && intervals[active[r]].end < current->start) {
+                active[r] = -1;
+            }
+        }
+
+        // the caller saved registers go to the intervals without calls first,
+        // which leaves the callee saved ones for the others
+        int chosen = -1;
+        for (unsigned int k = 0; k < reg_count && chosen < 0; k++) {
+            unsigned int r = (k + callee_saved) % reg_count;
+            if (active[r] < 0 && regalloc_fits(current, r, callee_saved)) {
+                chosen = r;
+            }
+        }
+
+        // otherwise the interval that is worth the least gives its register
+        // up, the one that lasts longest among equals
+        if (chosen < 0) {
+            unsigned long weight = current->weight;
+            unsigned int end = current->end;
+            for (unsigned int r = 0; r < reg_count; r++) {
+                if (!regalloc_fits(current, r, callee_saved)) {
+                    continue;
+                }
+
+                regalloc_interval *victim = &intervals[active[r]];
+                if (victim->weight < weight ||
+                    (victim->weight == weight && victim->end > end)) {
+                    chosen = r;
+                    weight = victim->weight;
+                    end = victim->end;
+                }
+            }
+            if (chosen >= 0) {
+                registers[intervals[active[chosen]].temp] = -1;
+            }
+        }
+
+        if (chosen >= 0) {
+            active[chosen] = i;
+            registers[current->temp] = chosen;
+        }
+    }
+
+    free(active);
+    free(calls);
+    free(seen);
+    free(intervals);
+    codegen_tac_cfg_free(&cfg);
+}
@@ -0,0 +1,290 @@
+#include "codegen.h"
+#include "ds.h"
+
+// The share of the calls of a site, in percent, that the profile has to see
+// reaching the guessed implementation
+#define SPECULATE_PROFILE_SHARE 80
+
+// Without a profile, more than this share of the objects that the program
+// allocates of the static type have to be of the guessed classes
+#define SPECULATE_STATIC_SHARE 50
+
+static unsigned int speculate_class_index(semantic_mapping *mapping,
+                                          const char *type) {
+    for (unsigned int i = 0; i < mapping->classes.count; i++) {
+        semantic_mapping_item *item = NULL;
+        ds_dynamic_array_get_ref(&mapping->classes, i, (void **)&item);
+
+        if (strcmp(item->class_name, type) == 0) {
+            return i;
+        }
+    }
+
+    return mapping->classes.count;
+}
+
+// The last tag of the subtree of a class: the tags are numbered in DFS
+// order, so the classes that conform to it follow it
+static unsigned int speculate_subtree_end(semantic_mapping *mapping,
+                                          unsigned int start) {
+    semantic_mapping_item *root = NULL;
+    ds_dynamic_array_get_ref(&mapping->classes, start, (void **)&root);
+
+    unsigned int end = start;
+    while (end + 1 < mapping->classes.count) {
+        semantic_mapping_item *item = NULL;
+        ds_dynamic_array_get_ref(&mapping->classes, end + 1, (void **)&item);
+        if (!codegen_class_conforms(item, root->class_name)) {
+            break;
+        }
+        end++;
+    }
+
+    return end;
+}
+
+static semantic_mapping_item *speculate_class(semantic_mapping *mapping,
+                                              unsigned int index) {
+    semantic_mapping_item *item = NULL;
+    ds_dynamic_array_get_ref(&mapping->classes, index, (void **)&item);
+    return item;
+}
+
+// The implementation of the method that every class of the subtree uses,
+// or NULL if they do not all use the same one
+static tac_method_summary *speculate_target(tac_optimizer *optimizer,
+                                            unsigned int start,
+                                            unsigned int end,
+                                            const char *method) {
+    tac_method_summary *target = NULL;
+    for (unsigned int i = start; i <= end; i++) {
+        tac_method_summary *summary = codegen_tac_method_summary(
+            optimizer, speculate_class(optimizer->mapping, i)->class_name,
+            method);
+        if (summary == NULL || (target != NULL && target != summary)) {
+            return NULL;
+        }
+        target = summary;
+    }
+
+    return target;
+}
+
+void codegen_tac_count_allocations(tac_optimizer *optimizer) {
+    semantic_mapping *mapping = optimizer->mapping;
+    optimizer->allocations =
+        calloc(mapping->classes.count + 1, sizeof(unsigned long));
+
+    for (unsigned int i = 0; i < optimizer->summaries.count; i++) {
+        tac_method_summary *summary = NULL;
+        ds_dynamic_array_get_ref(&optimizer->summaries, i, (void **)&summary);
+
+        for (unsigned int k = 0; k < summary->tac.instrs.count; k++) {
+            tac_instr *instr = NULL;
+            ds_dynamic_array_get_ref(&summary->tac.instrs, k, (void **)&instr);
+
+            if (instr->kind == TAC_ASSIGN_NEW &&
+                strcmp(instr->assign_new.type, "SELF_TYPE") != 0) {
+                optimizer->allocations[speculate_class_index(
+                    mapping, instr->assign_new.type)]++;
+            }
+        }
+    }
+}
+
+// The classes that the receiver of the call is seen having: the ones the
+// profile counted at the site, or the allocations of the whole program when
+// the site has no counts. Returns whether they come from the profile.
+static int speculate_weights(tac_optimizer *optimizer,
+                             tac_dispatch_call *call, unsigned long **weights) {
+    tac_profile *profile = optimizer->options.profile;
+    if (profile != NULL && call->site != 0) {
+        *weights = profile->receivers + (call->site - 1) * profile->classes;
+        return 1;
+    }
+
+    *weights = optimizer->allocations;
+    return 0;
+}
+
+// The implementation that the call most likely reaches, and the subtree of
+// classes that are sure to reach it, or NULL if no one is likely enough
+static tac_method_summary *speculate_guess(tac_optimizer *optimizer,
+                                           tac_result *tac,
+                                           tac_dispatch_call *call,
+                                           unsigned int *guess) {
+    semantic_mapping *mapping = optimizer->mapping;
+    unsigned int start = speculate_class_index(
+        mapping, codegen_tac_receiver_type(tac, call));
+    if (start == mapping->classes.count) {
+        return NULL;
+    }
+    unsigned int end = speculate_subtree_end(mapping, start);
+
+    unsigned long *weights = NULL;
+    int profiled = speculate_weights(optimizer, call, &weights);
+
+    unsigned long total = 0;
+    for (unsigned int i = start; i <= end; i++) {
+        total += weights[i];
+    }
+
+    // the static type itself has more than one target, or the call would
+    // have been devirtualized; a tie goes to the larger subtree, which
+    // comes first
+    tac_method_summary *best = NULL;
+    unsigned long best_weight = 0;
+    for (unsigned int i = start + 1; i <= end; i++) {
+        unsigned int last = speculate_subtree_end(mapping, i);
+
+        unsigned long weight = 0;
+        for (unsigned int k = i; k <= last; k++) {
+            weight += weights[k];
+        }
+        if (weight <= best_weight) {
+            continue;
+        }
+
+        tac_method_summary *target =
+            speculate_target(optimizer, i, last, call->method);
+        if (target != NULL) {
+            best = target;
+            best_weight = weight;
+            *guess = i;
+        }
+    }
+
+    if (best == NULL) {
+        return NULL;
+    }
+    if (profiled && 100 * best_weight < SPECULATE_PROFILE_SHARE * total) {
+        return NULL;
+    }
+    if (!profiled && 100 * best_weight <= SPECULATE_STATIC_SHARE * total) {
+        return NULL;
+    }
+
+    return best;
+}
+
+static int speculate_new_label(tac_result *tac) {
+    return tac->label_count++;
+}
+
+static tac_operand speculate_new_temp(tac_result *tac) {
+    return (tac_operand){.kind = TAC_OPERAND_TEMP, .index = tac->temp_count++};
+}
+
+static void speculate_append(ds_dynamic_array *instrs, tac_instr instr) {
+    ds_dynamic_array_append(instrs, &instr);
+}
+
+// Split the call into a direct call on the classes of the guess and the
+// dynamic dispatch for the rest:
+//
+//     v <- isvoid x          (not for self)
+//     bt v slow
+//     g <- x isinstance Guess
+//     bt g fast
+//   slow:
+//     r <- x.m(args)
+//     jump done
+//   fast:
+//     r <- x@Impl.m(args)
+//   done:
+static void speculate_branch(tac_result *tac, tac_dispatch_call *call,
+                             const char *guess, tac_method_summary *target,
+                             ds_dynamic_array *instrs) {
+    int slow = speculate_new_label(tac);
+    int fast = speculate_new_label(tac);
+    int done = speculate_new_label(tac);
+
+    if (call->expr.kind != TAC_OPERAND_SELF) {
+        tac_operand isvoid = speculate_new_temp(tac);
+        speculate_append(
+            instrs, (tac_instr){.kind = TAC_ASSIGN_ISVOID,
+                                .assign_unary = {.ident = isvoid,
+                                                 .expr = call->expr}});
+        speculate_append(instrs,
+                         (tac_instr){.kind = TAC_JUMP_IF_TRUE,
+                                     .jump_if_true = {.expr = isvoid,
+                                                      .label = slow}});
+    }
+
+    tac_operand matches = speculate_new_temp(tac);
+    speculate_append(instrs,
+                     (tac_instr){.kind = TAC_ASSIGN_ISINSTANCE,
+                                 .isinstance = {.ident = matches,
+                                                .expr = call->expr,
+                                                .type = (char *)guess}});
+    speculate_append(instrs, (tac_instr){.kind = TAC_JUMP_IF_TRUE,
+                                         .jump_if_true = {.expr = matches,
+                                                          .label = fast}});
+
+    tac_dispatch_call direct = *call;
+    direct.type = (char *)target->class->class_name;
+    ds_dynamic_array_init(&direct.args, sizeof(tac_operand));
+    for (unsigned int k = 0; k < call->args.count; k++) {
+        tac_operand arg;
+        ds_dynamic_array_get(&call->args, k, &arg);
+        ds_dynamic_array_append(&direct.args, &arg);
+    }
+
+    speculate_append(instrs,
+                     (tac_instr){.kind = TAC_LABEL, .label = {.label = slow}});
+    speculate_append(instrs, (tac_instr){.kind = TAC_DISPATCH_CALL,
+                                         .dispatch_call = *call});
+    speculate_append(instrs,
+                     (tac_instr){.kind = TAC_JUMP, .jump = {.label = done}});
+    speculate_append(instrs,
+                     (tac_instr){.kind = TAC_LABEL, .label = {.label = fast}});
+    speculate_append(instrs, (tac_instr){.kind = TAC_DISPATCH_CALL,
+                                         .dispatch_call = direct});
+    speculate_append(instrs,
+                     (tac_instr){.kind = TAC_LABEL, .label = {.label = done}});
+}
+
+void codegen_tac_speculate(tac_optimizer *optimizer, tac_result *tac) {
+    int inline_enabled =
+        codegen_tac_pass_enabled(optimizer, TAC_PASS_INLINE) &&
+        optimizer->options.inline_threshold > 0;
+
+    ds_dynamic_array instrs;
+    ds_dynamic_array_init(&instrs, sizeof(tac_instr));
+
+    for (unsigned int i = 0; i < tac->instrs.count; i++) {
+        tac_instr *instr = NULL;
+        ds_dynamic_array_get_ref(&tac->instrs, i, (void **)&instr);
+
+        unsigned int guess = 0;
+        tac_method_summary *target = NULL;
+        if (instr->kind == TAC_DISPATCH_CALL &&
+            instr->dispatch_call.type == NULL) {
+            target = speculate_guess(optimizer, tac, &instr->dispatch_call,
+                                     &guess);
+        }
+        if (target == NULL) {
+            ds_dynamic_array_append(&instrs, instr);
+            continue;
+        }
+
+        optimizer->speculated++;
+        const char *class_name =
+            speculate_class(optimizer->mapping, guess)->class_name;
+
+        tac_dispatch_call direct = instr->dispatch_call;
+        direct.type = (char *)target->class->class_name;
+        if (inline_enabled &&
+            codegen_tac_is_inlinable(optimizer, tac, &direct)) {
+            speculate_branch(tac, &instr->dispatch_call, class_name, target,
+                             &instrs);
+            continue;
+        }
+
+        instr->dispatch_call.guess = (char *)class_name;
+        ds_dynamic_array_append(&instrs, instr);
+    }
+
+    ds_dynamic_array_free(&tac->instrs);
+    tac->instrs = instrs;
+}
@@ -0,0 +1,759 @@
+#include "codegen.h"
+#include "ds.h"
+
+static tac_basic_block *ssa_block(tac_cfg *cfg, unsigned int index) {
+    tac_basic_block *block = NULL;
+    ds_dynamic_array_get_ref(&cfg->blocks, index, (void **)&block);
+    return block;
+}
+
+static tac_instr *ssa_instr(tac_result *tac, unsigned int index) {
+    tac_instr *instr = NULL;
+    ds_dynamic_array_get_ref(&tac->instrs, index, (void **)&instr);
+    return instr;
+}
+
+static tac_operand ssa_var_operand(tac_result *tac, unsigned int var) {
+    if (var < tac->temp_count) {
+        return (tac_operand){.kind = TAC_OPERAND_TEMP, .index = var};
+    }
+
+    return (tac_operand){.kind = TAC_OPERAND_FORMAL,
+                         .index = var - tac->temp_count};
+}
+
+static tac_operand ssa_new_temp(tac_result *tac) {
+    return (tac_operand){.kind = TAC_OPERAND_TEMP,
+                         .index = tac->temp_count++};
+}
+
+// The dominance frontier of every block, as arrays of block indices
+static ds_dynamic_array *ssa_frontiers(tac_cfg *cfg) {
+    ds_dynamic_array *frontiers =
+        malloc(sizeof(ds_dynamic_array) * (cfg->blocks.count + 1));
+
+    for (unsigned int i = 0; i < cfg->blocks.count; i++) {
+        ds_dynamic_array_init(&frontiers[i], sizeof(unsigned int));
+    }
+
+    for (unsigned int i = 0; i < cfg->blocks.count; i++) {
+        tac_basic_block *block = ssa_block(cfg, i);
+        if (block->rpo < 0 || block->preds.count < 2) {
+            continue;
+        }
+
+        for (unsigned int j = 0; j < block->preds.count; j++) {
+            unsigned int runner;
+            ds_dynamic_array_get(&block->preds, j, &runner);
+            if (ssa_block(cfg, runner)->rpo < 0) {
+                continue;
+            }
+
+            while ((int)runner != block->idom) {
+                ds_dynamic_array *frontier = &frontiers[runner];
+
+                int found = 0;
+                for (unsigned int k = 0; k < frontier->count; k++) {
+                    unsigned int index;
+                    ds_dynamic_array_get(frontier, k, &index);
+                    if (index == i) {
+                        found = 1;
+                        break;
+                    }
+                }
+                if (!found) {
+                    ds_dynamic_array_append(frontier, &i);
+                }
+
+                if (ssa_block(cfg, runner)->idom < 0) {
+                    break;
+                }
+                runner = ssa_block(cfg, runner)->idom;
+            }
+        }
+    }
+
+    return frontiers;
+}
+
+// Insert the phi instructions, with one argument per predecessor, right after
+// the labels of the blocks in the iterated dominance frontier of the
+// definitions of each variable that is live at the join
+static void ssa_insert_phis(tac_result *tac, tac_cfg *cfg) {
+    unsigned int var_count = cfg->var_count;
+    unsigned int block_count = cfg->blocks.count;
+
+    ds_dynamic_array *frontiers = ssa_frontiers(cfg);
+
+    // defined[v * block_count + b] is set if block b defines variable v
+    char *defined = calloc((size_t)var_count * block_count + 1, 1);
+    for (unsigned int i = 0; i < block_count; i++) {
+        tac_basic_block *block = ssa_block(cfg, i);
+        if (block->rpo < 0) {
+            continue;
+        }
+
+        for (unsigned int j = block->start; j < block->end; j++) {
+            tac_operand *def = codegen_tac_instr_def(ssa_instr(tac, j));
+            if (def == NULL) {
+                continue;
+            }
+
+            int var = codegen_tac_var_index(tac, *def);
+            if (var >= 0) {
+                defined[(size_t)var * block_count + i] = 1;
+            }
+        }
+    }
+
+    // phis[b] holds the variables that need a phi at the start of block b
+    ds_dynamic_array *phis = malloc(sizeof(ds_dynamic_array) * (block_count + 1));
+    for (unsigned int i = 0; i < block_count; i++) {
+        ds_dynamic_array_init(&phis[i], sizeof(unsigned int));
+    }
+
+    char *has_phi = calloc(block_count + 1, 1);
+    char *queued = calloc(block_count + 1, 1);
+    unsigned int *worklist = malloc(sizeof(unsigned int) * (block_count + 1));
+
+    for (unsigned int var = 0; var < var_count; var++) {
+        unsigned int count = 0;
+        memset(has_phi, 0, block_count);
+        memset(queued, 0, block_count);
+
+        for (unsigned int i = 0; i < block_count; i++) {
+            if (defined[(size_t)var * block_count + i]) {
+                worklist[count++] = i;
+                queued[i] = 1;
+            }
+        }
+
+        while (count > 0) {
+            unsigned int index = worklist[--count];
+
+            ds_dynamic_array *frontier = &frontiers[index];
+            for (unsigned int k = 0; k < frontier->count; k++) {
+                unsigned int join;
+                ds_dynamic_array_get(frontier, k, &join);
+
+                if (has_phi[join] ||
+                    !tac_bitset_test(ssa_block(cfg, join)->live_in, var)) {
+                    continue;
+                }
+
+                has_phi[join] = 1;
+                ds_dynamic_array_append(&phis[join], &var);
+
+                if (!queued[join]) {
+                    queued[join] = 1;
+                    worklist[count++] = join;
+                }
+            }
+        }
+    }
+
+    ds_dynamic_array instrs;
+    ds_dynamic_array_init(&instrs, sizeof(tac_instr));
+
+    for (unsigned int i = 0; i < block_count; i++) {
+        tac_basic_block *block = ssa_block(cfg, i);
+
+        ds_dynamic_array_append(&instrs, ssa_instr(tac, block->start));
+
+        for (unsigned int j = 0; j < phis[i].count; j++) {
+            unsigned int var;
+            ds_dynamic_array_get(&phis[i], j, &var);
+
+            tac_instr phi = {.kind = TAC_PHI,
+                             .phi = {.ident = ssa_var_operand(tac, var)}};
+            ds_dynamic_array_init(&phi.phi.args, sizeof(tac_phi_arg));
+
+            for (unsigned int k = 0; k < block->preds.count; k++) {
+                unsigned int pred;
+                ds_dynamic_array_get(&block->preds, k, &pred);
+
+                tac_phi_arg arg = {.label = ssa_block(cfg, pred)->label,
+                                   .value = {.kind = TAC_OPERAND_NONE}};
+                ds_dynamic_array_append(&phi.phi.args, &arg);
+            }
+
+            ds_dynamic_array_append(&instrs, &phi);
+        }
+
+        for (unsigned int j = block->start + 1; j < block->end; j++) {
+            ds_dynamic_array_append(&instrs, ssa_instr(tac, j));
+        }
+
+        ds_dynamic_array_free(&phis[i]);
+        ds_dynamic_array_free(&frontiers[i]);
+    }
+
+    ds_dynamic_array_free(&tac->instrs);
+    tac->instrs = instrs;
+
+    free(phis);
+    free(frontiers);
+    free(defined);
+    free(has_phi);
+    free(queued);
+    free(worklist);
+}
+
+typedef struct ssa_rename_context {
+        tac_result *tac;
+        tac_cfg *cfg;
+        unsigned int var_count;    // variables before renaming
+        unsigned int temp_count;   // temporaries before renaming
+        ds_dynamic_array *stacks;  // tac_operand, one stack per variable
+        ds_dynamic_array *children; // unsigned int, dominator tree
+        ds_dynamic_array uses;     // tac_operand *
+} ssa_rename_context;
+
+// Variable index of an operand as numbered before the renaming started
+static int ssa_original_var(ssa_rename_context *context, tac_operand operand) {
+    switch (operand.kind) {
+    case TAC_OPERAND_TEMP:
+        if ((unsigned int)operand.index < context->temp_count) {
+            return operand.index;
+        }
+        return -1;
+    case TAC_OPERAND_FORMAL:
+        return context->temp_count + operand.index;
+    default:
+        return -1;
+    }
+}
+
+static tac_operand ssa_top(ssa_rename_context *context, unsigned int var) {
+    ds_dynamic_array *stack = &context->stacks[var];
+
+    tac_operand operand;
+    ds_dynamic_array_get(stack, stack->count - 1, &operand);
+    return operand;
+}
+
+static void ssa_rename_block(ssa_rename_context *context, unsigned int index) {
+    tac_result *tac = context->tac;
+    tac_basic_block *block = ssa_block(context->cfg, index);
+
+    ds_dynamic_array pushed;
+    ds_dynamic_array_init(&pushed, sizeof(unsigned int));
+
+    for (unsigned int i = block->start + 1; i < block->end; i++) {
+        tac_instr *instr = ssa_instr(tac, i);
+
+        if (instr->kind != TAC_PHI) {
+            context->uses.count = 0;
+            codegen_tac_instr_uses(instr, &context->uses);
+
+            for (unsigned int j = 0; j < context->uses.count; j++) {
+                tac_operand *operand = NULL;
+                ds_dynamic_array_get(&context->uses, j, &operand);
+
+                int var = ssa_original_var(context, *operand);
+                if (var >= 0) {
+                    *operand = ssa_top(context, var);
+                }
+            }
+        }
+
+        tac_operand *def = codegen_tac_instr_def(instr);
+        if (def == NULL) {
+            continue;
+        }
+
+        int var = ssa_original_var(context, *def);
+        if (var < 0) {
+            continue;
+        }
+
+        *def = ssa_new_temp(tac);
+        ds_dynamic_array_append(&context->stacks[var], def);
+        ds_dynamic_array_append(&pushed, &var);
+    }
+
+    for (unsigned int i = 0; i < block->succs.count; i++) {
+        unsigned int succ;
+        ds_dynamic_array_get(&block->succs, i, &succ);
+        tac_basic_block *succ_block = ssa_block(context->cfg, succ);
+
+        for (unsigned int j = succ_block->start + 1; j < succ_block->end; j++) {
+            tac_instr *instr = ssa_instr(tac, j);
+            if (instr->kind != TAC_PHI) {
+                break;
+            }
+
+            for (unsigned int k = 0; k < instr->phi.args.count; k++) {
+                tac_phi_arg *arg = NULL;
+                ds_dynamic_array_get_ref(&instr->phi.args, k, (void **)&arg);
+
+                if (arg->label == block->label) {
+                    arg->value = ssa_top(context, arg->value.index);
+                }
+            }
+        }
+    }
+
+    ds_dynamic_array *children = &context->children[index];
+    for (unsigned int i = 0; i < children->count; i++) {
+        unsigned int child;
+        ds_dynamic_array_get(children, i, &child);
+        ssa_rename_block(context, child);
+    }
+
+    for (unsigned int i = 0; i < pushed.count; i++) {
+        unsigned int var;
+        ds_dynamic_array_get(&pushed, i, &var);
+        context->stacks[var].count--;
+    }
+
+    ds_dynamic_array_free(&pushed);
+}
+
+void codegen_tac_to_ssa(tac_result *tac) {
+    tac_cfg cfg;
+    codegen_tac_cfg_build(tac, &cfg);
+    codegen_tac_cfg_liveness(tac, &cfg);
+
+    ssa_insert_phis(tac, &cfg);
+    codegen_tac_cfg_free(&cfg);
+    codegen_tac_cfg_build(tac, &cfg);
+
+    ssa_rename_context context = {.tac = tac,
+                                  .cfg = &cfg,
+                                  .var_count = cfg.var_count,
+                                  .temp_count = tac->temp_count};
+    ds_dynamic_array_init(&context.uses, sizeof(tac_operand *));
+
+    // the phis are still named after the original variable, which is used
+    // by the predecessors to find the stack of the argument; the arguments
+    // remember it as a temporary index until they are renamed
+    for (unsigned int i = 0; i < tac->instrs.count; i++) {
+        tac_instr *instr = ssa_instr(tac, i);
+        if (instr->kind != TAC_PHI) {
+            continue;
+        }
+
+        int var = codegen_tac_var_index(tac, instr->phi.ident);
+        for (unsigned int k = 0; k < instr->phi.args.count; k++) {
+            tac_phi_arg *arg = NULL;
+            ds_dynamic_array_get_ref(&instr->phi.args, k, (void **)&arg);
+            arg->value = (tac_operand){.kind = TAC_OPERAND_NONE, .index = var};
+        }
+    }
+
+    // the bottom of every stack is the variable itself, so a use that is not
+    // reached by any definition keeps its original slot
+    context.stacks = malloc(sizeof(ds_dynamic_array) * (cfg.var_count + 1));
+    for (unsigned int i = 0; i < cfg.var_count; i++) {
+        ds_dynamic_array_init(&context.stacks[i], sizeof(tac_operand));
+        tac_operand operand = ssa_var_operand(tac, i);
+        ds_dynamic_array_append(&context.stacks[i], &operand);
+    }
+
+    context.children = malloc(sizeof(ds_dynamic_array) * (cfg.blocks.count + 1));
+    for (unsigned int i = 0; i < cfg.blocks.count; i++) {
+        ds_dynamic_array_init(&context.children[i], sizeof(unsigned int));
+    }
+    for (unsigned int i = 0; i < cfg.blocks.count; i++) {
+        int idom = ssa_block(&cfg, i)->idom;
+        if (idom >= 0) {
+            ds_dynamic_array_append(&context.children[idom], &i);
+        }
+    }
+
+    ssa_rename_block(&context, 0);
+
+    // arguments from unreachable predecessors are never renamed
+    for (unsigned int i = 0; i < tac->instrs.count; i++) {
+        tac_instr *instr = ssa_instr(tac, i);
+        if (instr->kind != TAC_PHI) {
+            continue;
+        }
+
+        for (unsigned int k = 0; k < instr->phi.args.count; k++) {
+            tac_phi_arg *arg = NULL;
+            ds_dynamic_array_get_ref(&instr->phi.args, k, (void **)&arg);
+            if (arg->value.kind == TAC_OPERAND_NONE) {
+                arg->value.index = 0;
+            }
+        }
+    }
+
+    for (unsigned int i = 0; i < cfg.var_count; i++) {
+        ds_dynamic_array_free(&context.stacks[i]);
+    }
+    for (unsigned int i = 0; i < cfg.blocks.count; i++) {
+        ds_dynamic_array_free(&context.children[i]);
+    }
+    free(context.stacks);
+    free(context.children);
+    ds_dynamic_array_free(&context.uses);
+    codegen_tac_cfg_free(&cfg);
+}
+
+static int ssa_is_terminator(tac_instr *instr) {
+    return instr->kind == TAC_JUMP || instr->kind == TAC_JUMP_IF_TRUE ||
+           instr->kind == TAC_CASE;
+}
+
+// Every phi gets a fresh temporary that is written at the end of each
+// predecessor and copied into the phi at the start of its block. The
+// temporary is only read at the join, so writing it on the other edges of a
+// branch is harmless and no critical edge has to be split.
+void codegen_tac_from_ssa(tac_result *tac) {
+    tac_cfg cfg;
+    codegen_tac_cfg_build(tac, &cfg);
+
+    unsigned int block_count = cfg.blocks.count;
+    ds_dynamic_array *tails = malloc(sizeof(ds_dynamic_array) * (block_count + 1));
+    ds_dynamic_array *heads = malloc(sizeof(ds_dynamic_array) * (block_count + 1));
+    for (unsigned int i = 0; i < block_count; i++) {
+        ds_dynamic_array_init(&tails[i], sizeof(tac_instr));
+        ds_dynamic_array_init(&heads[i], sizeof(tac_instr));
+    }
+
+    for (unsigned int i = 0; i < block_count; i++) {
+        tac_basic_block *block = ssa_block(&cfg, i);
+
+        for (unsigned int j = block->start + 1; j < block->end; j++) {
+            tac_instr *instr = ssa_instr(tac, j);
+            if (instr->kind != TAC_PHI) {
+                break;
+            }
+
+            tac_operand copy = ssa_new_temp(tac);
+
+            for (unsigned int k = 0; k < instr->phi.args.count; k++) {
+                tac_phi_arg arg;
+                ds_dynamic_array_get(&instr->phi.args, k, &arg);
+
+                int pred = -1;
+                ds_dynamic_array_get(&cfg.labels, arg.label, &pred);
+                if (arg.value.kind == TAC_OPERAND_NONE || pred < 0 ||
+                    ssa_block(&cfg, pred)->rpo < 0) {
+                    continue;
+                }
+
+                tac_instr tail = {.kind = TAC_ASSIGN_VALUE,
+                                  .assign_value = {.ident = copy,
+                                                   .expr = arg.value}};
+                ds_dynamic_array_append(&tails[pred], &tail);
+            }
+
+            tac_instr head = {.kind = TAC_ASSIGN_VALUE,
+                              .assign_value = {.ident = instr->phi.ident,
+                                               .expr = copy}};
+            ds_dynamic_array_append(&heads[i], &head);
+
+            ds_dynamic_array_free(&instr->phi.args);
+        }
+    }
+
+    ds_dynamic_array instrs;
+    ds_dynamic_array_init(&instrs, sizeof(tac_instr));
+
+    for (unsigned int i = 0; i < block_count; i++) {
+        tac_basic_block *block = ssa_block(&cfg, i);
+
+        unsigned int end = block->end;
+        tac_instr *last = ssa_instr(tac, end - 1);
+        if (end - 1 > block->start && ssa_is_terminator(last)) {
+            end--;
+        }
+
+        for (unsigned int j = block->start; j < end; j++) {
+            tac_instr *instr = ssa_instr(tac, j);
+            if (instr->kind == TAC_PHI) {
+                continue;
+            }
+
+            ds_dynamic_array_append(&instrs, instr);
+
+            if (j == block->start) {
+                for (unsigned int k = 0; k < heads[i].count; k++) {
+                    tac_instr head;
+                    ds_dynamic_array_get(&heads[i], k, &head);
+                    ds_dynamic_array_append(&instrs, &head);
+                }
+            }
+        }
+
+        for (unsigned int k = 0; k < tails[i].count; k++) {
+            tac_instr tail;
+            ds_dynamic_array_get(&tails[i], k, &tail);
+            ds_dynamic_array_append(&instrs, &tail);
+        }
+
+        if (end != block->end) {
+            ds_dynamic_array_append(&instrs, last);
+        }
+
+        ds_dynamic_array_free(&tails[i]);
+        ds_dynamic_array_free(&heads[i]);
+    }
+
+    ds_dynamic_array_free(&tac->instrs);
+    tac->instrs = instrs;
+
+    free(tails);
+    free(heads);
+    codegen_tac_cfg_free(&cfg);
+}
+
+// Coalescing needs a bit matrix over the temporaries, methods with more of
+// them than this are only renumbered
+#define SSA_COALESCE_LIMIT 8192
+
+typedef struct ssa_interference {
+        unsigned int count;
+        unsigned int words;
+        unsigned long *matrix;
+} ssa_interference;
+
+static unsigned long *ssa_row(ssa_interference *graph, unsigned int var) {
+    return graph->matrix + (size_t)var * graph->words;
+}
+
+static void ssa_interfere(ssa_interference *graph, unsigned int a,
+                          unsigned int b) {
+    if (a == b) {
+        return;
+    }
+
+    ssa_row(graph, a)[b / TAC_BITSET_WORD] |= 1UL << (b % TAC_BITSET_WORD);
+    ssa_row(graph, b)[a / TAC_BITSET_WORD] |= 1UL << (a % TAC_BITSET_WORD);
+}
+
+static int ssa_copy_source(tac_instr *instr, tac_operand *source) {
+    if (instr->kind == TAC_ASSIGN_VALUE) {
+        *source = instr->assign_value.expr;
+        return 1;
+    }
+
+    if (instr->kind == TAC_CAST) {
+        *source = instr->cast.expr;
+        return 1;
+    }
+
+    return 0;
+}
+
+// The assembler allocates the result object of these before it reads the
+// operands, so the result must not share a slot with any of them
+static int ssa_is_early_clobber(tac_instr *instr) {
+    switch (instr->kind) {
+    case TAC_ASSIGN_ISINSTANCE:
+    case TAC_ASSIGN_ISVOID:
+    case TAC_ASSIGN_ADD:
+    case TAC_ASSIGN_SUB:
+    case TAC_ASSIGN_MUL:
+    case TAC_ASSIGN_DIV:
+    case TAC_ASSIGN_NEG:
+    case TAC_ASSIGN_LT:
+    case TAC_ASSIGN_LE:
+    case TAC_ASSIGN_NOT:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// Walk every block backwards from its live out set: a definition interferes
+// with everything live after it, except with the source of a copy
+static void ssa_build_interference(tac_result *tac, tac_cfg *cfg,
+                                   ssa_interference *graph) {
+    unsigned long *live = calloc(cfg->word_count + 1, sizeof(long));
+
+    ds_dynamic_array uses;
+    ds_dynamic_array_init(&uses, sizeof(tac_operand *));
+
+    for (unsigned int i = 0; i < cfg->blocks.count; i++) {
+        tac_basic_block *block = ssa_block(cfg, i);
+        if (block->rpo < 0) {
+            continue;
+        }
+
+        memcpy(live, block->live_out, cfg->word_count * sizeof(long));
+
+        for (unsigned int j = block->end; j > block->start; j--) {
+            tac_instr *instr = ssa_instr(tac, j - 1);
+
+            tac_operand *def = codegen_tac_instr_def(instr);
+            int def_var = def != NULL ? codegen_tac_var_index(tac, *def) : -1;
+
+            if (def_var >= 0) {
+                tac_operand source;
+                int source_var = -1;
+                if (ssa_copy_source(instr, &source)) {
+                    source_var = codegen_tac_var_index(tac, source);
+                }
+
+                for (unsigned int w = 0; w < cfg->word_count; w++) {
+                    unsigned long bits = live[w];
+                    while (bits != 0) {
+                        unsigned int bit = __builtin_ctzl(bits);
+                        bits &= bits - 1;
+
+                        int var = w * TAC_BITSET_WORD + bit;
+                        if (var != source_var) {
+                            ssa_interfere(graph, def_var, var);
+                        }
+                    }
+                }
+
+                live[def_var / TAC_BITSET_WORD] &=
+                    ~(1UL << (def_var % TAC_BITSET_WORD));
+            }
+
+            uses.count = 0;
+            codegen_tac_instr_uses(instr, &uses);
+            for (unsigned int k = 0; k < uses.count; k++) {
+                tac_operand *operand = NULL;
+                ds_dynamic_array_get(&uses, k, &operand);
+
+                int var = codegen_tac_var_index(tac, *operand);
+                if (var < 0) {
+                    continue;
+                }
+
+                live[var / TAC_BITSET_WORD] |= 1UL << (var % TAC_BITSET_WORD);
+                if (def_var >= 0 && ssa_is_early_clobber(instr)) {
+                    ssa_interfere(graph, def_var, var);
+                }
+            }
+        }
+    }
+
+    ds_dynamic_array_free(&uses);
+    free(live);
+}
+
+static unsigned int ssa_find(unsigned int *parent, unsigned int var) {
+    while (parent[var] != var) {
+        parent[var] = parent[parent[var]];
+        var = parent[var];
+    }
+
+    return var;
+}
+
+static int ssa_is_redundant_copy(tac_instr *instr) {
+    tac_operand source;
+    if (!ssa_copy_source(instr, &source)) {
+        return 0;
+    }
+
+    tac_operand *def = codegen_tac_instr_def(instr);
+    return def->kind == TAC_OPERAND_TEMP && source.kind == TAC_OPERAND_TEMP &&
+           def->index == source.index;
+}
+
+void codegen_tac_coalesce(tac_result *tac) {
+    unsigned int temp_count = tac->temp_count;
+    unsigned int *parent = malloc(sizeof(unsigned int) * (temp_count + 1));
+    for (unsigned int i = 0; i < temp_count; i++) {
+        parent[i] = i;
+    }
+
+    if (temp_count <= SSA_COALESCE_LIMIT) {
+        tac_cfg cfg;
+        codegen_tac_cfg_build(tac, &cfg);
+        codegen_tac_cfg_liveness(tac, &cfg);
+
+        ssa_interference graph = {.count = cfg.var_count,
+                                  .words = cfg.word_count};
+        graph.matrix =
+            calloc((size_t)graph.count * graph.words + 1, sizeof(long));
+        ssa_build_interference(tac, &cfg, &graph);
+
+        for (unsigned int i = 0; i < tac->instrs.count; i++) {
+            tac_instr *instr = ssa_instr(tac, i);
+
+            tac_operand source;
+            if (!ssa_copy_source(instr, &source)) {
+                continue;
+            }
+
+            tac_operand *def = codegen_tac_instr_def(instr);
+            if (def->kind != TAC_OPERAND_TEMP ||
+                source.kind != TAC_OPERAND_TEMP) {
+                continue;
+            }
+
+            unsigned int a = ssa_find(parent, def->index);
+            unsigned int b = ssa_find(parent, source.index);
+            if (a == b || tac_bitset_test(ssa_row(&graph, a), b)) {
+                continue;
+            }
+
+            // b joins a: a inherits every neighbour of b
+            parent[b] = a;
+            unsigned long *row_a = ssa_row(&graph, a);
+            unsigned long *row_b = ssa_row(&graph, b);
+            for (unsigned int w = 0; w < graph.words; w++) {
+                unsigned long bits = row_b[w];
+                row_a[w] |= bits;
+                while (bits != 0) {
+                    unsigned int bit = __builtin_ctzl(bits);
+                    bits &= bits - 1;
+                    ssa_interfere(&graph, a, w * TAC_BITSET_WORD + bit);
+                }
+            }
+        }
+
+        free(graph.matrix);
+        codegen_tac_cfg_free(&cfg);
+    }
+
+    // number the surviving temporaries in order of first appearance
+    unsigned int *map = malloc(sizeof(unsigned int) * (temp_count + 1));
+    for (unsigned int i = 0; i < temp_count; i++) {
+        map[i] = temp_count;
+    }
+
+    unsigned int next = 0;
+    ds_dynamic_array uses;
+    ds_dynamic_array_init(&uses, sizeof(tac_operand *));
+
+    ds_dynamic_array instrs;
+    ds_dynamic_array_init(&instrs, sizeof(tac_instr));
+
+    for (unsigned int i = 0; i < tac->instrs.count; i++) {
+        tac_instr *instr = ssa_instr(tac, i);
+
+        uses.count = 0;
+        codegen_tac_instr_uses(instr, &uses);
+        tac_operand *def = codegen_tac_instr_def(instr);
+        if (def != NULL) {
+            ds_dynamic_array_append(&uses, &def);
+        }
+
+        for (unsigned int k = 0; k < uses.count; k++) {
+            tac_operand *operand = NULL;
+            ds_dynamic_array_get(&uses, k, &operand);
+
+            if (operand->kind != TAC_OPERAND_TEMP) {
+                continue;
+            }
+
+            unsigned int root = ssa_find(parent, operand->index);
+            if (map[root] == temp_count) {
+                map[root] = next++;
+            }
+            operand->index = map[root];
+        }
+
+        if (!ssa_is_redundant_copy(instr)) {
+            ds_dynamic_array_append(&instrs, instr);
+        }
+    }
+
+    ds_dynamic_array_free(&tac->instrs);
+    tac->instrs = instrs;
+    tac->temp_count = next;
+
+    ds_dynamic_array_free(&uses);
+    free(parent);
+    free(map);
+}
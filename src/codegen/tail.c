@@ -0,0 +1,100 @@
+#include "codegen.h"
+#include "ds.h"
+
+static tac_instr *tail_instr(tac_result *tac, unsigned int index) {
+    tac_instr *instr = NULL;
+    ds_dynamic_array_get_ref(&tac->instrs, index, (void **)&instr);
+    return instr;
+}
+
+static int tail_same_temp(tac_operand a, tac_operand b) {
+    return a.kind == TAC_OPERAND_TEMP && b.kind == TAC_OPERAND_TEMP &&
+           a.index == b.index;
+}
+
+// Follow the value of the call through the jumps and the copies that come
+// after it; the call is in tail position if nothing else happens before the
+// value is returned
+static int tail_is_returned(tac_result *tac, int *labels, unsigned int index) {
+    tac_operand value = tail_instr(tac, index)->dispatch_call.ident;
+    if (value.kind != TAC_OPERAND_TEMP) {
+        return 0;
+    }
+
+    unsigned int last = tac->instrs.count - 1;
+    for (unsigned int steps = 0; steps < tac->instrs.count; steps++) {
+        if (++index > last) {
+            return 0;
+        }
+
+        tac_instr *instr = tail_instr(tac, index);
+        switch (instr->kind) {
+        case TAC_LABEL:
+            break;
+        case TAC_JUMP:
+            if (labels[instr->jump.label] < 0) {
+                return 0;
+            }
+            index = labels[instr->jump.label];
+            break;
+        case TAC_ASSIGN_VALUE:
+            if (!tail_same_temp(instr->assign_value.expr, value) ||
+                instr->assign_value.ident.kind != TAC_OPERAND_TEMP) {
+                return 0;
+            }
+            value = instr->assign_value.ident;
+            break;
+        case TAC_CAST:
+            if (!tail_same_temp(instr->cast.expr, value) ||
+                instr->cast.ident.kind != TAC_OPERAND_TEMP) {
+                return 0;
+            }
+            value = instr->cast.ident;
+            break;
+        case TAC_IDENT:
+            if (index == last) {
+                return tail_same_temp(instr->ident.name, value);
+            }
+            break;
+        default:
+            return 0;
+        }
+    }
+
+    return 0;
+}
+
+void codegen_tac_mark_tail_calls(tac_result *tac) {
+    // the frame of an attribute initializer belongs to the init routine
+    if (tac->method == NULL || tac->instrs.count == 0) {
+        return;
+    }
+
+    int *labels = malloc(sizeof(int) * (tac->label_count + 1));
+    for (unsigned int i = 0; i <= tac->label_count; i++) {
+        labels[i] = -1;
+    }
+    for (unsigned int i = 0; i < tac->instrs.count; i++) {
+        tac_instr *instr = tail_instr(tac, i);
+        if (instr->kind == TAC_LABEL) {
+            labels[instr->label.label] = i;
+        }
+    }
+
+    for (unsigned int i = 0; i < tac->instrs.count; i++) {
+        tac_instr *instr = tail_instr(tac, i);
+        if (instr->kind != TAC_DISPATCH_CALL) {
+            continue;
+        }
+
+        // the callee finds its arguments in the slots of the ones of the
+        // caller, so it cannot take more of them
+        tac_dispatch_call *call = &instr->dispatch_call;
+        if (call->args.count <= tac->method->formals.count &&
+            tail_is_returned(tac, labels, i)) {
+            call->tail = 1;
+        }
+    }
+
+    free(labels);
+}
@@ -0,0 +1,330 @@
+#include "codegen.h"
+#include "ds.h"
+
+// Loops deeper than this weigh the same as this
+#define UNBOX_MAX_DEPTH 6
+
+enum unbox_type {
+    UNBOX_UNSET,
+    UNBOX_INT,
+    UNBOX_BOOL,
+    UNBOX_OBJECT,
+};
+
+static tac_instr *unbox_instr(tac_result *tac, unsigned int index) {
+    tac_instr *instr = NULL;
+    ds_dynamic_array_get_ref(&tac->instrs, index, (void **)&instr);
+    return instr;
+}
+
+static enum unbox_type unbox_type_of(const char *type) {
+    if (type == NULL) {
+        return UNBOX_OBJECT;
+    }
+    if (strcmp(type, "Int") == 0) {
+        return UNBOX_INT;
+    }
+    if (strcmp(type, "Bool") == 0) {
+        return UNBOX_BOOL;
+    }
+    return UNBOX_OBJECT;
+}
+
+static enum unbox_type unbox_join(enum unbox_type a, enum unbox_type b) {
+    if (a == UNBOX_UNSET) {
+        return b;
+    }
+    if (b == UNBOX_UNSET || a == b) {
+        return a;
+    }
+    return UNBOX_OBJECT;
+}
+
+// The static type of an operand; the slots of the extern attributes hold
+// raw values that are not objects at all
+static enum unbox_type unbox_operand_type(tac_result *tac,
+                                          enum unbox_type *types,
+                                          tac_operand operand) {
+    switch (operand.kind) {
+    case TAC_OPERAND_TEMP:
+        return types[operand.index];
+    case TAC_OPERAND_FORMAL: {
+        formal_node *formal = NULL;
+        ds_dynamic_array_get_ref((ds_dynamic_array *)&tac->method->formals,
+                                 operand.index, (void **)&formal);
+        return unbox_type_of(formal->type.value);
+    }
+    case TAC_OPERAND_ATTRIBUTE: {
+        class_mapping_attribute *attribute = NULL;
+        ds_dynamic_array_get_ref(&tac->class->attributes, operand.index,
+                                 (void **)&attribute);
+        if (attribute->attribute->value.kind == EXPR_EXTERN) {
+            return UNBOX_OBJECT;
+        }
+        return unbox_type_of(attribute->attribute->type.value);
+    }
+    case TAC_OPERAND_INT:
+        return UNBOX_INT;
+    case TAC_OPERAND_BOOL:
+        return UNBOX_BOOL;
+    default:
+        return UNBOX_OBJECT;
+    }
+}
+
+static enum unbox_type unbox_def_type(tac_optimizer *optimizer,
+                                      tac_result *tac, enum unbox_type *types,
+                                      tac_instr *instr) {
+    switch (instr->kind) {
+    case TAC_ASSIGN_VALUE:
+        return unbox_operand_type(tac, types, instr->assign_value.expr);
+    case TAC_CAST:
+        return unbox_type_of(instr->cast.type);
+    case TAC_ASSIGN_NEW:
+    case TAC_ASSIGN_DEFAULT:
+        return unbox_type_of(instr->assign_new.type);
+    case TAC_DISPATCH_CALL: {
+        tac_dispatch_call *call = &instr->dispatch_call;
+        const char *type = call->type;
+        if (type == NULL) {
+            type = codegen_tac_receiver_type(tac, call);
+        }
+
+        tac_method_summary *summary =
+            codegen_tac_method_summary(optimizer, type, call->method);
+        if (summary == NULL) {
+            return UNBOX_OBJECT;
+        }
+        return unbox_type_of(summary->method->type.value);
+    }
+    case TAC_LOAD_FIELD:
+        return unbox_type_of(instr->field.type);
+    case TAC_ASSIGN_ADD:
+    case TAC_ASSIGN_SUB:
+    case TAC_ASSIGN_MUL:
+    case TAC_ASSIGN_DIV:
+    case TAC_ASSIGN_NEG:
+    case TAC_ASSIGN_INT:
+        return UNBOX_INT;
+    case TAC_ASSIGN_LT:
+    case TAC_ASSIGN_LE:
+    case TAC_ASSIGN_NOT:
+    case TAC_ASSIGN_ISVOID:
+    case TAC_ASSIGN_ISINSTANCE:
+    case TAC_ASSIGN_EQ:
+    case TAC_ASSIGN_BOOL:
+        return UNBOX_BOOL;
+    default:
+        return UNBOX_OBJECT;
+    }
+}
+
+// Instructions that allocate the object they define when it is boxed
+static int unbox_allocates(tac_instr *instr) {
+    switch (instr->kind) {
+    case TAC_ASSIGN_ADD:
+    case TAC_ASSIGN_SUB:
+    case TAC_ASSIGN_MUL:
+    case TAC_ASSIGN_DIV:
+    case TAC_ASSIGN_NEG:
+    case TAC_ASSIGN_LT:
+    case TAC_ASSIGN_LE:
+    case TAC_ASSIGN_NOT:
+    case TAC_ASSIGN_ISVOID:
+    case TAC_ASSIGN_ISINSTANCE:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+int codegen_tac_reads_value(tac_instr *instr, enum tac_repr ident) {
+    switch (instr->kind) {
+    case TAC_JUMP_IF_TRUE:
+    case TAC_CHECK_VOID:
+    case TAC_ASSIGN_ADD:
+    case TAC_ASSIGN_SUB:
+    case TAC_ASSIGN_MUL:
+    case TAC_ASSIGN_DIV:
+    case TAC_ASSIGN_NEG:
+    case TAC_ASSIGN_LT:
+    case TAC_ASSIGN_LE:
+    case TAC_ASSIGN_NOT:
+        return 1;
+    case TAC_ASSIGN_EQ:
+        return strcmp(instr->assign_eq.type, "Int") == 0 ||
+               strcmp(instr->assign_eq.type, "Bool") == 0;
+    case TAC_ASSIGN_VALUE:
+    case TAC_CAST:
+        // a copy reads whatever its destination holds
+        return ident != TAC_REPR_OBJECT;
+    default:
+        return 0;
+    }
+}
+
+static unsigned int unbox_find(unsigned int *groups, unsigned int temp) {
+    while (groups[temp] != temp) {
+        groups[temp] = groups[groups[temp]];
+        temp = groups[temp];
+    }
+    return temp;
+}
+
+static int unbox_copy_temp(tac_instr *instr, tac_operand *source) {
+    switch (instr->kind) {
+    case TAC_ASSIGN_VALUE:
+        *source = instr->assign_value.expr;
+        break;
+    case TAC_CAST:
+        *source = instr->cast.expr;
+        break;
+    default:
+        return 0;
+    }
+
+    tac_operand *def = codegen_tac_instr_def(instr);
+    return def->kind == TAC_OPERAND_TEMP && source->kind == TAC_OPERAND_TEMP;
+}
+
+void codegen_tac_representations(tac_optimizer *optimizer, tac_result *tac,
+                                 enum tac_repr *reprs) {
+    unsigned int count = tac->temp_count;
+    enum unbox_type *types = malloc(sizeof(enum unbox_type) * (count + 1));
+    unsigned int *groups = malloc(sizeof(unsigned int) * (count + 1));
+    for (unsigned int i = 0; i < count; i++) {
+        types[i] = UNBOX_OBJECT;
+        groups[i] = i;
+        reprs[i] = TAC_REPR_OBJECT;
+    }
+
+    // a temporary that is never assigned, like the value of a loop that does
+    // not run, is read as the void in its slot
+    for (unsigned int i = 0; i < tac->instrs.count; i++) {
+        tac_operand *def = codegen_tac_instr_def(unbox_instr(tac, i));
+        if (def != NULL && def->kind == TAC_OPERAND_TEMP) {
+            types[def->index] = UNBOX_UNSET;
+        }
+    }
+
+    // the type of a temporary is the join of what all its definitions
+    // assign, which needs a fixpoint when temporaries are copied around
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+
+        for (unsigned int i = 0; i < tac->instrs.count; i++) {
+            tac_instr *instr = unbox_instr(tac, i);
+
+            tac_operand *def = codegen_tac_instr_def(instr);
+            if (def == NULL || def->kind != TAC_OPERAND_TEMP) {
+                continue;
+            }
+
+            enum unbox_type type = unbox_join(
+                types[def->index], unbox_def_type(optimizer, tac, types, instr));
+            if (type != types[def->index]) {
+                types[def->index] = type;
+                changed = 1;
+            }
+        }
+    }
+
+    // temporaries that are copied into each other share the representation,
+    // so that the copies between them never box or unbox
+    for (unsigned int i = 0; i < tac->instrs.count; i++) {
+        tac_instr *instr = unbox_instr(tac, i);
+
+        tac_operand source;
+        if (!unbox_copy_temp(instr, &source)) {
+            continue;
+        }
+
+        tac_operand *def = codegen_tac_instr_def(instr);
+        if (types[def->index] == types[source.index]) {
+            groups[unbox_find(groups, def->index)] =
+                unbox_find(groups, source.index);
+        }
+    }
+
+    // weigh the allocations that unboxing saves against the ones that the
+    // boxing of the object uses costs, counting loops as many executions
+    unsigned long *saved = calloc(count + 1, sizeof(unsigned long));
+    unsigned long *boxed = calloc(count + 1, sizeof(unsigned long));
+    unsigned long *read = calloc(count + 1, sizeof(unsigned long));
+
+    tac_cfg cfg;
+    codegen_tac_cfg_build(tac, &cfg);
+
+    ds_dynamic_array uses;
+    ds_dynamic_array_init(&uses, sizeof(tac_operand *));
+
+    for (unsigned int b = 0; b < cfg.blocks.count; b++) {
+        tac_basic_block *block = NULL;
+        ds_dynamic_array_get_ref(&cfg.blocks, b, (void **)&block);
+
+        int depth = block->loop_depth;
+        if (depth > UNBOX_MAX_DEPTH) {
+            depth = UNBOX_MAX_DEPTH;
+        }
+        unsigned long weight = 1UL << (3 * depth);
+
+        for (unsigned int i = block->start; i < block->end; i++) {
+            tac_instr *instr = unbox_instr(tac, i);
+
+            tac_operand *def = codegen_tac_instr_def(instr);
+            enum tac_repr ident = TAC_REPR_OBJECT;
+            if (def != NULL && def->kind == TAC_OPERAND_TEMP) {
+                if (unbox_allocates(instr)) {
+                    saved[unbox_find(groups, def->index)] += weight;
+                }
+                if (types[def->index] != UNBOX_OBJECT) {
+                    ident = TAC_REPR_INT;
+                }
+            }
+
+            tac_operand source;
+            if (unbox_copy_temp(instr, &source) &&
+                unbox_find(groups, source.index) ==
+                    unbox_find(groups, def->index)) {
+                continue;
+            }
+
+            uses.count = 0;
+            codegen_tac_instr_uses(instr, &uses);
+            for (unsigned int k = 0; k < uses.count; k++) {
+                tac_operand *operand = NULL;
+                ds_dynamic_array_get(&uses, k, &operand);
+                if (operand->kind != TAC_OPERAND_TEMP) {
+                    continue;
+                }
+
+                unsigned int group = unbox_find(groups, operand->index);
+                if (codegen_tac_reads_value(instr, ident)) {
+                    read[group] += weight;
+                } else {
+                    boxed[group] += weight;
+                }
+            }
+        }
+    }
+
+    for (unsigned int i = 0; i < count; i++) {
+        unsigned int group = unbox_find(groups, i);
+        if (types[i] == UNBOX_UNSET || types[i] == UNBOX_OBJECT ||
+            boxed[group] > saved[group] ||
+            (saved[group] == 0 && read[group] == 0)) {
+            continue;
+        }
+
+        reprs[i] = types[i] == UNBOX_INT ? TAC_REPR_INT : TAC_REPR_BOOL;
+    }
+
+    ds_dynamic_array_free(&uses);
+    codegen_tac_cfg_free(&cfg);
+    free(saved);
+    free(boxed);
+    free(read);
+    free(types);
+    free(groups);
+}
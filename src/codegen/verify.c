@@ -0,0 +1,200 @@
+#include "codegen.h"
+#include "ds.h"
+
+#define VERIFY_MESSAGE_SIZE 256
+
+static char verify_message[VERIFY_MESSAGE_SIZE];
+
+static tac_instr *verify_instr(tac_result *tac, unsigned int index) {
+    tac_instr *instr = NULL;
+    ds_dynamic_array_get_ref(&tac->instrs, index, (void **)&instr);
+    return instr;
+}
+
+static const char *verify_fail(unsigned int index, const char *message,
+                               int value) {
+    snprintf(verify_message, VERIFY_MESSAGE_SIZE, "instruction %u: %s %d",
+             index, message, value);
+    return verify_message;
+}
+
+static const char *verify_operand(tac_result *tac, unsigned int index,
+                                  tac_operand *operand) {
+    switch (operand->kind) {
+    case TAC_OPERAND_TEMP:
+        if (operand->index < 0 ||
+            (unsigned int)operand->index >= tac->temp_count) {
+            return verify_fail(index, "temporary out of range", operand->index);
+        }
+        break;
+    case TAC_OPERAND_FORMAL:
+        if (tac->method == NULL || operand->index < 0 ||
+            (unsigned int)operand->index >= tac->method->formals.count) {
+            return verify_fail(index, "formal out of range", operand->index);
+        }
+        break;
+    case TAC_OPERAND_ATTRIBUTE:
+        if (operand->index < 0 ||
+            (unsigned int)operand->index >= tac->class->attributes.count) {
+            return verify_fail(index, "attribute out of range",
+                               operand->index);
+        }
+        break;
+    default:
+        break;
+    }
+
+    return NULL;
+}
+
+// The labels that the instruction jumps to
+static void verify_targets(tac_instr *instr, ds_dynamic_array *targets) {
+    switch (instr->kind) {
+    case TAC_JUMP:
+        ds_dynamic_array_append(targets, &instr->jump.label);
+        break;
+    case TAC_JUMP_IF_TRUE:
+        ds_dynamic_array_append(targets, &instr->jump_if_true.label);
+        break;
+    case TAC_CASE:
+        for (unsigned int k = 0; k < instr->case_jump.branches.count; k++) {
+            tac_case_branch *branch = NULL;
+            ds_dynamic_array_get_ref(&instr->case_jump.branches, k,
+                                     (void **)&branch);
+            ds_dynamic_array_append(targets, &branch->label);
+        }
+        break;
+    case TAC_PHI:
+        for (unsigned int k = 0; k < instr->phi.args.count; k++) {
+            tac_phi_arg *arg = NULL;
+            ds_dynamic_array_get_ref(&instr->phi.args, k, (void **)&arg);
+            ds_dynamic_array_append(targets, &arg->label);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static const char *verify_instrs(tac_result *tac, int ssa, int *labels,
+                                 int *defs, ds_dynamic_array *operands) {
+    for (unsigned int i = 0; i < tac->instrs.count; i++) {
+        tac_instr *instr = verify_instr(tac, i);
+
+        if (instr->kind == TAC_LABEL) {
+            int label = instr->label.label;
+            if (label < 0 || (unsigned int)label >= tac->label_count) {
+                return verify_fail(i, "label out of range", label);
+            }
+            if (labels[label]) {
+                return verify_fail(i, "label defined twice", label);
+            }
+            labels[label] = 1;
+        }
+
+        if (instr->kind == TAC_PHI) {
+            if (!ssa) {
+                return verify_fail(i, "phi outside of SSA form",
+                                   instr->phi.ident.index);
+            }
+
+            tac_instr *prev = i > 0 ? verify_instr(tac, i - 1) : NULL;
+            if (prev != NULL && prev->kind != TAC_LABEL &&
+                prev->kind != TAC_PHI) {
+                return verify_fail(i, "phi after the start of the block of",
+                                   instr->phi.ident.index);
+            }
+        }
+
+        operands->count = 0;
+        codegen_tac_instr_uses(instr, operands);
+        for (unsigned int k = 0; k < operands->count; k++) {
+            tac_operand *operand = NULL;
+            ds_dynamic_array_get(operands, k, &operand);
+
+            // a phi has no value for the predecessors where the variable
+            // is not defined yet
+            if (operand->kind == TAC_OPERAND_NONE && instr->kind != TAC_PHI) {
+                return verify_fail(i, "missing operand of kind", instr->kind);
+            }
+
+            const char *error = verify_operand(tac, i, operand);
+            if (error != NULL) {
+                return error;
+            }
+        }
+
+        tac_operand *def = codegen_tac_instr_def(instr);
+        if (def == NULL) {
+            continue;
+        }
+
+        switch (def->kind) {
+        case TAC_OPERAND_TEMP:
+        case TAC_OPERAND_FORMAL:
+        case TAC_OPERAND_ATTRIBUTE: {
+            const char *error = verify_operand(tac, i, def);
+            if (error != NULL) {
+                return error;
+            }
+            break;
+        }
+        default:
+            return verify_fail(i, "assignment to an operand of kind",
+                               def->kind);
+        }
+
+        if (ssa && def->kind == TAC_OPERAND_TEMP && defs[def->index]++ > 0) {
+            return verify_fail(i, "temporary defined twice", def->index);
+        }
+    }
+
+    return NULL;
+}
+
+const char *codegen_tac_verify(tac_result *tac, int ssa) {
+    if (tac->instrs.count == 0) {
+        return NULL;
+    }
+
+    // the value of the method comes last, unless the method never returns
+    // and its exit block was deleted as unreachable; then the last block
+    // still has to jump away instead of running off the end
+    tac_instr *last = verify_instr(tac, tac->instrs.count - 1);
+    if (last->kind != TAC_IDENT && last->kind != TAC_JUMP &&
+        last->kind != TAC_CASE) {
+        return verify_fail(tac->instrs.count - 1, "last instruction of kind",
+                           last->kind);
+    }
+
+    int *labels = calloc(tac->label_count + 1, sizeof(int));
+    int *defs = calloc(tac->temp_count + 1, sizeof(int));
+    ds_dynamic_array operands;
+    ds_dynamic_array_init(&operands, sizeof(tac_operand *));
+
+    const char *error = verify_instrs(tac, ssa, labels, defs, &operands);
+
+    // the jumps can only be checked once all the labels are known
+    ds_dynamic_array targets;
+    ds_dynamic_array_init(&targets, sizeof(int));
+    for (unsigned int i = 0; i < tac->instrs.count && error == NULL; i++) {
+        targets.count = 0;
+        verify_targets(verify_instr(tac, i), &targets);
+
+        for (unsigned int k = 0; k < targets.count && error == NULL; k++) {
+            int label = 0;
+            ds_dynamic_array_get(&targets, k, &label);
+
+            if (label < 0 || (unsigned int)label >= tac->label_count ||
+                !labels[label]) {
+                error = verify_fail(i, "jump to an undefined label", label);
+            }
+        }
+    }
+
+    ds_dynamic_array_free(&targets);
+    ds_dynamic_array_free(&operands);
+    free(labels);
+    free(defs);
+    return error;
+}
@@ -2,5 +2,6 @@
 #define DS_SS_IMPLEMENTATION
 #define DS_SB_IMPLEMENTATION
 #define DS_LL_IMPLEMENTATION
+#define DS_HT_IMPLEMENTATION
 #define DS_AP_IMPLEMENTATION
 #include "ds.h"
@@ -1,5 +1,6 @@
 #include "util.h"
 #include <dirent.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -43,6 +44,10 @@ typedef struct build_context {
         ds_dynamic_array user_programs; // program_node
         program_node program;
         semantic_mapping mapping;
+
+        // the object that the compiler encoded, when fasm does not run
+        asm_object object;
+        int assembled;
 } build_context;
 
 static int build_context_prelude_init(build_context *context) {
@@ -143,6 +148,7 @@ static int build_context_init(build_context *context,
     int result = 0;
 
     context->parser = parser;
+    context->assembled = 0;
 
     ds_dynamic_array_init(&context->prelude_filepaths, sizeof(const char *));
     ds_dynamic_array_init(&context->user_filepaths, sizeof(const char *));
@@ -304,10 +310,23 @@ defer:
 static enum status_code gatekeeping(build_context *context) {
     int semantic_stop = ds_argparse_get_flag(&context->parser, ARG_SEMANTIC);
     int mapping_stop = ds_argparse_get_flag(&context->parser, ARG_MAPPING);
+    char *jobs_value = ds_argparse_get_value(&context->parser, ARG_JOBS);
 
     int result = STATUS_OK;
 
-    if (semantic_check(&context->program, &context->mapping) != SEMANTIC_OK) {
+    unsigned int jobs = 1;
+    if (jobs_value != NULL) {
+        char *end = NULL;
+        long value = strtol(jobs_value, &end, 10);
+        if (end == jobs_value || *end != '\0' || value < 1 || value > INT_MAX) {
+            DS_LOG_ERROR("Invalid number of jobs: %s", jobs_value);
+            return_defer(STATUS_ERROR);
+        }
+        jobs = value;
+    }
+
+    if (semantic_check(&context->program, &context->mapping, jobs) !=
+        SEMANTIC_OK) {
         return_defer(STATUS_ERROR);
     }
 
@@ -332,36 +351,175 @@ defer:
     return result;
 }
 
+// Encode the runtime of the modules and the generated code into the object
+// of the context, without the text of the assembly
+static int codegen_object(build_context *context, const tac_options *options) {
+    int result = 0;
+    char *buffer = NULL;
+
+    asm_object *object = &context->object;
+    assembler_object_init(object);
+    ds_string_builder sb;
+    ds_string_builder_init(&sb);
+
+    // the runtime of the modules is one source, as fasm sees it, so that a
+    // module can use the constants of another one; the code of a module
+    // that comes before any section goes to the code of the program, in
+    // whatever order the modules were given
+    ds_string_builder_append(&sb, "section '.text' executable\n");
+    for (size_t i = 0; i < context->asm_filepaths.count; i++) {
+        const char *asm_filepath = NULL;
+        ds_dynamic_array_get(&context->asm_filepaths, i,
+                             (void **)&asm_filepath);
+
+        int length = util_read_file(asm_filepath, &buffer);
+        if (length < 0) {
+            DS_LOG_ERROR("Failed to read file: %s", asm_filepath);
+            return_defer(1);
+        }
+        ds_string_builder_appendn(&sb, buffer, length);
+        ds_string_builder_appendc(&sb, '\n');
+        free(buffer);
+        buffer = NULL;
+    }
+    ds_string_builder_build(&sb, &buffer);
+
+    if (assembler_object_source(object, buffer) != 0) {
+        DS_LOG_WARN("Failed to encode the runtime of the modules");
+        return_defer(1);
+    }
+
+    if (assembler_run(NULL, object, &context->mapping, options) !=
+        ASSEMBLER_OK) {
+        return_defer(1);
+    }
+
+defer:
+    if (result != 0) {
+        assembler_object_free(object);
+    }
+    free(buffer);
+    ds_string_builder_free(&sb);
+    return result;
+}
+
 static enum status_code codegen(build_context *context) {
     int length;
     char *buffer = NULL;
 
     int tacgen_stop = ds_argparse_get_flag(&context->parser, ARG_TACGEN);
+    int cfg_format = ds_argparse_get_flag(&context->parser, ARG_CFG);
+    int dot_format = ds_argparse_get_flag(&context->parser, ARG_DOT);
+    int ssa_form = ds_argparse_get_flag(&context->parser, ARG_SSA);
+    int optimized = ds_argparse_get_flag(&context->parser, ARG_OPT);
     int assembler_stop = ds_argparse_get_flag(&context->parser, ARG_ASSEMBLER);
+    int use_fasm = ds_argparse_get_flag(&context->parser, ARG_FASM);
+    char *inline_threshold =
+        ds_argparse_get_value(&context->parser, ARG_INLINE_THRESHOLD);
+    char *opt_level = ds_argparse_get_value(&context->parser, ARG_OPT_LEVEL);
+    char *passes = ds_argparse_get_value(&context->parser, ARG_PASSES);
+    int profile_generate =
+        ds_argparse_get_flag(&context->parser, ARG_PROFILE_GENERATE);
+    char *profile_use = ds_argparse_get_value(&context->parser, ARG_PROFILE_USE);
+    tac_profile profile = {.counts = NULL};
     char *output = ds_argparse_get_value(&context->parser, ARG_OUTPUT);
     char *asm_path = NULL;
 
     int result = STATUS_OK;
 
+    tac_options options;
+    codegen_tac_options_init(&options);
+    if (inline_threshold != NULL) {
+        char *end = NULL;
+        long value = strtol(inline_threshold, &end, 10);
+        if (end == inline_threshold || *end != '\0' || value < 0 ||
+            value > INT_MAX) {
+            DS_LOG_ERROR("Invalid inline threshold: %s", inline_threshold);
+            return_defer(STATUS_ERROR);
+        }
+        options.inline_threshold = value;
+    }
+    if (opt_level != NULL) {
+        char *end = NULL;
+        long value = strtol(opt_level, &end, 10);
+        if (end == opt_level || *end != '\0' || value < 0 || value > 2 ||
+            codegen_tac_options_set_level(&options, value) != 0) {
+            DS_LOG_ERROR("Invalid optimization level: %s", opt_level);
+            return_defer(STATUS_ERROR);
+        }
+    }
+    if (passes != NULL &&
+        codegen_tac_options_set_passes(&options, passes) != 0) {
+        return_defer(STATUS_ERROR);
+    }
+    options.verify = ds_argparse_get_flag(&context->parser, ARG_VERIFY);
+    options.time_passes =
+        ds_argparse_get_flag(&context->parser, ARG_TIME_PASSES);
+
     if (output == NULL) {
         output = DEFAULT_OUTPUT;
     }
 
+    if (profile_use != NULL) {
+        if (codegen_tac_profile_load(profile_use, &profile) != 0) {
+            return_defer(STATUS_ERROR);
+        }
+        options.profile = &profile;
+    }
+
+    if (profile_generate == 1) {
+        // the program can run from anywhere, so the path is absolute
+        char *cwd = NULL;
+        char *path = output;
+        if (output[0] != '/' &&
+            (util_cwd(&cwd) != 0 || util_append_path(cwd, output, &path) != 0)) {
+            DS_LOG_ERROR("Failed to resolve the profile path");
+            return_defer(STATUS_ERROR);
+        }
+        if (util_append_extension(path, "profile",
+                                  (char **)&options.profile_path) != 0) {
+            DS_LOG_ERROR("Failed to append extension");
+            return_defer(STATUS_ERROR);
+        }
+
+        // the calls are counted where the source has them, so that a build
+        // that inlines them finds the counts of every copy
+        options.passes &= ~(1u << TAC_PASS_INLINE);
+    }
+
     if (assembler_stop == 0 && util_append_extension(output, "asm", &asm_path) != 0) {
         DS_LOG_ERROR("Failed to append extension");
         return_defer(STATUS_ERROR);
     }
 
     if (tacgen_stop == 1) {
+        enum tac_print_format format = TAC_PRINT_TEXT;
+        if (dot_format == 1) {
+            format = TAC_PRINT_DOT;
+        } else if (cfg_format == 1) {
+            format = TAC_PRINT_CFG;
+        }
+
         for (size_t i = 0; i < context->user_programs.count; i++) {
             program_node *program = NULL;
             ds_dynamic_array_get_ref(&context->user_programs, i,
                                      (void **)&program);
-            codegen_tac_print(&context->mapping, program);
+            codegen_tac_print(&context->mapping, program, format, ssa_form,
+                              optimized ? &options : NULL);
         }
         return_defer(STATUS_STOP);
     }
 
+    // the assembly is only written out for --asm and --fasm, or when the
+    // runtime of a module has something that the encoder does not know
+    if (assembler_stop == 0 && use_fasm == 0) {
+        if (codegen_object(context, &options) == 0) {
+            context->assembled = 1;
+            return_defer(STATUS_OK);
+        }
+        DS_LOG_WARN("Falling back to %s", FASM);
+    }
+
     if (util_write_file(asm_path, "format ELF64\n", "w") != 0) {
         DS_LOG_ERROR("Failed to write file: %s", asm_path);
         return_defer(STATUS_ERROR);
@@ -386,7 +544,8 @@ static enum status_code codegen(build_context *context) {
     }
 
     // assembler
-    if (assembler_run(asm_path, &context->mapping) != ASSEMBLER_OK) {
+    if (assembler_run(asm_path, NULL, &context->mapping, &options) !=
+        ASSEMBLER_OK) {
         return_defer(STATUS_ERROR);
     }
 
@@ -397,6 +556,7 @@ static enum status_code codegen(build_context *context) {
     return_defer(STATUS_OK);
 
 defer:
+    codegen_tac_profile_free(&profile);
     return result;
 }
 
@@ -476,6 +636,21 @@ static enum status_code ld_run(build_context *context) {
         return_defer(STATUS_ERROR);
     }
 
+    // a program that needs no library is linked here, from the object in
+    // memory, and the others go through ld
+    if (context->assembled && ld_flags.count == 0) {
+        DS_LOG_INFO("Linking: %s", output);
+        if (assembler_object_link(&context->object, output) != 0) {
+            DS_LOG_ERROR("Failed to link: %s", output);
+            return_defer(STATUS_ERROR);
+        }
+        return_defer(STATUS_OK);
+    }
+    if (context->assembled &&
+        assembler_object_write(&context->object, obj_path) != 0) {
+        return_defer(STATUS_ERROR);
+    }
+
     int needed = ld_flags.count + 5;
     ld_flags_array = malloc(sizeof(char *) * needed);
     if (ld_flags_array == NULL) {
@@ -517,6 +692,9 @@ static enum status_code ld_run(build_context *context) {
     return_defer(STATUS_OK);
 
 defer:
+    if (context->assembled) {
+        assembler_object_free(&context->object);
+    }
     return result;
 }
 
@@ -563,7 +741,7 @@ int main(int argc, char **argv) {
         return_defer(1);
     }
 
-    int fasm_result = fasm_run(&context);
+    int fasm_result = context.assembled ? STATUS_OK : fasm_run(&context);
     if (fasm_result == STATUS_STOP) {
         return_defer(0);
     }
@@ -1,6 +1,7 @@
 #include "semantic.h"
 #include "ds.h"
 #include "parser.h"
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 
@@ -44,13 +45,26 @@ typedef struct method_environment {
 
 typedef struct object_environment_item {
         const char *class_name;
-        ds_dynamic_array objects; // object_context
+        ds_hash_table objects; // const char * -> object_context
 } object_environment_item;
 
 typedef struct object_environment {
         ds_dynamic_array items; // object_environment_item
 } object_environment;
 
+#define OBJECT_SCOPE_CAPACITY 64
+
+typedef struct object_scope_entry {
+        object_context object;
+        int shadowed; // index of the entry with the same name, or -1
+} object_scope_entry;
+
+typedef struct object_scope {
+        object_environment_item *attributes;
+        ds_dynamic_array entries; // object_scope_entry
+        ds_hash_table index;      // const char * -> int
+} object_scope;
+
 static node_info *token_get_node_info(expr_node *node) {
     switch (node->kind) {
     case EXPR_ASSIGN:
@@ -870,6 +884,21 @@ static void build_method_environment(semantic_context *context,
     }
 }
 
+static unsigned int object_name_hash(const void *key) {
+    const char *name = *(const char **)key;
+
+    unsigned int hash = 5381;
+    while (*name != '\0') {
+        hash = hash * 33 + (unsigned char)*name++;
+    }
+
+    return hash;
+}
+
+static int object_name_compare(const void *lhs, const void *rhs) {
+    return strcmp(*(const char **)lhs, *(const char **)rhs);
+}
+
 static void build_object_environment(semantic_context *context,
                                      program_node *program,
                                      object_environment *env) {
@@ -881,16 +910,28 @@ static void build_object_environment(semantic_context *context,
 
         const char *class_name = class_ctx->name;
 
+        unsigned int count = 1;
+        class_context *current_ctx = class_ctx;
+        do {
+            count += current_ctx->objects.count;
+            current_ctx = current_ctx->parent;
+        } while (current_ctx != NULL && class_ctx != current_ctx);
+
         object_environment_item item = {.class_name = class_name};
-        ds_dynamic_array_init(&item.objects, sizeof(object_context));
+        ds_hash_table_init(&item.objects, sizeof(const char *),
+                           sizeof(object_context), 2 * count + 1,
+                           object_name_hash, object_name_compare);
 
-        class_context *current_ctx = class_ctx;
+        // Inherited attributes are inserted after the own ones, so when a
+        // name is redefined the most ancestral definition wins, as before.
+        current_ctx = class_ctx;
         do {
             for (unsigned int j = 0; j < current_ctx->objects.count; j++) {
                 object_context attribute_ctx;
                 ds_dynamic_array_get(&current_ctx->objects, j, &attribute_ctx);
 
-                ds_dynamic_array_append(&item.objects, &attribute_ctx);
+                ds_hash_table_insert(&item.objects, &attribute_ctx.name,
+                                     &attribute_ctx);
             }
 
             current_ctx = current_ctx->parent;
@@ -898,30 +939,79 @@ static void build_object_environment(semantic_context *context,
 
         object_context object = {
             .name = "self", .type = SELF_TYPE, .external = 0};
-        ds_dynamic_array_append(&item.objects, &object);
+        ds_hash_table_insert(&item.objects, &object.name, &object);
 
         ds_dynamic_array_append(&env->items, &item);
     }
 }
 
-static void get_object_environment(object_environment *env,
-                                   const char *class_name,
-                                   object_environment_item *item) {
+static object_environment_item *
+get_object_environment(object_environment *env, const char *class_name) {
     for (unsigned int i = 0; i < env->items.count; i++) {
         object_environment_item *env_item = NULL;
         ds_dynamic_array_get_ref(&env->items, i, (void **)&env_item);
 
         if (strcmp(env_item->class_name, class_name) == 0) {
-            (*item).class_name = env_item->class_name;
-            ds_dynamic_array_copy(&env_item->objects, &(*item).objects);
-            return;
+            return env_item;
         }
     }
+
+    return NULL;
+}
+
+// The object scope is the chain of formals, let and case bindings on top of
+// the immutable attribute layer of the current class.
+static void object_scope_init(object_scope *scope) {
+    scope->attributes = NULL;
+    ds_dynamic_array_init(&scope->entries, sizeof(object_scope_entry));
+    ds_hash_table_init(&scope->index, sizeof(const char *), sizeof(int),
+                       OBJECT_SCOPE_CAPACITY, object_name_hash,
+                       object_name_compare);
+}
+
+static void object_scope_push(object_scope *scope, object_context object) {
+    int shadowed = -1;
+    ds_hash_table_get(&scope->index, &object.name, &shadowed);
+
+    object_scope_entry entry = {.object = object, .shadowed = shadowed};
+    ds_dynamic_array_append(&scope->entries, &entry);
+
+    int index = scope->entries.count - 1;
+    ds_hash_table_insert(&scope->index, &object.name, &index);
+}
+
+static void object_scope_pop(object_scope *scope) {
+    object_scope_entry *entry = NULL;
+    ds_dynamic_array_get_ref(&scope->entries, scope->entries.count - 1,
+                             (void **)&entry);
+
+    ds_hash_table_insert(&scope->index, &entry->object.name, &entry->shadowed);
+    ds_dynamic_array_pop(&scope->entries, NULL);
+}
+
+static object_context *object_scope_find(object_scope *scope,
+                                         const char *name) {
+    int index = -1;
+    ds_hash_table_get(&scope->index, &name, &index);
+
+    if (index >= 0) {
+        object_scope_entry *entry = NULL;
+        ds_dynamic_array_get_ref(&scope->entries, index, (void **)&entry);
+        return &entry->object;
+    }
+
+    object_context *object = NULL;
+    if (ds_hash_table_get_ref(&scope->attributes->objects, &name,
+                              (void **)&object) != 0) {
+        return NULL;
+    }
+
+    return object;
 }
 
 static const char *semantic_check_expression(
     semantic_context *context, expr_node *expr, class_context *class_ctx,
-    method_environment *method_env, object_environment_item *object_env);
+    method_environment *method_env, object_scope *object_env);
 
 static int is_let_init_name_illegal(semantic_context *context,
                                     let_init_node *init) {
@@ -968,7 +1058,7 @@ static int is_let_init_type_incompatible(semantic_context *context,
 
 static const char *semantic_check_let_expression(
     semantic_context *context, let_node *expr, class_context *class_ctx,
-    method_environment *method_env, object_environment_item *object_env) {
+    method_environment *method_env, object_scope *object_env) {
 
     unsigned int depth = 0;
     for (unsigned int i = 0; i < expr->inits.count; i++) {
@@ -1003,7 +1093,7 @@ static const char *semantic_check_let_expression(
 
         object_context object = {
             .name = init->name.value, .type = init_type, .external = 0};
-        ds_dynamic_array_append(&object_env->objects, &object);
+        object_scope_push(object_env, object);
 
         depth++;
     }
@@ -1012,7 +1102,7 @@ static const char *semantic_check_let_expression(
         context, expr->body, class_ctx, method_env, object_env);
 
     for (unsigned int i = 0; i < depth; i++) {
-        ds_dynamic_array_pop(&object_env->objects, NULL);
+        object_scope_pop(object_env);
     }
 
     return body_type;
@@ -1060,7 +1150,7 @@ static int is_case_variable_type_undefined(semantic_context *context,
 
 static const char *semantic_check_case_expression(
     semantic_context *context, case_node *expr, class_context *class_ctx,
-    method_environment *method_env, object_environment_item *object_env) {
+    method_environment *method_env, object_scope *object_env) {
     const char *case_type = NULL;
 
     semantic_check_expression(context, expr->expr, class_ctx, method_env, object_env);
@@ -1087,7 +1177,7 @@ static const char *semantic_check_case_expression(
         object_context object = {.name = branch->name.value,
                                  .type = branch->type.value,
                                  .external = 0};
-        ds_dynamic_array_append(&object_env->objects, &object);
+        object_scope_push(object_env, object);
 
         const char *branch_type = semantic_check_expression(
             context, branch->body, class_ctx, method_env, object_env);
@@ -1099,42 +1189,29 @@ static const char *semantic_check_case_expression(
                                               case_type, branch_type);
         }
 
-        ds_dynamic_array_pop(&object_env->objects, NULL);
+        object_scope_pop(object_env);
     }
 
     return case_type;
 }
 
-static int is_ident_undefined(object_environment_item *object_env,
+static int is_ident_undefined(object_scope *object_env,
                               node_info *ident) {
-    for (unsigned int i = 0; i < object_env->objects.count; i++) {
-        object_context object;
-        ds_dynamic_array_get(&object_env->objects, i, &object);
-
-        if (strcmp(object.name, ident->value) == 0) {
-            return 0;
-        }
-    }
-
-    return 1;
+    return object_scope_find(object_env, ident->value) == NULL;
 }
 
 #define context_show_error_ident_undefined(context, ident)                     \
     context_show_errorf(context, ident->line, ident->col,                      \
                         "Undefined identifier %s", ident->value)
 
-static int is_external_ident(object_environment_item *object_env,
+static int is_external_ident(object_scope *object_env,
                              node_info *ident) {
-    for (unsigned int i = 0; i < object_env->objects.count; i++) {
-        object_context object;
-        ds_dynamic_array_get(&object_env->objects, object_env->objects.count - i - 1, &object);
-
-        if (strcmp(object.name, ident->value) == 0) {
-            return object.external;
-        }
+    object_context *object = object_scope_find(object_env, ident->value);
+    if (object == NULL) {
+        return 0;
     }
 
-    return 0;
+    return object->external;
 }
 
 #define context_show_error_external_ident(context, ident)                      \
@@ -1143,7 +1220,7 @@ static int is_external_ident(object_environment_item *object_env,
 
 static const char *semantic_check_ident_expression(
     semantic_context *context, node_info *expr, class_context *class_ctx,
-    method_environment *method_env, object_environment_item *object_env) {
+    method_environment *method_env, object_scope *object_env) {
     if (is_ident_undefined(object_env, expr)) {
         context_show_error_ident_undefined(context, expr);
     }
@@ -1152,17 +1229,12 @@ static const char *semantic_check_ident_expression(
         context_show_error_external_ident(context, expr);
     }
 
-    unsigned int n = object_env->objects.count;
-    for (unsigned int i = 0; i < n; i++) {
-        object_context object;
-        ds_dynamic_array_get(&object_env->objects, n - i - 1, &object);
-
-        if (strcmp(object.name, expr->value) == 0) {
-            return object.type;
-        }
+    object_context *object = object_scope_find(object_env, expr->value);
+    if (object == NULL) {
+        return NULL;
     }
 
-    return NULL;
+    return object->type;
 }
 
 static int is_operand_not_int(const char *type) {
@@ -1176,7 +1248,7 @@ static int is_operand_not_int(const char *type) {
 
 static const char *semantic_check_arith_expression(
     semantic_context *context, expr_binary_node *expr, class_context *class_ctx,
-    method_environment *method_env, object_environment_item *object_env) {
+    method_environment *method_env, object_scope *object_env) {
     const char *left_type = semantic_check_expression(
         context, expr->lhs, class_ctx, method_env, object_env);
     const char *right_type = semantic_check_expression(
@@ -1203,7 +1275,7 @@ static const char *semantic_check_arith_expression(
 
 static char *semantic_check_neg_expression(
     semantic_context *context, expr_unary_node *expr, class_context *class_ctx,
-    method_environment *method_env, object_environment_item *object_env) {
+    method_environment *method_env, object_scope *object_env) {
     const char *expr_type = semantic_check_expression(
         context, expr->expr, class_ctx, method_env, object_env);
 
@@ -1222,7 +1294,7 @@ static char *semantic_check_neg_expression(
 
 static const char *semantic_check_cmp_expression(
     semantic_context *context, expr_binary_node *expr, class_context *class_ctx,
-    method_environment *method_env, object_environment_item *object_env) {
+    method_environment *method_env, object_scope *object_env) {
     const char *left_type = semantic_check_expression(
         context, expr->lhs, class_ctx, method_env, object_env);
     const char *right_type = semantic_check_expression(
@@ -1265,7 +1337,7 @@ static int is_operand_types_not_comparable(const char *left_type,
 
 static const char *semantic_check_eq_expression(
     semantic_context *context, expr_binary_node *expr, class_context *class_ctx,
-    method_environment *method_env, object_environment_item *object_env) {
+    method_environment *method_env, object_scope *object_env) {
     const char *left_type = semantic_check_expression(
         context, expr->lhs, class_ctx, method_env, object_env);
     const char *right_type = semantic_check_expression(
@@ -1294,7 +1366,7 @@ static int is_operand_not_bool(const char *type) {
 
 static char *semantic_check_not_expression(
     semantic_context *context, expr_unary_node *expr, class_context *class_ctx,
-    method_environment *method_env, object_environment_item *object_env) {
+    method_environment *method_env, object_scope *object_env) {
     const char *expr_type = semantic_check_expression(
         context, expr->expr, class_ctx, method_env, object_env);
 
@@ -1340,7 +1412,7 @@ static int is_assign_incopatible_types(semantic_context *context,
 
 static const char *semantic_check_assign_expression(
     semantic_context *context, assign_node *expr, class_context *class_ctx,
-    method_environment *method_env, object_environment_item *object_env) {
+    method_environment *method_env, object_scope *object_env) {
 
     if (is_assign_name_illegal(context, expr)) {
         context_show_error_assign_name_illegal(context, expr);
@@ -1351,19 +1423,11 @@ static const char *semantic_check_assign_expression(
         context_show_error_external_ident(context, &expr->name);
     }
 
-    const char *object_type = NULL;
-    for (unsigned int i = 0; i < object_env->objects.count; i++) {
-        object_context object;
-        ds_dynamic_array_get(&object_env->objects, i, &object);
-
-        if (strcmp(object.name, expr->name.value) == 0) {
-            object_type = object.type;
-            break;
-        }
-    }
-    if (object_type == NULL) {
+    object_context *object = object_scope_find(object_env, expr->name.value);
+    if (object == NULL) {
         return NULL;
     }
+    const char *object_type = object->type;
 
     const char *expr_type = semantic_check_expression(
         context, expr->value, class_ctx, method_env, object_env);
@@ -1399,7 +1463,7 @@ static int is_new_type_undefined(semantic_context *context, node_info *expr) {
 
 static const char *semantic_check_new_expression(
     semantic_context *context, new_node *expr, class_context *class_ctx,
-    method_environment *method_env, object_environment_item *object_env) {
+    method_environment *method_env, object_scope *object_env) {
     if (is_new_type_undefined(context, &expr->type)) {
         context_show_error_new_type_undefined(context, expr);
         return NULL;
@@ -1418,7 +1482,7 @@ static int is_while_condition_not_bool(const char *type) {
 
 static const char *semantic_check_loop_expression(
     semantic_context *context, loop_node *expr, class_context *class_ctx,
-    method_environment *method_env, object_environment_item *object_env) {
+    method_environment *method_env, object_scope *object_env) {
     const char *cond_type = semantic_check_expression(
         context, expr->predicate, class_ctx, method_env, object_env);
     if (cond_type != NULL && is_while_condition_not_bool(cond_type)) {
@@ -1443,7 +1507,7 @@ static int is_if_condition_not_bool(const char *type) {
 
 static const char *semantic_check_if_expression(
     semantic_context *context, cond_node *expr, class_context *class_ctx,
-    method_environment *method_env, object_environment_item *object_env) {
+    method_environment *method_env, object_scope *object_env) {
     const char *cond_type = semantic_check_expression(
         context, expr->predicate, class_ctx, method_env, object_env);
     if (cond_type != NULL && is_if_condition_not_bool(cond_type)) {
@@ -1461,7 +1525,7 @@ static const char *semantic_check_if_expression(
 
 static const char *semantic_check_block_expression(
     semantic_context *context, block_node *block, class_context *class_ctx,
-    method_environment *method_env, object_environment_item *object_env) {
+    method_environment *method_env, object_scope *object_env) {
     const char *block_type = NULL;
     for (unsigned int i = 0; i < block->exprs.count; i++) {
         expr_node *expr = NULL;
@@ -1476,7 +1540,7 @@ static const char *semantic_check_block_expression(
 
 static const char *semantic_check_isvoid_expression(
     semantic_context *context, expr_unary_node *expr, class_context *class_ctx,
-    method_environment *method_env, object_environment_item *object_env) {
+    method_environment *method_env, object_scope *object_env) {
     semantic_check_expression(context, expr->expr, class_ctx, method_env,
                               object_env);
 
@@ -1518,7 +1582,7 @@ static int is_arg_type_incompatible(semantic_context *context,
 
 static const char *semantic_check_dispatch_expression(
     semantic_context *context, dispatch_node *expr, class_context *class_ctx,
-    method_environment *method_env, object_environment_item *object_env) {
+    method_environment *method_env, object_scope *object_env) {
     method_environment_item *method_item = NULL;
     find_method_env(method_env, class_ctx->name, expr->method.value,
                     &method_item);
@@ -1593,7 +1657,7 @@ static int is_not_valid_static_dispatch(semantic_context *context,
 static const char *semantic_check_dispatch_full_expression(
     semantic_context *context, dispatch_full_node *expr,
     class_context *class_ctx, method_environment *method_env,
-    object_environment_item *object_env) {
+    object_scope *object_env) {
     const char *expr_type = semantic_check_expression(
         context, expr->expr, class_ctx, method_env, object_env);
 
@@ -1683,7 +1747,7 @@ static const char *semantic_check_dispatch_full_expression(
 
 static const char *semantic_check_expression(
     semantic_context *context, expr_node *expr, class_context *class_ctx,
-    method_environment *method_env, object_environment_item *object_env) {
+    method_environment *method_env, object_scope *object_env) {
     const char *type = NULL;
 
     switch (expr->kind) {
@@ -1804,64 +1868,61 @@ static int is_method_return_type_incompatible(semantic_context *context,
                         "with declared return type %s",                        \
                         return_type, method->name.value, method_type)
 
-static void semantic_check_method_body(semantic_context *context,
-                                       program_node *program,
-                                       method_environment *method_env,
-                                       object_environment *object_envs) {
-    for (unsigned int i = 0; i < program->classes.count; i++) {
-        class_node *class = NULL;
-        ds_dynamic_array_get_ref(&program->classes, i, (void **)&class);
-        context->filename = class->filename;
+static void semantic_check_class_method_body(semantic_context *context,
+                                             class_node *class,
+                                             method_environment *method_env,
+                                             object_environment *object_envs,
+                                             object_scope *object_env) {
+    context->filename = class->filename;
 
-        class_context *class_ctx = NULL;
-        find_class_ctx(context, class->name.value, &class_ctx);
+    class_context *class_ctx = NULL;
+    find_class_ctx(context, class->name.value, &class_ctx);
 
-        if (class_ctx == NULL) {
-            continue;
-        }
+    if (class_ctx == NULL) {
+        return;
+    }
 
-        object_environment_item object_env = {0};
-        get_object_environment(object_envs, class->name.value, &object_env);
+    object_env->attributes =
+        get_object_environment(object_envs, class->name.value);
 
-        for (unsigned int j = 0; j < class->methods.count; j++) {
-            method_node *method = NULL;
-            ds_dynamic_array_get_ref(&class->methods, j, (void **)&method);
+    for (unsigned int j = 0; j < class->methods.count; j++) {
+        method_node *method = NULL;
+        ds_dynamic_array_get_ref(&class->methods, j, (void **)&method);
 
-            method_context *method_ctx = NULL;
-            find_method_ctx(class_ctx, method->name.value, &method_ctx);
+        method_context *method_ctx = NULL;
+        find_method_ctx(class_ctx, method->name.value, &method_ctx);
 
-            if (method_ctx == NULL) {
-                continue;
-            }
+        if (method_ctx == NULL) {
+            continue;
+        }
 
-            unsigned int depth = 0;
-            for (unsigned int k = 0; k < method_ctx->formals.count; k++) {
-                object_context formal_ctx;
-                ds_dynamic_array_get(&method_ctx->formals, k, &formal_ctx);
+        unsigned int depth = 0;
+        for (unsigned int k = 0; k < method_ctx->formals.count; k++) {
+            object_context formal_ctx;
+            ds_dynamic_array_get(&method_ctx->formals, k, &formal_ctx);
 
-                ds_dynamic_array_append(&object_env.objects, &formal_ctx);
+            object_scope_push(object_env, formal_ctx);
 
-                depth++;
-            }
+            depth++;
+        }
 
-            expr_node *body = &method->body;
-            const char *body_type = semantic_check_expression(
-                context, body, class_ctx, method_env, &object_env);
-
-            if (body_type != NULL) {
-                if (is_method_return_type_incompatible(context, class_ctx->name,
-                                                       body_type,
-                                                       method_ctx->type)) {
-                    context_show_error_method_body_incompatible_return_type(
-                        context, token_get_node_info(body), method, body_type,
-                        method_ctx->type);
-                }
-            }
+        expr_node *body = &method->body;
+        const char *body_type = semantic_check_expression(
+            context, body, class_ctx, method_env, object_env);
 
-            for (unsigned int k = 0; k < depth; k++) {
-                ds_dynamic_array_pop(&object_env.objects, NULL);
+        if (body_type != NULL) {
+            if (is_method_return_type_incompatible(context, class_ctx->name,
+                                                   body_type,
+                                                   method_ctx->type)) {
+                context_show_error_method_body_incompatible_return_type(
+                    context, token_get_node_info(body), method, body_type,
+                    method_ctx->type);
             }
         }
+
+        for (unsigned int k = 0; k < depth; k++) {
+            object_scope_pop(object_env);
+        }
     }
 }
 
@@ -1880,52 +1941,202 @@ static int is_attribute_value_type_incompatible(semantic_context *context,
         "is incompatible with declared type %s",                               \
         value_type, attr->name.value, attr_type)
 
-static void semantic_check_attribute_init(semantic_context *context,
-                                          program_node *program,
-                                          method_environment *method_env,
-                                          object_environment *object_envs) {
+static void semantic_check_class_attribute_init(
+    semantic_context *context, class_node *class,
+    method_environment *method_env, object_environment *object_envs,
+    object_scope *object_env) {
+    context->filename = class->filename;
+
+    class_context *class_ctx = NULL;
+    find_class_ctx(context, class->name.value, &class_ctx);
+
+    if (class_ctx == NULL) {
+        return;
+    }
+
+    object_env->attributes =
+        get_object_environment(object_envs, class->name.value);
+
+    for (unsigned int j = 0; j < class->attributes.count; j++) {
+        attribute_node *attribute = NULL;
+        ds_dynamic_array_get_ref(&class->attributes, j, (void **)&attribute);
+
+        object_context *object_ctx = NULL;
+        find_object_ctx(class_ctx, attribute->name.value, &object_ctx);
+
+        if (object_ctx == NULL) {
+            continue;
+        }
+
+        expr_node *body = &attribute->value;
+        const char *value_type = semantic_check_expression(
+            context, body, class_ctx, method_env, object_env);
+
+        if (value_type != NULL) {
+            if (is_attribute_value_type_incompatible(context, class_ctx->name,
+                                                     value_type,
+                                                     object_ctx->type)) {
+                context_show_error_attribute_init_incompatible(
+                    context, token_get_node_info(body), attribute,
+                    object_ctx->type, value_type);
+            }
+        }
+    }
+}
+
+enum semantic_stage {
+    SEMANTIC_STAGE_METHOD_BODY,
+    SEMANTIC_STAGE_ATTRIBUTE_INIT,
+};
+
+// A class checked in one stage; the diagnostics are written to a private
+// buffer and flushed in the original order once every task is done.
+typedef struct semantic_task {
+        enum semantic_stage stage;
+        class_node *class;
+        semantic_context context;
+        char *buffer;
+        size_t size;
+} semantic_task;
+
+typedef struct semantic_pool {
+        ds_dynamic_array tasks; // semantic_task
+        unsigned int next;
+        pthread_mutex_t lock;
+
+        method_environment *method_env;
+        object_environment *object_envs;
+} semantic_pool;
+
+static void semantic_run_task(semantic_task *task,
+                              method_environment *method_env,
+                              object_environment *object_envs,
+                              object_scope *object_env) {
+    switch (task->stage) {
+    case SEMANTIC_STAGE_METHOD_BODY:
+        return semantic_check_class_method_body(&task->context, task->class,
+                                                method_env, object_envs,
+                                                object_env);
+    case SEMANTIC_STAGE_ATTRIBUTE_INIT:
+        return semantic_check_class_attribute_init(&task->context,
+                                                   task->class, method_env,
+                                                   object_envs, object_env);
+    }
+}
+
+static void *semantic_pool_worker(void *arg) {
+    semantic_pool *pool = arg;
+
+    object_scope object_env;
+    object_scope_init(&object_env);
+
+    while (1) {
+        pthread_mutex_lock(&pool->lock);
+        unsigned int index = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (index >= pool->tasks.count) {
+            break;
+        }
+
+        semantic_task *task = NULL;
+        ds_dynamic_array_get_ref(&pool->tasks, index, (void **)&task);
+
+        semantic_run_task(task, pool->method_env, pool->object_envs,
+                          &object_env);
+    }
+
+    return NULL;
+}
+
+static void semantic_check_bodies_sequential(semantic_context *context,
+                                             program_node *program,
+                                             method_environment *method_env,
+                                             object_environment *object_envs) {
+    object_scope object_env;
+    object_scope_init(&object_env);
+
     for (unsigned int i = 0; i < program->classes.count; i++) {
         class_node *class = NULL;
         ds_dynamic_array_get_ref(&program->classes, i, (void **)&class);
-        context->filename = class->filename;
 
-        class_context *class_ctx = NULL;
-        find_class_ctx(context, class->name.value, &class_ctx);
+        semantic_check_class_method_body(context, class, method_env,
+                                         object_envs, &object_env);
+    }
 
-        if (class_ctx == NULL) {
-            continue;
+    for (unsigned int i = 0; i < program->classes.count; i++) {
+        class_node *class = NULL;
+        ds_dynamic_array_get_ref(&program->classes, i, (void **)&class);
+
+        semantic_check_class_attribute_init(context, class, method_env,
+                                            object_envs, &object_env);
+    }
+}
+
+static void semantic_check_bodies_parallel(semantic_context *context,
+                                           program_node *program,
+                                           method_environment *method_env,
+                                           object_environment *object_envs,
+                                           unsigned int jobs) {
+    semantic_pool pool = {.next = 0,
+                          .method_env = method_env,
+                          .object_envs = object_envs};
+    ds_dynamic_array_init(&pool.tasks, sizeof(semantic_task));
+    pthread_mutex_init(&pool.lock, NULL);
+
+    enum semantic_stage stages[] = {SEMANTIC_STAGE_METHOD_BODY,
+                                    SEMANTIC_STAGE_ATTRIBUTE_INIT};
+    for (unsigned int s = 0; s < sizeof(stages) / sizeof(stages[0]); s++) {
+        for (unsigned int i = 0; i < program->classes.count; i++) {
+            semantic_task task = {.stage = stages[s], .context = *context};
+            ds_dynamic_array_get_ref(&program->classes, i,
+                                     (void **)&task.class);
+
+            task.context.result = SEMANTIC_OK;
+            ds_dynamic_array_append(&pool.tasks, &task);
         }
+    }
 
-        object_environment_item object_env = {0};
-        get_object_environment(object_envs, class->name.value, &object_env);
+    // open the buffers only once the tasks array stops growing, since the
+    // stream keeps pointers to the buffer and size of the task
+    for (unsigned int i = 0; i < pool.tasks.count; i++) {
+        semantic_task *task = NULL;
+        ds_dynamic_array_get_ref(&pool.tasks, i, (void **)&task);
 
-        for (unsigned int j = 0; j < class->attributes.count; j++) {
-            attribute_node *attribute = NULL;
-            ds_dynamic_array_get_ref(&class->attributes, j,
-                                     (void **)&attribute);
+        task->context.error_fd = open_memstream(&task->buffer, &task->size);
+        if (task->context.error_fd == NULL) {
+            DS_PANIC("Failed to open diagnostics buffer");
+        }
+    }
 
-            object_context *object_ctx = NULL;
-            find_object_ctx(class_ctx, attribute->name.value, &object_ctx);
+    if (jobs > pool.tasks.count) {
+        jobs = pool.tasks.count;
+    }
 
-            if (object_ctx == NULL) {
-                continue;
-            }
+    pthread_t *workers = malloc(sizeof(pthread_t) * jobs);
+    for (unsigned int i = 0; i < jobs; i++) {
+        pthread_create(&workers[i], NULL, semantic_pool_worker, &pool);
+    }
+    for (unsigned int i = 0; i < jobs; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    free(workers);
 
-            expr_node *body = &attribute->value;
-            const char *value_type = semantic_check_expression(
-                context, body, class_ctx, method_env, &object_env);
-
-            if (value_type != NULL) {
-                if (is_attribute_value_type_incompatible(
-                        context, class_ctx->name, value_type,
-                        object_ctx->type)) {
-                    context_show_error_attribute_init_incompatible(
-                        context, token_get_node_info(body), attribute,
-                        object_ctx->type, value_type);
-                }
-            }
+    for (unsigned int i = 0; i < pool.tasks.count; i++) {
+        semantic_task *task = NULL;
+        ds_dynamic_array_get_ref(&pool.tasks, i, (void **)&task);
+
+        fclose(task->context.error_fd);
+        fwrite(task->buffer, 1, task->size, context->error_fd);
+        free(task->buffer);
+
+        if (task->context.result != SEMANTIC_OK) {
+            context->result = task->context.result;
         }
     }
+
+    pthread_mutex_destroy(&pool.lock);
+    ds_dynamic_array_free(&pool.tasks);
 }
 
 static void find_class_mapping(semantic_mapping *mapping, const char *name,
@@ -2235,7 +2446,9 @@ static void build_semantic_mapping(semantic_context *context,
     }
 }
 
-enum semantic_result semantic_check(program_node *program, semantic_mapping *mapping) {
+enum semantic_result semantic_check(program_node *program,
+                                    semantic_mapping *mapping,
+                                    unsigned int jobs) {
     semantic_context context = {.filename = program->filename};
 
     context.result = SEMANTIC_OK;
@@ -2252,8 +2465,13 @@ enum semantic_result semantic_check(program_node *program, semantic_mapping *map
     method_environment method_env;
     build_method_environment(&context, program, &method_env);
 
-    semantic_check_method_body(&context, program, &method_env, &object_env);
-    semantic_check_attribute_init(&context, program, &method_env, &object_env);
+    if (jobs > 1) {
+        semantic_check_bodies_parallel(&context, program, &method_env,
+                                       &object_env, jobs);
+    } else {
+        semantic_check_bodies_sequential(&context, program, &method_env,
+                                         &object_env);
+    }
 
     if (context.result == SEMANTIC_OK) {
         build_semantic_mapping(&context, program, mapping);
@@ -1,6 +1,32 @@
 #include "ds.h"
 #include "util.h"
 
+// The parser only knows options that are separate words: -O<level> becomes
+// --opt-level <level>, whatever the level is, so that a bad one is reported,
+// and --name=value becomes --name value. The strings live as long as the
+// parser.
+static void util_split_arguments(int argc, char **argv, ds_dynamic_array *args) {
+    for (int i = 0; i < argc; i++) {
+        char *arg = argv[i];
+        char *value = NULL;
+
+        if (i > 0 && arg[0] == '-' && arg[1] == 'O' && arg[2] != '\0') {
+            value = arg + 2;
+            arg = "--" ARG_OPT_LEVEL;
+        } else if (i > 0 && arg[0] == '-' && arg[1] == '-' &&
+                   strchr(arg, '=') != NULL) {
+            arg = strdup(arg);
+            value = strchr(arg, '=');
+            *value++ = '\0';
+        }
+
+        ds_dynamic_array_append(args, &arg);
+        if (value != NULL) {
+            ds_dynamic_array_append(args, &value);
+        }
+    }
+}
+
 int util_parse_arguments(ds_argparse_parser *parser, int argc, char **argv) {
     ds_argparse_parser_init(parser, PROGRAM_NAME, PROGRAM_DESCRIPTION,
                             PROGRAM_VERSION);
@@ -55,6 +81,103 @@ int util_parse_arguments(ds_argparse_parser *parser, int argc, char **argv) {
                                        .type = ARGUMENT_TYPE_FLAG,
                                        .required = 0}));
 
+    ds_argparse_add_argument(
+        parser,
+        ((ds_argparse_options){.short_name = 'g',
+                               .long_name = ARG_CFG,
+                               .description = "Annotate the TAC with the CFG",
+                               .type = ARGUMENT_TYPE_FLAG,
+                               .required = 0}));
+
+    ds_argparse_add_argument(
+        parser,
+        ((ds_argparse_options){.short_name = 'd',
+                               .long_name = ARG_DOT,
+                               .description = "Print the TAC CFG as DOT",
+                               .type = ARGUMENT_TYPE_FLAG,
+                               .required = 0}));
+
+    ds_argparse_add_argument(
+        parser,
+        ((ds_argparse_options){.short_name = 'e',
+                               .long_name = ARG_SSA,
+                               .description = "Print the TAC in SSA form",
+                               .type = ARGUMENT_TYPE_FLAG,
+                               .required = 0}));
+
+    ds_argparse_add_argument(
+        parser,
+        ((ds_argparse_options){.short_name = 'P',
+                               .long_name = ARG_OPT,
+                               .description = "Print the optimized TAC",
+                               .type = ARGUMENT_TYPE_FLAG,
+                               .required = 0}));
+
+    ds_argparse_add_argument(
+        parser,
+        ((ds_argparse_options){.short_name = 'n',
+                               .long_name = ARG_INLINE_THRESHOLD,
+                               .description = "Largest method size, in TAC "
+                                              "instructions, to inline "
+                                              "(0 disables inlining)",
+                               .type = ARGUMENT_TYPE_VALUE,
+                               .required = 0}));
+
+    ds_argparse_add_argument(
+        parser,
+        ((ds_argparse_options){.short_name = 'L',
+                               .long_name = ARG_OPT_LEVEL,
+                               .description = "Optimization level, from 0 to "
+                                              "2 (also -O0, -O1 and -O2)",
+                               .type = ARGUMENT_TYPE_VALUE,
+                               .required = 0}));
+
+    ds_argparse_add_argument(
+        parser,
+        ((ds_argparse_options){.short_name = 'p',
+                               .long_name = ARG_PASSES,
+                               .description = "Comma separated passes to "
+                                              "run, or to skip with a '-' "
+                                              "prefix",
+                               .type = ARGUMENT_TYPE_VALUE,
+                               .required = 0}));
+
+    ds_argparse_add_argument(
+        parser,
+        ((ds_argparse_options){.short_name = 'T',
+                               .long_name = ARG_TIME_PASSES,
+                               .description = "Print the time and changes of "
+                                              "every pass",
+                               .type = ARGUMENT_TYPE_FLAG,
+                               .required = 0}));
+
+    ds_argparse_add_argument(
+        parser,
+        ((ds_argparse_options){.short_name = 'V',
+                               .long_name = ARG_VERIFY,
+                               .description = "Check the TAC after every pass",
+                               .type = ARGUMENT_TYPE_FLAG,
+                               .required = 0}));
+
+    ds_argparse_add_argument(
+        parser,
+        ((ds_argparse_options){.short_name = 'G',
+                               .long_name = ARG_PROFILE_GENERATE,
+                               .description = "Build a program that writes "
+                                              "its profile to the output "
+                                              "file with .profile appended",
+                               .type = ARGUMENT_TYPE_FLAG,
+                               .required = 0}));
+
+    ds_argparse_add_argument(
+        parser,
+        ((ds_argparse_options){.short_name = 'U',
+                               .long_name = ARG_PROFILE_USE,
+                               .description = "Optimize with the profile of "
+                                              "an instrumented run",
+                               .type = ARGUMENT_TYPE_VALUE,
+                               .required = 0}));
+
     ds_argparse_add_argument(
         parser, ((ds_argparse_options){.short_name = 'a',
                                        .long_name = ARG_ASSEMBLER,
@@ -62,6 +185,13 @@ int util_parse_arguments(ds_argparse_parser *parser, int argc, char **argv) {
                                        .type = ARGUMENT_TYPE_FLAG,
                                        .required = 0}));
 
+    ds_argparse_add_argument(
+        parser, ((ds_argparse_options){.short_name = 'F',
+                                       .long_name = ARG_FASM,
+                                       .description = "Assemble with fasm",
+                                       .type = ARGUMENT_TYPE_FLAG,
+                                       .required = 0}));
+
     ds_argparse_add_argument(
         parser, ((ds_argparse_options){.short_name = 'm',
                                        .long_name = ARG_MODULE,
@@ -69,6 +199,18 @@ int util_parse_arguments(ds_argparse_parser *parser, int argc, char **argv) {
                                        .type = ARGUMENT_TYPE_VALUE_ARRAY,
                                        .required = 0}));
 
-    return ds_argparse_parse(parser, argc, argv);
+    ds_argparse_add_argument(
+        parser,
+        ((ds_argparse_options){.short_name = 'j',
+                               .long_name = ARG_JOBS,
+                               .description = "Number of type checking jobs",
+                               .type = ARGUMENT_TYPE_VALUE,
+                               .required = 0}));
+
+    ds_dynamic_array args;
+    ds_dynamic_array_init(&args, sizeof(char *));
+    util_split_arguments(argc, argv, &args);
+
+    return ds_argparse_parse(parser, args.count, (char **)args.items);
 }
 
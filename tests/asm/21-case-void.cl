@@ -0,0 +1,19 @@
+class Main inherits IO {
+    describe(x: Object): String {
+        case x of
+            i: Int => "an integer";
+            s: String => "a string";
+            o: Object => "an object";
+        esac
+    };
+
+    main(): Object {
+        let nothing: Object
+        in {
+            out_string(describe(3)).out_string("\n");
+            out_string(describe(new Main)).out_string("\n");
+            out_string(describe(nothing)).out_string("\n");
+            out_string("not reached\n");
+        }
+    };
+};
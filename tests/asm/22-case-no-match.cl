@@ -0,0 +1,40 @@
+class Shape {
+    name(): String { "shape" };
+};
+
+class Circle inherits Shape {
+    name(): String { "circle" };
+};
+
+class Square inherits Shape {
+    name(): String { "square" };
+};
+
+class Triangle inherits Shape {
+    name(): String { "triangle" };
+};
+
+class Hexagon inherits Shape {
+    name(): String { "hexagon" };
+};
+
+class Main inherits IO {
+    corners(s: Shape): Int {
+        case s of
+            c: Circle => 0;
+            q: Square => 4;
+            h: Hexagon => 6;
+            i: Int => i;
+        esac
+    };
+
+    main(): Object {
+        {
+            out_int(corners(new Circle)).out_string("\n");
+            out_int(corners(new Square)).out_string("\n");
+            out_int(corners(new Hexagon)).out_string("\n");
+            out_int(corners(new Triangle)).out_string("\n");
+            out_string("not reached\n");
+        }
+    };
+};
@@ -0,0 +1,63 @@
+class A {
+    name(): String { "A" };
+};
+
+class B inherits A {
+    name(): String { "B" };
+};
+
+class C inherits B {
+    name(): String { "C" };
+};
+
+class D inherits C {
+    name(): String { "D" };
+};
+
+class E inherits D {
+    name(): String { "E" };
+};
+
+class F inherits B {
+    name(): String { "F" };
+};
+
+class Main inherits IO {
+    -- more branches than the chain takes, so this is a jump table
+    table(x: Object): String {
+        case x of
+            o: Object => "Object";
+            a: A => "A";
+            b: B => "B";
+            d: D => "D";
+            f: F => "F";
+        esac
+    };
+
+    -- few enough branches for a chain of compares
+    chain(x: A): String {
+        case x of
+            a: A => "A";
+            c: C => "C";
+            e: E => "E";
+        esac
+    };
+
+    show(x: A): Object {
+        out_string(x.name()).out_string(": ")
+            .out_string(table(x)).out_string(" ")
+            .out_string(chain(x)).out_string("\n")
+    };
+
+    main(): Object {
+        {
+            show(new A);
+            show(new B);
+            show(new C);
+            show(new D);
+            show(new E);
+            show(new F);
+            out_string(table(3)).out_string("\n");
+        }
+    };
+};
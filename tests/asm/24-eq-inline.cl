@@ -0,0 +1,61 @@
+class Money {
+    cents: Int;
+
+    init(c: Int): SELF_TYPE {
+        {
+            cents <- c;
+            self;
+        }
+    };
+
+    cents(): Int {
+        cents
+    };
+
+    equals(other: Object): Bool {
+        case other of
+            m: Money => m.cents() = cents;
+            o: Object => false;
+        esac
+    };
+};
+
+class Main inherits IO {
+    check(name: String, b: Bool): Object {
+        if b then
+            out_string(name).out_string(": true\n")
+        else
+            out_string(name).out_string(": false\n")
+        fi
+    };
+
+    main(): Object {
+        let a: String <- "hello",
+            b: String <- "hello".concat(""),
+            c: String <- "hellp",
+            nothing: Object,
+            other: Object,
+            thing: Object <- new Object,
+            boxed: Object <- 42,
+            int: Int <- 42,
+            some: Money <- new Money.init(150),
+            same: Money <- new Money.init(150),
+            less: Money <- new Money.init(149)
+        in {
+            check("equal strings", a = b);
+            check("different strings of the same length", a = c);
+            check("strings of different lengths", a = "hell");
+            check("empty strings", "" = "".concat(""));
+            check("void = void", nothing = other);
+            check("void = object", nothing = thing);
+            check("object = void", thing = nothing);
+            check("object = itself", thing = thing);
+            check("boxed Int = Int", case boxed of i: Int => i = int; esac);
+            check("Int = boxed Int", case boxed of i: Int => 41 = i; esac);
+            check("boxed Int = boxed Int", boxed = boxed);
+            check("overridden equals", some = same);
+            check("overridden equals, different", some = less);
+            check("overridden equals, other class", some = thing);
+        }
+    };
+};
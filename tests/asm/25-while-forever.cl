@@ -0,0 +1,21 @@
+class Main inherits IO {
+    count: Int;
+
+    -- the loop never ends by itself, so the end of the method is unreachable
+    forever(): Object {
+        while true loop
+            {
+                count <- count + 1;
+                out_string("x ").out_int(count).out_string("\n");
+                if count = 3 then abort() else self fi;
+            }
+        pool
+    };
+
+    main(): Object {
+        {
+            forever();
+            out_string("not reached\n");
+        }
+    };
+};
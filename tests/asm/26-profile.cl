@@ -0,0 +1,38 @@
+class Animal {
+    sound(): String { "..." };
+};
+
+class Dog inherits Animal {
+    sound(): String { "woof" };
+};
+
+class Cat inherits Animal {
+    sound(): String { "meow" };
+};
+
+class Main inherits IO {
+    -- mostly dogs, so the profile sees one hot receiver and a rare one
+    pick(i: Int): Animal {
+        if i - i / 10 * 10 = 0 then new Cat else new Dog fi
+    };
+
+    main(): Object {
+        let i: Int <- 0,
+            dogs: Int <- 0,
+            cats: Int <- 0
+        in {
+            while i < 1000 loop
+                {
+                    if pick(i).sound() = "woof" then
+                        dogs <- dogs + 1
+                    else
+                        cats <- cats + 1
+                    fi;
+                    i <- i + 1;
+                }
+            pool;
+            out_int(dogs).out_string(" dogs\n");
+            out_int(cats).out_string(" cats\n");
+        }
+    };
+};
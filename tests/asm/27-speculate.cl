@@ -0,0 +1,71 @@
+class Shape {
+    area(): Int { 0 };
+
+    -- too large to inline, so the guess stays on the call
+    describe(io: IO): IO {
+        {
+            io.out_string("a shape");
+            io.out_string(" with area ");
+            io.out_int(area());
+            io.out_string(" and ");
+            io.out_int(area() * 2);
+            io.out_string(" for two");
+            io.out_string("\n");
+        }
+    };
+};
+
+class Square inherits Shape {
+    side: Int;
+
+    init(s: Int): SELF_TYPE { { side <- s; self; } };
+
+    area(): Int { side * side };
+};
+
+class Circle inherits Shape {
+    radius: Int;
+
+    init(r: Int): SELF_TYPE { { radius <- r; self; } };
+
+    area(): Int { 3 * radius * radius };
+
+    describe(io: IO): IO {
+        {
+            io.out_string("a circle");
+            io.out_string(" with area ");
+            io.out_int(area());
+            io.out_string(" and ");
+            io.out_int(area() * 2);
+            io.out_string(" for two");
+            io.out_string("\n");
+        }
+    };
+};
+
+class Main inherits IO {
+    -- the program allocates mostly squares, so the calls are guessed to
+    -- reach Square.area and Shape.describe; the other classes take the
+    -- dispatch table instead
+    shape(i: Int): Shape {
+        if i = 0 then new Square.init(1) else
+        if i = 1 then new Square.init(2) else
+        if i = 2 then new Square.init(3) else
+        if i = 3 then new Square.init(4) else
+        if i = 4 then new Circle.init(5) else
+        new Shape
+        fi fi fi fi fi
+    };
+
+    main(): Object {
+        let i: Int <- 0
+        in
+            while i < 6 loop
+                {
+                    out_int(shape(i).area()).out_string(" ");
+                    shape(i).describe(self);
+                    i <- i + 1;
+                }
+            pool
+    };
+};
@@ -0,0 +1,69 @@
+class Main inherits IO {
+    count: Int;
+
+    -- returns a constant, but the call still has to print and count
+    logged(): Int {
+        {
+            out_string("logged\n");
+            count <- count + 1;
+            7;
+        }
+    };
+
+    -- specialized on constant steps and verbose flags; the prints of the
+    -- verbose copy have to stay
+    sum(n: Int, step: Int, verbose: Bool): Int {
+        let total: Int <- 0,
+            i: Int <- 0
+        in {
+            while i < n loop
+                {
+                    if verbose then
+                        out_string("step ").out_int(i).out_string("\n")
+                    else
+                        self
+                    fi;
+                    total <- total + step * 2 + step;
+                    i <- i + 1;
+                }
+            pool;
+            total;
+        }
+    };
+
+    -- the method assigns the formal that gets a constant
+    countdown(n: Int): Int {
+        {
+            while 0 < n loop
+                {
+                    count <- count + 1;
+                    n <- n - 1;
+                }
+            pool;
+            n;
+        }
+    };
+
+    -- recursive, called with a constant flag
+    fact(n: Int, trace: Bool): Int {
+        {
+            if trace then out_string("fact ").out_int(n).out_string("\n")
+            else self fi;
+            if n = 0 then 1 else n * fact(n - 1, trace) fi;
+        }
+    };
+
+    main(): Object {
+        {
+            out_int(logged() + logged()).out_string("\n");
+            out_int(sum(3, 2, true)).out_string("\n");
+            out_int(sum(4, 2, false)).out_string("\n");
+            out_int(sum({ out_string("argument\n"); 2; }, 5, false))
+                .out_string("\n");
+            out_int(countdown(5)).out_string("\n");
+            out_int(fact(4, true)).out_string("\n");
+            out_int(fact(5, false)).out_string("\n");
+            out_int(count).out_string("\n");
+        }
+    };
+};
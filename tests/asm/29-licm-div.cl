@@ -0,0 +1,61 @@
+class Main inherits IO {
+    -- the divisor does not change in the loop, but the division must not
+    -- run before the loop when the loop never runs
+    never(n: Int, d: Int): Int {
+        let i: Int <- 0,
+            total: Int <- 0
+        in {
+            while i < n loop
+                {
+                    total <- total + 100 / d;
+                    i <- i + 1;
+                }
+            pool;
+            total;
+        }
+    };
+
+    -- nor when the branch that divides is not taken
+    guarded(n: Int, d: Int): Int {
+        let i: Int <- 0,
+            total: Int <- 0
+        in {
+            while i < n loop
+                {
+                    if d = 0 then total <- total + 1
+                    else total <- total + 100 / d fi;
+                    i <- i + 1;
+                }
+            pool;
+            total;
+        }
+    };
+
+    -- an invariant product that can be hoisted, and divisions by constants
+    -- that round toward zero
+    scaled(n: Int, k: Int): Int {
+        let i: Int <- 0,
+            total: Int <- 0
+        in {
+            while i < n loop
+                {
+                    total <- total + k * 12 + (0 - i) / 4 + i / 3 + i * 7;
+                    i <- i + 1;
+                }
+            pool;
+            total;
+        }
+    };
+
+    main(): Object {
+        {
+            out_int(never(0, 0)).out_string("\n");
+            out_int(never(3, 7)).out_string("\n");
+            out_int(guarded(4, 0)).out_string("\n");
+            out_int(guarded(4, 20)).out_string("\n");
+            out_int(scaled(10, 5)).out_string("\n");
+            out_int((0 - 7) / 2).out_string(" ").out_int(7 / (0 - 2))
+                .out_string("\n");
+        }
+    };
+};
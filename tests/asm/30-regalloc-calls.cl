@@ -0,0 +1,67 @@
+class Counter {
+    n: Int;
+
+    next(): Int { { n <- n + 1; n; } };
+};
+
+class Main inherits IO {
+    c: Counter <- new Counter;
+
+    -- clobbers whatever registers a call may clobber
+    noise(x: Int): Int {
+        let a: Int <- x * 3,
+            b: Int <- a + c.next(),
+            d: Int <- b * a - x
+        in d - b
+    };
+
+    mix(a: Int, b: Int, d: Int, e: Int, f: Int, g: Int): Int {
+        a - b + d * 2 - e + f * 3 - g
+    };
+
+    -- more values live across the calls than there are registers
+    pressure(n: Int): Int {
+        let v1: Int <- n + 1, v2: Int <- n + 2, v3: Int <- n + 3,
+            v4: Int <- n + 4, v5: Int <- n + 5, v6: Int <- n + 6,
+            v7: Int <- n + 7, v8: Int <- n + 8, v9: Int <- n + 9,
+            v10: Int <- n + 10, v11: Int <- n + 11, v12: Int <- n + 12,
+            v13: Int <- n + 13, v14: Int <- n + 14, v15: Int <- n + 15,
+            v16: Int <- n + 16, s: String <- "s", total: Int <- 0,
+            i: Int <- 0
+        in {
+            while i < 5 loop
+                {
+                    v1 <- v1 + noise(v2);
+                    v3 <- v3 + noise(v4) - v5;
+                    v6 <- mix(v7, noise(v8), v9, noise(v10), v11, v12);
+                    s <- s.concat(c.next().to_string());
+                    v13 <- v13 + v14 * noise(v15) - v16;
+                    i <- i + 1;
+                }
+            pool;
+            total <- v1 + v2 + v3 + v4 + v5 + v6 + v7 + v8 + v9 + v10 + v11
+                + v12 + v13 + v14 + v15 + v16;
+            out_string(s).out_string("\n");
+            total;
+        }
+    };
+
+    -- a value computed before a recursive call is read after it returns
+    depth(n: Int): Int {
+        if n = 0 then 0 else
+            let before: Int <- n * n,
+                inner: Int <- depth(n - 1)
+            in before + inner + noise(n) - noise(n)
+        fi
+    };
+
+    main(): Object {
+        {
+            out_int(pressure(3)).out_string("\n");
+            out_int(depth(20)).out_string("\n");
+            out_int(mix(noise(1), noise(2), noise(3), noise(4), noise(5),
+                noise(6))).out_string("\n");
+            out_int(c.next()).out_string("\n");
+        }
+    };
+};
@@ -0,0 +1,63 @@
+class Point {
+    x: Int;
+    y: Int;
+
+    init(a: Int, b: Int): SELF_TYPE { { x <- a; y <- b; self; } };
+
+    x(): Int { x };
+
+    y(): Int { y };
+
+    -- attribute reads and writes through the slot address
+    move(dx: Int, dy: Int): SELF_TYPE {
+        {
+            x <- x + dx;
+            y <- y + dy;
+            self;
+        }
+    };
+
+    below(p: Point): Bool { y < p.y() };
+
+    same(p: Point): Bool { (x = p.x()).and(y = p.y()) };
+};
+
+class Main inherits IO {
+    origin: Point <- new Point.init(0, 0);
+
+    -- arguments pushed from registers, memory and constants
+    area(a: Point, b: Point, scale: Int, offset: Int): Int {
+        (b.x() - a.x()) * (b.y() - a.y()) * scale + offset
+    };
+
+    -- comparisons whose flags become a Bool, and a value kept in rax
+    -- across the rewritten copies
+    sign(n: Int): Int {
+        if n < 0 then ~1 else if n = 0 then 0 else 1 fi fi
+    };
+
+    main(): Object {
+        let p: Point <- new Point.init(1, 2),
+            q: Point <- new Point.init(4, 6),
+            i: Int <- 0,
+            steps: Int <- 0
+        in {
+            while i < 4 loop
+                {
+                    p.move(i, 1);
+                    if p.below(q) then steps <- steps + 1 else steps fi;
+                    i <- i + 1;
+                }
+            pool;
+            out_int(p.x()).out_string(" ").out_int(p.y()).out_string("\n");
+            out_int(steps).out_string("\n");
+            out_int(area(origin, q, 2, 1)).out_string("\n");
+            out_int(area(p, q, sign(~5), sign(0))).out_string("\n");
+            if p.same(new Point.init(7, 6)) then out_string("same\n")
+            else out_string("different\n") fi;
+            if origin.below(p) = p.below(origin) then out_string("equal\n")
+            else out_string("not equal\n") fi;
+            out_int(sign(9) + sign(~9) + sign(0)).out_string("\n");
+        }
+    };
+};
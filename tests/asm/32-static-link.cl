@@ -0,0 +1,76 @@
+-- built into a static executable by the compiler's own linker: the
+-- strings, the class tables and the case tables are all absolute
+-- addresses that the linker has to relocate
+class Node {
+    value: Int;
+    next: Node;
+
+    init(v: Int, n: Node): SELF_TYPE { { value <- v; next <- n; self; } };
+
+    value(): Int { value };
+
+    next(): Node { next };
+};
+
+class Leaf inherits Node {};
+
+class Twig inherits Node {};
+
+class Branch inherits Node {};
+
+class Main inherits IO {
+    names: String <- "zero one two three four five six seven eight nine";
+
+    kind(n: Node): String {
+        case n of
+            l: Leaf => "leaf";
+            t: Twig => "twig";
+            b: Branch => "branch";
+            o: Node => "node";
+        esac
+    };
+
+    word(i: Int): String {
+        let start: Int <- 0,
+            seen: Int <- 0,
+            j: Int <- 0
+        in {
+            while seen < i loop
+                {
+                    if names.substr(j, 1) = " " then
+                        { seen <- seen + 1; start <- j + 1; }
+                    else self fi;
+                    j <- j + 1;
+                }
+            pool;
+            j <- start;
+            while if j < names.length() then not names.substr(j, 1) = " "
+                  else false fi loop
+                j <- j + 1
+            pool;
+            names.substr(start, j - start);
+        }
+    };
+
+    main(): Object {
+        let none: Node,
+            list: Node <- new Leaf.init(3, new Twig.init(1,
+                              new Branch.init(4, new Node.init(1,
+                              new Leaf.init(5, new Node.init(9,
+                              new Twig.init(2, new Branch.init(6, none)))))))),
+            sum: Int <- 0
+        in {
+            while not isvoid list loop
+                {
+                    out_string(word(list.value())).out_string(" ")
+                        .out_string(kind(list)).out_string("\n");
+                    sum <- sum + list.value();
+                    list <- list.next();
+                }
+            pool;
+            out_int(sum).out_string("\n");
+            out_string(type_name()).out_string(" ")
+                .out_string(new Branch.type_name()).out_string("\n");
+        }
+    };
+};
@@ -0,0 +1,16 @@
+class Main {
+    main() : Int {
+        let i : Int <- 0, sum : Int <- 0
+        in {
+            while i < 10 loop {
+                if i < 5 then
+                    sum <- sum + i
+                else
+                    sum <- sum - 1
+                fi;
+                i <- i + 1;
+            } pool;
+            sum;
+        }
+    };
+};
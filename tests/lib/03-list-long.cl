@@ -0,0 +1,23 @@
+class Main {
+    build(n: Int): List {
+        let void: List, l: List <- new List.single(0), i: Int <- 1
+        in {
+            while i < n loop {
+                l <- new List.init(i, l);
+                i <- i + 1;
+            } pool;
+            l;
+        }
+    };
+
+    main(): Object {
+        let io: IO <- new IO,
+            l: List <- build(300000).concat(build(200000)).append(42)
+        in {
+            io.out_int(l.count()).out_string("\n");
+            case l.index(0) of x: Int => io.out_int(x).out_string("\n"); esac;
+            case l.index(300000) of x: Int => io.out_int(x).out_string("\n"); esac;
+            case l.index(500000) of x: Int => io.out_int(x).out_string("\n"); esac;
+        }
+    };
+};
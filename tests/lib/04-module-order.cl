@@ -0,0 +1,17 @@
+-- random.asm has no section of its own, and comes before the prelude here
+class Main inherits IO {
+    random: Random <- new Random;
+
+    main(): Object {
+        let first: Int <- random.srand(7).random(),
+            again: Int <- random.srand(7).random()
+        in {
+            if first = again then out_string("same sequence\n")
+            else out_string("different sequence\n") fi;
+            if first < 0 then out_string("negative\n")
+            else out_string("not negative\n") fi;
+            if 0 < new Time.time() then out_string("time\n")
+            else out_string("no time\n") fi;
+        }
+    };
+};
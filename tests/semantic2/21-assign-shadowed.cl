@@ -0,0 +1,21 @@
+class A {
+    x : Bool;
+
+    f(x : Int) : Int {
+        {
+            let x : String <- "a"
+            in {
+                x <- "b";
+                x;
+            };
+            case x of
+                x : Int => {
+                    x <- 2;
+                    x;
+                };
+            esac;
+            x <- 1;
+            x;
+        }
+    };
+};
@@ -0,0 +1,11 @@
+class A {
+    sum(n : Int) : Int {
+        let i : Int <- 0, s : Int <- 0 in {
+            while i < n loop {
+                s <- s + i;
+                i <- i + 1;
+            } pool;
+            s;
+        }
+    };
+};
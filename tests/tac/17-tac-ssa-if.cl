@@ -0,0 +1,8 @@
+class A {
+    max(a : Int, b : Int) : Int {
+        let m : Int <- a in {
+            if m < b then m <- b else m <- m + 0 fi;
+            m;
+        }
+    };
+};
@@ -0,0 +1,12 @@
+class A {
+    w : Int <- 3;
+
+    f(x : Int, y : Int) : Int {
+        let a : Int <- x * y + w,
+            b : Int <- x * y + w
+        in {
+            w <- a;
+            a + b + w;
+        }
+    };
+};
@@ -0,0 +1,14 @@
+class Shape {
+    area() : Int { 0 };
+    sides() : Int { 0 };
+};
+
+class Square inherits Shape {
+    area() : Int { 4 };
+};
+
+class A {
+    f(s : Shape) : Int {
+        s.area() + s.sides()
+    };
+};
@@ -0,0 +1,9 @@
+class A {
+    f(x : Int) : Int {
+        let a : Int <- 2 * 3,
+            b : Int <- x * a,
+            c : Int <- x * a
+        in
+            if a < 5 then 0 else b + c fi
+    };
+};
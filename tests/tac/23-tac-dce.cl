@@ -0,0 +1,10 @@
+class A {
+    f(x : Int) : Int {
+        let unused : Int <- x * x,
+            y : Int <- x + 1
+        in {
+            unused <- y * 2;
+            y;
+        }
+    };
+};
@@ -0,0 +1,8 @@
+class A {
+    f(x : Int) : Int {
+        let a : Int <- 2 * 3,
+            b : Int <- a + 4
+        in
+            if b < a then x else b - 10 + x fi
+    };
+};
@@ -0,0 +1,18 @@
+class Point {
+    x : Int;
+    y : Int;
+
+    sum() : Int { x + y };
+};
+
+class A {
+    kept : Point;
+
+    local(a : Int) : Int {
+        let p : Point <- new Point in p.sum() + a
+    };
+
+    stored(a : Int) : Int {
+        let p : Point <- new Point in { kept <- p; a; }
+    };
+};
@@ -0,0 +1,15 @@
+class A {
+    count(n : Int) : Int {
+        let i : Int <- 0, s : Int <- 0 in {
+            while i < n loop {
+                s <- s + i;
+                i <- i + 1;
+            } pool;
+            s;
+        }
+    };
+
+    keep(n : Int) : Object {
+        let o : Object <- n in o
+    };
+};